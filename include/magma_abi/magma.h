@@ -27,7 +27,18 @@ magma_status_t magma_get_error(struct magma_connection_t* connection);
 // MAGMA_QUERY_FIRST_VENDOR_ID.
 magma_status_t magma_query(int fd, uint64_t id, uint64_t* value_out);
 
+// Performs |count| queries in a single round trip to the driver.
+// |count| must be no greater than MAGMA_QUERY_BATCH_MAX_COUNT; on success |values_out[i]| holds
+// the result for |ids[i]|.
+magma_status_t magma_query_batch(int fd, const uint64_t* ids, uint32_t count,
+                                 uint64_t* values_out);
+
+// Creates a context of normal priority.
 void magma_create_context(struct magma_connection_t* connection, uint32_t* context_id_out);
+// Creates a context whose submissions are ordered, and passed to the driver, at |priority|, one of
+// MAGMA_CONTEXT_PRIORITY_*.
+void magma_create_context_with_priority(struct magma_connection_t* connection, uint32_t priority,
+                                        uint32_t* context_id_out);
 void magma_release_context(struct magma_connection_t* connection, uint32_t context_id);
 
 magma_status_t magma_create_buffer(struct magma_connection_t* connection, uint64_t size,
@@ -41,6 +52,25 @@ magma_status_t magma_map(struct magma_connection_t* connection, magma_buffer_t b
                          void** addr_out);
 magma_status_t magma_unmap(struct magma_connection_t* connection, magma_buffer_t buffer);
 
+// Maps the part of |buffer| spanning [offset, offset + length) and returns the address of |offset|
+// in |addr_out|.  Ranges are reference counted per page; overlapping ranges share mappings.
+// |flags| is a combination of MAGMA_MAP_FLAG_*.  Ranges mapped at the same time must agree on
+// MAGMA_MAP_FLAG_READ_ONLY.  MAGMA_MAP_FLAG_WRITE_COMBINED applies to the whole buffer and must
+// be given before the buffer is first used.
+magma_status_t magma_map_range(struct magma_connection_t* connection, magma_buffer_t buffer,
+                               uint64_t offset, uint64_t length, uint32_t flags, void** addr_out);
+
+// Releases a range mapped by magma_map_range.
+magma_status_t magma_unmap_range(struct magma_connection_t* connection, magma_buffer_t buffer,
+                                 uint64_t offset, uint64_t length);
+
+// Buffers are kept mapped after their last unmap, so a later magma_map needn't map them again,
+// until the total size of such buffers exceeds |budget_bytes|; least recently unmapped buffers
+// are then unmapped.  A budget of 0 disables the cache.
+void magma_set_mapping_cache_budget(uint64_t budget_bytes);
+
+void magma_get_mapping_cache_stats(struct magma_mapping_cache_stats* stats_out);
+
 magma_status_t magma_create_command_buffer(struct magma_connection_t* connection, uint64_t size,
                                            magma_buffer_t* buffer_out);
 void magma_release_command_buffer(struct magma_connection_t* connection,
@@ -53,6 +83,24 @@ void magma_release_command_buffer(struct magma_connection_t* connection,
 void magma_submit_command_buffer(struct magma_connection_t* connection,
                                  magma_buffer_t command_buffer, uint32_t context_id);
 
+// Registers the contents of |command_buffer|, laid out as for magma_submit_command_buffer, for
+// repeated submission.  The system driver copies and validates it once, here, so later submits
+// skip that work; changes to |command_buffer| after this call have no effect.  Doesn't take
+// ownership of |command_buffer|.  Timeline points aren't supported.  A persistent command buffer
+// is released when any of the buffers it references is released.
+magma_status_t magma_create_persistent_command_buffer(struct magma_connection_t* connection,
+                                                      magma_buffer_t command_buffer,
+                                                      uint32_t* command_buffer_id_out);
+void magma_release_persistent_command_buffer(struct magma_connection_t* connection,
+                                             uint32_t command_buffer_id);
+
+// Executes a persistent command buffer.  If |patch| isn't null, its batch start offset and the
+// semaphores in |semaphore_ids| replace those registered, for this submit only.
+void magma_submit_persistent_command_buffer(struct magma_connection_t* connection,
+                                            uint32_t command_buffer_id, uint32_t context_id,
+                                            const struct magma_system_command_buffer_patch* patch,
+                                            const uint64_t* semaphore_ids);
+
 void magma_wait_rendering(struct magma_connection_t* connection, magma_buffer_t buffer);
 
 // makes the buffer returned by |buffer| able to be imported via |buffer_handle_out|
@@ -86,6 +134,17 @@ magma_status_t magma_display_page_flip(struct magma_connection_t* connection, ma
                                        const magma_semaphore_t* signal_semaphores,
                                        magma_semaphore_t buffer_presented_semaphore);
 
+// As magma_display_page_flip, additionally waiting until each of |wait_points| is reached before
+// scanning out the buffer, and advancing each of |signal_points| when the buffer is no longer
+// being displayed.
+magma_status_t magma_display_page_flip_timeline(
+    struct magma_connection_t* connection, magma_buffer_t buffer, uint32_t wait_semaphore_count,
+    const magma_semaphore_t* wait_semaphores, uint32_t signal_semaphore_count,
+    const magma_semaphore_t* signal_semaphores, uint32_t wait_point_count,
+    const struct magma_system_timeline_point* wait_points, uint32_t signal_point_count,
+    const struct magma_system_timeline_point* signal_points,
+    magma_semaphore_t buffer_presented_semaphore);
+
 // Creates a semaphore on the given connection.  If successful |semaphore_out| will be set.
 magma_status_t magma_create_semaphore(struct magma_connection_t* connection,
                                       magma_semaphore_t* semaphore_out);
@@ -115,6 +174,42 @@ magma_status_t magma_export_semaphore(struct magma_connection_t* connection,
 magma_status_t magma_import_semaphore(struct magma_connection_t* connection,
                                       uint32_t semaphore_handle, magma_semaphore_t* semaphore_out);
 
+// Creates a timeline semaphore with the given initial value on the given connection.  If
+// successful |semaphore_out| will be set.
+magma_status_t magma_create_timeline_semaphore(struct magma_connection_t* connection,
+                                               uint64_t initial_value,
+                                               magma_timeline_semaphore_t* semaphore_out);
+
+// Destroys |semaphore|.
+void magma_release_timeline_semaphore(struct magma_connection_t* connection,
+                                      magma_timeline_semaphore_t semaphore);
+
+// Returns the object id for the given timeline semaphore.
+uint64_t magma_get_timeline_semaphore_id(magma_timeline_semaphore_t semaphore);
+
+// Returns the current value of |semaphore|.
+uint64_t magma_get_timeline_semaphore_value(magma_timeline_semaphore_t semaphore);
+
+// Advances |semaphore| to |value|.  Has no effect if the value is already at least |value|.
+void magma_signal_timeline_semaphore(magma_timeline_semaphore_t semaphore, uint64_t value);
+
+// Waits for |semaphore| to reach |value|.  Returns MAGMA_STATUS_TIMED_OUT if the timeout
+// expires first.
+magma_status_t magma_wait_timeline_semaphore(magma_timeline_semaphore_t semaphore, uint64_t value,
+                                             uint64_t timeout);
+
+// Exports |semaphore| so it can be imported into another connection via the two handles.
+magma_status_t magma_export_timeline_semaphore(struct magma_connection_t* connection,
+                                               magma_timeline_semaphore_t semaphore,
+                                               uint32_t* memory_handle_out,
+                                               uint32_t* event_handle_out);
+
+// Imports the timeline semaphore referred to by the given handles into the given connection and
+// makes it accessible via |semaphore_out|
+magma_status_t magma_import_timeline_semaphore(struct magma_connection_t* connection,
+                                               uint32_t memory_handle, uint32_t event_handle,
+                                               magma_timeline_semaphore_t* semaphore_out);
+
 #if defined(__cplusplus)
 }
 #endif
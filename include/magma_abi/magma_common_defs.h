@@ -14,9 +14,21 @@ extern "C" {
 #define MAGMA_CAPABILITY_RENDERING 1
 #define MAGMA_CAPABILITY_DISPLAY 2
 
+// Context priorities, lowest first.  High priority is reserved for connections with the display
+// capability.
+#define MAGMA_CONTEXT_PRIORITY_LOW 0
+#define MAGMA_CONTEXT_PRIORITY_NORMAL 1
+#define MAGMA_CONTEXT_PRIORITY_HIGH 2
+
 #define MAGMA_QUERY_DEVICE_ID 1
 #define MAGMA_QUERY_VENDOR_PARAM_0 10000
 
+// maximum number of ids that may be passed to magma_query_batch
+#define MAGMA_QUERY_BATCH_MAX_COUNT 64
+
+// maximum number of semaphores a magma_system_command_buffer_patch may replace
+#define MAGMA_COMMAND_BUFFER_PATCH_MAX_SEMAPHORES 64
+
 #define MAGMA_DOMAIN_CPU 0x00000001
 #define MAGMA_DOMAIN_GTT 0x00000040
 
@@ -30,6 +42,10 @@ extern "C" {
 #define MAGMA_STATUS_CONNECTION_LOST (-6)
 #define MAGMA_STATUS_TIMED_OUT (-7)
 
+// flags for magma_map_range
+#define MAGMA_MAP_FLAG_READ_ONLY 0x00000001
+#define MAGMA_MAP_FLAG_WRITE_COMBINED 0x00000002
+
 // possible values for magma_image_tiling_t
 #define MAGMA_IMAGE_TILING_OPTIMAL 0
 #define MAGMA_IMAGE_TILING_LINEAR 1
@@ -42,6 +58,8 @@ typedef uintptr_t magma_buffer_t;
 
 typedef uintptr_t magma_semaphore_t;
 
+typedef uintptr_t magma_timeline_semaphore_t;
+
 struct magma_connection_t {
     uint32_t magic_;
 };
@@ -65,13 +83,31 @@ struct magma_system_exec_resource {
     uint64_t length;
 };
 
-// A batch buffer to be executed plus the resources required to execute it
+// A batch buffer to be executed plus the resources required to execute it.  The timeline counts
+// grew the header, moving everything that follows it: clients built against the older layout must
+// be rebuilt, and must set both counts.
 struct magma_system_command_buffer {
     uint32_t batch_buffer_resource_index; // resource index of the batch buffer to execute
     uint32_t batch_start_offset;          // relative to the starting offset of the buffer
     uint32_t num_resources;
     uint32_t wait_semaphore_count;
     uint32_t signal_semaphore_count;
+    uint32_t wait_timeline_count;   // timeline points that must be reached before execution
+    uint32_t signal_timeline_count; // timeline points signalled when execution completes
+};
+
+// The fields of a persistent command buffer replaced for one submit.  Accompanied by an array of
+// its wait semaphore ids followed by its signal semaphore ids.
+struct magma_system_command_buffer_patch {
+    uint32_t batch_start_offset;
+    uint32_t wait_semaphore_count;
+    uint32_t signal_semaphore_count;
+};
+
+// a point on a timeline semaphore
+struct magma_system_timeline_point {
+    uint64_t semaphore_id;
+    uint64_t value;
 };
 
 struct magma_system_connection_request {
@@ -88,6 +124,14 @@ struct magma_display_size {
     uint32_t height;
 };
 
+struct magma_mapping_cache_stats {
+    uint64_t hit_count;      // maps satisfied by an existing mapping
+    uint64_t miss_count;     // maps which created a new mapping
+    uint64_t eviction_count; // unmapped buffers unmapped to stay within the budget
+    uint64_t cached_bytes;   // size of unmapped buffers currently kept mapped
+    uint64_t budget_bytes;
+};
+
 #if defined(__cplusplus)
 }
 #endif
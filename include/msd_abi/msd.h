@@ -45,7 +45,10 @@ magma_status_t msd_device_display_get_size(struct msd_device_t* dev,
 void msd_connection_close(struct msd_connection_t* connection);
 
 // Creates a context for the given connection. returns null on failure.
-struct msd_context_t* msd_connection_create_context(struct msd_connection_t* connection);
+// |priority| is one of MAGMA_CONTEXT_PRIORITY_*; the msd may prefer, or preempt in favour of, work
+// on higher priority contexts.
+struct msd_context_t* msd_connection_create_context(struct msd_connection_t* connection,
+                                                    uint32_t priority);
 
 // Provides a buffer to be scanned out on the next vblank event.
 // The first |wait_semaphore_count| of |semaphores| will be waited upon prior to scanning
@@ -65,6 +68,11 @@ void msd_connection_present_buffer(struct msd_connection_t* connection, struct m
 magma_status_t msd_connection_wait_rendering(struct msd_connection_t* connection,
                                              struct msd_buffer_t* buf);
 
+// Makes any msd_connection_wait_rendering blocked on |connection|, and any made afterwards,
+// return MAGMA_STATUS_CONNECTION_LOST promptly.  Called from another thread when the connection is
+// being shut down.
+void msd_connection_cancel_waits(struct msd_connection_t* connection);
+
 // Destroys the given context.
 void msd_context_destroy(struct msd_context_t* ctx);
 
@@ -76,6 +84,8 @@ void msd_context_destroy(struct msd_context_t* ctx);
 // |wait_semaphores| are the semaphores that must be signaled before starting command buffer
 // execution
 // |signal_semaphores| are the semaphores to be signaled upon completion of the command buffer
+// The semaphore ids in |cmd_buf| may be stale; only its semaphore counts are to be used.
+// |cmd_buf| may be submitted again, so it mustn't be modified.
 magma_status_t msd_context_execute_command_buffer(struct msd_context_t* ctx,
                                                   struct msd_buffer_t* cmd_buf,
                                                   struct msd_buffer_t** exec_resources,
@@ -86,6 +96,10 @@ magma_status_t msd_context_execute_command_buffer(struct msd_context_t* ctx,
 // May be used to free up resources such as a cached address space mapping for the given buffer.
 void msd_context_release_buffer(struct msd_context_t* context, struct msd_buffer_t* buffer);
 
+// Equivalent to msd_context_release_buffer for each of the |count| |buffers|.
+void msd_context_release_buffers(struct msd_context_t* context, struct msd_buffer_t** buffers,
+                                 uint32_t count);
+
 // Creates a buffer that owns the provided handle
 // The resulting msd_buffer_t is owned by the caller and must be destroyed
 // Returns NULL on failure.
@@ -2,6 +2,10 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
 #include "lib/app/cpp/application_context.h"
 #include "lib/app/cpp/connect.h"
 #include "lib/fsl/tasks/message_loop.h"
@@ -72,6 +76,41 @@ static uint32_t hsv_inc(uint32_t index, int16_t inc) {
     return signed_index;
 }
 
+// Measures the time between successive presents and periodically prints a summary.
+class FrameTimer {
+ public:
+  void Frame() {
+      auto now = std::chrono::steady_clock::now();
+      if (frame_count_++ > 0) {
+          double ms = std::chrono::duration<double, std::milli>(now - last_frame_).count();
+          total_ms_ += ms;
+          min_ms_ = std::min(min_ms_, ms);
+          max_ms_ = std::max(max_ms_, ms);
+          if (++interval_count_ == kReportInterval) {
+              printf("frame time avg %.2f ms min %.2f ms max %.2f ms (%u frames)\n",
+                     total_ms_ / interval_count_, min_ms_, max_ms_, interval_count_);
+              interval_count_ = 0;
+              total_ms_ = 0;
+              min_ms_ = std::numeric_limits<double>::max();
+              max_ms_ = 0;
+          }
+      }
+      last_frame_ = now;
+  }
+
+ private:
+  static constexpr uint32_t kReportInterval = 120;
+
+  std::chrono::steady_clock::time_point last_frame_;
+  uint64_t frame_count_ = 0;
+  uint32_t interval_count_ = 0;
+  double total_ms_ = 0;
+  double min_ms_ = std::numeric_limits<double>::max();
+  double max_ms_ = 0;
+};
+
+FrameTimer frame_timer;
+
 class BufferHandler : public fsl::MessageLoopHandler {
  public:
   BufferHandler(Buffer *buffer, uint32_t index) :
@@ -87,6 +126,8 @@ class BufferHandler : public fsl::MessageLoopHandler {
   void OnHandleReady(zx_handle_t handle,
                      zx_signals_t pending,
                      uint64_t count) override {
+      frame_timer.Frame();
+
       buffer_->Reset();
       zx::event acq, rel;
       buffer_->dupAcquireFence(&acq);
@@ -4,9 +4,20 @@
 #include "lib/fxl/logging.h"
 
 namespace display_pipe {
-ImagePipeImpl::ImagePipeImpl(std::shared_ptr<MagmaConnection> conn) : conn_(conn) {}
+ImagePipeImpl::ImagePipeImpl(std::shared_ptr<MagmaConnection> conn)
+    : conn_(conn), fence_cache_(conn, kFenceCacheCapacity)
+{
+}
 
-ImagePipeImpl::~ImagePipeImpl() = default;
+ImagePipeImpl::~ImagePipeImpl()
+{
+    for (auto semaphore : pending_presented_semaphores_) {
+        conn_->ReleaseSemaphore(semaphore);
+    }
+    for (auto semaphore : free_presented_semaphores_) {
+        conn_->ReleaseSemaphore(semaphore);
+    }
+}
 
 void ImagePipeImpl::AddImage(uint32_t image_id, scenic::ImageInfoPtr image_info, zx::vmo memory,
                              scenic::MemoryType memory_type, uint64_t memory_offset)
@@ -42,29 +53,61 @@ void ImagePipeImpl::PresentImage(uint32_t image_id, uint64_t presentation_time,
     }
 
     magma_semaphore_t buffer_presented_semaphore;
-    if (!conn_->CreateSemaphore(&buffer_presented_semaphore)) {
-        FXL_LOG(ERROR) << "Can't present unknown image id " << image_id << ".";
+    if (!GetPresentedSemaphore(&buffer_presented_semaphore)) {
+        FXL_LOG(ERROR) << "Can't create buffer presented semaphore.";
         fsl::MessageLoop::GetCurrent()->PostQuitTask();
         return;
     }
 
     magma_semaphore_t wait_semaphore;
     magma_semaphore_t signal_semaphore;
-    conn_->ImportSemaphore(acquire_fence, &wait_semaphore);
-    conn_->ImportSemaphore(release_fence, &signal_semaphore);
+    if (!fence_cache_.Get(std::move(acquire_fence), &wait_semaphore) ||
+        !fence_cache_.Get(std::move(release_fence), &signal_semaphore)) {
+        FXL_LOG(ERROR) << "Can't import fences for image id " << image_id << ".";
+        free_presented_semaphores_.push_back(buffer_presented_semaphore);
+        fsl::MessageLoop::GetCurrent()->PostQuitTask();
+        return;
+    }
 
     conn_->DisplayPageFlip(i->second->buffer(), 1, &wait_semaphore, 1, &signal_semaphore,
                            buffer_presented_semaphore);
 
-    conn_->ReleaseSemaphore(buffer_presented_semaphore);
-    conn_->ReleaseSemaphore(wait_semaphore);
-    conn_->ReleaseSemaphore(signal_semaphore);
+    pending_presented_semaphores_.push_back(buffer_presented_semaphore);
+    if (pending_presented_semaphores_.size() > kMaxPendingPresentedSemaphores) {
+        // Flips are not being presented (the display may be disabled), so stop tracking the
+        // oldest rather than accumulating semaphores.
+        conn_->ReleaseSemaphore(pending_presented_semaphores_.front());
+        pending_presented_semaphores_.pop_front();
+    }
+
     auto info = scenic::PresentationInfo::New();
     info->presentation_time = presentation_time;
     info->presentation_interval = 0;
     callback(std::move(info));
 }
 
+bool ImagePipeImpl::GetPresentedSemaphore(magma_semaphore_t* sem_out)
+{
+    RecyclePresentedSemaphores();
+
+    if (free_presented_semaphores_.empty())
+        return conn_->CreateSemaphore(sem_out);
+
+    *sem_out = free_presented_semaphores_.back();
+    free_presented_semaphores_.pop_back();
+    return true;
+}
+
+void ImagePipeImpl::RecyclePresentedSemaphores()
+{
+    // A zero timeout wait consumes the signal, leaving the semaphore ready for reuse.
+    while (!pending_presented_semaphores_.empty() &&
+           conn_->WaitSemaphore(pending_presented_semaphores_.front(), 0)) {
+        free_presented_semaphores_.push_back(pending_presented_semaphores_.front());
+        pending_presented_semaphores_.pop_front();
+    }
+}
+
 void ImagePipeImpl::AddBinding(fidl::InterfaceRequest<ImagePipe> request)
 {
     bindings_.AddBinding(this, std::move(request));
@@ -5,11 +5,14 @@
 #ifndef MAGMA_IMAGE_PIPE_IMPL_H_
 #define MAGMA_IMAGE_PIPE_IMPL_H_
 
+#include <deque>
 #include <unordered_map>
+#include <vector>
 
 #include "lib/images/fidl/image_pipe.fidl.h"
 #include "lib/fidl/cpp/bindings/binding_set.h"
 #include "magma/src/display_pipe/image.h"
+#include "magma/src/display_pipe/semaphore_cache.h"
 
 namespace display_pipe {
 
@@ -27,8 +30,19 @@ public:
     void AddBinding(fidl::InterfaceRequest<ImagePipe> request);
 
 private:
+    // Returns a buffer presented semaphore, reusing one whose flip has already been presented.
+    bool GetPresentedSemaphore(magma_semaphore_t* sem_out);
+    void RecyclePresentedSemaphores();
+
+    static constexpr uint32_t kFenceCacheCapacity = 32;
+    static constexpr uint32_t kMaxPendingPresentedSemaphores = 8;
+
     std::shared_ptr<MagmaConnection> conn_;
     std::unordered_map<uint32_t, std::unique_ptr<Image>> images_;
+    SemaphoreCache fence_cache_;
+    // Presented semaphores in flip order; the driver signals them in the same order.
+    std::deque<magma_semaphore_t> pending_presented_semaphores_;
+    std::vector<magma_semaphore_t> free_presented_semaphores_;
     fidl::BindingSet<scenic::ImagePipe> bindings_;
 
     FXL_DISALLOW_COPY_AND_ASSIGN(ImagePipeImpl);
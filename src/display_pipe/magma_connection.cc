@@ -73,10 +73,10 @@ bool MagmaConnection::CreateSemaphore(magma_semaphore_t *sem) {
     return status == MAGMA_STATUS_OK;
 }
 
-bool MagmaConnection::ImportSemaphore(const zx::event &event,
+bool MagmaConnection::ImportSemaphore(zx::event event,
                                       magma_semaphore_t *sem) {
     magma_status_t status;
-    status = magma_import_semaphore(conn_, event.get(), sem);
+    status = magma_import_semaphore(conn_, event.release(), sem);
     return status == MAGMA_STATUS_OK;
 }
 
@@ -92,6 +92,10 @@ void MagmaConnection::ResetSemaphore(magma_semaphore_t sem) {
     magma_reset_semaphore(sem);
 }
 
+bool MagmaConnection::WaitSemaphore(magma_semaphore_t sem, uint64_t timeout_ms) {
+    return magma_wait_semaphore(sem, timeout_ms) == MAGMA_STATUS_OK;
+}
+
 void MagmaConnection::DisplayPageFlip(magma_buffer_t buffer, uint32_t wait_semaphore_count,
                                       const magma_semaphore_t* wait_semaphores,
                                       uint32_t signal_semaphore_count,
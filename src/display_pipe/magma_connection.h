@@ -21,10 +21,13 @@ class MagmaConnection {
   void FreeBuffer(magma_buffer_t buffer);
 
   bool CreateSemaphore(magma_semaphore_t *sem);
-  bool ImportSemaphore(const zx::event &event, magma_semaphore_t *sem);
+  // Consumes |event|.
+  bool ImportSemaphore(zx::event event, magma_semaphore_t *sem);
   void ReleaseSemaphore(magma_semaphore_t sem);
   void SignalSemaphore(magma_semaphore_t sem);
   void ResetSemaphore(magma_semaphore_t sem);
+  // Returns true if |sem| was signaled within |timeout_ms|, resetting it.
+  bool WaitSemaphore(magma_semaphore_t sem, uint64_t timeout_ms);
 
   void DisplayPageFlip(magma_buffer_t buffer, uint32_t wait_semaphore_count,
                        const magma_semaphore_t* wait_semaphores, uint32_t signal_semaphore_count,
@@ -0,0 +1,61 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma/src/display_pipe/semaphore_cache.h"
+
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
+
+#include "lib/fxl/logging.h"
+
+namespace display_pipe {
+
+SemaphoreCache::SemaphoreCache(std::shared_ptr<MagmaConnection> conn, uint32_t capacity)
+    : conn_(std::move(conn)), capacity_(capacity)
+{
+    FXL_DCHECK(capacity_ > 0);
+}
+
+SemaphoreCache::~SemaphoreCache()
+{
+    for (auto& entry : entries_) {
+        conn_->ReleaseSemaphore(entry.semaphore);
+    }
+}
+
+bool SemaphoreCache::Get(zx::event event, magma_semaphore_t* sem_out)
+{
+    zx_info_handle_basic_t info;
+    zx_status_t status = event.get_info(ZX_INFO_HANDLE_BASIC, &info, sizeof(info), nullptr,
+                                        nullptr);
+    if (status != ZX_OK) {
+        FXL_LOG(ERROR) << "Can't get koid for fence: " << status << ".";
+        return false;
+    }
+
+    auto iter = map_.find(info.koid);
+    if (iter != map_.end()) {
+        hit_count_++;
+        entries_.splice(entries_.begin(), entries_, iter->second);
+        *sem_out = iter->second->semaphore;
+        return true;
+    }
+
+    miss_count_++;
+    magma_semaphore_t semaphore;
+    if (!conn_->ImportSemaphore(std::move(event), &semaphore))
+        return false;
+
+    if (entries_.size() >= capacity_) {
+        conn_->ReleaseSemaphore(entries_.back().semaphore);
+        map_.erase(entries_.back().koid);
+        entries_.pop_back();
+    }
+
+    entries_.push_front(Entry{info.koid, semaphore});
+    map_[info.koid] = entries_.begin();
+    *sem_out = semaphore;
+    return true;
+}
+} // namespace display_pipe
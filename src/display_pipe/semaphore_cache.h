@@ -0,0 +1,52 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_SEMAPHORE_CACHE_H_
+#define MAGMA_SEMAPHORE_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include <zx/event.h>
+
+#include "lib/fxl/macros.h"
+#include "magma/src/display_pipe/magma_connection.h"
+
+namespace display_pipe {
+
+// Magma semaphores imported from client fences, keyed by the koid of the fence.  Clients present
+// the same few fences over and over, so after the first frame a fence costs no import or release
+// messages.  Once the cache is full the least recently used semaphore is released.
+class SemaphoreCache {
+public:
+    SemaphoreCache(std::shared_ptr<MagmaConnection> conn, uint32_t capacity);
+    ~SemaphoreCache();
+
+    // Returns the semaphore for |event|, importing it if it isn't cached.  Consumes |event|.
+    // The semaphore remains owned by the cache.
+    bool Get(zx::event event, magma_semaphore_t* sem_out);
+
+    uint64_t hit_count() { return hit_count_; }
+    uint64_t miss_count() { return miss_count_; }
+
+private:
+    struct Entry {
+        uint64_t koid;
+        magma_semaphore_t semaphore;
+    };
+
+    std::shared_ptr<MagmaConnection> conn_;
+    uint32_t capacity_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> map_;
+    uint64_t hit_count_ = 0;
+    uint64_t miss_count_ = 0;
+
+    FXL_DISALLOW_COPY_AND_ASSIGN(SemaphoreCache);
+};
+} // namespace display_pipe
+
+#endif // MAGMA_SEMAPHORE_CACHE_H_
@@ -3,15 +3,21 @@
 // found in the LICENSE file.
 
 #include "magma.h"
+#include "magma_capture.h"
+#include "magma_mapping_cache.h"
 #include "magma_util/command_buffer.h"
 #include "magma_util/macros.h"
 #include "platform_connection.h"
 #include "platform_semaphore.h"
 #include "platform_thread.h"
+#include "platform_timeline_semaphore.h"
 #include "platform_trace.h"
 #include "zircon/zircon_platform_ioctl.h"
 #include <vector>
 
+// Buffers at least this large aren't left in the release queue.
+static constexpr uint64_t kImmediateReleaseSize = 1024 * 1024;
+
 magma_connection_t* magma_create_connection(int fd, uint32_t capabilities)
 {
 
@@ -26,18 +32,32 @@ magma_connection_t* magma_create_connection(int fd, uint32_t capabilities)
         return DRETP(nullptr, "fdio_ioctl failed: %d", ioctl_ret);
 
     // Here we release ownership of the connection to the client
-    return magma::PlatformIpcConnection::Create(device_handle).release();
+    magma_connection_t* connection =
+        magma::PlatformIpcConnection::Create(device_handle).release();
+    if (connection) {
+        if (auto capture = MagmaCapture::Get())
+            capture->RecordConnection(magma_capture::kCreateConnection, connection, capabilities);
+    }
+    return connection;
 }
 
 void magma_release_connection(magma_connection_t* connection)
 {
+    if (auto capture = MagmaCapture::Get()) {
+        capture->RecordConnection(magma_capture::kReleaseConnection, connection, 0);
+        capture->Flush();
+    }
+
     // TODO(MA-109): close the connection
     delete magma::PlatformIpcConnection::cast(connection);
 }
 
 magma_status_t magma_get_error(magma_connection_t* connection)
 {
-    return magma::PlatformIpcConnection::cast(connection)->GetError();
+    magma_status_t status = magma::PlatformIpcConnection::cast(connection)->GetError();
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordError(connection, status);
+    return status;
 }
 
 magma_status_t magma_query(int fd, uint64_t id, uint64_t* value_out)
@@ -53,13 +73,44 @@ magma_status_t magma_query(int fd, uint64_t id, uint64_t* value_out)
     return MAGMA_STATUS_OK;
 }
 
+magma_status_t magma_query_batch(int fd, const uint64_t* ids, uint32_t count,
+                                 uint64_t* values_out)
+{
+    if (!ids || !values_out)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "bad ids or values_out address");
+    if (count == 0 || count > MAGMA_QUERY_BATCH_MAX_COUNT)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "bad count %u", count);
+
+    size_t size = count * sizeof(uint64_t);
+    int ret = fdio_ioctl(fd, IOCTL_MAGMA_QUERY_BATCH, ids, size, values_out, size);
+    if (ret < 0)
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "fdio_ioctl failed: %d", ret);
+    if (static_cast<size_t>(ret) != size)
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "short read: %d", ret);
+
+    return MAGMA_STATUS_OK;
+}
+
 void magma_create_context(magma_connection_t* connection, uint32_t* context_id_out)
 {
-    magma::PlatformIpcConnection::cast(connection)->CreateContext(context_id_out);
+    magma_create_context_with_priority(connection, MAGMA_CONTEXT_PRIORITY_NORMAL, context_id_out);
+}
+
+void magma_create_context_with_priority(magma_connection_t* connection, uint32_t priority,
+                                        uint32_t* context_id_out)
+{
+    magma::PlatformIpcConnection::cast(connection)->CreateContext(priority, context_id_out);
+
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordContext(magma_capture::kCreateContext, connection, *context_id_out,
+                               priority);
 }
 
 void magma_release_context(magma_connection_t* connection, uint32_t context_id)
 {
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordContext(magma_capture::kReleaseContext, connection, context_id);
+
     magma::PlatformIpcConnection::cast(connection)->DestroyContext(context_id);
 }
 
@@ -75,6 +126,9 @@ magma_status_t magma_create_buffer(magma_connection_t* connection, uint64_t size
     if (result != MAGMA_STATUS_OK)
         return DRET(result);
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kCreateBuffer, connection, platform_buffer.get());
+
     *size_out = platform_buffer->size();
     *buffer_out =
         reinterpret_cast<magma_buffer_t>(platform_buffer.release()); // Ownership passed across abi
@@ -85,7 +139,15 @@ magma_status_t magma_create_buffer(magma_connection_t* connection, uint64_t size
 void magma_release_buffer(magma_connection_t* connection, magma_buffer_t buffer)
 {
     auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
-    magma::PlatformIpcConnection::cast(connection)->ReleaseBuffer(platform_buffer->id());
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kReleaseBuffer, connection, platform_buffer);
+
+    auto ipc_connection = magma::PlatformIpcConnection::cast(connection);
+    ipc_connection->ReleaseBuffer(platform_buffer->id());
+    // The driver holds the memory of a queued release, so large buffers are released now.
+    if (platform_buffer->size() >= kImmediateReleaseSize)
+        ipc_connection->FlushReleases();
+    MagmaMappingCache::Get()->Remove(platform_buffer);
     delete platform_buffer;
 }
 
@@ -111,6 +173,9 @@ magma_status_t magma_import(magma_connection_t* connection, uint32_t buffer_hand
     if (result != MAGMA_STATUS_OK)
         return DRET_MSG(result, "ImportBuffer failed");
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kImportBuffer, connection, platform_buffer.get());
+
     *buffer_out = reinterpret_cast<magma_buffer_t>(platform_buffer.release());
 
     return MAGMA_STATUS_OK;
@@ -146,6 +211,9 @@ magma_status_t magma_import_fd(magma_connection_t* connection, int fd, magma_buf
     if (result != MAGMA_STATUS_OK)
         return DRET_MSG(result, "ImportBuffer failed");
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kImportBuffer, connection, platform_buffer.get());
+
     *buffer_out = reinterpret_cast<magma_buffer_t>(platform_buffer.release());
 
     return MAGMA_STATUS_OK;
@@ -155,9 +223,12 @@ magma_status_t magma_map(magma_connection_t* connection, magma_buffer_t buffer,
 {
     auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
 
-    if (!platform_buffer->MapCpu(addr_out))
+    if (!MagmaMappingCache::Get()->Map(platform_buffer, addr_out))
         return DRET(MAGMA_STATUS_MEMORY_ERROR);
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kMapBuffer, connection, platform_buffer);
+
     return MAGMA_STATUS_OK;
 }
 
@@ -165,12 +236,62 @@ magma_status_t magma_unmap(magma_connection_t* connection, magma_buffer_t buffer
 {
     auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
 
-    if (!platform_buffer->UnmapCpu())
+    if (!MagmaMappingCache::Get()->Unmap(platform_buffer))
         return DRET(MAGMA_STATUS_MEMORY_ERROR);
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kUnmapBuffer, connection, platform_buffer);
+
     return MAGMA_STATUS_OK;
 }
 
+magma_status_t magma_map_range(magma_connection_t* connection, magma_buffer_t buffer,
+                               uint64_t offset, uint64_t length, uint32_t flags, void** addr_out)
+{
+    if (flags & ~(MAGMA_MAP_FLAG_READ_ONLY | MAGMA_MAP_FLAG_WRITE_COMBINED))
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "invalid flags 0x%x", flags);
+
+    uint32_t platform_flags = 0;
+    if (flags & MAGMA_MAP_FLAG_READ_ONLY)
+        platform_flags |= magma::PlatformBuffer::kMapReadOnly;
+    if (flags & MAGMA_MAP_FLAG_WRITE_COMBINED)
+        platform_flags |= magma::PlatformBuffer::kMapWriteCombined;
+
+    auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
+    if (!platform_buffer->MapCpuRange(offset, length, platform_flags, addr_out))
+        return DRET(MAGMA_STATUS_MEMORY_ERROR);
+
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBufferRange(magma_capture::kMapBufferRange, connection, platform_buffer,
+                                   offset, length, flags);
+
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_unmap_range(magma_connection_t* connection, magma_buffer_t buffer,
+                                 uint64_t offset, uint64_t length)
+{
+    auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
+    if (!platform_buffer->UnmapCpuRange(offset, length))
+        return DRET(MAGMA_STATUS_MEMORY_ERROR);
+
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBufferRange(magma_capture::kUnmapBufferRange, connection, platform_buffer,
+                                   offset, length);
+
+    return MAGMA_STATUS_OK;
+}
+
+void magma_set_mapping_cache_budget(uint64_t budget_bytes)
+{
+    MagmaMappingCache::Get()->SetBudget(budget_bytes);
+}
+
+void magma_get_mapping_cache_stats(magma_mapping_cache_stats* stats_out)
+{
+    *stats_out = MagmaMappingCache::Get()->stats();
+}
+
 magma_status_t magma_create_command_buffer(magma_connection_t* connection, uint64_t size,
                                            magma_buffer_t* buffer_out)
 {
@@ -178,13 +299,8 @@ magma_status_t magma_create_command_buffer(magma_connection_t* connection, uint6
     if (!platform_buffer)
         return DRET(MAGMA_STATUS_MEMORY_ERROR);
 
-    // Mapping can be expensive (mostly due to aslr);
-    // and we want to map this buffer on submit to pull out the batch buffer id (see below).
-    // To avoid mapping twice, we do an initial map here, so that when the client does map-unmap
-    // then submits, the mapping will probably still be alive inside the platform buffer.
-    void* data;
-    platform_buffer->MapCpu(&data);
-
+    // Submit maps this buffer to pull out the batch buffer id (see below); the mapping cache
+    // keeps the client's mapping alive after it unmaps, so that map is cheap.
     *buffer_out =
         reinterpret_cast<magma_buffer_t>(platform_buffer.release()); // Ownership passed across abi
 
@@ -194,7 +310,9 @@ magma_status_t magma_create_command_buffer(magma_connection_t* connection, uint6
 void magma_release_command_buffer(struct magma_connection_t* connection,
                                   magma_buffer_t command_buffer)
 {
-    delete reinterpret_cast<magma::PlatformBuffer*>(command_buffer);
+    auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(command_buffer);
+    MagmaMappingCache::Get()->Remove(platform_buffer);
+    delete platform_buffer;
 }
 
 void magma_submit_command_buffer(magma_connection_t* connection, magma_buffer_t command_buffer,
@@ -233,15 +351,66 @@ void magma_submit_command_buffer(magma_connection_t* connection, magma_buffer_t
         interpreter.resource(interpreter.batch_buffer_resource_index()).buffer_id();
     TRACE_FLOW_BEGIN("magma", "command_buffer", batch_buffer_id);
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSubmit(connection, platform_buffer, context_id);
+
     magma::PlatformIpcConnection::cast(connection)->ExecuteCommandBuffer(buffer_handle, context_id);
 
+    MagmaMappingCache::Get()->Remove(platform_buffer);
     delete platform_buffer;
 }
 
+magma_status_t magma_create_persistent_command_buffer(magma_connection_t* connection,
+                                                      magma_buffer_t command_buffer,
+                                                      uint32_t* command_buffer_id_out)
+{
+    auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(command_buffer);
+
+    uint32_t buffer_handle;
+    if (!platform_buffer->duplicate_handle(&buffer_handle))
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to duplicate handle");
+
+    magma::PlatformIpcConnection::cast(connection)->CreatePersistentCommandBuffer(
+        buffer_handle, command_buffer_id_out);
+
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordCreatePersistentCommandBuffer(connection, platform_buffer,
+                                                     *command_buffer_id_out);
+    return MAGMA_STATUS_OK;
+}
+
+void magma_release_persistent_command_buffer(magma_connection_t* connection,
+                                             uint32_t command_buffer_id)
+{
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordReleasePersistentCommandBuffer(connection, command_buffer_id);
+
+    magma::PlatformIpcConnection::cast(connection)->ReleasePersistentCommandBuffer(
+        command_buffer_id);
+}
+
+void magma_submit_persistent_command_buffer(magma_connection_t* connection,
+                                            uint32_t command_buffer_id, uint32_t context_id,
+                                            const magma_system_command_buffer_patch* patch,
+                                            const uint64_t* semaphore_ids)
+{
+    TRACE_DURATION("magma", "submit_persistent_command_buffer");
+
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSubmitPersistentCommandBuffer(connection, command_buffer_id, context_id,
+                                                     patch, semaphore_ids);
+
+    magma::PlatformIpcConnection::cast(connection)->ExecutePersistentCommandBuffer(
+        command_buffer_id, context_id, patch, semaphore_ids);
+}
+
 void magma_wait_rendering(magma_connection_t* connection, magma_buffer_t buffer)
 {
     auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordBuffer(magma_capture::kWaitRendering, connection, platform_buffer);
+
     magma::PlatformIpcConnection::cast(connection)->WaitRendering(platform_buffer->id());
 }
 
@@ -279,9 +448,55 @@ magma_status_t magma_display_page_flip(magma_connection_t* connection, magma_buf
              ->duplicate_handle(&buffer_presented_handle))
         return DRET_MSG(MAGMA_STATUS_ACCESS_DENIED, "failed to duplicate handle");
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordPageFlip(connection, platform_buffer->id(), semaphore_ids,
+                                wait_semaphore_count,
+                                magma_get_semaphore_id(buffer_presented_semaphore));
+
     magma::PlatformIpcConnection::cast(connection)
         ->PageFlip(platform_buffer->id(), wait_semaphore_count, signal_semaphore_count,
-                   semaphore_ids.data(), buffer_presented_handle);
+                   semaphore_ids.data(), 0, 0, nullptr, buffer_presented_handle);
+
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_display_page_flip_timeline(
+    magma_connection_t* connection, magma_buffer_t buffer, uint32_t wait_semaphore_count,
+    const magma_semaphore_t* wait_semaphores, uint32_t signal_semaphore_count,
+    const magma_semaphore_t* signal_semaphores, uint32_t wait_point_count,
+    const magma_system_timeline_point* wait_points, uint32_t signal_point_count,
+    const magma_system_timeline_point* signal_points, magma_semaphore_t buffer_presented_semaphore)
+{
+    auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
+
+    std::vector<uint64_t> semaphore_ids(wait_semaphore_count + signal_semaphore_count);
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < wait_semaphore_count; i++) {
+        semaphore_ids[index++] = magma_get_semaphore_id(wait_semaphores[i]);
+    }
+    for (uint32_t i = 0; i < signal_semaphore_count; i++) {
+        semaphore_ids[index++] = magma_get_semaphore_id(signal_semaphores[i]);
+    }
+
+    std::vector<magma_system_timeline_point> timeline_points(wait_points,
+                                                             wait_points + wait_point_count);
+    timeline_points.insert(timeline_points.end(), signal_points,
+                           signal_points + signal_point_count);
+
+    uint32_t buffer_presented_handle;
+    if (!reinterpret_cast<magma::PlatformSemaphore*>(buffer_presented_semaphore)
+             ->duplicate_handle(&buffer_presented_handle))
+        return DRET_MSG(MAGMA_STATUS_ACCESS_DENIED, "failed to duplicate handle");
+
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordPageFlip(connection, platform_buffer->id(), semaphore_ids,
+                                wait_semaphore_count,
+                                magma_get_semaphore_id(buffer_presented_semaphore));
+
+    magma::PlatformIpcConnection::cast(connection)
+        ->PageFlip(platform_buffer->id(), wait_semaphore_count, signal_semaphore_count,
+                   semaphore_ids.data(), wait_point_count, signal_point_count,
+                   timeline_points.data(), buffer_presented_handle);
 
     return MAGMA_STATUS_OK;
 }
@@ -302,6 +517,9 @@ magma_status_t magma_create_semaphore(magma_connection_t* connection,
     if (result != MAGMA_STATUS_OK)
         return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to ImportObject");
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSemaphore(magma_capture::kCreateSemaphore, connection, semaphore->id());
+
     *semaphore_out = reinterpret_cast<magma_semaphore_t>(semaphore.release());
     return MAGMA_STATUS_OK;
 }
@@ -309,6 +527,10 @@ magma_status_t magma_create_semaphore(magma_connection_t* connection,
 void magma_release_semaphore(magma_connection_t* connection, magma_semaphore_t semaphore)
 {
     auto platform_semaphore = reinterpret_cast<magma::PlatformSemaphore*>(semaphore);
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSemaphore(magma_capture::kReleaseSemaphore, connection,
+                                 platform_semaphore->id());
+
     magma::PlatformIpcConnection::cast(connection)
         ->ReleaseObject(platform_semaphore->id(), magma::PlatformObject::SEMAPHORE);
     delete platform_semaphore;
@@ -321,16 +543,28 @@ uint64_t magma_get_semaphore_id(magma_semaphore_t semaphore)
 
 void magma_signal_semaphore(magma_semaphore_t semaphore)
 {
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSemaphore(magma_capture::kSignalSemaphore, nullptr,
+                                 magma_get_semaphore_id(semaphore));
+
     reinterpret_cast<magma::PlatformSemaphore*>(semaphore)->Signal();
 }
 
 void magma_reset_semaphore(magma_semaphore_t semaphore)
 {
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSemaphore(magma_capture::kResetSemaphore, nullptr,
+                                 magma_get_semaphore_id(semaphore));
+
     reinterpret_cast<magma::PlatformSemaphore*>(semaphore)->Reset();
 }
 
 magma_status_t magma_wait_semaphore(magma_semaphore_t semaphore, uint64_t timeout)
 {
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSemaphore(magma_capture::kWaitSemaphore, nullptr,
+                                 magma_get_semaphore_id(semaphore), timeout);
+
     if (!reinterpret_cast<magma::PlatformSemaphore*>(semaphore)->Wait(timeout))
         return MAGMA_STATUS_TIMED_OUT;
 
@@ -364,7 +598,102 @@ magma_status_t magma_import_semaphore(magma_connection_t* connection, uint32_t s
     if (result != MAGMA_STATUS_OK)
         return DRET_MSG(result, "ImportObject failed: %d", result);
 
+    if (auto capture = MagmaCapture::Get())
+        capture->RecordSemaphore(magma_capture::kImportSemaphore, connection,
+                                 platform_semaphore->id());
+
     *semaphore_out = reinterpret_cast<magma_semaphore_t>(platform_semaphore.release());
 
     return MAGMA_STATUS_OK;
 }
+
+magma_status_t magma_create_timeline_semaphore(magma_connection_t* connection,
+                                               uint64_t initial_value,
+                                               magma_timeline_semaphore_t* semaphore_out)
+{
+    auto semaphore = magma::PlatformTimelineSemaphore::Create(initial_value);
+    if (!semaphore)
+        return MAGMA_STATUS_MEMORY_ERROR;
+
+    uint32_t memory_handle, event_handle;
+    if (!semaphore->duplicate_handles(&memory_handle, &event_handle))
+        return DRET_MSG(MAGMA_STATUS_ACCESS_DENIED, "failed to duplicate handles");
+
+    magma_status_t result = magma::PlatformIpcConnection::cast(connection)
+                                ->ImportTimelineSemaphore(memory_handle, event_handle);
+    if (result != MAGMA_STATUS_OK)
+        return DRET_MSG(result, "failed to ImportTimelineSemaphore: %d", result);
+
+    *semaphore_out = reinterpret_cast<magma_timeline_semaphore_t>(semaphore.release());
+    return MAGMA_STATUS_OK;
+}
+
+void magma_release_timeline_semaphore(magma_connection_t* connection,
+                                      magma_timeline_semaphore_t semaphore)
+{
+    auto platform_semaphore = reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore);
+    magma::PlatformIpcConnection::cast(connection)
+        ->ReleaseObject(platform_semaphore->id(), magma::PlatformObject::TIMELINE_SEMAPHORE);
+    delete platform_semaphore;
+}
+
+uint64_t magma_get_timeline_semaphore_id(magma_timeline_semaphore_t semaphore)
+{
+    return reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->id();
+}
+
+uint64_t magma_get_timeline_semaphore_value(magma_timeline_semaphore_t semaphore)
+{
+    return reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->value();
+}
+
+void magma_signal_timeline_semaphore(magma_timeline_semaphore_t semaphore, uint64_t value)
+{
+    reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->Signal(value);
+}
+
+magma_status_t magma_wait_timeline_semaphore(magma_timeline_semaphore_t semaphore, uint64_t value,
+                                             uint64_t timeout)
+{
+    if (!reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->Wait(value, timeout))
+        return MAGMA_STATUS_TIMED_OUT;
+
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_export_timeline_semaphore(magma_connection_t* connection,
+                                               magma_timeline_semaphore_t semaphore,
+                                               uint32_t* memory_handle_out,
+                                               uint32_t* event_handle_out)
+{
+    auto platform_semaphore = reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore);
+
+    if (!platform_semaphore->duplicate_handles(memory_handle_out, event_handle_out))
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "duplicate_handles failed");
+
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_import_timeline_semaphore(magma_connection_t* connection,
+                                               uint32_t memory_handle, uint32_t event_handle,
+                                               magma_timeline_semaphore_t* semaphore_out)
+{
+    auto platform_semaphore =
+        magma::PlatformTimelineSemaphore::Import(memory_handle, event_handle);
+    if (!platform_semaphore)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "PlatformTimelineSemaphore::Import failed");
+
+    uint32_t duplicate_memory_handle, duplicate_event_handle;
+    if (!platform_semaphore->duplicate_handles(&duplicate_memory_handle, &duplicate_event_handle))
+        return DRET_MSG(MAGMA_STATUS_ACCESS_DENIED, "failed to duplicate handles");
+
+    magma_status_t result =
+        magma::PlatformIpcConnection::cast(connection)
+            ->ImportTimelineSemaphore(duplicate_memory_handle, duplicate_event_handle);
+    if (result != MAGMA_STATUS_OK)
+        return DRET_MSG(result, "ImportTimelineSemaphore failed: %d", result);
+
+    *semaphore_out = reinterpret_cast<magma_timeline_semaphore_t>(platform_semaphore.release());
+
+    return MAGMA_STATUS_OK;
+}
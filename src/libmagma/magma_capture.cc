@@ -0,0 +1,385 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_capture.h"
+#include "magma_util/command_buffer.h"
+#include "platform_trace.h"
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace magma_capture;
+
+namespace {
+
+class CaptureCommandBuffer : public magma::CommandBuffer {
+public:
+    CaptureCommandBuffer(magma::PlatformBuffer* platform_buffer)
+        : platform_buffer_(platform_buffer)
+    {
+    }
+
+    magma::PlatformBuffer* platform_buffer() override { return platform_buffer_; }
+
+    // The bytes of the buffer the layout actually uses.
+    uint64_t used_size()
+    {
+        uint64_t size = sizeof(magma_system_command_buffer) +
+                        sizeof(uint64_t) * (wait_semaphore_count() + signal_semaphore_count()) +
+                        sizeof(magma_system_timeline_point) *
+                            (static_cast<uint64_t>(wait_timeline_count()) +
+                             signal_timeline_count()) +
+                        sizeof(magma_system_exec_resource) * num_resources();
+        for (uint32_t i = 0; i < num_resources(); i++) {
+            size += sizeof(magma_system_relocation_entry) * resource(i).num_relocations();
+        }
+        return size;
+    }
+
+private:
+    magma::PlatformBuffer* platform_buffer_;
+};
+
+} // namespace
+
+MagmaCapture* MagmaCapture::Get()
+{
+    static MagmaCapture* capture = []() -> MagmaCapture* {
+        const char* path = getenv(kEnvironmentVariable);
+        if (!path || !path[0])
+            return nullptr;
+        FILE* file = fopen(path, "wb");
+        if (!file)
+            return DRETP(nullptr, "failed to open capture file %s", path);
+        magma::log(magma::LOG_INFO, "magma: capturing to %s", path);
+        return new MagmaCapture(file);
+    }();
+    return capture;
+}
+
+MagmaCapture::MagmaCapture(FILE* file) : file_(file), start_(std::chrono::steady_clock::now())
+{
+    FileHeader header = {kMagic, kVersion};
+    if (fwrite(&header, sizeof(header), 1, file_) != 1)
+        DLOG("failed to write capture header");
+}
+
+MagmaCapture::~MagmaCapture() { fclose(file_); }
+
+void MagmaCapture::WriteRecord(RecordType type, const void* const* data, const uint32_t* sizes,
+                               uint32_t count)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    WriteRecordLocked(type, data, sizes, count);
+}
+
+void MagmaCapture::WriteRecordLocked(RecordType type, const void* const* data,
+                                     const uint32_t* sizes, uint32_t count)
+{
+    RecordHeader header;
+    header.type = type;
+    header.size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        header.size += sizes[i];
+    }
+
+    header.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start_)
+                              .count();
+
+    bool success = fwrite(&header, sizeof(header), 1, file_) == 1;
+    for (uint32_t i = 0; success && i < count; i++) {
+        if (sizes[i])
+            success = fwrite(data[i], sizes[i], 1, file_) == 1;
+    }
+    if (!success)
+        DLOG("failed to write capture record type %u", type);
+}
+
+void MagmaCapture::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    fflush(file_);
+}
+
+void MagmaCapture::RecordConnection(RecordType type, magma_connection_t* connection,
+                                    uint32_t capabilities)
+{
+    if (type == kReleaseConnection) {
+        // The connection's persistent command buffers go with it.
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto key = reinterpret_cast<uintptr_t>(connection);
+        persistent_batches_.erase(persistent_batches_.lower_bound(std::make_pair(key, 0u)),
+                                  persistent_batches_.upper_bound(std::make_pair(key, UINT32_MAX)));
+    }
+
+    WriteRecord(type, ConnectionRecord{reinterpret_cast<uintptr_t>(connection), capabilities});
+}
+
+void MagmaCapture::RecordError(magma_connection_t* connection, magma_status_t status)
+{
+    WriteRecord(kGetError, ErrorRecord{reinterpret_cast<uintptr_t>(connection), status});
+}
+
+void MagmaCapture::RecordContext(RecordType type, magma_connection_t* connection,
+                                 uint32_t context_id, uint32_t priority)
+{
+    WriteRecord(type,
+                ContextRecord{reinterpret_cast<uintptr_t>(connection), context_id, priority});
+}
+
+void MagmaCapture::RecordBuffer(RecordType type, magma_connection_t* connection,
+                                magma::PlatformBuffer* buffer)
+{
+    if (type == kCreateBuffer || type == kImportBuffer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        buffers_.emplace(buffer->id(), buffer);
+    } else if (type == kReleaseBuffer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto range = buffers_.equal_range(buffer->id());
+        for (auto iter = range.first; iter != range.second; iter++) {
+            if (iter->second == buffer) {
+                buffers_.erase(iter);
+                break;
+            }
+        }
+    }
+
+    WriteRecord(type,
+                BufferRecord{reinterpret_cast<uintptr_t>(connection), buffer->id(), buffer->size()});
+}
+
+void MagmaCapture::RecordBufferRange(RecordType type, magma_connection_t* connection,
+                                     magma::PlatformBuffer* buffer, uint64_t offset,
+                                     uint64_t length, uint32_t flags)
+{
+    WriteRecord(type, BufferRangeRecord{reinterpret_cast<uintptr_t>(connection), buffer->id(),
+                                        offset, length, flags});
+}
+
+void MagmaCapture::RecordNotCaptured(RecordType type, magma_connection_t* connection,
+                                     uint64_t size)
+{
+    WriteRecord(kNotCaptured,
+                NotCapturedRecord{reinterpret_cast<uintptr_t>(connection), type, size});
+}
+
+void MagmaCapture::RecordSubmit(magma_connection_t* connection,
+                                magma::PlatformBuffer* command_buffer, uint32_t context_id)
+{
+    TRACE_DURATION("magma", "RecordSubmit");
+
+    CaptureCommandBuffer interpreter(command_buffer);
+    if (!interpreter.Initialize()) {
+        DLOG("failed to initialize command buffer for capture");
+        RecordNotCaptured(kSubmitCommandBuffer, connection, command_buffer->size());
+        return;
+    }
+
+    if (interpreter.used_size() > kMaxContentsSize) {
+        DLOG("command buffer too large to capture: %" PRIu64, interpreter.used_size());
+        RecordNotCaptured(kSubmitCommandBuffer, connection, interpreter.used_size());
+        return;
+    }
+
+    void* command_buffer_addr;
+    if (!command_buffer->MapCpu(&command_buffer_addr)) {
+        DLOG("failed to map command buffer for capture");
+        RecordNotCaptured(kSubmitCommandBuffer, connection, interpreter.used_size());
+        return;
+    }
+
+    SubmitRecord record = {};
+    record.connection = reinterpret_cast<uintptr_t>(connection);
+    record.context_id = context_id;
+    record.command_buffer_size = interpreter.used_size();
+
+    const CaptureCommandBuffer::ExecResource& batch =
+        interpreter.resource(interpreter.batch_buffer_resource_index());
+
+    // The client may release the batch buffer once the submit is queued, so its contents are read
+    // now.
+    std::unique_lock<std::mutex> lock(mutex_);
+    void* batch_addr;
+    uint64_t batch_offset;
+    uint32_t batch_size;
+    magma::PlatformBuffer* batch_buffer =
+        MapBatchLocked({batch.buffer_id(), batch.offset(), batch.length()}, &batch_addr,
+                       &batch_offset, &batch_size);
+    record.batch_offset = batch_offset;
+    record.batch_size = batch_size;
+
+    const void* data[] = {&record, command_buffer_addr,
+                          static_cast<uint8_t*>(batch_addr) + record.batch_offset};
+    const uint32_t sizes[] = {sizeof(record), record.command_buffer_size, record.batch_size};
+    WriteRecordLocked(kSubmitCommandBuffer, data, sizes, 3);
+
+    if (batch_buffer)
+        batch_buffer->UnmapCpu();
+    lock.unlock();
+
+    command_buffer->UnmapCpu();
+}
+
+magma::PlatformBuffer* MagmaCapture::MapBatchLocked(const Batch& batch, void** addr_out,
+                                                    uint64_t* offset_out, uint32_t* size_out)
+{
+    *addr_out = nullptr;
+    *offset_out = 0;
+    *size_out = 0;
+
+    // Holding the lock keeps a concurrent release from destroying the buffer while it's mapped.
+    auto iter = buffers_.find(batch.buffer_id);
+    if (iter == buffers_.end() || batch.offset >= iter->second->size())
+        return DRETP(nullptr, "batch buffer 0x%" PRIx64 " not captured", batch.buffer_id);
+    magma::PlatformBuffer* batch_buffer = iter->second;
+
+    uint64_t available = batch_buffer->size() - batch.offset;
+    uint64_t length = batch.length ? std::min(batch.length, available) : available;
+    if (length > kMaxContentsSize)
+        return DRETP(nullptr, "batch of %" PRIu64 " bytes too large to capture", length);
+    if (!batch_buffer->MapCpu(addr_out))
+        return DRETP(nullptr, "failed to map batch buffer for capture");
+
+    *offset_out = batch.offset;
+    *size_out = static_cast<uint32_t>(length);
+    return batch_buffer;
+}
+
+void MagmaCapture::RecordCreatePersistentCommandBuffer(magma_connection_t* connection,
+                                                       magma::PlatformBuffer* command_buffer,
+                                                       uint32_t command_buffer_id)
+{
+    CaptureCommandBuffer interpreter(command_buffer);
+    if (!interpreter.Initialize()) {
+        DLOG("failed to initialize persistent command buffer for capture");
+        RecordNotCaptured(kCreatePersistentCommandBuffer, connection, command_buffer->size());
+        return;
+    }
+
+    if (interpreter.used_size() > kMaxContentsSize) {
+        DLOG("persistent command buffer too large to capture: %" PRIu64, interpreter.used_size());
+        RecordNotCaptured(kCreatePersistentCommandBuffer, connection, interpreter.used_size());
+        return;
+    }
+
+    void* command_buffer_addr;
+    if (!command_buffer->MapCpu(&command_buffer_addr)) {
+        DLOG("failed to map persistent command buffer for capture");
+        RecordNotCaptured(kCreatePersistentCommandBuffer, connection, interpreter.used_size());
+        return;
+    }
+
+    uintptr_t key = reinterpret_cast<uintptr_t>(connection);
+
+    PersistentCommandBufferRecord record;
+    record.connection = key;
+    record.command_buffer_id = command_buffer_id;
+    record.command_buffer_size = interpreter.used_size();
+
+    const CaptureCommandBuffer::ExecResource& batch =
+        interpreter.resource(interpreter.batch_buffer_resource_index());
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    persistent_batches_[std::make_pair(key, command_buffer_id)] = {
+        batch.buffer_id(), batch.offset(), batch.length()};
+
+    const void* data[] = {&record, command_buffer_addr};
+    const uint32_t sizes[] = {sizeof(record), record.command_buffer_size};
+    WriteRecordLocked(kCreatePersistentCommandBuffer, data, sizes, 2);
+    lock.unlock();
+
+    command_buffer->UnmapCpu();
+}
+
+void MagmaCapture::RecordReleasePersistentCommandBuffer(magma_connection_t* connection,
+                                                        uint32_t command_buffer_id)
+{
+    uintptr_t key = reinterpret_cast<uintptr_t>(connection);
+    PersistentCommandBufferRecord record = {key, command_buffer_id, 0};
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    persistent_batches_.erase(std::make_pair(key, command_buffer_id));
+    const void* data = &record;
+    const uint32_t size = sizeof(record);
+    WriteRecordLocked(kReleasePersistentCommandBuffer, &data, &size, 1);
+}
+
+void MagmaCapture::RecordSubmitPersistentCommandBuffer(
+    magma_connection_t* connection, uint32_t command_buffer_id, uint32_t context_id,
+    const magma_system_command_buffer_patch* patch, const uint64_t* semaphore_ids)
+{
+    TRACE_DURATION("magma", "RecordSubmitPersistentCommandBuffer");
+
+    uintptr_t key = reinterpret_cast<uintptr_t>(connection);
+    PersistentSubmitRecord record = {};
+    record.connection = key;
+    record.command_buffer_id = command_buffer_id;
+    record.context_id = context_id;
+    if (patch) {
+        // The connection rejects larger patches, so there's nothing to replay.
+        if (static_cast<uint64_t>(patch->wait_semaphore_count) + patch->signal_semaphore_count >
+            MAGMA_COMMAND_BUFFER_PATCH_MAX_SEMAPHORES) {
+            DLOG("patch has too many semaphores for capture");
+            return;
+        }
+        record.patched = 1;
+        record.batch_start_offset = patch->batch_start_offset;
+        record.wait_semaphore_count = patch->wait_semaphore_count;
+        record.signal_semaphore_count = patch->signal_semaphore_count;
+    }
+
+    // The batch is read at each submit, since the client may have changed it since the last.
+    std::unique_lock<std::mutex> lock(mutex_);
+    void* batch_addr = nullptr;
+    uint64_t batch_offset = 0;
+    uint32_t batch_size = 0;
+    magma::PlatformBuffer* batch_buffer = nullptr;
+    auto iter = persistent_batches_.find(std::make_pair(key, command_buffer_id));
+    if (iter != persistent_batches_.end()) {
+        batch_buffer = MapBatchLocked(iter->second, &batch_addr, &batch_offset, &batch_size);
+    } else {
+        DLOG("persistent command buffer %u not captured", command_buffer_id);
+    }
+    record.batch_offset = batch_offset;
+    record.batch_size = batch_size;
+
+    const void* data[] = {&record, semaphore_ids,
+                          static_cast<uint8_t*>(batch_addr) + record.batch_offset};
+    const uint32_t sizes[] = {
+        sizeof(record),
+        static_cast<uint32_t>(sizeof(uint64_t) *
+                              (record.wait_semaphore_count + record.signal_semaphore_count)),
+        record.batch_size};
+    WriteRecordLocked(kSubmitPersistentCommandBuffer, data, sizes, 3);
+
+    if (batch_buffer)
+        batch_buffer->UnmapCpu();
+}
+
+void MagmaCapture::RecordPageFlip(magma_connection_t* connection, uint64_t buffer_id,
+                                  const std::vector<uint64_t>& semaphore_ids,
+                                  uint32_t wait_semaphore_count,
+                                  uint64_t buffer_presented_semaphore_id)
+{
+    DASSERT(wait_semaphore_count <= semaphore_ids.size());
+
+    PageFlipRecord record;
+    record.connection = reinterpret_cast<uintptr_t>(connection);
+    record.buffer_id = buffer_id;
+    record.wait_semaphore_count = wait_semaphore_count;
+    record.signal_semaphore_count = semaphore_ids.size() - wait_semaphore_count;
+    record.buffer_presented_semaphore_id = buffer_presented_semaphore_id;
+
+    const void* data[] = {&record, semaphore_ids.data()};
+    const uint32_t sizes[] = {sizeof(record),
+                              static_cast<uint32_t>(semaphore_ids.size() * sizeof(uint64_t))};
+    WriteRecord(kPageFlip, data, sizes, 2);
+}
+
+void MagmaCapture::RecordSemaphore(RecordType type, magma_connection_t* connection,
+                                   uint64_t semaphore_id, uint64_t timeout_ms)
+{
+    WriteRecord(type,
+                SemaphoreRecord{reinterpret_cast<uintptr_t>(connection), semaphore_id, timeout_ms});
+}
@@ -0,0 +1,113 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_CAPTURE_H_
+#define MAGMA_CAPTURE_H_
+
+#include "magma_capture_format.h"
+#include "magma_common_defs.h"
+#include "magma_util/macros.h"
+#include "platform_buffer.h"
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+// Records the ABI calls a process makes, for replay by magma_replay.  Capture is opt in: it's
+// enabled by setting MAGMA_CAPTURE_FILE to the path to write, and is then on for the life of the
+// process.  Records are buffered and written as they're made, so a capture can be of any length.
+//
+// Submits record the command buffer and the batch buffer's contents; other buffers contribute
+// only their ids and sizes; submits of persistent command buffers record the batch buffer's
+// contents at the time.  Timeline semaphore calls aren't recorded, and page flips drop their
+// timeline points.
+class MagmaCapture {
+public:
+    static constexpr const char* kEnvironmentVariable = "MAGMA_CAPTURE_FILE";
+
+    // Returns null unless capture is enabled.
+    static MagmaCapture* Get();
+
+    // Takes ownership of |file|.
+    explicit MagmaCapture(FILE* file);
+
+    ~MagmaCapture();
+
+    void RecordConnection(magma_capture::RecordType type, magma_connection_t* connection,
+                          uint32_t capabilities);
+    void RecordError(magma_connection_t* connection, magma_status_t status);
+    void RecordContext(magma_capture::RecordType type, magma_connection_t* connection,
+                       uint32_t context_id, uint32_t priority = MAGMA_CONTEXT_PRIORITY_NORMAL);
+
+    // Buffers that are created or imported are tracked until released, so submits can read the
+    // contents of their batch buffers.
+    void RecordBuffer(magma_capture::RecordType type, magma_connection_t* connection,
+                      magma::PlatformBuffer* buffer);
+    void RecordBufferRange(magma_capture::RecordType type, magma_connection_t* connection,
+                           magma::PlatformBuffer* buffer, uint64_t offset, uint64_t length,
+                           uint32_t flags = 0);
+
+    void RecordSubmit(magma_connection_t* connection, magma::PlatformBuffer* command_buffer,
+                      uint32_t context_id);
+    void RecordCreatePersistentCommandBuffer(magma_connection_t* connection,
+                                             magma::PlatformBuffer* command_buffer,
+                                             uint32_t command_buffer_id);
+    void RecordReleasePersistentCommandBuffer(magma_connection_t* connection,
+                                              uint32_t command_buffer_id);
+    void RecordSubmitPersistentCommandBuffer(magma_connection_t* connection,
+                                             uint32_t command_buffer_id, uint32_t context_id,
+                                             const magma_system_command_buffer_patch* patch,
+                                             const uint64_t* semaphore_ids);
+    void RecordPageFlip(magma_connection_t* connection, uint64_t buffer_id,
+                        const std::vector<uint64_t>& semaphore_ids, uint32_t wait_semaphore_count,
+                        uint64_t buffer_presented_semaphore_id);
+    void RecordSemaphore(magma_capture::RecordType type, magma_connection_t* connection,
+                         uint64_t semaphore_id, uint64_t timeout_ms = 0);
+
+    // Pushes buffered records to the file.
+    void Flush();
+
+private:
+    // Where a command buffer's batch is.
+    struct Batch {
+        uint64_t buffer_id;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    // Maps the tracked buffer holding |batch|, returning it and setting the address and extent of
+    // the contents to record.  Returns null, with an empty extent, if the contents can't be read.
+    magma::PlatformBuffer* MapBatchLocked(const Batch& batch, void** addr_out,
+                                          uint64_t* offset_out, uint32_t* size_out);
+
+    // Writes a record of |size| bytes gathered from |count| pieces.
+    void WriteRecord(magma_capture::RecordType type, const void* const* data,
+                     const uint32_t* sizes, uint32_t count);
+    void WriteRecordLocked(magma_capture::RecordType type, const void* const* data,
+                           const uint32_t* sizes, uint32_t count);
+
+    void RecordNotCaptured(magma_capture::RecordType type, magma_connection_t* connection,
+                           uint64_t size);
+
+    template <typename T> void WriteRecord(magma_capture::RecordType type, const T& payload)
+    {
+        const void* data = &payload;
+        uint32_t size = sizeof(T);
+        WriteRecord(type, &data, &size, 1);
+    }
+
+    std::mutex mutex_;
+    FILE* file_;
+    std::chrono::steady_clock::time_point start_;
+    // Keyed by id; a buffer imported more than once has several entries.
+    std::unordered_multimap<uint64_t, magma::PlatformBuffer*> buffers_;
+    // The batches of persistent command buffers, keyed by connection and command buffer id.
+    std::map<std::pair<uintptr_t, uint32_t>, Batch> persistent_batches_;
+
+    DISALLOW_COPY_AND_ASSIGN(MagmaCapture);
+};
+
+#endif // MAGMA_CAPTURE_H_
@@ -0,0 +1,165 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_CAPTURE_FORMAT_H_
+#define MAGMA_CAPTURE_FORMAT_H_
+
+#include <stdint.h>
+
+// The file written by libmagma's capture mode and read by magma_replay.  A FileHeader is followed
+// by a stream of records, each a RecordHeader and |size| bytes of payload.  Payloads start with
+// the struct for their type; submit, persistent command buffer and page flip records carry
+// variable length data after it.
+//
+// Objects are identified as the capturing process saw them: connections by their client address,
+// buffers and semaphores by their global ids, contexts by their per connection ids.  All fields
+// are little endian.
+namespace magma_capture {
+
+constexpr uint32_t kMagic = 0x5043474d; // "MGCP"
+// Version 2 added ContextRecord::priority.  Version 3 added persistent command buffers, version 4
+// buffer ranges, and version 5 kNotCaptured.
+constexpr uint32_t kVersion = 5;
+
+// Command buffers and batch contents larger than this aren't captured, so a record's size always
+// fits RecordHeader::size.  A call whose command buffer is too large is recorded as kNotCaptured.
+constexpr uint32_t kMaxContentsSize = 1u << 30;
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+} __attribute__((packed));
+
+enum RecordType : uint32_t {
+    kCreateConnection = 1,
+    kReleaseConnection,
+    kGetError,
+    kCreateContext,
+    kReleaseContext,
+    kCreateBuffer,
+    kImportBuffer,
+    kReleaseBuffer,
+    kMapBuffer,
+    kUnmapBuffer,
+    kWaitRendering,
+    kSubmitCommandBuffer,
+    kPageFlip,
+    kCreateSemaphore,
+    kImportSemaphore,
+    kReleaseSemaphore,
+    kSignalSemaphore,
+    kResetSemaphore,
+    kWaitSemaphore,
+    kCreatePersistentCommandBuffer,
+    kReleasePersistentCommandBuffer,
+    kSubmitPersistentCommandBuffer,
+    kMapBufferRange,
+    kUnmapBufferRange,
+    kNotCaptured,
+};
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t size;
+    // Since capture started.
+    uint64_t timestamp_ns;
+} __attribute__((packed));
+
+// kCreateConnection, kReleaseConnection.
+struct ConnectionRecord {
+    uint64_t connection;
+    uint32_t capabilities;
+} __attribute__((packed));
+
+struct ErrorRecord {
+    uint64_t connection;
+    int32_t status;
+} __attribute__((packed));
+
+// kCreateContext, kReleaseContext.  |priority| is only meaningful on creation.
+struct ContextRecord {
+    uint64_t connection;
+    uint32_t context_id;
+    uint32_t priority;
+} __attribute__((packed));
+
+// kCreateBuffer, kImportBuffer, kReleaseBuffer, kMapBuffer, kUnmapBuffer, kWaitRendering.
+struct BufferRecord {
+    uint64_t connection;
+    uint64_t buffer_id;
+    uint64_t size;
+} __attribute__((packed));
+
+// kMapBufferRange, kUnmapBufferRange.  |flags| are the MAGMA_MAP_FLAGs, and only meaningful when
+// mapping.
+struct BufferRangeRecord {
+    uint64_t connection;
+    uint64_t buffer_id;
+    uint64_t offset;
+    uint64_t length;
+    uint32_t flags;
+} __attribute__((packed));
+
+// Followed by |command_buffer_size| bytes of command buffer, then |batch_size| bytes of the batch
+// buffer's contents starting at |batch_offset|.  Contents of other resources aren't captured.
+struct SubmitRecord {
+    uint64_t connection;
+    uint32_t context_id;
+    uint32_t command_buffer_size;
+    uint64_t batch_offset;
+    uint32_t batch_size;
+} __attribute__((packed));
+
+// kCreatePersistentCommandBuffer, followed by |command_buffer_size| bytes of command buffer.
+// kReleasePersistentCommandBuffer, with |command_buffer_size| zero.
+struct PersistentCommandBufferRecord {
+    uint64_t connection;
+    uint32_t command_buffer_id;
+    uint32_t command_buffer_size;
+} __attribute__((packed));
+
+// If |patched|, followed by the patch's |wait_semaphore_count| then |signal_semaphore_count|
+// semaphore ids.  Then |batch_size| bytes of the batch buffer's contents starting at
+// |batch_offset|, read at the time of the submit.
+struct PersistentSubmitRecord {
+    uint64_t connection;
+    uint32_t command_buffer_id;
+    uint32_t context_id;
+    uint32_t patched;
+    uint32_t batch_start_offset;
+    uint32_t wait_semaphore_count;
+    uint32_t signal_semaphore_count;
+    uint64_t batch_offset;
+    uint32_t batch_size;
+} __attribute__((packed));
+
+// Followed by |wait_semaphore_count| then |signal_semaphore_count| semaphore ids.
+struct PageFlipRecord {
+    uint64_t connection;
+    uint64_t buffer_id;
+    uint32_t wait_semaphore_count;
+    uint32_t signal_semaphore_count;
+    uint64_t buffer_presented_semaphore_id;
+} __attribute__((packed));
+
+// Stands in for a call of |type| that couldn't be captured, so replay can report the gap.  |size|
+// is the size of the command buffer that couldn't be recorded.
+struct NotCapturedRecord {
+    uint64_t connection;
+    uint32_t type;
+    uint64_t size;
+} __attribute__((packed));
+
+// kCreateSemaphore, kImportSemaphore, kReleaseSemaphore, kSignalSemaphore, kResetSemaphore,
+// kWaitSemaphore.  |connection| is zero for calls that don't take one; |timeout_ms| is only set
+// for waits.
+struct SemaphoreRecord {
+    uint64_t connection;
+    uint64_t semaphore_id;
+    uint64_t timeout_ms;
+} __attribute__((packed));
+
+} // namespace magma_capture
+
+#endif // MAGMA_CAPTURE_FORMAT_H_
@@ -0,0 +1,114 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_mapping_cache.h"
+#include "platform_trace.h"
+
+MagmaMappingCache* MagmaMappingCache::Get()
+{
+    static MagmaMappingCache* cache = new MagmaMappingCache(kDefaultBudget);
+    return cache;
+}
+
+bool MagmaMappingCache::Map(magma::PlatformBuffer* buffer, void** addr_out)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto iter = entries_.find(buffer);
+    if (iter != entries_.end()) {
+        Entry& entry = iter->second;
+        if (entry.map_count == 0) {
+            idle_.erase(entry.idle_iter);
+            cached_bytes_ -= buffer->size();
+        }
+        entry.map_count++;
+        hit_count_++;
+        *addr_out = entry.addr;
+        return true;
+    }
+
+    TRACE_DURATION("magma", "MappingCache miss");
+    void* addr;
+    if (!buffer->MapCpu(&addr))
+        return DRETF(false, "MapCpu failed");
+
+    miss_count_++;
+    entries_[buffer] = Entry{addr, 1, idle_.end()};
+    *addr_out = addr;
+    return true;
+}
+
+bool MagmaMappingCache::Unmap(magma::PlatformBuffer* buffer)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto iter = entries_.find(buffer);
+    if (iter == entries_.end() || iter->second.map_count == 0)
+        return DRETF(false, "buffer not mapped");
+
+    Entry& entry = iter->second;
+    if (--entry.map_count > 0)
+        return true;
+
+    if (buffer->size() > budget_) {
+        entries_.erase(iter);
+        if (!buffer->UnmapCpu())
+            return DRETF(false, "UnmapCpu failed");
+        return true;
+    }
+
+    idle_.push_front(buffer);
+    entry.idle_iter = idle_.begin();
+    cached_bytes_ += buffer->size();
+    EvictLocked();
+    return true;
+}
+
+void MagmaMappingCache::Remove(magma::PlatformBuffer* buffer)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto iter = entries_.find(buffer);
+    if (iter == entries_.end())
+        return;
+
+    if (iter->second.map_count == 0) {
+        idle_.erase(iter->second.idle_iter);
+        cached_bytes_ -= buffer->size();
+    }
+    entries_.erase(iter);
+}
+
+void MagmaMappingCache::SetBudget(uint64_t budget)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    budget_ = budget;
+    EvictLocked();
+}
+
+magma_mapping_cache_stats MagmaMappingCache::stats()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    magma_mapping_cache_stats stats;
+    stats.hit_count = hit_count_;
+    stats.miss_count = miss_count_;
+    stats.eviction_count = eviction_count_;
+    stats.cached_bytes = cached_bytes_;
+    stats.budget_bytes = budget_;
+    return stats;
+}
+
+void MagmaMappingCache::EvictLocked()
+{
+    while (cached_bytes_ > budget_) {
+        DASSERT(!idle_.empty());
+        magma::PlatformBuffer* buffer = idle_.back();
+        idle_.pop_back();
+        cached_bytes_ -= buffer->size();
+        entries_.erase(buffer);
+        eviction_count_++;
+        if (!buffer->UnmapCpu())
+            DLOG("UnmapCpu failed on eviction");
+    }
+}
@@ -0,0 +1,60 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_MAPPING_CACHE_H_
+#define MAGMA_MAPPING_CACHE_H_
+
+#include "magma_common_defs.h"
+#include "magma_util/macros.h"
+#include "platform_buffer.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Keeps buffers mapped after their last magma_unmap so that mapping them again is just a pointer
+// return.  Unmapped buffers are held up to a budget of address space and evicted least recently
+// used first.  Mappings are process wide, so there is a single cache per process.
+class MagmaMappingCache {
+public:
+    static constexpr uint64_t kDefaultBudget = 64 * 1024 * 1024;
+
+    static MagmaMappingCache* Get();
+
+    explicit MagmaMappingCache(uint64_t budget) : budget_(budget) {}
+
+    bool Map(magma::PlatformBuffer* buffer, void** addr_out);
+    bool Unmap(magma::PlatformBuffer* buffer);
+
+    // Forgets |buffer|, which is about to be destroyed; destroying it drops any mapping.
+    void Remove(magma::PlatformBuffer* buffer);
+
+    // Evicts as needed to fit the new budget.
+    void SetBudget(uint64_t budget);
+
+    magma_mapping_cache_stats stats();
+
+private:
+    struct Entry {
+        void* addr;
+        // Zero if the buffer is only held by the cache, in which case it's in |idle_|.
+        uint32_t map_count;
+        std::list<magma::PlatformBuffer*>::iterator idle_iter;
+    };
+
+    void EvictLocked();
+
+    std::mutex mutex_;
+    uint64_t budget_;
+    uint64_t cached_bytes_ = 0;
+    std::unordered_map<magma::PlatformBuffer*, Entry> entries_;
+    // Most recently unmapped first.
+    std::list<magma::PlatformBuffer*> idle_;
+    uint64_t hit_count_ = 0;
+    uint64_t miss_count_ = 0;
+    uint64_t eviction_count_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(MagmaMappingCache);
+};
+
+#endif // MAGMA_MAPPING_CACHE_H_
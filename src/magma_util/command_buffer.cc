@@ -24,6 +24,11 @@ bool CommandBuffer::Initialize()
     if (total_size > max_size)
         return DRETF(false, "Platform Buffer backing CommandBuffer is not large enough");
 
+    total_size += sizeof(magma_system_timeline_point) *
+                  (static_cast<uint64_t>(wait_timeline_count()) + signal_timeline_count());
+    if (total_size > max_size)
+        return DRETF(false, "Platform Buffer backing CommandBuffer is not large enough");
+
     total_size += sizeof(magma_system_exec_resource) * num_resources();
     if (total_size > max_size)
         return DRETF(false, "Platform Buffer backing CommandBuffer is not large enough");
@@ -34,8 +39,12 @@ bool CommandBuffer::Initialize()
 
     uint64_t* signal_semaphore_ids = wait_semaphore_ids + wait_semaphore_count();
 
+    magma_system_timeline_point* timeline_points =
+        reinterpret_cast<magma_system_timeline_point*>(signal_semaphore_ids +
+                                                       signal_semaphore_count());
+
     magma_system_exec_resource* resource_base = reinterpret_cast<magma_system_exec_resource*>(
-        signal_semaphore_ids + signal_semaphore_count());
+        timeline_points + wait_timeline_count() + signal_timeline_count());
 
     magma_system_relocation_entry* relocations_base =
         reinterpret_cast<magma_system_relocation_entry*>(resource_base + num_resources());
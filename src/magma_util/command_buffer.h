@@ -16,8 +16,10 @@ namespace magma {
 //  1) magma_system_command_buffer
 //  2) array of wait semaphore ids
 //  3) array of signal semaphore ids
-//  4) array of exec resources
-//  5) array of relocations (per resource)
+//  4) array of wait timeline points
+//  5) array of signal timeline points
+//  6) array of exec resources
+//  7) array of relocations (per resource)
 //
 class CommandBuffer {
 public:
@@ -45,6 +47,10 @@ public:
 
     uint32_t signal_semaphore_count() const { return command_buffer_->signal_semaphore_count; }
 
+    uint32_t wait_timeline_count() const { return command_buffer_->wait_timeline_count; }
+
+    uint32_t signal_timeline_count() const { return command_buffer_->signal_timeline_count; }
+
     uint32_t batch_start_offset() const
     {
         DASSERT(command_buffer_);
@@ -102,7 +108,28 @@ public:
         return signal_semaphores[index];
     }
 
+    const magma_system_timeline_point& wait_timeline_point(uint32_t index) const
+    {
+        DASSERT(initialized_);
+        DASSERT(index < wait_timeline_count());
+        return timeline_points()[index];
+    }
+
+    const magma_system_timeline_point& signal_timeline_point(uint32_t index) const
+    {
+        DASSERT(initialized_);
+        DASSERT(index < signal_timeline_count());
+        return timeline_points()[wait_timeline_count() + index];
+    }
+
 private:
+    magma_system_timeline_point* timeline_points() const
+    {
+        return reinterpret_cast<magma_system_timeline_point*>(
+            reinterpret_cast<uint64_t*>(command_buffer_ + 1) + wait_semaphore_count() +
+            signal_semaphore_count());
+    }
+
     magma_system_command_buffer* command_buffer_ = nullptr;
     bool initialized_ = false;
     std::vector<ExecResource> resources_;
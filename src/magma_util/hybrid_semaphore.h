@@ -0,0 +1,161 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef HYBRID_SEMAPHORE_H
+#define HYBRID_SEMAPHORE_H
+
+#include "magma_util/dlog.h"
+#include "magma_util/macros.h"
+#include "platform_buffer.h"
+#include "platform_semaphore.h"
+#include "platform_trace.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace magma {
+
+// A binary semaphore with the same semantics as PlatformSemaphore, whose state is kept in a word
+// of shared memory.  Signal and Wait are atomic operations on that word; the kernel event is only
+// touched when a waiter has announced that it is going to sleep.
+// The memory and the event may be shared with another process; see duplicate_handles and Import.
+class HybridSemaphore {
+public:
+    static std::unique_ptr<HybridSemaphore> Create()
+    {
+        auto buffer = magma::PlatformBuffer::Create(PAGE_SIZE, "hybrid-semaphore");
+        if (!buffer)
+            return DRETP(nullptr, "failed to create buffer");
+
+        auto event = magma::PlatformSemaphore::Create();
+        if (!event)
+            return DRETP(nullptr, "failed to create event");
+
+        return Create(std::move(buffer), std::move(event));
+    }
+
+    // Takes ownership of both handles.
+    static std::unique_ptr<HybridSemaphore> Import(uint32_t buffer_handle, uint32_t event_handle)
+    {
+        auto buffer = magma::PlatformBuffer::Import(buffer_handle);
+        if (!buffer)
+            return DRETP(nullptr, "failed to import buffer");
+
+        auto event = magma::PlatformSemaphore::Import(event_handle);
+        if (!event)
+            return DRETP(nullptr, "failed to import event");
+
+        return Create(std::move(buffer), std::move(event));
+    }
+
+    HybridSemaphore(std::unique_ptr<magma::PlatformBuffer> buffer,
+                    std::unique_ptr<magma::PlatformSemaphore> event, std::atomic_uint32_t* state)
+        : buffer_(std::move(buffer)), event_(std::move(event)), state_(state)
+    {
+    }
+
+    ~HybridSemaphore() { buffer_->UnmapCpu(); }
+
+    uint64_t id() { return event_->id(); }
+
+    bool duplicate_handles(uint32_t* buffer_handle_out, uint32_t* event_handle_out)
+    {
+        if (!buffer_->duplicate_handle(buffer_handle_out))
+            return DRETF(false, "failed to duplicate buffer handle");
+        if (!event_->duplicate_handle(event_handle_out))
+            return DRETF(false, "failed to duplicate event handle");
+        return true;
+    }
+
+    void Signal()
+    {
+        TRACE_DURATION("magma:sync", "hybrid semaphore signal", "id", id());
+        uint32_t state = state_->fetch_or(kSignaled);
+        if (state & kWaiter) {
+            ++kernel_signal_count_;
+            event_->Signal();
+        }
+    }
+
+    void Reset() { state_->fetch_and(~kSignaled); }
+
+    // Returns true if the semaphore is signalled before the timeout expires, in which case the
+    // state is reset to unsignalled.  Only one thread should ever wait on a given semaphore.
+    bool Wait(uint64_t timeout_ms)
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        if (timeout_ms != UINT64_MAX)
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+        uint32_t state = state_->load();
+        while (true) {
+            if (state & kSignaled) {
+                if (state_->compare_exchange_weak(state, 0))
+                    return true;
+                continue;
+            }
+
+            if (!(state & kWaiter) && !state_->compare_exchange_weak(state, state | kWaiter))
+                continue;
+
+            uint64_t remaining_ms = UINT64_MAX;
+            if (timeout_ms != UINT64_MAX) {
+                auto now = std::chrono::steady_clock::now();
+                remaining_ms =
+                    now >= deadline
+                        ? 0
+                        : std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now)
+                              .count();
+            }
+
+            TRACE_DURATION("magma:sync", "hybrid semaphore sleep", "id", id());
+            ++kernel_wait_count_;
+            if (!event_->Wait(remaining_ms)) {
+                // Withdraw as a waiter; a racing Signal may still have set the state.
+                state = state_->fetch_and(~kWaiter);
+                if (!(state & kSignaled))
+                    return false;
+                state &= ~kWaiter;
+                continue;
+            }
+            // Wakeups may be stale, so recheck the state.
+            state = state_->load();
+        }
+    }
+
+    bool Wait() { return Wait(UINT64_MAX); }
+
+    // Number of times Signal had to wake a sleeper, and Wait had to sleep.
+    uint64_t kernel_signal_count() { return kernel_signal_count_; }
+    uint64_t kernel_wait_count() { return kernel_wait_count_; }
+
+private:
+    static constexpr uint32_t kSignaled = 1;
+    static constexpr uint32_t kWaiter = 2;
+
+    static std::unique_ptr<HybridSemaphore> Create(std::unique_ptr<magma::PlatformBuffer> buffer,
+                                                   std::unique_ptr<magma::PlatformSemaphore> event)
+    {
+        void* addr;
+        if (!buffer->MapCpu(&addr))
+            return DRETP(nullptr, "failed to map buffer");
+
+        static_assert(ATOMIC_INT_LOCK_FREE == 2, "state must be lock free");
+        auto state = reinterpret_cast<std::atomic_uint32_t*>(addr);
+
+        return std::make_unique<HybridSemaphore>(std::move(buffer), std::move(event), state);
+    }
+
+    std::unique_ptr<magma::PlatformBuffer> buffer_;
+    std::unique_ptr<magma::PlatformSemaphore> event_;
+    std::atomic_uint32_t* state_;
+    std::atomic_uint64_t kernel_signal_count_{0};
+    std::atomic_uint64_t kernel_wait_count_{0};
+
+    DISALLOW_COPY_AND_ASSIGN(HybridSemaphore);
+};
+
+} // namespace magma
+
+#endif // HYBRID_SEMAPHORE_H
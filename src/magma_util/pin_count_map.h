@@ -0,0 +1,200 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PIN_COUNT_MAP_H
+#define PIN_COUNT_MAP_H
+
+#include "magma_util/macros.h"
+#include <map>
+
+namespace magma {
+
+// Tracks pin (or other reference) counts as a set of disjoint extents, each of which has a
+// uniform nonzero count.  Adjacent extents always have different counts.  Pinning or unpinning a
+// range is O(log n + k) for n extents of which k overlap the range, regardless of the length of
+// the range.
+class PinCountMap {
+public:
+    // Increments the pin count of every unit in [start, start + count).
+    void Pin(uint32_t start, uint32_t count)
+    {
+        if (!count)
+            return;
+        uint32_t end = start + count;
+        DASSERT(end > start);
+
+        Split(start);
+        Split(end);
+
+        uint32_t pos = start;
+        auto iter = extents_.lower_bound(start);
+        while (pos < end) {
+            if (iter != extents_.end() && iter->first == pos) {
+                iter->second.count++;
+                pos = iter->second.end;
+                ++iter;
+            } else {
+                uint32_t gap_end =
+                    (iter == extents_.end() || iter->first > end) ? end : iter->first;
+                extents_.emplace_hint(iter, pos, Extent{gap_end, 1});
+                pos = gap_end;
+            }
+        }
+
+        Merge(start);
+        Merge(end);
+    }
+
+    // Decrements the pin count of every unit in [start, start + count), calling
+    // |released(release_start, release_count)| for each maximal range whose count drops to zero.
+    // Fails without changing anything if any unit in the range isn't pinned.
+    template <typename Released> bool Unpin(uint32_t start, uint32_t count, Released released)
+    {
+        if (!count)
+            return true;
+        if (!IsPinned(start, count))
+            return DRETF(false, "range not pinned");
+        uint32_t end = start + count;
+
+        Split(start);
+        Split(end);
+
+        uint32_t release_start = 0;
+        uint32_t release_end = 0;
+        auto iter = extents_.find(start);
+        while (iter != extents_.end() && iter->first < end) {
+            DASSERT(iter->second.count > 0);
+            if (--iter->second.count > 0) {
+                ++iter;
+                continue;
+            }
+            if (release_end != iter->first) {
+                if (release_end > release_start)
+                    released(release_start, release_end - release_start);
+                release_start = iter->first;
+            }
+            release_end = iter->second.end;
+            iter = extents_.erase(iter);
+        }
+        if (release_end > release_start)
+            released(release_start, release_end - release_start);
+
+        Merge(start);
+        Merge(end);
+        return true;
+    }
+
+    // Drops the count of every unit in [start, start + count) to zero.
+    void Erase(uint32_t start, uint32_t count)
+    {
+        if (!count)
+            return;
+        uint32_t end = start + count;
+
+        Split(start);
+        Split(end);
+
+        auto iter = extents_.lower_bound(start);
+        while (iter != extents_.end() && iter->first < end)
+            iter = extents_.erase(iter);
+    }
+
+    // Calls |gap(gap_start, gap_count)| for each maximal unpinned range within
+    // [start, start + count).
+    template <typename Gap> void ForEachGap(uint32_t start, uint32_t count, Gap gap)
+    {
+        uint32_t end = start + count;
+        uint32_t pos = start;
+
+        auto iter = Find(start);
+        if (iter == extents_.end())
+            iter = extents_.lower_bound(start);
+        while (pos < end) {
+            if (iter != extents_.end() && iter->first <= pos) {
+                pos = iter->second.end;
+                ++iter;
+                continue;
+            }
+            uint32_t gap_end = (iter == extents_.end() || iter->first > end) ? end : iter->first;
+            gap(pos, gap_end - pos);
+            pos = gap_end;
+        }
+    }
+
+    // Returns true if every unit in [start, start + count) is pinned.
+    bool IsPinned(uint32_t start, uint32_t count)
+    {
+        if (!count)
+            return true;
+        uint32_t end = start + count;
+
+        auto iter = Find(start);
+        if (iter == extents_.end())
+            return false;
+        while (iter->second.end < end) {
+            uint32_t pos = iter->second.end;
+            if (++iter == extents_.end() || iter->first != pos)
+                return false;
+        }
+        return true;
+    }
+
+    uint32_t pin_count(uint32_t unit)
+    {
+        auto iter = Find(unit);
+        return iter == extents_.end() ? 0 : iter->second.count;
+    }
+
+    bool empty() { return extents_.empty(); }
+
+    uint32_t extent_count() { return extents_.size(); }
+
+private:
+    struct Extent {
+        uint32_t end;
+        uint32_t count;
+    };
+
+    using Map = std::map<uint32_t, Extent>;
+
+    // Returns the extent containing |unit|, or end().
+    Map::iterator Find(uint32_t unit)
+    {
+        auto iter = extents_.upper_bound(unit);
+        if (iter == extents_.begin())
+            return extents_.end();
+        --iter;
+        return unit < iter->second.end ? iter : extents_.end();
+    }
+
+    // Ensures no extent straddles |unit|.
+    void Split(uint32_t unit)
+    {
+        auto iter = Find(unit);
+        if (iter == extents_.end() || iter->first == unit)
+            return;
+        Extent tail{iter->second.end, iter->second.count};
+        iter->second.end = unit;
+        extents_.emplace_hint(std::next(iter), unit, tail);
+    }
+
+    // Joins the extent starting at |unit| with its predecessor if they abut with equal counts.
+    void Merge(uint32_t unit)
+    {
+        auto iter = extents_.find(unit);
+        if (iter == extents_.end() || iter == extents_.begin())
+            return;
+        auto prev = std::prev(iter);
+        if (prev->second.end != unit || prev->second.count != iter->second.count)
+            return;
+        prev->second.end = iter->second.end;
+        extents_.erase(iter);
+    }
+
+    Map extents_;
+};
+
+} // namespace magma
+
+#endif // PIN_COUNT_MAP_H
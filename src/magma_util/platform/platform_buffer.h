@@ -13,6 +13,14 @@ namespace magma {
 // In general only the const functions in this class must be implemented in a threadsafe way
 class PlatformBuffer {
 public:
+    enum MapFlags : uint32_t {
+        kMapReadOnly = 1 << 0,
+        // Makes the buffer write combined.  This is a property of the whole buffer, so it must be
+        // requested before the buffer has any pages committed or mapped, and thereafter applies
+        // to every mapping.
+        kMapWriteCombined = 1 << 1,
+    };
+
     static std::unique_ptr<PlatformBuffer> Create(uint64_t size, const char* name);
     // Import takes ownership of the handle.
     static std::unique_ptr<PlatformBuffer> Import(uint32_t handle);
@@ -40,16 +48,36 @@ public:
     virtual bool MapCpu(void** addr_out) = 0;
     virtual bool UnmapCpu() = 0;
 
+    // Maps the pages spanning [offset, offset + length) and returns the address of |offset|.
+    // Range mappings are reference counted per page and placed at their offset within a single
+    // reservation, so overlapping and adjacent ranges share mappings.  |flags| is a combination
+    // of MapFlags; every range mapped at once must have the same kMapReadOnly setting.
+    virtual bool MapCpuRange(uint64_t offset, uint64_t length, uint32_t flags,
+                             void** addr_out) = 0;
+    // Releases a range previously mapped with MapCpuRange.
+    virtual bool UnmapCpuRange(uint64_t offset, uint64_t length) = 0;
+
     virtual bool PinPages(uint32_t start_page_index, uint32_t page_count) = 0;
     virtual bool UnpinPages(uint32_t start_page_index, uint32_t page_count) = 0;
 
-    virtual bool MapPageCpu(uint32_t page_index, void** addr_out) = 0;
+    // Maps a single page as a range, so |flags| is subject to the same rules as for MapCpuRange.
+    virtual bool MapPageCpu(uint32_t page_index, uint32_t flags, void** addr_out) = 0;
+    bool MapPageCpu(uint32_t page_index, void** addr_out)
+    {
+        return MapPageCpu(page_index, 0, addr_out);
+    }
     virtual bool UnmapPageCpu(uint32_t page_index) = 0;
 
     virtual bool MapPageRangeBus(uint32_t start_page_index, uint32_t page_count,
                                  uint64_t addr_out[]) = 0;
     virtual bool UnmapPageRangeBus(uint32_t start_page_index, uint32_t page_count) = 0;
 
+    // Bus addresses are cached while their pages stay pinned; this counts the MapPageRangeBus
+    // calls answered entirely from the cache.
+    virtual uint64_t bus_lookups_avoided() const = 0;
+    // The same count across every buffer in the process.
+    static uint64_t total_bus_lookups_avoided();
+
     static bool IdFromHandle(uint32_t handle, uint64_t* id_out);
 };
 
@@ -27,18 +27,24 @@ public:
 
     // Imports a buffer for use in the system driver
     virtual magma_status_t ImportBuffer(PlatformBuffer* buffer) = 0;
-    // Destroys the buffer with |buffer_id| within this connection
-    // returns false if |buffer_id| has not been imported
+    // Destroys the buffer with |buffer_id| within this connection.  Releases may be queued and sent
+    // to the driver together; a release of an unimported id is reported by GetError, not here.
     virtual magma_status_t ReleaseBuffer(uint64_t buffer_id) = 0;
+    // Sends any queued releases.
+    virtual magma_status_t FlushReleases() = 0;
 
     // Imports an object for use in the system driver
     virtual magma_status_t ImportObject(uint32_t handle, PlatformObject::Type object_type) = 0;
 
+    // Imports a timeline semaphore from its memory and event handles, taking ownership of both.
+    virtual magma_status_t ImportTimelineSemaphore(uint32_t memory_handle,
+                                                   uint32_t event_handle) = 0;
+
     // Releases the connection's reference to the given object.
     virtual magma_status_t ReleaseObject(uint64_t object_id, PlatformObject::Type object_type) = 0;
 
-    // Creates a context and returns the context id
-    virtual void CreateContext(uint32_t* context_id_out) = 0;
+    // Creates a context of the given MAGMA_CONTEXT_PRIORITY_* and returns the context id
+    virtual void CreateContext(uint32_t priority, uint32_t* context_id_out) = 0;
     // Destroys a context for the given id
     virtual void DestroyContext(uint32_t context_id) = 0;
 
@@ -46,12 +52,26 @@ public:
 
     virtual void ExecuteCommandBuffer(uint32_t command_buffer_handle, uint32_t context_id) = 0;
 
+    // Registers the command buffer |command_buffer_handle| for repeated execution, taking ownership
+    // of the handle, and returns its id.
+    virtual void CreatePersistentCommandBuffer(uint32_t command_buffer_handle,
+                                               uint32_t* command_buffer_id_out) = 0;
+    virtual void ReleasePersistentCommandBuffer(uint32_t command_buffer_id) = 0;
+    // |patch| may be null; otherwise |semaphore_ids| holds the semaphores it counts.
+    virtual void ExecutePersistentCommandBuffer(uint32_t command_buffer_id, uint32_t context_id,
+                                                const magma_system_command_buffer_patch* patch,
+                                                const uint64_t* semaphore_ids) = 0;
+
     // Blocks until all gpu work currently queued that references the buffer
     // with |buffer_id| has completed.
     virtual void WaitRendering(uint64_t buffer_id) = 0;
 
+    // |timeline_points| holds |wait_point_count| wait points followed by |signal_point_count|
+    // signal points.
     virtual void PageFlip(uint64_t buffer_id, uint32_t wait_semaphore_count,
                           uint32_t signal_semaphore_count, const uint64_t* semaphore_ids,
+                          uint32_t wait_point_count, uint32_t signal_point_count,
+                          const magma_system_timeline_point* timeline_points,
                           uint32_t buffer_presented_handle) = 0;
 
     static PlatformIpcConnection* cast(magma_connection_t* connection)
@@ -75,20 +95,32 @@ public:
         virtual ~Delegate() {}
         virtual bool ImportBuffer(uint32_t handle, uint64_t* buffer_id_out) = 0;
         virtual bool ReleaseBuffer(uint64_t buffer_id) = 0;
+        // Releases all of the |count| buffers, or none of them if any id is unknown.
+        virtual bool ReleaseBuffers(const uint64_t* buffer_ids, uint32_t count) = 0;
 
         virtual bool ImportObject(uint32_t handle, PlatformObject::Type object_type) = 0;
         virtual bool ReleaseObject(uint64_t object_id, PlatformObject::Type object_type) = 0;
+        virtual bool ImportTimelineSemaphore(uint32_t memory_handle, uint32_t event_handle) = 0;
 
-        virtual bool CreateContext(uint32_t context_id) = 0;
+        virtual bool CreateContext(uint32_t context_id, uint32_t priority) = 0;
         virtual bool DestroyContext(uint32_t context_id) = 0;
 
         virtual magma::Status ExecuteCommandBuffer(uint32_t command_buffer_handle,
                                                    uint32_t context_id) = 0;
+
+        virtual bool CreatePersistentCommandBuffer(uint32_t command_buffer_handle,
+                                                   uint32_t command_buffer_id) = 0;
+        virtual bool ReleasePersistentCommandBuffer(uint32_t command_buffer_id) = 0;
+        virtual magma::Status
+        ExecutePersistentCommandBuffer(uint32_t command_buffer_id, uint32_t context_id,
+                                       const magma_system_command_buffer_patch* patch,
+                                       const uint64_t* semaphore_ids) = 0;
         virtual magma::Status WaitRendering(uint64_t buffer_id) = 0;
 
         virtual magma::Status
         PageFlip(uint64_t buffer_id, uint32_t wait_semaphore_count, uint32_t signal_semaphore_count,
-                 uint64_t* semaphore_ids,
+                 uint64_t* semaphore_ids, uint32_t wait_point_count, uint32_t signal_point_count,
+                 magma_system_timeline_point* timeline_points,
                  std::unique_ptr<magma::PlatformSemaphore> buffer_presented_semaphore) = 0;
     };
 
@@ -24,6 +24,20 @@ public:
     virtual Status Wait(uint64_t* key_out, uint64_t timeout_ms) = 0;
 
     Status Wait(uint64_t* key_out) { return Wait(key_out, UINT64_MAX); }
+
+    // Waits as above for the first packet, then collects any further packets that are already
+    // queued without blocking, up to |max_keys| in total.  On success |count_out| is at least 1.
+    // Each collected packet still takes its own non-blocking port wait; what the caller saves is
+    // a wakeup and a pass through its own bookkeeping per packet.
+    // Collecting stops once |max_keys| keys are held, so a caller that bounds |max_keys| by the
+    // packets that can be outstanding is spared a final wait that finds the port empty.
+    virtual Status WaitMany(uint64_t* keys_out, uint32_t max_keys, uint32_t* count_out,
+                            uint64_t timeout_ms) = 0;
+
+    Status WaitMany(uint64_t* keys_out, uint32_t max_keys, uint32_t* count_out)
+    {
+        return WaitMany(keys_out, max_keys, count_out, UINT64_MAX);
+    }
 };
 
 } // namespace magma
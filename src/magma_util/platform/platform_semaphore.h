@@ -5,6 +5,7 @@
 #ifndef PLATFORM_SEMAPHORE_H
 #define PLATFORM_SEMAPHORE_H
 
+#include <atomic>
 #include <memory>
 
 #include "magma_util/macros.h"
@@ -63,8 +64,21 @@ public:
     bool Wait() { return Wait(UINT64_MAX); }
 
     // Registers an async wait delivered on the given port when this semaphore is signalled.
+    // The port returns |key| when the wait completes.
     // Note that a port wait completion will not autoreset the semaphore.
-    virtual bool WaitAsync(PlatformPort* platform_port) = 0;
+    virtual bool WaitAsync(PlatformPort* platform_port, uint64_t key) = 0;
+
+    // As above, using the semaphore id as the key.
+    bool WaitAsync(PlatformPort* platform_port) { return WaitAsync(platform_port, id()); }
+
+    // Marks this semaphore as having a port waiter; returns false if it already has one.
+    // Lets a SemaphorePort reject a second waiter without looking the semaphore up by id.
+    bool ClaimWaiter() { return !has_waiter_.exchange(true); }
+
+    void ReleaseWaiter() { has_waiter_ = false; }
+
+private:
+    std::atomic_bool has_waiter_{false};
 };
 
 } // namespace magma
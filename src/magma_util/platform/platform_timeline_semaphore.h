@@ -0,0 +1,58 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef PLATFORM_TIMELINE_SEMAPHORE_H
+#define PLATFORM_TIMELINE_SEMAPHORE_H
+
+#include <memory>
+
+#include "magma_util/macros.h"
+
+namespace magma {
+
+class PlatformPort;
+
+// A timeline semaphore holds a 64 bit value that only increases.  Signalling sets a new value;
+// waiting blocks until the value reaches a given point.  Unlike PlatformSemaphore, a timeline
+// semaphore is never reset, so one long-lived object can order an unbounded sequence of work.
+//
+// The value lives in memory shared by every process that has imported the semaphore; an event
+// is used to wake sleeping waiters.  Any number of threads may wait concurrently.
+class PlatformTimelineSemaphore {
+public:
+    static std::unique_ptr<PlatformTimelineSemaphore> Create(uint64_t initial_value);
+
+    // Takes ownership of both handles.
+    static std::unique_ptr<PlatformTimelineSemaphore> Import(uint32_t memory_handle,
+                                                             uint32_t event_handle);
+
+    virtual ~PlatformTimelineSemaphore() {}
+
+    // returns a unique, immutable id for the underlying object
+    virtual uint64_t id() = 0;
+
+    // on success, duplicates of the underlying handles which are owned by the caller
+    virtual bool duplicate_handles(uint32_t* memory_handle_out, uint32_t* event_handle_out) = 0;
+
+    virtual uint64_t value() = 0;
+
+    // Advances the value to |value| and wakes any waiters.  Values never decrease, so signalling
+    // a value less than the current value has no effect.
+    virtual void Signal(uint64_t value) = 0;
+
+    // Returns true if the value reaches at least |value| before the timeout expires.
+    virtual bool Wait(uint64_t value, uint64_t timeout_ms) = 0;
+
+    bool Wait(uint64_t value) { return Wait(value, UINT64_MAX); }
+
+    // If the value has already reached |value|, sets |reached_out| and registers nothing.
+    // Otherwise registers an async wait delivered on the given port with |key| when the value
+    // next changes; the caller should then check the value again.
+    virtual bool WaitAsync(PlatformPort* platform_port, uint64_t key, uint64_t value,
+                           bool* reached_out) = 0;
+};
+
+} // namespace magma
+
+#endif // PLATFORM_TIMELINE_SEMAPHORE_H
@@ -4,125 +4,23 @@
 
 #include "magma_util/dlog.h"
 #include "magma_util/macros.h"
+#include "magma_util/pin_count_map.h"
 #include "fdio/io.h"
 #include "platform_buffer.h"
 #include "platform_object.h"
 #include "platform_trace.h"
+#include <algorithm>
+#include <atomic>
 #include <ddk/driver.h>
 #include <limits.h> // PAGE_SIZE
 #include <map>
+#include <vector>
 #include <zx/vmar.h>
 #include <zx/vmo.h>
-#include <vector>
 
 namespace magma {
 
-class PinCountArray {
-public:
-    using pin_count_t = uint8_t;
-
-    static constexpr uint32_t kPinCounts = PAGE_SIZE / sizeof(pin_count_t);
-
-    PinCountArray() : count_(kPinCounts) {}
-
-    uint32_t pin_count(uint32_t index)
-    {
-        DASSERT(index < count_.size());
-        return count_[index];
-    }
-
-    void incr(uint32_t index)
-    {
-        DASSERT(index < count_.size());
-        total_count_++;
-        DASSERT(count_[index] < static_cast<pin_count_t>(~0));
-        ++count_[index];
-    }
-
-    // If pin count is positive, decrements the pin count and returns the new pin count.
-    // Otherwise returns -1.
-    int32_t decr(uint32_t index)
-    {
-        DASSERT(index < count_.size());
-        if (count_[index] == 0)
-            return -1;
-        DASSERT(total_count_ > 0);
-        --total_count_;
-        return --count_[index];
-    }
-
-    uint32_t total_count() { return total_count_; }
-
-private:
-    uint32_t total_count_{};
-    std::vector<pin_count_t> count_;
-};
-
-class PinCountSparseArray {
-public:
-    static std::unique_ptr<PinCountSparseArray> Create(uint32_t page_count)
-    {
-        uint32_t array_size = page_count / PinCountArray::kPinCounts;
-        if (page_count % PinCountArray::kPinCounts)
-            array_size++;
-        return std::unique_ptr<PinCountSparseArray>(new PinCountSparseArray(array_size));
-    }
-
-    uint32_t total_pin_count() { return total_pin_count_; }
-
-    uint32_t pin_count(uint32_t page_index)
-    {
-        uint32_t array_index = page_index / PinCountArray::kPinCounts;
-        uint32_t array_offset = page_index - PinCountArray::kPinCounts * array_index;
-
-        auto& array = sparse_array_[array_index];
-        if (!array)
-            return 0;
-
-        return array->pin_count(array_offset);
-    }
-
-    void incr(uint32_t page_index)
-    {
-        uint32_t array_index = page_index / PinCountArray::kPinCounts;
-        uint32_t array_offset = page_index - PinCountArray::kPinCounts * array_index;
-
-        if (!sparse_array_[array_index]) {
-            sparse_array_[array_index] = std::unique_ptr<PinCountArray>(new PinCountArray());
-        }
-
-        sparse_array_[array_index]->incr(array_offset);
-
-        ++total_pin_count_;
-    }
-
-    int32_t decr(uint32_t page_index)
-    {
-        uint32_t array_index = page_index / PinCountArray::kPinCounts;
-        uint32_t array_offset = page_index - PinCountArray::kPinCounts * array_index;
-
-        auto& array = sparse_array_[array_index];
-        if (!array)
-            return DRETF(false, "page not pinned");
-
-        int32_t ret = array->decr(array_offset);
-        if (ret < 0)
-            return DRET_MSG(ret, "page not pinned");
-
-        --total_pin_count_;
-
-        if (array->total_count() == 0)
-            array.reset();
-
-        return ret;
-    }
-
-private:
-    PinCountSparseArray(uint32_t array_size) : sparse_array_(array_size) {}
-
-    std::vector<std::unique_ptr<PinCountArray>> sparse_array_;
-    uint32_t total_pin_count_{};
-};
+static std::atomic<uint64_t> g_bus_lookups_avoided{0};
 
 class ZirconPlatformBuffer : public PlatformBuffer {
 public:
@@ -131,7 +29,6 @@ public:
         DLOG("ZirconPlatformBuffer ctor size %ld vmo 0x%x", size, vmo_.get());
 
         DASSERT(magma::is_page_aligned(size));
-        pin_count_array_ = PinCountSparseArray::Create(size / PAGE_SIZE);
 
         bool success = PlatformObject::IdFromHandle(vmo_.get(), &koid_);
         DASSERT(success);
@@ -168,21 +65,42 @@ public:
     bool MapCpu(void** addr_out) override;
     bool UnmapCpu() override;
 
+    bool MapCpuRange(uint64_t offset, uint64_t length, uint32_t flags, void** addr_out) override;
+    bool UnmapCpuRange(uint64_t offset, uint64_t length) override;
+
     bool PinPages(uint32_t start_page_index, uint32_t page_count) override;
     bool UnpinPages(uint32_t start_page_index, uint32_t page_count) override;
 
-    bool MapPageCpu(uint32_t page_index, void** addr_out) override;
+    bool MapPageCpu(uint32_t page_index, uint32_t flags, void** addr_out) override;
     bool UnmapPageCpu(uint32_t page_index) override;
 
     bool MapPageRangeBus(uint32_t start_page_index, uint32_t page_count,
                          uint64_t addr_out[]) override;
     bool UnmapPageRangeBus(uint32_t start_page_index, uint32_t page_count) override;
 
+    uint64_t bus_lookups_avoided() const override { return bus_lookups_avoided_; }
+
     uint32_t num_pages() { return size_ / PAGE_SIZE; }
 
 private:
     void ReleasePages();
 
+    // Caches |addrs| as the bus addresses of the pages starting at |start_page|, which mustn't be
+    // cached already.
+    void InsertBusAddrExtent(uint32_t start_page, std::vector<uint64_t> addrs);
+    // Forgets the cached bus addresses of the given pages.
+    void EraseBusAddrs(uint32_t start_page, uint32_t page_count);
+
+    // Reserves the address space range mappings are placed in.
+    bool EnsurePagedVmar();
+
+    // Returns the pages spanning the given byte range.
+    static uint32_t first_page(uint64_t offset) { return offset / PAGE_SIZE; }
+    static uint32_t range_page_count(uint64_t offset, uint64_t length)
+    {
+        return magma::round_up(offset + length, PAGE_SIZE) / PAGE_SIZE - first_page(offset);
+    }
+
     zx_status_t vmar_unmap()
     {
         zx_status_t status =
@@ -197,9 +115,18 @@ private:
     uint64_t koid_;
     void* virt_addr_{};
     uint32_t map_count_ = 0;
-    std::unique_ptr<PinCountSparseArray> pin_count_array_;
+    PinCountMap pin_count_map_;
+    // Bus addresses of pinned pages that have been looked up, in extents keyed by their first
+    // page.  Extents neither overlap nor touch, and are trimmed as their pages are unpinned.
+    std::map<uint32_t, std::vector<uint64_t>> bus_addr_extents_;
+    uint64_t bus_lookups_avoided_ = 0;
     std::map<uint32_t, void*> mapped_pages_;
     zx::vmar paged_vmar_;
+    uintptr_t paged_vmar_addr_ = 0;
+    // Number of range mappings covering each page.
+    PinCountMap range_map_counts_;
+    uint32_t range_map_flags_ = 0;
+    bool write_combined_ = false;
 };
 
 bool ZirconPlatformBuffer::GetFd(int* fd_out) const
@@ -294,9 +221,7 @@ bool ZirconPlatformBuffer::PinPages(uint32_t start_page_index, uint32_t page_cou
     if (status != ZX_OK && status != ZX_ERR_NOT_SUPPORTED)
         return DRETF(false, "failed to lock vmo pages: %d", status);
 
-    for (uint32_t i = 0; i < page_count; i++) {
-        pin_count_array_->incr(start_page_index + i);
-    }
+    pin_count_map_.Pin(start_page_index, page_count);
 
     return true;
 }
@@ -310,91 +235,158 @@ bool ZirconPlatformBuffer::UnpinPages(uint32_t start_page_index, uint32_t page_c
     if ((start_page_index + page_count) * PAGE_SIZE > size())
         return DRETF(false, "offset + length greater than buffer size");
 
-    uint32_t pages_to_unpin = 0;
+    // Unlock each range whose last pin this was.
+    bool unlocked = true;
+    bool unpinned = pin_count_map_.Unpin(
+        start_page_index, page_count,
+        [this, &unlocked](uint32_t page_index, uint32_t unlock_page_count) {
+            EraseBusAddrs(page_index, unlock_page_count);
+            zx_status_t status = vmo_.op_range(ZX_VMO_OP_UNLOCK, page_index * PAGE_SIZE,
+                                               unlock_page_count * PAGE_SIZE, nullptr, 0);
+            if (status != ZX_OK && status != ZX_ERR_NOT_SUPPORTED) {
+                DLOG("failed to unlock page_index %u page_count %u: %d", page_index,
+                     unlock_page_count, status);
+                unlocked = false;
+            }
+        });
+    if (!unpinned)
+        return DRETF(false, "page not pinned");
+    if (!unlocked)
+        return DRETF(false, "failed to unlock pages");
 
-    for (uint32_t i = 0; i < page_count; i++) {
-        uint32_t pin_count = pin_count_array_->pin_count(start_page_index + i);
+    return true;
+}
 
-        if (pin_count == 0)
-            return DRETF(false, "page not pinned");
+void ZirconPlatformBuffer::ReleasePages()
+{
+    TRACE_DURATION("magma", "ReleasePages");
+    if (!pin_count_map_.empty()) {
+        // Still have some pinned pages, unlock.
+        zx_status_t status = vmo_.op_range(ZX_VMO_OP_UNLOCK, 0, size(), nullptr, 0);
+        if (status != ZX_OK && status != ZX_ERR_NOT_SUPPORTED)
+            DLOG("failed to unlock pages: %d", status);
+    }
+
+    // Destroying the vmar removes any range mappings.
+    mapped_pages_.clear();
+}
+
+bool ZirconPlatformBuffer::EnsurePagedVmar()
+{
+    if (paged_vmar_.get())
+        return true;
+
+    zx_status_t status = zx::vmar::root_self().allocate(
+        0, size_, ZX_VM_FLAG_CAN_MAP_SPECIFIC | ZX_VM_FLAG_CAN_MAP_READ | ZX_VM_FLAG_CAN_MAP_WRITE,
+        &paged_vmar_, &paged_vmar_addr_);
+    if (status != ZX_OK)
+        return DRETF(false, "vmar allocate failed: %d", status);
+    return true;
+}
 
-        if (pin_count == 1)
-            pages_to_unpin++;
+bool ZirconPlatformBuffer::MapCpuRange(uint64_t offset, uint64_t length, uint32_t flags,
+                                       void** addr_out)
+{
+    TRACE_DURATION("magma", "MapCpuRange");
+    if (!length)
+        return DRETF(false, "zero length");
+    if (offset > size() || length > size() - offset)
+        return DRETF(false, "offset 0x%" PRIx64 " length 0x%" PRIx64 " outside buffer", offset,
+                     length);
+
+    if (range_map_counts_.empty()) {
+        range_map_flags_ = flags & kMapReadOnly;
+    } else if ((flags & kMapReadOnly) != range_map_flags_) {
+        return DRETF(false, "read only flag doesn't match existing range mappings");
     }
 
-    DLOG("pages_to_unpin %u page_count %u", pages_to_unpin, page_count);
+    if ((flags & kMapWriteCombined) && !write_combined_) {
+        zx_status_t status =
+            zx_vmo_set_cache_policy(vmo_.get(), ZX_CACHE_POLICY_WRITE_COMBINING);
+        if (status != ZX_OK)
+            return DRETF(false, "failed to make buffer write combined: %d", status);
+        write_combined_ = true;
+    }
 
-    if (pages_to_unpin == page_count) {
-        for (uint32_t i = 0; i < page_count; i++) {
-            pin_count_array_->decr(start_page_index + i);
-        }
+    if (!EnsurePagedVmar())
+        return false;
 
-        // Unlock the entire range.
-        zx_status_t status = vmo_.op_range(ZX_VMO_OP_UNLOCK, start_page_index * PAGE_SIZE,
-                                           page_count * PAGE_SIZE, nullptr, 0);
-        if (status != ZX_OK && status != ZX_ERR_NOT_SUPPORTED) {
-            return DRETF(false, "failed to unlock full range: %d", status);
-        }
+    uint32_t start_page = first_page(offset);
+    uint32_t page_count = range_page_count(offset, length);
 
-    } else {
-        // Unlock page by page
-        for (uint32_t page_index = start_page_index; page_index < start_page_index + page_count;
-             page_index++) {
-            if (pin_count_array_->decr(page_index) == 0) {
-                zx_status_t status =
-                    vmo_.op_range(ZX_VMO_OP_UNLOCK, page_index * PAGE_SIZE, PAGE_SIZE, nullptr, 0);
-                if (status != ZX_OK && status != ZX_ERR_NOT_SUPPORTED) {
-                    return DRETF(false, "failed to unlock page_index %u: %u", page_index, status);
-                }
-            }
+    std::vector<std::pair<uint32_t, uint32_t>> gaps;
+    range_map_counts_.ForEachGap(start_page, page_count,
+                                 [&gaps](uint32_t gap_start, uint32_t gap_count) {
+                                     gaps.push_back(std::make_pair(gap_start, gap_count));
+                                 });
+
+    uint32_t perms = ZX_VM_FLAG_PERM_READ;
+    if (!(flags & kMapReadOnly))
+        perms |= ZX_VM_FLAG_PERM_WRITE;
+
+    for (uint32_t i = 0; i < gaps.size(); i++) {
+        uint64_t gap_offset = gaps[i].first * PAGE_SIZE;
+        uintptr_t ptr;
+        zx_status_t status = paged_vmar_.map(gap_offset, vmo_, gap_offset,
+                                             gaps[i].second * PAGE_SIZE,
+                                             ZX_VM_FLAG_SPECIFIC | perms, &ptr);
+        if (status != ZX_OK) {
+            for (uint32_t j = 0; j < i; j++)
+                paged_vmar_.unmap(paged_vmar_addr_ + gaps[j].first * PAGE_SIZE,
+                                  gaps[j].second * PAGE_SIZE);
+            return DRETF(false, "vmar map failed: %d", status);
         }
     }
 
+    range_map_counts_.Pin(start_page, page_count);
+
+    *addr_out = reinterpret_cast<void*>(paged_vmar_addr_ + offset);
     return true;
 }
 
-void ZirconPlatformBuffer::ReleasePages()
+bool ZirconPlatformBuffer::UnmapCpuRange(uint64_t offset, uint64_t length)
 {
-    TRACE_DURATION("magma", "ReleasePages");
-    if (pin_count_array_->total_pin_count()) {
-        // Still have some pinned pages, unlock.
-        zx_status_t status = vmo_.op_range(ZX_VMO_OP_UNLOCK, 0, size(), nullptr, 0);
-        if (status != ZX_OK && status != ZX_ERR_NOT_SUPPORTED)
-            DLOG("failed to unlock pages: %d", status);
-    }
+    TRACE_DURATION("magma", "UnmapCpuRange");
+    if (!length)
+        return DRETF(false, "zero length");
+    if (offset > size() || length > size() - offset)
+        return DRETF(false, "offset 0x%" PRIx64 " length 0x%" PRIx64 " outside buffer", offset,
+                     length);
+
+    bool unmapped = true;
+    bool found = range_map_counts_.Unpin(
+        first_page(offset), range_page_count(offset, length),
+        [this, &unmapped](uint32_t start_page, uint32_t page_count) {
+            zx_status_t status = paged_vmar_.unmap(paged_vmar_addr_ + start_page * PAGE_SIZE,
+                                                   page_count * PAGE_SIZE);
+            if (status != ZX_OK) {
+                DLOG("failed to unmap pages %u..%u: %d", start_page,
+                     start_page + page_count - 1, status);
+                unmapped = false;
+            }
+        });
+    if (!found)
+        return DRETF(false, "range not mapped");
+    if (!unmapped)
+        return DRETF(false, "failed to unmap range");
 
-    for (auto& pair : mapped_pages_) {
-        UnmapPageCpu(pair.first);
-    }
+    return true;
 }
 
-bool ZirconPlatformBuffer::MapPageCpu(uint32_t page_index, void** addr_out)
+bool ZirconPlatformBuffer::MapPageCpu(uint32_t page_index, uint32_t flags, void** addr_out)
 {
     auto iter = mapped_pages_.find(page_index);
     if (iter != mapped_pages_.end()) {
+        // A mapped page keeps range mappings alive, so their flags still apply.
+        if ((flags & kMapReadOnly) != range_map_flags_)
+            return DRETF(false, "read only flag doesn't match existing range mappings");
         *addr_out = iter->second;
         return true;
     }
 
-    if (!paged_vmar_.get()) {
-        uintptr_t addr;
-        zx_status_t status = zx::vmar::root_self().allocate(
-            0, size_,
-            ZX_VM_FLAG_CAN_MAP_SPECIFIC | ZX_VM_FLAG_CAN_MAP_READ | ZX_VM_FLAG_CAN_MAP_WRITE,
-            &paged_vmar_, &addr);
-        if (status != ZX_OK)
-            return DRETF(false, "vmar allocate failed: %d", status);
-    }
-    DASSERT(paged_vmar_.get());
-
-    uintptr_t ptr;
-    zx_status_t status =
-        paged_vmar_.map(page_index * PAGE_SIZE, vmo_, page_index * PAGE_SIZE, PAGE_SIZE,
-                        ZX_VM_FLAG_SPECIFIC | ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &ptr);
-    if (status != ZX_OK)
-        return DRETF(false, "vmar map failed: %d", status);
+    if (!MapCpuRange(page_index * PAGE_SIZE, PAGE_SIZE, flags, addr_out))
+        return DRETF(false, "failed to map page_index %u", page_index);
 
-    *addr_out = reinterpret_cast<void*>(ptr);
     mapped_pages_.insert(std::make_pair(page_index, *addr_out));
     return true;
 }
@@ -406,11 +398,9 @@ bool ZirconPlatformBuffer::UnmapPageCpu(uint32_t page_index)
         return DRETF(false, "page_index %u not mapped", page_index);
     }
 
-    uintptr_t addr = reinterpret_cast<uintptr_t>(iter->second);
     mapped_pages_.erase(iter);
 
-    zx_status_t status = paged_vmar_.unmap(addr, PAGE_SIZE);
-    if (status != ZX_OK)
+    if (!UnmapCpuRange(page_index * PAGE_SIZE, PAGE_SIZE))
         return DRETF(false, "failed to unmap vmo page %d", page_index);
 
     return true;
@@ -422,28 +412,112 @@ bool ZirconPlatformBuffer::MapPageRangeBus(uint32_t start_page_index, uint32_t p
     TRACE_DURATION("magma", "MapPageRangeBus");
     static_assert(sizeof(zx_paddr_t) == sizeof(uint64_t), "unexpected sizeof(zx_paddr_t)");
 
-    for (uint32_t i = start_page_index; i < start_page_index + page_count; i++) {
-        if (pin_count_array_->pin_count(i) == 0)
-            return DRETF(false, "zero pin_count for page %u", i);
-    }
+    if (!pin_count_map_.IsPinned(start_page_index, page_count))
+        return DRETF(false, "zero pin_count in pages %u..%u", start_page_index,
+                     start_page_index + page_count - 1);
+
+    // Locked pages can't move, so addresses looked up while pinned stay valid until unpinned.
+    uint32_t end_page = start_page_index + page_count;
+    uint32_t page = start_page_index;
+    bool looked_up = false;
+    while (page < end_page) {
+        auto next = bus_addr_extents_.upper_bound(page);
+        if (next != bus_addr_extents_.begin()) {
+            auto extent = std::prev(next);
+            uint32_t extent_end = extent->first + extent->second.size();
+            if (page < extent_end) {
+                uint32_t count = std::min(end_page, extent_end) - page;
+                auto first = extent->second.begin() + (page - extent->first);
+                std::copy(first, first + count, addr_out + (page - start_page_index));
+                page += count;
+                continue;
+            }
+        }
 
-    zx_status_t status;
-    {
-        TRACE_DURATION("magma", "vmo lookup");
-        status = vmo_.op_range(ZX_VMO_OP_LOOKUP, start_page_index * PAGE_SIZE,
-                               page_count * PAGE_SIZE, addr_out, page_count * sizeof(addr_out[0]));
+        // Look up the pages up to the next cached extent.
+        uint32_t gap_end =
+            next == bus_addr_extents_.end() ? end_page : std::min(end_page, next->first);
+        std::vector<uint64_t> addrs(gap_end - page);
+        zx_status_t status;
+        {
+            TRACE_DURATION("magma", "vmo lookup");
+            status = vmo_.op_range(ZX_VMO_OP_LOOKUP, page * PAGE_SIZE, addrs.size() * PAGE_SIZE,
+                                   addrs.data(), addrs.size() * sizeof(addrs[0]));
+        }
+        if (status != ZX_OK)
+            return DRETF(false, "failed to lookup vmo");
+        std::copy(addrs.begin(), addrs.end(), addr_out + (page - start_page_index));
+        InsertBusAddrExtent(page, std::move(addrs));
+        looked_up = true;
+        page = gap_end;
     }
-    if (status != ZX_OK)
-        return DRETF(false, "failed to lookup vmo");
 
+    if (!looked_up) {
+        bus_lookups_avoided_++;
+        g_bus_lookups_avoided++;
+    }
     return true;
 }
 
+void ZirconPlatformBuffer::InsertBusAddrExtent(uint32_t start_page, std::vector<uint64_t> addrs)
+{
+    // Merge with neighbouring extents, so each run of looked up pages is one extent.
+    auto next = bus_addr_extents_.lower_bound(start_page);
+    if (next != bus_addr_extents_.end() && next->first == start_page + addrs.size()) {
+        addrs.insert(addrs.end(), next->second.begin(), next->second.end());
+        next = bus_addr_extents_.erase(next);
+    }
+    if (next != bus_addr_extents_.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second.size() == start_page) {
+            prev->second.insert(prev->second.end(), addrs.begin(), addrs.end());
+            return;
+        }
+    }
+    bus_addr_extents_.emplace_hint(next, start_page, std::move(addrs));
+}
+
+void ZirconPlatformBuffer::EraseBusAddrs(uint32_t start_page, uint32_t page_count)
+{
+    uint32_t end_page = start_page + page_count;
+    auto iter = bus_addr_extents_.upper_bound(start_page);
+    if (iter != bus_addr_extents_.begin())
+        iter = std::prev(iter);
+
+    while (iter != bus_addr_extents_.end() && iter->first < end_page) {
+        uint32_t extent_start = iter->first;
+        uint32_t extent_end = extent_start + iter->second.size();
+        if (extent_end <= start_page) {
+            ++iter;
+            continue;
+        }
+
+        std::vector<uint64_t> tail;
+        if (extent_end > end_page)
+            tail.assign(iter->second.end() - (extent_end - end_page), iter->second.end());
+
+        if (extent_start < start_page) {
+            iter->second.resize(start_page - extent_start);
+            iter->second.shrink_to_fit();
+            ++iter;
+        } else {
+            iter = bus_addr_extents_.erase(iter);
+        }
+
+        if (!tail.empty()) {
+            bus_addr_extents_.emplace_hint(iter, end_page, std::move(tail));
+            break;
+        }
+    }
+}
+
 bool ZirconPlatformBuffer::UnmapPageRangeBus(uint32_t start_page_index, uint32_t page_count)
 {
     return true;
 }
 
+uint64_t PlatformBuffer::total_bus_lookups_avoided() { return g_bus_lookups_avoided; }
+
 std::unique_ptr<PlatformBuffer> PlatformBuffer::Create(uint64_t size, const char* name)
 {
     size = magma::round_up(size, PAGE_SIZE);
@@ -6,7 +6,11 @@
 #include "platform_connection.h"
 
 #include "zx/channel.h"
+#include <algorithm>
+#include <chrono>
 #include <list>
+#include <mutex>
+#include <vector>
 #include <zircon/syscalls.h>
 #include <zircon/types.h>
 
@@ -14,7 +18,7 @@ namespace magma {
 
 enum OpCode {
     ImportBuffer,
-    ReleaseBuffer,
+    ReleaseBuffers,
     ImportObject,
     ReleaseObject,
     CreateContext,
@@ -23,6 +27,10 @@ enum OpCode {
     WaitRendering,
     PageFlip,
     GetError,
+    ImportTimelineSemaphore,
+    CreatePersistentCommandBuffer,
+    ReleasePersistentCommandBuffer,
+    ExecutePersistentCommandBuffer,
 };
 
 struct ImportBufferOp {
@@ -30,10 +38,19 @@ struct ImportBufferOp {
     static constexpr uint32_t kNumHandles = 1;
 } __attribute__((packed));
 
-struct ReleaseBufferOp {
-    const OpCode opcode = ReleaseBuffer;
+// Sent with only the first |count| ids.
+struct ReleaseBuffersOp {
+    static constexpr uint32_t kMaxCount = 128;
+
+    const OpCode opcode = ReleaseBuffers;
     static constexpr uint32_t kNumHandles = 0;
-    uint64_t buffer_id;
+    uint32_t count;
+    uint64_t buffer_ids[kMaxCount];
+
+    static uint32_t size(uint32_t count)
+    {
+        return sizeof(ReleaseBuffersOp) - sizeof(uint64_t) * (kMaxCount - count);
+    }
 } __attribute__((packed));
 
 struct ImportObjectOp {
@@ -53,6 +70,7 @@ struct CreateContextOp {
     const OpCode opcode = CreateContext;
     static constexpr uint32_t kNumHandles = 0;
     uint32_t context_id;
+    uint32_t priority;
 } __attribute__((packed));
 
 struct DestroyContextOp {
@@ -67,6 +85,37 @@ struct ExecuteCommandBufferOp {
     uint32_t context_id;
 } __attribute__((packed));
 
+struct CreatePersistentCommandBufferOp {
+    const OpCode opcode = CreatePersistentCommandBuffer;
+    static constexpr uint32_t kNumHandles = 1;
+    uint32_t command_buffer_id;
+} __attribute__((packed));
+
+struct ReleasePersistentCommandBufferOp {
+    const OpCode opcode = ReleasePersistentCommandBuffer;
+    static constexpr uint32_t kNumHandles = 0;
+    uint32_t command_buffer_id;
+} __attribute__((packed));
+
+// Sent with only the semaphore ids of the patch, if there is one.
+struct ExecutePersistentCommandBufferOp {
+    static constexpr uint32_t kMaxSemaphoreCount = MAGMA_COMMAND_BUFFER_PATCH_MAX_SEMAPHORES;
+
+    const OpCode opcode = ExecutePersistentCommandBuffer;
+    static constexpr uint32_t kNumHandles = 0;
+    uint32_t command_buffer_id;
+    uint32_t context_id;
+    uint32_t patched;
+    magma_system_command_buffer_patch patch;
+    uint64_t semaphore_ids[kMaxSemaphoreCount];
+
+    static uint32_t size(uint32_t semaphore_count)
+    {
+        return sizeof(ExecutePersistentCommandBufferOp) -
+               sizeof(uint64_t) * (kMaxSemaphoreCount - semaphore_count);
+    }
+} __attribute__((packed));
+
 struct WaitRenderingOp {
     const OpCode opcode = WaitRendering;
     static constexpr uint32_t kNumHandles = 0;
@@ -74,20 +123,34 @@ struct WaitRenderingOp {
 } __attribute__((packed));
 
 // Note PageFlipOp must be overlayed on a memory allocation dynamically sized
-// for the number of semaphores.
+// for the number of semaphores and timeline points; the points follow the semaphore ids.
 struct PageFlipOp {
     const OpCode opcode = PageFlip;
     static constexpr uint32_t kNumHandles = 1;
     uint64_t buffer_id;
     uint64_t signal_semaphore_count;
     uint32_t wait_semaphore_count;
+    uint32_t wait_point_count;
+    uint32_t signal_point_count;
     uint64_t semaphore_ids[];
 
-    static uint32_t size(uint32_t semaphore_count)
+    static uint32_t size(uint32_t semaphore_count, uint32_t point_count)
     {
-        return sizeof(PageFlipOp) + sizeof(uint64_t) * semaphore_count;
+        return sizeof(PageFlipOp) + sizeof(uint64_t) * semaphore_count +
+               sizeof(magma_system_timeline_point) * point_count;
     }
 
+    magma_system_timeline_point* timeline_points()
+    {
+        return reinterpret_cast<magma_system_timeline_point*>(
+            semaphore_ids + wait_semaphore_count + signal_semaphore_count);
+    }
+
+} __attribute__((packed));
+
+struct ImportTimelineSemaphoreOp {
+    const OpCode opcode = ImportTimelineSemaphore;
+    static constexpr uint32_t kNumHandles = 2;
 } __attribute__((packed));
 
 struct GetErrorOp {
@@ -114,16 +177,62 @@ PageFlipOp* OpCast<PageFlipOp>(uint8_t* bytes, uint32_t num_bytes, zx_handle_t*
         return DRETP(nullptr, "too few bytes for a page flip: %u", num_bytes);
 
     auto page_flip_op = reinterpret_cast<PageFlipOp*>(bytes);
-    const uint32_t expected_size =
-        PageFlipOp::size(page_flip_op->wait_semaphore_count + page_flip_op->signal_semaphore_count);
+    const uint64_t expected_size =
+        sizeof(PageFlipOp) +
+        sizeof(uint64_t) * (static_cast<uint64_t>(page_flip_op->wait_semaphore_count) +
+                            page_flip_op->signal_semaphore_count) +
+        sizeof(magma_system_timeline_point) *
+            (static_cast<uint64_t>(page_flip_op->wait_point_count) +
+             page_flip_op->signal_point_count);
     if (num_bytes != expected_size)
-        return DRETP(nullptr, "wrong number of bytes in message, expected %u, got %u",
+        return DRETP(nullptr, "wrong number of bytes in message, expected %" PRIu64 ", got %u",
                      expected_size, num_bytes);
     if (kNumHandles != PageFlipOp::kNumHandles)
         return DRETP(nullptr, "wrong number of handles in message");
     return reinterpret_cast<PageFlipOp*>(bytes);
 }
 
+template <>
+ReleaseBuffersOp* OpCast<ReleaseBuffersOp>(uint8_t* bytes, uint32_t num_bytes,
+                                           zx_handle_t* handles, uint32_t kNumHandles)
+{
+    if (num_bytes < ReleaseBuffersOp::size(0))
+        return DRETP(nullptr, "too few bytes for a buffer release: %u", num_bytes);
+
+    auto release_op = reinterpret_cast<ReleaseBuffersOp*>(bytes);
+    if (release_op->count > ReleaseBuffersOp::kMaxCount)
+        return DRETP(nullptr, "too many buffers released: %u", release_op->count);
+    if (num_bytes != ReleaseBuffersOp::size(release_op->count))
+        return DRETP(nullptr, "wrong number of bytes in message, expected %u, got %u",
+                     ReleaseBuffersOp::size(release_op->count), num_bytes);
+    if (kNumHandles != ReleaseBuffersOp::kNumHandles)
+        return DRETP(nullptr, "wrong number of handles in message");
+    return release_op;
+}
+
+template <>
+ExecutePersistentCommandBufferOp*
+OpCast<ExecutePersistentCommandBufferOp>(uint8_t* bytes, uint32_t num_bytes, zx_handle_t* handles,
+                                         uint32_t kNumHandles)
+{
+    if (num_bytes < ExecutePersistentCommandBufferOp::size(0))
+        return DRETP(nullptr, "too few bytes for a persistent command buffer: %u", num_bytes);
+
+    auto execute_op = reinterpret_cast<ExecutePersistentCommandBufferOp*>(bytes);
+    const uint64_t semaphore_count =
+        execute_op->patched ? static_cast<uint64_t>(execute_op->patch.wait_semaphore_count) +
+                                  execute_op->patch.signal_semaphore_count
+                            : 0;
+    if (semaphore_count > ExecutePersistentCommandBufferOp::kMaxSemaphoreCount)
+        return DRETP(nullptr, "too many semaphores in patch: %" PRIu64, semaphore_count);
+    if (num_bytes != ExecutePersistentCommandBufferOp::size(semaphore_count))
+        return DRETP(nullptr, "wrong number of bytes in message, expected %u, got %u",
+                     ExecutePersistentCommandBufferOp::size(semaphore_count), num_bytes);
+    if (kNumHandles != ExecutePersistentCommandBufferOp::kNumHandles)
+        return DRETP(nullptr, "wrong number of handles in message");
+    return execute_op;
+}
+
 class ZirconPlatformConnection : public PlatformConnection,
                                   public std::enable_shared_from_this<ZirconPlatformConnection> {
 public:
@@ -137,8 +246,9 @@ public:
 
     bool HandleRequest() override
     {
-        constexpr uint32_t num_bytes = 256;
-        constexpr uint32_t kNumHandles = 1;
+        constexpr uint32_t num_bytes = std::max<uint32_t>(
+            {256, sizeof(ReleaseBuffersOp), sizeof(ExecutePersistentCommandBufferOp)});
+        constexpr uint32_t kNumHandles = 2;
 
         uint32_t actual_bytes;
         uint32_t actual_handles;
@@ -183,9 +293,9 @@ public:
                         OpCast<ImportBufferOp>(bytes, actual_bytes, handles, actual_handles),
                         handles);
                     break;
-                case OpCode::ReleaseBuffer:
-                    success = ReleaseBuffer(
-                        OpCast<ReleaseBufferOp>(bytes, actual_bytes, handles, actual_handles));
+                case OpCode::ReleaseBuffers:
+                    success = ReleaseBuffers(
+                        OpCast<ReleaseBuffersOp>(bytes, actual_bytes, handles, actual_handles));
                     break;
                 case OpCode::ImportObject:
                     success = ImportObject(
@@ -222,6 +332,28 @@ public:
                     success =
                         GetError(OpCast<GetErrorOp>(bytes, actual_bytes, handles, actual_handles));
                     break;
+                case OpCode::ImportTimelineSemaphore:
+                    success = ImportTimelineSemaphore(
+                        OpCast<ImportTimelineSemaphoreOp>(bytes, actual_bytes, handles,
+                                                          actual_handles),
+                        handles);
+                    break;
+                case OpCode::CreatePersistentCommandBuffer:
+                    success = CreatePersistentCommandBuffer(
+                        OpCast<CreatePersistentCommandBufferOp>(bytes, actual_bytes, handles,
+                                                                actual_handles),
+                        handles);
+                    break;
+                case OpCode::ReleasePersistentCommandBuffer:
+                    success = ReleasePersistentCommandBuffer(
+                        OpCast<ReleasePersistentCommandBufferOp>(bytes, actual_bytes, handles,
+                                                                 actual_handles));
+                    break;
+                case OpCode::ExecutePersistentCommandBuffer:
+                    success = ExecutePersistentCommandBuffer(
+                        OpCast<ExecutePersistentCommandBufferOp>(bytes, actual_bytes, handles,
+                                                                 actual_handles));
+                    break;
                 default:
                     break;
             }
@@ -254,13 +386,18 @@ private:
         return true;
     }
 
-    bool ReleaseBuffer(ReleaseBufferOp* op)
+    bool ReleaseBuffers(ReleaseBuffersOp* op)
     {
-        DLOG("Operation: ReleaseBuffer");
+        DLOG("Operation: ReleaseBuffers");
         if (!op)
             return DRETF(false, "malformed message");
-        if (!delegate_->ReleaseBuffer(op->buffer_id))
+        if (!delegate_->ReleaseBuffers(op->buffer_ids, op->count)) {
+            // Release what can be, so one bad id doesn't leak the rest of the batch.
+            for (uint32_t i = 0; i < op->count; i++) {
+                delegate_->ReleaseBuffer(op->buffer_ids[i]);
+            }
             SetError(MAGMA_STATUS_INVALID_ARGS);
+        }
         return true;
     }
 
@@ -290,7 +427,7 @@ private:
         DLOG("Operation: CreateContext");
         if (!op)
             return DRETF(false, "malformed message");
-        if (!delegate_->CreateContext(op->context_id))
+        if (!delegate_->CreateContext(op->context_id, op->priority))
             SetError(MAGMA_STATUS_INTERNAL_ERROR);
         return true;
     }
@@ -318,6 +455,41 @@ private:
         return true;
     }
 
+    bool CreatePersistentCommandBuffer(CreatePersistentCommandBufferOp* op, zx_handle_t* handle)
+    {
+        DLOG("Operation: CreatePersistentCommandBuffer");
+        if (!op)
+            return DRETF(false, "malformed message");
+        if (!delegate_->CreatePersistentCommandBuffer(*handle, op->command_buffer_id))
+            SetError(MAGMA_STATUS_INVALID_ARGS);
+        return true;
+    }
+
+    bool ReleasePersistentCommandBuffer(ReleasePersistentCommandBufferOp* op)
+    {
+        DLOG("Operation: ReleasePersistentCommandBuffer");
+        if (!op)
+            return DRETF(false, "malformed message");
+        if (!delegate_->ReleasePersistentCommandBuffer(op->command_buffer_id))
+            SetError(MAGMA_STATUS_INVALID_ARGS);
+        return true;
+    }
+
+    bool ExecutePersistentCommandBuffer(ExecutePersistentCommandBufferOp* op)
+    {
+        DLOG("Operation: ExecutePersistentCommandBuffer");
+        if (!op)
+            return DRETF(false, "malformed message");
+        magma::Status status = delegate_->ExecutePersistentCommandBuffer(
+            op->command_buffer_id, op->context_id, op->patched ? &op->patch : nullptr,
+            op->semaphore_ids);
+        if (status.get() == MAGMA_STATUS_CONTEXT_KILLED)
+            ShutdownEvent()->Signal();
+        if (!status)
+            SetError(status.get());
+        return true;
+    }
+
     bool WaitRendering(WaitRenderingOp* op)
     {
         DLOG("Operation: WaitRendering");
@@ -346,12 +518,23 @@ private:
 
         magma::Status status =
             delegate_->PageFlip(op->buffer_id, op->wait_semaphore_count, op->signal_semaphore_count,
-                                op->semaphore_ids, std::move(buffer_presented_semaphore));
+                                op->semaphore_ids, op->wait_point_count, op->signal_point_count,
+                                op->timeline_points(), std::move(buffer_presented_semaphore));
         if (!status)
             SetError(status);
         return true;
     }
 
+    bool ImportTimelineSemaphore(ImportTimelineSemaphoreOp* op, zx_handle_t* handles)
+    {
+        DLOG("Operation: ImportTimelineSemaphore");
+        if (!op)
+            return DRETF(false, "malformed message");
+        if (!delegate_->ImportTimelineSemaphore(handles[0], handles[1]))
+            SetError(MAGMA_STATUS_INVALID_ARGS);
+        return true;
+    }
+
     bool GetError(GetErrorOp* op)
     {
         DLOG("Operation: GetError");
@@ -393,6 +576,12 @@ public:
         if (!buffer)
             return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "attempting to import null buffer");
 
+        // A release of the same buffer must reach the driver first, or the import would be
+        // refused as a duplicate.
+        magma_status_t result = FlushReleases(buffer->id());
+        if (result != MAGMA_STATUS_OK)
+            return DRET_MSG(result, "failed to flush releases");
+
         uint32_t duplicate_handle;
         if (!buffer->duplicate_handle(&duplicate_handle))
             return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "failed to get duplicate_handle");
@@ -400,7 +589,7 @@ public:
         zx_handle_t duplicate_handle_zx = duplicate_handle;
 
         ImportBufferOp op;
-        magma_status_t result = channel_write(&op, sizeof(op), &duplicate_handle_zx, 1);
+        result = channel_write(&op, sizeof(op), &duplicate_handle_zx, 1);
         if (result != MAGMA_STATUS_OK) {
             zx_handle_close(duplicate_handle);
             return DRET_MSG(result, "failed to write to channel");
@@ -409,21 +598,28 @@ public:
         return MAGMA_STATUS_OK;
     }
 
-    // Destroys the buffer with |buffer_id| within this connection
-    // returns false if the buffer with |buffer_id| has not been imported
+    // Queues the release of |buffer_id|; a full queue is sent at once.
     magma_status_t ReleaseBuffer(uint64_t buffer_id) override
     {
-        ReleaseBufferOp op;
-        op.buffer_id = buffer_id;
-        magma_status_t result = channel_write(&op, sizeof(op), nullptr, 0);
-        if (result != MAGMA_STATUS_OK)
-            return DRET_MSG(result, "failed to write to channel");
+        std::unique_lock<std::mutex> lock(release_mutex_);
+        if (pending_releases_.empty())
+            oldest_release_time_ = std::chrono::steady_clock::now();
+        pending_releases_.push_back(buffer_id);
+        if (pending_releases_.size() < ReleaseBuffersOp::kMaxCount)
+            return MAGMA_STATUS_OK;
+        return FlushReleasesLocked();
+    }
 
-        return MAGMA_STATUS_OK;
+    magma_status_t FlushReleases() override
+    {
+        std::unique_lock<std::mutex> lock(release_mutex_);
+        return FlushReleasesLocked();
     }
 
     magma_status_t ImportObject(uint32_t handle, PlatformObject::Type object_type) override
     {
+        FlushStaleReleases();
+
         zx_handle_t duplicate_handle_zx = handle;
 
         ImportObjectOp op;
@@ -438,8 +634,29 @@ public:
         return MAGMA_STATUS_OK;
     }
 
+    magma_status_t ImportTimelineSemaphore(uint32_t memory_handle, uint32_t event_handle) override
+    {
+        FlushStaleReleases();
+
+        zx_handle_t handles[ImportTimelineSemaphoreOp::kNumHandles] = {memory_handle,
+                                                                       event_handle};
+
+        ImportTimelineSemaphoreOp op;
+        magma_status_t result =
+            channel_write(&op, sizeof(op), handles, ImportTimelineSemaphoreOp::kNumHandles);
+        if (result != MAGMA_STATUS_OK) {
+            zx_handle_close(memory_handle);
+            zx_handle_close(event_handle);
+            return DRET_MSG(result, "failed to write to channel");
+        }
+
+        return MAGMA_STATUS_OK;
+    }
+
     magma_status_t ReleaseObject(uint64_t object_id, PlatformObject::Type object_type) override
     {
+        FlushStaleReleases();
+
         ReleaseObjectOp op;
         op.object_id = object_id;
         op.object_type = object_type;
@@ -451,13 +668,16 @@ public:
     }
 
     // Creates a context and returns the context id
-    void CreateContext(uint32_t* context_id_out) override
+    void CreateContext(uint32_t priority, uint32_t* context_id_out) override
     {
+        FlushStaleReleases();
+
         auto context_id = next_context_id_++;
         *context_id_out = context_id;
 
         CreateContextOp op;
         op.context_id = context_id;
+        op.priority = priority;
         magma_status_t result = channel_write(&op, sizeof(op), nullptr, 0);
         if (result != MAGMA_STATUS_OK)
             SetError(result);
@@ -466,6 +686,8 @@ public:
     // Destroys a context for the given id
     void DestroyContext(uint32_t context_id) override
     {
+        FlushStaleReleases();
+
         DestroyContextOp op;
         op.context_id = context_id;
         magma_status_t result = channel_write(&op, sizeof(op), nullptr, 0);
@@ -475,9 +697,32 @@ public:
 
     void ExecuteCommandBuffer(uint32_t command_buffer_handle, uint32_t context_id) override
     {
+        magma_status_t result = FlushReleases();
+        if (result != MAGMA_STATUS_OK)
+            SetError(result);
+
         ExecuteCommandBufferOp op;
         op.context_id = context_id;
 
+        zx_handle_t duplicate_handle_zx = command_buffer_handle;
+        result = channel_write(&op, sizeof(op), &duplicate_handle_zx, 1);
+        if (result != MAGMA_STATUS_OK) {
+            zx_handle_close(command_buffer_handle);
+            SetError(result);
+        }
+    }
+
+    void CreatePersistentCommandBuffer(uint32_t command_buffer_handle,
+                                       uint32_t* command_buffer_id_out) override
+    {
+        FlushStaleReleases();
+
+        auto command_buffer_id = next_persistent_command_buffer_id_++;
+        *command_buffer_id_out = command_buffer_id;
+
+        CreatePersistentCommandBufferOp op;
+        op.command_buffer_id = command_buffer_id;
+
         zx_handle_t duplicate_handle_zx = command_buffer_handle;
         magma_status_t result = channel_write(&op, sizeof(op), &duplicate_handle_zx, 1);
         if (result != MAGMA_STATUS_OK) {
@@ -486,8 +731,54 @@ public:
         }
     }
 
+    void ReleasePersistentCommandBuffer(uint32_t command_buffer_id) override
+    {
+        FlushStaleReleases();
+
+        ReleasePersistentCommandBufferOp op;
+        op.command_buffer_id = command_buffer_id;
+        magma_status_t result = channel_write(&op, sizeof(op), nullptr, 0);
+        if (result != MAGMA_STATUS_OK)
+            SetError(result);
+    }
+
+    void ExecutePersistentCommandBuffer(uint32_t command_buffer_id, uint32_t context_id,
+                                        const magma_system_command_buffer_patch* patch,
+                                        const uint64_t* semaphore_ids) override
+    {
+        // A released buffer must release the command buffers referencing it before they run.
+        magma_status_t result = FlushReleases();
+        if (result != MAGMA_STATUS_OK)
+            SetError(result);
+
+        ExecutePersistentCommandBufferOp op;
+        op.command_buffer_id = command_buffer_id;
+        op.context_id = context_id;
+        op.patched = patch != nullptr;
+        op.patch = {};
+        uint64_t semaphore_count = 0;
+        if (patch) {
+            op.patch = *patch;
+            semaphore_count =
+                static_cast<uint64_t>(patch->wait_semaphore_count) + patch->signal_semaphore_count;
+            if (semaphore_count > ExecutePersistentCommandBufferOp::kMaxSemaphoreCount) {
+                SetError(DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
+                                  "too many semaphores in patch: %" PRIu64, semaphore_count));
+                return;
+            }
+            std::copy(semaphore_ids, semaphore_ids + semaphore_count, op.semaphore_ids);
+        }
+
+        result = channel_write(&op, ExecutePersistentCommandBufferOp::size(semaphore_count),
+                               nullptr, 0);
+        if (result != MAGMA_STATUS_OK)
+            SetError(result);
+    }
+
     void WaitRendering(uint64_t buffer_id) override
     {
+        FlushStaleReleases();
+
         WaitRenderingOp op;
         op.buffer_id = buffer_id;
         magma_status_t result = channel_write(&op, sizeof(op), nullptr, 0);
@@ -508,10 +799,15 @@ public:
 
     void PageFlip(uint64_t buffer_id, uint32_t wait_semaphore_count,
                   uint32_t signal_semaphore_count, const uint64_t* semaphore_ids,
+                  uint32_t wait_point_count, uint32_t signal_point_count,
+                  const magma_system_timeline_point* timeline_points,
                   uint32_t buffer_presented_handle) override
     {
+        FlushStaleReleases();
+
         const uint32_t payload_size =
-            PageFlipOp::size(wait_semaphore_count + signal_semaphore_count);
+            PageFlipOp::size(wait_semaphore_count + signal_semaphore_count,
+                             wait_point_count + signal_point_count);
         std::unique_ptr<uint8_t[]> payload(new uint8_t[payload_size]);
 
         // placement new on top of the allocation
@@ -519,9 +815,15 @@ public:
         op->buffer_id = buffer_id;
         op->signal_semaphore_count = signal_semaphore_count;
         op->wait_semaphore_count = wait_semaphore_count;
+        op->wait_point_count = wait_point_count;
+        op->signal_point_count = signal_point_count;
         for (uint32_t i = 0; i < wait_semaphore_count + signal_semaphore_count; i++) {
             op->semaphore_ids[i] = semaphore_ids[i];
         }
+        magma_system_timeline_point* points = op->timeline_points();
+        for (uint32_t i = 0; i < wait_point_count + signal_point_count; i++) {
+            points[i] = timeline_points[i];
+        }
 
         zx_handle_t zx_buffer_presented_handle = buffer_presented_handle;
         magma_status_t result =
@@ -532,7 +834,12 @@ public:
 
     magma_status_t GetError() override
     {
-        magma_status_t result = error_;
+        // Releases may fail, so they're sent before asking for errors.
+        magma_status_t result = FlushReleases();
+        if (result != MAGMA_STATUS_OK)
+            SetError(result);
+
+        result = error_;
         error_ = 0;
         if (result != MAGMA_STATUS_OK)
             return result;
@@ -593,6 +900,47 @@ public:
     }
 
 private:
+    // Flushes the queued releases if they include |buffer_id|.
+    magma_status_t FlushReleases(uint64_t buffer_id)
+    {
+        std::unique_lock<std::mutex> lock(release_mutex_);
+        if (std::find(pending_releases_.begin(), pending_releases_.end(), buffer_id) ==
+            pending_releases_.end())
+            return MAGMA_STATUS_OK;
+        return FlushReleasesLocked();
+    }
+
+    // Releases don't wait for the queue to fill for more than a frame or so, if the connection
+    // is being used at all.
+    void FlushStaleReleases()
+    {
+        std::unique_lock<std::mutex> lock(release_mutex_);
+        if (pending_releases_.empty() ||
+            std::chrono::steady_clock::now() - oldest_release_time_ < kMaxReleaseDelay)
+            return;
+        magma_status_t result = FlushReleasesLocked();
+        if (result != MAGMA_STATUS_OK)
+            SetError(result);
+    }
+
+    magma_status_t FlushReleasesLocked()
+    {
+        if (pending_releases_.empty())
+            return MAGMA_STATUS_OK;
+
+        DASSERT(pending_releases_.size() <= ReleaseBuffersOp::kMaxCount);
+        ReleaseBuffersOp op;
+        op.count = pending_releases_.size();
+        std::copy(pending_releases_.begin(), pending_releases_.end(), op.buffer_ids);
+        pending_releases_.clear();
+
+        magma_status_t result = channel_write(&op, ReleaseBuffersOp::size(op.count), nullptr, 0);
+        if (result != MAGMA_STATUS_OK)
+            return DRET_MSG(result, "failed to write to channel");
+
+        return MAGMA_STATUS_OK;
+    }
+
     magma_status_t channel_write(const void* bytes, uint32_t num_bytes, const zx_handle_t* handles,
                                  uint32_t num_handles)
     {
@@ -607,11 +955,22 @@ private:
         }
     }
 
+    static constexpr std::chrono::milliseconds kMaxReleaseDelay{16};
+
     zx::channel channel_;
     uint32_t next_context_id_{};
+    uint32_t next_persistent_command_buffer_id_{};
     magma_status_t error_{};
+
+    // Releases not yet sent; the connection is closed without sending them, as the driver
+    // releases everything a connection holds when it closes.
+    std::vector<uint64_t> pending_releases_;
+    std::chrono::steady_clock::time_point oldest_release_time_;
+    std::mutex release_mutex_;
 };
 
+constexpr std::chrono::milliseconds ZirconPlatformIpcConnection::kMaxReleaseDelay;
+
 std::unique_ptr<PlatformIpcConnection> PlatformIpcConnection::Create(uint32_t device_handle)
 {
     return std::unique_ptr<ZirconPlatformIpcConnection>(
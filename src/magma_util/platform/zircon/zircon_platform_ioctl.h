@@ -13,5 +13,6 @@
 #define IOCTL_MAGMA_DUMP_STATUS IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_GPU, 3)
 #define IOCTL_MAGMA_TEST_RESTART IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_GPU, 4)
 #define IOCTL_MAGMA_DISPLAY_GET_SIZE IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_GPU, 5)
+#define IOCTL_MAGMA_QUERY_BATCH IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_GPU, 6)
 
 #endif // _ZIRCON_PLATFORM_CONNECTION_H_
@@ -31,6 +31,30 @@ Status ZirconPlatformPort::Wait(uint64_t* key_out, uint64_t timeout_ms)
     return MAGMA_STATUS_OK;
 }
 
+Status ZirconPlatformPort::WaitMany(uint64_t* keys_out, uint32_t max_keys, uint32_t* count_out,
+                                    uint64_t timeout_ms)
+{
+    if (max_keys == 0)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "max_keys is zero");
+
+    Status status = Wait(&keys_out[0], timeout_ms);
+    if (!status)
+        return status;
+
+    uint32_t count = 1;
+    while (count < max_keys) {
+        // An expired deadline returns a queued packet if there is one, without blocking.
+        zx_port_packet_t packet;
+        if (port_.wait(0, &packet, 0) != ZX_OK)
+            break;
+        DLOG("port drained key 0x%" PRIx64, packet.key);
+        keys_out[count++] = packet.key;
+    }
+
+    *count_out = count;
+    return MAGMA_STATUS_OK;
+}
+
 std::unique_ptr<PlatformPort> PlatformPort::Create()
 {
     zx::port port;
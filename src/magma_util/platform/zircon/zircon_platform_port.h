@@ -18,6 +18,9 @@ public:
 
     Status Wait(uint64_t* key_out, uint64_t timeout_ms) override;
 
+    Status WaitMany(uint64_t* keys_out, uint32_t max_keys, uint32_t* count_out,
+                    uint64_t timeout_ms) override;
+
     zx::port& zx_port() { return port_; }
 
 private:
@@ -37,13 +37,13 @@ bool ZirconPlatformSemaphore::Wait(uint64_t timeout_ms)
     return true;
 }
 
-bool ZirconPlatformSemaphore::WaitAsync(PlatformPort* platform_port)
+bool ZirconPlatformSemaphore::WaitAsync(PlatformPort* platform_port, uint64_t key)
 {
     TRACE_DURATION("magma:sync", "semaphore wait async", "id", koid_);
     TRACE_FLOW_BEGIN("magma:sync", "semaphore wait async", koid_);
 
     auto port = static_cast<ZirconPlatformPort*>(platform_port);
-    zx_status_t status = event_.wait_async(port->zx_port(), id(), zx_signal(), ZX_WAIT_ASYNC_ONCE);
+    zx_status_t status = event_.wait_async(port->zx_port(), key, zx_signal(), ZX_WAIT_ASYNC_ONCE);
     if (status != ZX_OK)
         return DRETF(false, "wait_async failed: %d", status);
 
@@ -40,7 +40,8 @@ public:
 
     bool Wait(uint64_t timeout_ms) override;
 
-    bool WaitAsync(PlatformPort* platform_port) override;
+    using PlatformSemaphore::WaitAsync;
+    bool WaitAsync(PlatformPort* platform_port, uint64_t key) override;
 
     zx_handle_t zx_handle() { return event_.get(); }
 
@@ -0,0 +1,194 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_util/macros.h"
+#include "platform_object.h"
+#include "platform_timeline_semaphore.h"
+#include "platform_trace.h"
+#include "zircon_platform_port.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <zx/event.h>
+#include <zx/time.h>
+#include <zx/vmar.h>
+#include <zx/vmo.h>
+
+namespace magma {
+
+// Waiters can't reset a shared event without stealing wakeups from each other, so instead each
+// Signal moves a single asserted bit to the next of the eight user signals, and a waiter sleeps
+// until any bit other than the one it observed is asserted.  A waiter that sleeps across exactly
+// a multiple of eight signals would miss them, so sleeps are also bounded.
+class ZirconPlatformTimelineSemaphore : public PlatformTimelineSemaphore {
+public:
+    struct SharedState {
+        std::atomic_uint64_t value;
+        std::atomic_uint32_t sequence;
+    };
+
+    ZirconPlatformTimelineSemaphore(zx::vmo vmo, zx::event event, uint64_t koid,
+                                    SharedState* state)
+        : vmo_(std::move(vmo)), event_(std::move(event)), koid_(koid), state_(state)
+    {
+    }
+
+    ~ZirconPlatformTimelineSemaphore() override
+    {
+        zx::vmar::root_self().unmap(reinterpret_cast<uintptr_t>(state_), PAGE_SIZE);
+    }
+
+    uint64_t id() override { return koid_; }
+
+    bool duplicate_handles(uint32_t* memory_handle_out, uint32_t* event_handle_out) override
+    {
+        zx::vmo vmo;
+        zx_status_t status = vmo_.duplicate(ZX_RIGHT_SAME_RIGHTS, &vmo);
+        if (status != ZX_OK)
+            return DRETF(false, "vmo duplicate failed: %d", status);
+        zx::event event;
+        status = event_.duplicate(ZX_RIGHT_SAME_RIGHTS, &event);
+        if (status != ZX_OK)
+            return DRETF(false, "event duplicate failed: %d", status);
+        *memory_handle_out = vmo.release();
+        *event_handle_out = event.release();
+        return true;
+    }
+
+    uint64_t value() override { return state_->value.load(); }
+
+    void Signal(uint64_t value) override
+    {
+        TRACE_DURATION("magma:sync", "timeline semaphore signal", "id", koid_, "value", value);
+        uint64_t current = state_->value.load();
+        while (current < value && !state_->value.compare_exchange_weak(current, value))
+            ;
+        if (current >= value)
+            return;
+
+        // Concurrent signallers may update the event out of order, so repeat until the asserted
+        // bit matches the latest sequence.
+        uint32_t sequence = state_->sequence.fetch_add(1) + 1;
+        uint32_t signalled;
+        do {
+            zx_status_t status = event_.signal(kAllSignals, signal_for(sequence));
+            DASSERT(status == ZX_OK);
+            signalled = sequence;
+            sequence = state_->sequence.load();
+        } while (sequence != signalled);
+    }
+
+    bool Wait(uint64_t value, uint64_t timeout_ms) override
+    {
+        TRACE_DURATION("magma:sync", "timeline semaphore wait", "id", koid_, "value", value);
+        zx_time_t deadline =
+            timeout_ms == UINT64_MAX ? ZX_TIME_INFINITE : zx::deadline_after(ZX_MSEC(timeout_ms));
+
+        while (true) {
+            uint32_t sequence = state_->sequence.load();
+            if (state_->value.load() >= value)
+                return true;
+
+            zx_time_t slice_deadline = zx::deadline_after(ZX_MSEC(kMaxSleepMs));
+            zx_status_t status = event_.wait_one(kAllSignals & ~signal_for(sequence),
+                                                 std::min(deadline, slice_deadline), nullptr);
+            if (status == ZX_ERR_TIMED_OUT && zx_time_get(ZX_CLOCK_MONOTONIC) >= deadline)
+                return state_->value.load() >= value;
+            if (status != ZX_OK && status != ZX_ERR_TIMED_OUT)
+                return DRETF(false, "wait_one failed: %d", status);
+        }
+    }
+
+    bool WaitAsync(PlatformPort* platform_port, uint64_t key, uint64_t value,
+                   bool* reached_out) override
+    {
+        uint32_t sequence = state_->sequence.load();
+        if (state_->value.load() >= value) {
+            *reached_out = true;
+            return true;
+        }
+        *reached_out = false;
+
+        auto port = static_cast<ZirconPlatformPort*>(platform_port);
+        zx_status_t status = event_.wait_async(port->zx_port(), key,
+                                               kAllSignals & ~signal_for(sequence),
+                                               ZX_WAIT_ASYNC_ONCE);
+        if (status != ZX_OK)
+            return DRETF(false, "wait_async failed: %d", status);
+
+        return true;
+    }
+
+    static constexpr zx_signals_t kAllSignals = ZX_USER_SIGNAL_0 | ZX_USER_SIGNAL_1 |
+                                                ZX_USER_SIGNAL_2 | ZX_USER_SIGNAL_3 |
+                                                ZX_USER_SIGNAL_4 | ZX_USER_SIGNAL_5 |
+                                                ZX_USER_SIGNAL_6 | ZX_USER_SIGNAL_7;
+
+    static zx_signals_t signal_for(uint32_t sequence) { return ZX_USER_SIGNAL_0 << (sequence % 8); }
+
+private:
+    static constexpr uint64_t kMaxSleepMs = 100;
+
+    zx::vmo vmo_;
+    zx::event event_;
+    uint64_t koid_;
+    SharedState* state_;
+};
+
+static std::unique_ptr<PlatformTimelineSemaphore> CreateTimelineSemaphore(zx::vmo vmo,
+                                                                          zx::event event)
+{
+    uint64_t koid;
+    if (!PlatformObject::IdFromHandle(event.get(), &koid))
+        return DRETP(nullptr, "couldn't get koid from handle");
+
+    uintptr_t addr;
+    zx_status_t status = zx::vmar::root_self().map(
+        0, vmo, 0, PAGE_SIZE, ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr);
+    if (status != ZX_OK)
+        return DRETP(nullptr, "failed to map vmo: %d", status);
+
+    static_assert(sizeof(ZirconPlatformTimelineSemaphore::SharedState) <= PAGE_SIZE,
+                  "shared state too large");
+
+    return std::make_unique<ZirconPlatformTimelineSemaphore>(
+        std::move(vmo), std::move(event), koid,
+        reinterpret_cast<ZirconPlatformTimelineSemaphore::SharedState*>(addr));
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::unique_ptr<PlatformTimelineSemaphore> PlatformTimelineSemaphore::Create(uint64_t initial_value)
+{
+    zx::vmo vmo;
+    zx_status_t status = zx::vmo::create(PAGE_SIZE, 0, &vmo);
+    if (status != ZX_OK)
+        return DRETP(nullptr, "vmo::create failed: %d", status);
+
+    const char* name = "timeline-semaphore";
+    vmo.set_property(ZX_PROP_NAME, name, strlen(name));
+
+    zx::event event;
+    status = zx::event::create(0, &event);
+    if (status != ZX_OK)
+        return DRETP(nullptr, "event::create failed: %d", status);
+
+    status = event.signal(0, ZirconPlatformTimelineSemaphore::signal_for(0));
+    if (status != ZX_OK)
+        return DRETP(nullptr, "event signal failed: %d", status);
+
+    auto semaphore = CreateTimelineSemaphore(std::move(vmo), std::move(event));
+    if (semaphore)
+        semaphore->Signal(initial_value);
+    return semaphore;
+}
+
+std::unique_ptr<PlatformTimelineSemaphore> PlatformTimelineSemaphore::Import(uint32_t memory_handle,
+                                                                             uint32_t event_handle)
+{
+    return CreateTimelineSemaphore(zx::vmo(memory_handle), zx::event(event_handle));
+}
+
+} // namespace magma
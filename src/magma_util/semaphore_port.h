@@ -11,9 +11,11 @@
 #include "platform_port.h"
 #include "platform_semaphore.h"
 #include "platform_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include <unordered_map>
 #include <vector>
 
 namespace magma {
@@ -32,7 +34,7 @@ public:
         if (!quit_semaphore)
             return DRETP(nullptr, "failed to create quit semaphore");
 
-        if (!quit_semaphore->WaitAsync(port.get()))
+        if (!quit_semaphore->WaitAsync(port.get(), kQuitKey))
             return DRETP(nullptr, "WaitAsync failed on quit semaphore");
 
         return std::make_unique<SemaphorePort>(std::move(port), std::move(quit_semaphore));
@@ -42,6 +44,16 @@ public:
                   std::unique_ptr<magma::PlatformSemaphore> quit_semaphore)
         : port_(std::move(port)), quit_semaphore_(std::move(quit_semaphore))
     {
+        pending_.prev_ = pending_.next_ = &pending_;
+    }
+
+    ~SemaphorePort()
+    {
+        // Wait sets that never completed are still owned by the pending list.
+        while (pending_.next_ != &pending_) {
+            pending_.next_->ReleaseWaiters(pending_.next_->semaphore_count());
+            delete pending_.next_;
+        }
     }
 
     void Close()
@@ -50,6 +62,8 @@ public:
         quit_semaphore_->Signal();
     }
 
+    // A WaitSet is an intrusive node: while pending it is linked into the port's pending list and
+    // its address is the port key for each of its semaphores, so completions need no lookup.
     class WaitSet {
     public:
         WaitSet(std::function<void(WaitSet* batch)> callback, shared_semaphore_vector_t semaphores)
@@ -57,19 +71,27 @@ public:
         {
         }
 
-        void SemaphoreComplete()
+        ~WaitSet() { Unlink(); }
+
+        // Returns true when the last semaphore has completed; the caller then owns the wait set.
+        bool SemaphoreComplete(uint32_t count = 1)
         {
             TRACE_DURATION("magma:sync", "WaitSet::SemaphoreComplete");
 
-            DASSERT(completed_count_ < semaphore_count());
-            ++completed_count_;
-            DLOG("completed_count %u semaphore count %u", completed_count_, semaphore_count());
-            if (completed_count_ == semaphore_count()) {
-                for (auto semaphore : semaphores_) {
-                    semaphore->Reset();
-                }
-                callback_(this);
+            uint32_t completed_count = completed_count_.fetch_add(count) + count;
+            DASSERT(completed_count <= semaphore_count());
+            DLOG("completed_count %u semaphore count %u", completed_count, semaphore_count());
+            if (completed_count < semaphore_count())
+                return false;
+
+            for (auto semaphore : semaphores_) {
+                semaphore->Reset();
             }
+            // Release before the callback so it may wait on these semaphores again.
+            ReleaseWaiters(semaphore_count());
+            if (!aborted_)
+                callback_(this);
+            return true;
         }
 
         uint32_t semaphore_count() { return semaphores_.size(); }
@@ -81,34 +103,78 @@ public:
         }
 
     private:
+        WaitSet() {}
+
+        void ReleaseWaiters(uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; i++) {
+                semaphores_[i]->ReleaseWaiter();
+            }
+        }
+
+        void Unlink()
+        {
+            if (!prev_)
+                return;
+            prev_->next_ = next_;
+            next_->prev_ = prev_;
+            prev_ = next_ = nullptr;
+        }
+
         std::function<void(WaitSet* wait_set)> callback_;
         shared_semaphore_vector_t semaphores_;
-        uint32_t completed_count_ = 0;
+        std::atomic_uint32_t completed_count_{0};
+        bool aborted_ = false;
+        WaitSet* prev_ = nullptr;
+        WaitSet* next_ = nullptr;
+
+        friend class SemaphorePort;
     };
 
     // Note: fails if a given semaphore has already been waited (and not signalled),
     // because semaphores should not have multiple waiters.  See PlatformSemaphore.
     bool AddWaitSet(std::unique_ptr<WaitSet> wait_set)
     {
-        if (wait_set->semaphore_count() == 0)
+        // Once the last wait is registered the wait set may complete and be freed on the waiting
+        // thread, so don't read it after that.
+        uint32_t count = wait_set->semaphore_count();
+        if (count == 0)
             return DRETF(false, "waitset has no semaphores");
 
-        std::shared_ptr<WaitSet> shared_wait_set(std::move(wait_set));
-
-        std::unique_lock<std::mutex> lock(map_mutex_);
+        WaitSet* node = wait_set.get();
+        for (uint32_t i = 0; i < count; i++) {
+            if (!node->semaphore(i)->ClaimWaiter()) {
+                node->ReleaseWaiters(i);
+                return DRETF(false, "semaphore 0x%" PRIx64 " already pending",
+                             node->semaphore(i)->id());
+            }
+        }
+        armed_count_ += count;
 
-        for (uint32_t i = 0; i < shared_wait_set->semaphore_count(); i++) {
-            auto semaphore = shared_wait_set->semaphore(i);
+        {
+            std::unique_lock<std::mutex> lock(pending_mutex_);
+            wait_set.release();
+            node->prev_ = &pending_;
+            node->next_ = pending_.next_;
+            pending_.next_->prev_ = node;
+            pending_.next_ = node;
+        }
 
-            auto iter = map_.find(semaphore->id());
-            if (iter != map_.end())
-                return DRETF(false, "semaphore 0x%" PRIx64 " already in the map", semaphore->id());
+        uint64_t key = reinterpret_cast<uintptr_t>(node);
 
-            DLOG("adding semaphore 0x%" PRIx64 " to the map", semaphore->id());
-            map_[semaphore->id()] = shared_wait_set;
+        for (uint32_t i = 0; i < count; i++) {
+            auto semaphore = node->semaphore(i);
+            DLOG("adding semaphore 0x%" PRIx64 " to the port", semaphore->id());
 
-            if (!semaphore->WaitAsync(port_.get()))
+            if (!semaphore->WaitAsync(port_.get(), key)) {
+                // Waits already registered will still be delivered, but can't complete the wait
+                // set until the rest are accounted for, so |node| is still alive here.  Account
+                // for them so the wait set is freed, without a callback, once those arrive.
+                node->aborted_ = true;
+                if (node->SemaphoreComplete(count - i))
+                    Retire(&node, 1);
                 return DRETF(false, "WaitAsync failed");
+            }
         }
 
         return true;
@@ -117,36 +183,90 @@ public:
     Status WaitOne()
     {
         TRACE_DURATION("magma:sync", "SemaphorePort::WaitOne");
-        uint64_t id;
-        Status status = port_->Wait(&id);
+        uint64_t key;
+        Status status = port_->Wait(&key);
         if (!status)
             return DRET_MSG(status.get(), "port wait failed: %d", status.get());
 
-        DLOG("Wait returned id 0x%" PRIx64, id);
+        DLOG("Wait returned key 0x%" PRIx64, key);
 
-        if (id == quit_semaphore_->id())
+        if (key == kQuitKey)
             return MAGMA_STATUS_INTERNAL_ERROR; // matches the case where port_ is closed
 
-        std::unique_lock<std::mutex> lock(map_mutex_);
+        auto wait_set = reinterpret_cast<WaitSet*>(static_cast<uintptr_t>(key));
+        if (wait_set->SemaphoreComplete())
+            Retire(&wait_set, 1);
 
-        auto iter = map_.find(id);
-        DASSERT(iter != map_.end());
+        return MAGMA_STATUS_OK;
+    }
 
-        std::shared_ptr<WaitSet> wait_set = std::move(iter->second);
-        map_.erase(iter);
+    // Like WaitOne, but handles the completions already queued on the port, so a burst of
+    // signals (e.g. at frame end) is processed with one wakeup.  Each queued packet still costs a
+    // non-blocking port wait, so kernel calls are unchanged.
+    Status WaitBatch()
+    {
+        TRACE_DURATION("magma:sync", "SemaphorePort::WaitBatch");
+        // At most one packet per armed semaphore, plus the quit packet, can be queued.
+        // Asking for no more lets WaitMany stop without a wait that would find the port empty.
+        uint32_t max_keys = std::min<uint32_t>(kMaxBatchSize, armed_count_ + 1);
+        uint64_t keys[kMaxBatchSize];
+        uint32_t count;
+        Status status = port_->WaitMany(keys, max_keys, &count);
+        if (!status)
+            return DRET_MSG(status.get(), "port wait failed: %d", status.get());
+
+        DLOG("WaitMany returned %u keys", count);
+
+        WaitSet* completed[kMaxBatchSize];
+        uint32_t completed_count = 0;
+        bool quit = false;
 
-        lock.unlock();
+        for (uint32_t i = 0; i < count; i++) {
+            if (keys[i] == kQuitKey) {
+                quit = true;
+                continue;
+            }
+            auto wait_set = reinterpret_cast<WaitSet*>(static_cast<uintptr_t>(keys[i]));
+            if (wait_set->SemaphoreComplete())
+                completed[completed_count++] = wait_set;
+        }
 
-        wait_set->SemaphoreComplete();
+        Retire(completed, completed_count);
+
+        if (quit)
+            return MAGMA_STATUS_INTERNAL_ERROR; // matches the case where port_ is closed
 
         return MAGMA_STATUS_OK;
     }
 
 private:
+    static constexpr uint64_t kQuitKey = 0;
+    static constexpr uint32_t kMaxBatchSize = 64;
+
+    // Takes the lock once per call, rather than once per semaphore.
+    void Retire(WaitSet** wait_sets, uint32_t count)
+    {
+        if (count == 0)
+            return;
+        {
+            std::unique_lock<std::mutex> lock(pending_mutex_);
+            for (uint32_t i = 0; i < count; i++) {
+                wait_sets[i]->Unlink();
+            }
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            armed_count_ -= wait_sets[i]->semaphore_count();
+            delete wait_sets[i];
+        }
+    }
+
     std::unique_ptr<magma::PlatformPort> port_;
     std::unique_ptr<magma::PlatformSemaphore> quit_semaphore_;
-    std::mutex map_mutex_;
-    std::unordered_map<uint64_t, std::shared_ptr<WaitSet>> map_;
+    std::mutex pending_mutex_;
+    // Sentinel of the circular list of wait sets that have not yet completed.
+    WaitSet pending_;
+    // Number of semaphores in |pending_|.
+    std::atomic_uint32_t armed_count_{0};
 };
 
 } // namespace
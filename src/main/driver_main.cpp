@@ -219,6 +219,22 @@ static zx_status_t intel_i915_ioctl(void* ctx, uint32_t op, const void* in_buf,
             result = ZX_OK;
             break;
         }
+        case IOCTL_MAGMA_QUERY_BATCH: {
+            DLOG("IOCTL_MAGMA_QUERY_BATCH");
+            const uint64_t* ids = reinterpret_cast<const uint64_t*>(in_buf);
+            uint32_t count = in_len / sizeof(*ids);
+            if (!in_buf || count == 0 || count > MAGMA_QUERY_BATCH_MAX_COUNT ||
+                in_len % sizeof(*ids))
+                return DRET_MSG(ZX_ERR_INVALID_ARGS, "bad in_buf");
+            uint64_t* values_out = reinterpret_cast<uint64_t*>(out_buf);
+            if (!out_buf || out_len < count * sizeof(*values_out))
+                return DRET_MSG(ZX_ERR_INVALID_ARGS, "bad out_buf");
+            if (!device->magma_system_device->Query(ids, count, values_out))
+                return DRET_MSG(ZX_ERR_INVALID_ARGS, "batch query failed");
+            *out_actual = count * sizeof(*values_out);
+            result = ZX_OK;
+            break;
+        }
         case IOCTL_MAGMA_CONNECT: {
             DLOG("IOCTL_MAGMA_CONNECT");
             auto request = reinterpret_cast<const magma_system_connection_request*>(in_buf);
@@ -323,7 +339,12 @@ static void intel_i915_release(void* ctx)
 
     intel_i915_enable_backlight(device, false);
 
-    magma_stop(device);
+    // The device can't be freed while overdue connection threads may still run driver code.
+    if (magma_stop(device) != ZX_OK) {
+        magma::log(magma::LOG_WARNING, "waiting for overdue connections before release");
+        device->magma_system_device->JoinOverdueConnections();
+        device->magma_system_device.reset();
+    }
 
     delete (device);
 }
@@ -487,6 +508,8 @@ ZIRCON_DRIVER_END(intel_gen_gpu)
     return ZX_OK;
 }
 
+// Fails, keeping the device, if connection threads are still running at the shutdown deadline;
+// they may still be using the msd device, so the hardware can't be handed to another one yet.
 static int magma_stop(intel_i915_device_t* device)
 {
     DLOG("magma_stop");
@@ -494,7 +517,12 @@ static int magma_stop(intel_i915_device_t* device)
     device->console_framebuffer.reset();
     device->placeholder_framebuffer.reset();
 
-    device->magma_system_device->Shutdown();
+    auto stats = MagmaSystemDevice::Shutdown(device->magma_system_device);
+    magma::log(magma::LOG_INFO, "magma shutdown of %u connections took %u ms (%u overdue)",
+               stats.connection_count, stats.elapsed_ms, stats.overdue_count);
+    if (stats.overdue_count)
+        return DRET_MSG(ZX_ERR_SHOULD_WAIT, "%u connections overdue", stats.overdue_count);
+
     device->magma_system_device.reset();
 
     return ZX_OK;
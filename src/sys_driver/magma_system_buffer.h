@@ -5,6 +5,7 @@
 #ifndef _MAGMA_SYSTEM_BUFFER_H_
 #define _MAGMA_SYSTEM_BUFFER_H_
 
+#include "magma_system_commit_service.h"
 #include "msd.h"
 #include "platform_buffer.h"
 
@@ -22,7 +23,11 @@ class MagmaSystemBuffer {
 public:
     static std::unique_ptr<MagmaSystemBuffer>
     Create(std::unique_ptr<magma::PlatformBuffer> platform_buffer);
-    ~MagmaSystemBuffer() {}
+    ~MagmaSystemBuffer()
+    {
+        if (commit_job_)
+            commit_job_->Cancel();
+    }
 
     uint64_t size() { return platform_buf_->size(); }
     uint64_t id() { return platform_buf_->id(); }
@@ -32,11 +37,24 @@ public:
 
     msd_buffer_t* msd_buf() { return msd_buf_.get(); }
 
+    void set_commit_job(std::shared_ptr<MagmaSystemCommitService::Job> job)
+    {
+        commit_job_ = std::move(job);
+    }
+
+    // Blocks until the pages backing [offset, offset + length) are committed, if the buffer was
+    // queued for background commit.
+    bool WaitForCommit(uint64_t offset, uint64_t length)
+    {
+        return commit_job_ ? commit_job_->WaitRange(offset, length) : true;
+    }
+
 private:
     MagmaSystemBuffer(std::unique_ptr<magma::PlatformBuffer> platform_buf,
                       msd_buffer_unique_ptr_t msd_buf);
     std::unique_ptr<magma::PlatformBuffer> platform_buf_;
     msd_buffer_unique_ptr_t msd_buf_;
+    std::shared_ptr<MagmaSystemCommitService::Job> commit_job_;
 };
 
 #endif //_MAGMA_SYSTEM_BUFFER_H_
\ No newline at end of file
@@ -0,0 +1,207 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_system_commit_service.h"
+#include "magma_util/dlog.h"
+#include "platform_thread.h"
+#include "platform_trace.h"
+#include <algorithm>
+
+static constexpr uint32_t kChunkPageCount = MagmaSystemCommitService::kChunkSize / PAGE_SIZE;
+
+MagmaSystemCommitService::MagmaSystemCommitService(uint32_t thread_count)
+{
+    for (uint32_t i = 0; i < thread_count; i++) {
+        threads_.emplace_back([this] { Loop(); });
+    }
+}
+
+MagmaSystemCommitService::~MagmaSystemCommitService()
+{
+    {
+        std::unique_lock<std::mutex> lock(queue_->mutex);
+        queue_->quit = true;
+    }
+    queue_->work_available.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+std::shared_ptr<MagmaSystemCommitService::Job>
+MagmaSystemCommitService::Enqueue(magma::PlatformBuffer* buffer)
+{
+    if (buffer->size() < kMinBufferSize)
+        return nullptr;
+
+    uint32_t duplicate_handle;
+    if (!buffer->duplicate_handle(&duplicate_handle))
+        return DRETP(nullptr, "failed to duplicate buffer handle");
+
+    auto duplicate = magma::PlatformBuffer::Import(duplicate_handle);
+    if (!duplicate)
+        return DRETP(nullptr, "failed to import buffer duplicate");
+
+    uint32_t chunk_count = magma::round_up(buffer->size(), kChunkSize) / kChunkSize;
+    auto job = std::make_shared<Job>(std::move(duplicate), chunk_count, queue_);
+
+    {
+        std::unique_lock<std::mutex> lock(queue_->mutex);
+        queue_->jobs.push_back(job);
+    }
+    queue_->work_available.notify_one();
+
+    return job;
+}
+
+void MagmaSystemCommitService::Loop()
+{
+    magma::PlatformThreadHelper::SetCurrentThreadName("CommitService");
+
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_->mutex);
+            queue_->work_available.wait(lock,
+                                        [this] { return queue_->quit || !queue_->jobs.empty(); });
+            if (queue_->quit)
+                return;
+            job = std::move(queue_->jobs.front());
+            queue_->jobs.pop_front();
+        }
+
+        uint32_t chunk;
+        bool more;
+        if (!job->ClaimNext(&chunk, &more))
+            continue;
+
+        // Requeue before committing so another thread can start on the next chunk.  Checking
+        // under the queue lock means a job cancelled meanwhile is either not requeued or is
+        // found and removed by Cancel.
+        if (more) {
+            {
+                std::unique_lock<std::mutex> lock(queue_->mutex);
+                more = !job->cancelled();
+                if (more)
+                    queue_->jobs.push_back(job);
+            }
+            if (more)
+                queue_->work_available.notify_one();
+        }
+
+        if (job->CommitChunk(chunk))
+            background_chunk_count_++;
+    }
+}
+
+bool MagmaSystemCommitService::Job::ClaimNext(uint32_t* chunk_out, bool* more_out)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Submits may have committed chunks out of order.
+    while (next_chunk_ < chunks_.size() && chunks_[next_chunk_] != kPending)
+        next_chunk_++;
+
+    if (cancelled_ || next_chunk_ == chunks_.size())
+        return false;
+
+    *chunk_out = next_chunk_;
+    chunks_[next_chunk_++] = kCommitting;
+    *more_out = next_chunk_ < chunks_.size();
+    return true;
+}
+
+// Called with the chunk marked kCommitting and the lock not held.
+bool MagmaSystemCommitService::Job::CommitChunk(uint32_t chunk)
+{
+    TRACE_DURATION("magma", "CommitChunk", "chunk", chunk);
+
+    uint32_t page_count = magma::round_up(buffer_->size(), PAGE_SIZE) / PAGE_SIZE;
+    uint32_t start_page = chunk * kChunkPageCount;
+    bool success =
+        buffer_->CommitPages(start_page, std::min(kChunkPageCount, page_count - start_page));
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        chunks_[chunk] = success ? kCommitted : kFailed;
+    }
+    chunk_done_.notify_all();
+
+    return success ? true : DRETF(false, "failed to commit chunk %u", chunk);
+}
+
+void MagmaSystemCommitService::Job::ChunkRange(uint64_t offset, uint64_t length,
+                                               uint32_t* start_out, uint32_t* end_out)
+{
+    uint64_t size = buffer_->size();
+    uint64_t end = (length > size || offset > size - length) ? size : offset + length;
+    if (offset >= end) {
+        *start_out = *end_out = 0;
+        return;
+    }
+    *start_out = offset / kChunkSize;
+    *end_out = magma::round_up(end, kChunkSize) / kChunkSize;
+}
+
+bool MagmaSystemCommitService::Job::WaitRange(uint64_t offset, uint64_t length)
+{
+    TRACE_DURATION("magma", "WaitRange");
+
+    uint32_t start, end;
+    ChunkRange(offset, length, &start, &end);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (uint32_t chunk = start; chunk < end; chunk++) {
+        chunk_done_.wait(lock, [this, chunk] { return chunks_[chunk] != kCommitting; });
+        if (chunks_[chunk] == kCommitted)
+            continue;
+
+        // Pending, or a background commit failed; either way it's needed now.
+        chunks_[chunk] = kCommitting;
+        lock.unlock();
+        bool success = CommitChunk(chunk);
+        lock.lock();
+        if (!success)
+            return DRETF(false, "failed to commit chunk %u for submit", chunk);
+    }
+    return true;
+}
+
+bool MagmaSystemCommitService::Job::IsCommitted(uint64_t offset, uint64_t length)
+{
+    uint32_t start, end;
+    ChunkRange(offset, length, &start, &end);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (uint32_t chunk = start; chunk < end; chunk++) {
+        if (chunks_[chunk] != kCommitted)
+            return false;
+    }
+    return true;
+}
+
+bool MagmaSystemCommitService::Job::cancelled()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cancelled_;
+}
+
+void MagmaSystemCommitService::Job::Cancel()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cancelled_ = true;
+    }
+
+    auto queue = queue_.lock();
+    if (!queue)
+        return;
+
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    auto iter = std::find_if(queue->jobs.begin(), queue->jobs.end(),
+                             [this](const std::shared_ptr<Job>& job) { return job.get() == this; });
+    if (iter != queue->jobs.end())
+        queue->jobs.erase(iter);
+}
@@ -0,0 +1,102 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_SYSTEM_COMMIT_SERVICE_H_
+#define MAGMA_SYSTEM_COMMIT_SERVICE_H_
+
+#include "magma_util/macros.h"
+#include "platform_buffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Commits the pages of large buffers in chunks on background threads, so the first submit that
+// references a buffer doesn't stall while the kernel zeroes all of it.  A submit waits only for
+// the chunks its resources reference, and commits any of those nobody has started yet on its own
+// thread rather than waiting for them to come up in the queue.
+class MagmaSystemCommitService {
+private:
+    struct Queue;
+
+public:
+    // Smaller buffers are left to be committed when they're first pinned.
+    static constexpr uint64_t kMinBufferSize = 1024 * 1024;
+    static constexpr uint64_t kChunkSize = 256 * 1024;
+    static constexpr uint32_t kDefaultThreadCount = 2;
+
+    class Job {
+    public:
+        Job(std::unique_ptr<magma::PlatformBuffer> buffer, uint32_t chunk_count,
+            std::weak_ptr<Queue> queue)
+            : buffer_(std::move(buffer)), chunks_(chunk_count, kPending), queue_(std::move(queue))
+        {
+        }
+
+        // Blocks until every page in [offset, offset + length) is committed.  Ranges extending
+        // past the end of the buffer are clamped.
+        bool WaitRange(uint64_t offset, uint64_t length);
+
+        bool IsCommitted(uint64_t offset, uint64_t length);
+
+        // Stops background commits of chunks that haven't been started, and takes the job off
+        // the queue so it doesn't hold its buffer until a thread gets to it.
+        void Cancel();
+
+        uint32_t chunk_count() { return chunks_.size(); }
+
+    private:
+        enum ChunkState : uint8_t { kPending, kCommitting, kCommitted, kFailed };
+
+        // Returns false if there's nothing left for the background threads to commit.
+        bool ClaimNext(uint32_t* chunk_out, bool* more_out);
+        bool cancelled();
+        bool CommitChunk(uint32_t chunk);
+        void ChunkRange(uint64_t offset, uint64_t length, uint32_t* start_out, uint32_t* end_out);
+
+        // A duplicate of the client's buffer, so the job doesn't depend on its lifetime.
+        std::unique_ptr<magma::PlatformBuffer> buffer_;
+        std::mutex mutex_;
+        std::condition_variable chunk_done_;
+        std::vector<ChunkState> chunks_;
+        uint32_t next_chunk_ = 0;
+        bool cancelled_ = false;
+        // The service's queue, which the job may outlive.
+        std::weak_ptr<Queue> queue_;
+
+        friend class MagmaSystemCommitService;
+    };
+
+    explicit MagmaSystemCommitService(uint32_t thread_count);
+
+    ~MagmaSystemCommitService();
+
+    // Queues |buffer| for background commit.  Returns null if the buffer is too small to bother.
+    std::shared_ptr<Job> Enqueue(magma::PlatformBuffer* buffer);
+
+    uint64_t background_chunk_count() { return background_chunk_count_; }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable work_available;
+        // Jobs take turns a chunk at a time, so one huge buffer doesn't hold up all the others.
+        std::deque<std::shared_ptr<Job>> jobs;
+        bool quit = false;
+    };
+
+    void Loop();
+
+    std::vector<std::thread> threads_;
+    std::shared_ptr<Queue> queue_ = std::make_shared<Queue>();
+
+    std::atomic<uint64_t> background_chunk_count_{0};
+
+    DISALLOW_COPY_AND_ASSIGN(MagmaSystemCommitService);
+};
+
+#endif // MAGMA_SYSTEM_COMMIT_SERVICE_H_
@@ -5,8 +5,23 @@
 #include "magma_system_connection.h"
 #include "magma_system_device.h"
 #include "magma_util/macros.h"
+#include <unordered_set>
 #include <vector>
 
+const MagmaSystemConnection::Quota MagmaSystemConnection::kDefaultRenderQuota = {
+    1u << 18,      // max_buffer_count
+    16ull << 30,   // max_buffer_bytes
+    1u << 16,      // max_semaphore_count
+    256,           // max_context_count
+};
+
+const MagmaSystemConnection::Quota MagmaSystemConnection::kDefaultDisplayQuota = {
+    4096,          // max_buffer_count
+    4ull << 30,    // max_buffer_bytes
+    4096,          // max_semaphore_count
+    0,             // max_context_count
+};
+
 MagmaSystemConnection::MagmaSystemConnection(std::weak_ptr<MagmaSystemDevice> weak_device,
                                              msd_connection_unique_ptr_t msd_connection_t,
                                              uint32_t capabilities)
@@ -20,18 +35,28 @@ MagmaSystemConnection::MagmaSystemConnection(std::weak_ptr<MagmaSystemDevice> we
     // should already be enforced in MagmaSystemDevice
     DASSERT(has_render_capability_ || has_display_capability_);
     DASSERT((capabilities & ~(MAGMA_CAPABILITY_DISPLAY | MAGMA_CAPABILITY_RENDERING)) == 0);
+
+    auto device = device_.lock();
+    quota_ = device ? device->ConnectionQuota(capabilities)
+                    : (has_render_capability_ ? kDefaultRenderQuota : kDefaultDisplayQuota);
+    if (device)
+        device->ConnectionOpened(this);
 }
 
 MagmaSystemConnection::~MagmaSystemConnection()
 {
     auto device = device_.lock();
     if (device) {
-        for (auto iter = buffer_map_.begin(); iter != buffer_map_.end();) {
-            auto id = iter->first;
-            iter = buffer_map_.erase(iter);
-            device->ReleaseBuffer(id);
+        // The contexts are about to be destroyed, so only the device needs telling.
+        std::vector<uint64_t> ids;
+        ids.reserve(buffer_map_.size());
+        for (auto& pair : buffer_map_) {
+            ids.push_back(pair.first);
         }
-        device->ConnectionClosed(std::this_thread::get_id());
+        persistent_command_buffer_map_.clear();
+        buffer_map_.clear();
+        device->ReleaseBuffers(ids.data(), ids.size());
+        device->ConnectionClosed(this, std::this_thread::get_id());
     }
 }
 
@@ -41,23 +66,74 @@ uint32_t MagmaSystemConnection::GetDeviceId()
     return device ? device->GetDeviceId() : 0;
 }
 
-bool MagmaSystemConnection::CreateContext(uint32_t context_id)
+bool MagmaSystemConnection::CheckQuota(uint32_t buffer_count, uint64_t buffer_bytes,
+                                       uint32_t semaphore_count, uint32_t context_count)
+{
+    uint64_t semaphores = semaphore_map_.size() + timeline_semaphore_map_.size();
+    // buffer_bytes_ never exceeds the quota, so the subtraction can't wrap.
+    uint64_t buffers = buffer_map_.size() + persistent_command_buffer_map_.size();
+    if (buffers + buffer_count <= quota_.max_buffer_count &&
+        buffer_bytes <= quota_.max_buffer_bytes - buffer_bytes_ &&
+        semaphores + semaphore_count <= quota_.max_semaphore_count &&
+        context_map_.size() + context_count <= quota_.max_context_count)
+        return true;
+
+    std::unique_lock<std::mutex> lock(usage_mutex_);
+    usage_.rejected_count++;
+    return false;
+}
+
+void MagmaSystemConnection::UpdateUsage()
+{
+    std::unique_lock<std::mutex> lock(usage_mutex_);
+    usage_.buffer_count = buffer_map_.size() + persistent_command_buffer_map_.size();
+    usage_.buffer_bytes = buffer_bytes_;
+    usage_.semaphore_count = semaphore_map_.size() + timeline_semaphore_map_.size();
+    usage_.context_count = context_map_.size();
+}
+
+static_assert(MagmaSystemScheduler::kPriorityLow == MAGMA_CONTEXT_PRIORITY_LOW,
+              "scheduler priorities must match the abi");
+static_assert(MagmaSystemScheduler::kPriorityNormal == MAGMA_CONTEXT_PRIORITY_NORMAL,
+              "scheduler priorities must match the abi");
+static_assert(MagmaSystemScheduler::kPriorityHigh == MAGMA_CONTEXT_PRIORITY_HIGH,
+              "scheduler priorities must match the abi");
+
+bool MagmaSystemConnection::CreateContext(uint32_t context_id, uint32_t priority)
 {
     if (!has_render_capability_)
         return DRETF(false, "Attempting to create a context without render capability");
 
+    if (priority > MAGMA_CONTEXT_PRIORITY_HIGH)
+        return DRETF(false, "invalid context priority %u", priority);
+
+    // Left to any client, high priority would starve everyone else's rendering.
+    if (priority == MAGMA_CONTEXT_PRIORITY_HIGH && !has_display_capability_)
+        return DRETF(false, "high priority contexts need the display capability");
+
     auto iter = context_map_.find(context_id);
     if (iter != context_map_.end())
         return DRETF(false, "Attempting to add context with duplicate id");
 
-    auto msd_ctx = msd_connection_create_context(msd_connection());
+    if (!CheckQuota(0, 0, 0, 1))
+        return DRETF(false, "context quota of %u exceeded", quota_.max_context_count);
+
+    auto msd_ctx = msd_connection_create_context(msd_connection(), priority);
     if (!msd_ctx)
         return DRETF(false, "Failed to create msd context");
 
-    auto ctx = std::unique_ptr<MagmaSystemContext>(
-        new MagmaSystemContext(this, msd_context_unique_ptr_t(msd_ctx, &msd_context_destroy)));
+    std::unique_ptr<MagmaSystemScheduler::Queue> queue;
+    auto device = device_.lock();
+    if (device)
+        queue = device->scheduler()->CreateQueue(
+            reinterpret_cast<uintptr_t>(this),
+            static_cast<MagmaSystemScheduler::Priority>(priority));
+
+    auto ctx = std::unique_ptr<MagmaSystemContext>(new MagmaSystemContext(
+        this, msd_context_unique_ptr_t(msd_ctx, &msd_context_destroy), std::move(queue)));
 
     context_map_.insert(std::make_pair(context_id, std::move(ctx)));
+    UpdateUsage();
     return true;
 }
 
@@ -70,6 +146,7 @@ bool MagmaSystemConnection::DestroyContext(uint32_t context_id)
     if (iter == context_map_.end())
         return DRETF(false, "MagmaSystemConnection:Attempting to destroy invalid context id");
     context_map_.erase(iter);
+    UpdateUsage();
     return true;
 }
 
@@ -96,6 +173,11 @@ magma::Status MagmaSystemConnection::ExecuteCommandBuffer(uint32_t command_buffe
     if (!command_buffer)
         return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "Failed to import command buffer");
 
+    // Keeps the device's scheduler alive for the submit.
+    auto device = device_.lock();
+    if (!device)
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to lock device");
+
     auto context = LookupContext(context_id);
     if (!context)
         return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
@@ -104,6 +186,87 @@ magma::Status MagmaSystemConnection::ExecuteCommandBuffer(uint32_t command_buffe
     return context->ExecuteCommandBuffer(std::move(command_buffer));
 }
 
+bool MagmaSystemConnection::CreatePersistentCommandBuffer(uint32_t command_buffer_handle,
+                                                          uint32_t command_buffer_id)
+{
+    auto command_buffer = magma::PlatformBuffer::Import(command_buffer_handle);
+    if (!command_buffer)
+        return DRETF(false, "Failed to import command buffer");
+
+    if (!has_render_capability_)
+        return DRETF(false, "Attempting to create a command buffer without render capability");
+
+    if (persistent_command_buffer_map_.count(command_buffer_id))
+        return DRETF(false, "Attempting to add command buffer with duplicate id %u",
+                     command_buffer_id);
+
+    std::unique_ptr<MagmaSystemContext::ValidatedCommandBuffer> validated;
+    magma::Status status =
+        MagmaSystemContext::ValidateCommandBuffer(this, std::move(command_buffer), &validated);
+    if (!status)
+        return DRETF(false, "invalid command buffer: %d", status.get());
+
+    // Timeline points are bridged afresh for each submit, which would undo the savings.
+    if (validated->has_timeline_points())
+        return DRETF(false, "persistent command buffers can't have timeline points");
+
+    // The driver keeps the copy for as long as the client likes, so it counts as a buffer.
+    uint64_t size = validated->size();
+    if (!CheckQuota(1, size, 0, 0))
+        return DRETF(false, "buffer quota of %u buffers or %" PRIu64 " bytes exceeded",
+                     quota_.max_buffer_count, quota_.max_buffer_bytes);
+
+    persistent_command_buffer_map_[command_buffer_id] = std::move(validated);
+    buffer_bytes_ += size;
+    UpdateUsage();
+    return true;
+}
+
+bool MagmaSystemConnection::ReleasePersistentCommandBuffer(uint32_t command_buffer_id)
+{
+    auto iter = persistent_command_buffer_map_.find(command_buffer_id);
+    if (iter == persistent_command_buffer_map_.end())
+        return DRETF(false, "Attempting to release invalid command buffer id %u",
+                     command_buffer_id);
+    ErasePersistentCommandBuffer(iter);
+    UpdateUsage();
+    return true;
+}
+
+MagmaSystemConnection::persistent_command_buffer_map_t::iterator
+MagmaSystemConnection::ErasePersistentCommandBuffer(persistent_command_buffer_map_t::iterator iter)
+{
+    buffer_bytes_ -= iter->second->size();
+    return persistent_command_buffer_map_.erase(iter);
+}
+
+magma::Status MagmaSystemConnection::ExecutePersistentCommandBuffer(
+    uint32_t command_buffer_id, uint32_t context_id, const magma_system_command_buffer_patch* patch,
+    const uint64_t* semaphore_ids)
+{
+    if (!has_render_capability_)
+        return DRET_MSG(MAGMA_STATUS_ACCESS_DENIED,
+                        "Attempting to execute a command buffer without render capability");
+
+    // Released along with any of its buffers, so an unknown id isn't necessarily a client bug.
+    auto iter = persistent_command_buffer_map_.find(command_buffer_id);
+    if (iter == persistent_command_buffer_map_.end())
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "invalid command buffer id %u",
+                        command_buffer_id);
+
+    // Keeps the device's scheduler alive for the submit.
+    auto device = device_.lock();
+    if (!device)
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to lock device");
+
+    auto context = LookupContext(context_id);
+    if (!context)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
+                        "Attempting to execute command buffer on invalid context");
+
+    return context->ExecuteCommandBuffer(iter->second.get(), patch, semaphore_ids);
+}
+
 magma::Status MagmaSystemConnection::WaitRendering(uint64_t buffer_id)
 {
     if (!has_render_capability_)
@@ -115,12 +278,22 @@ magma::Status MagmaSystemConnection::WaitRendering(uint64_t buffer_id)
         return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "Couldn't find system buffer for id 0x%lx",
                         buffer_id);
 
+    // A cancel after this check still releases the wait below.
+    if (waits_cancelled_)
+        return DRET_MSG(MAGMA_STATUS_CONNECTION_LOST, "connection is shutting down");
+
     magma_status_t result =
         msd_connection_wait_rendering(msd_connection(), system_buffer->msd_buf());
 
     return DRET_MSG(result, "msd_connection_wait_rendering failed: %d", result);
 }
 
+void MagmaSystemConnection::CancelWaits()
+{
+    waits_cancelled_ = true;
+    msd_connection_cancel_waits(msd_connection());
+}
+
 bool MagmaSystemConnection::ImportBuffer(uint32_t handle, uint64_t* id_out)
 {
     auto device = device_.lock();
@@ -137,29 +310,64 @@ bool MagmaSystemConnection::ImportBuffer(uint32_t handle, uint64_t* id_out)
     if (iter != buffer_map_.end())
         return DRETF(false, "buffer 0x%" PRIx64 " already imported", id);
 
+    // Checked after the import, which takes ownership of the handle and gives the size.
+    uint64_t size = buf->size();
+    if (!CheckQuota(1, size, 0, 0)) {
+        buf.reset();
+        device->ReleaseBuffer(id);
+        return DRETF(false, "buffer quota exceeded");
+    }
+
     buffer_map_.insert(std::make_pair(id, buf));
+    buffer_bytes_ += size;
+    UpdateUsage();
     *id_out = id;
     return true;
 }
 
-bool MagmaSystemConnection::ReleaseBuffer(uint64_t id)
+bool MagmaSystemConnection::ReleaseBuffers(const uint64_t* ids, uint32_t count)
 {
     auto device = device_.lock();
     if (!device)
         return DRETF(false, "failed to lock device");
 
-    auto iter = buffer_map_.find(id);
-    if (iter == buffer_map_.end())
-        return DRETF(false, "Attempting to free invalid buffer id");
+    // used to validate that ids are not duplicated
+    std::unordered_set<uint64_t> id_set;
+    std::vector<std::shared_ptr<MagmaSystemBuffer>> buffers(count);
+    for (uint32_t i = 0; i < count; i++) {
+        auto iter = buffer_map_.find(ids[i]);
+        if (iter == buffer_map_.end())
+            return DRETF(false, "Attempting to free invalid buffer id 0x%" PRIx64, ids[i]);
+        if (!id_set.insert(ids[i]).second)
+            return DRETF(false, "Attempting to free buffer id 0x%" PRIx64 " twice", ids[i]);
+        buffers[i] = iter->second;
+    }
+
+    // A persistent command buffer can't outlive a buffer it references.
+    for (auto iter = persistent_command_buffer_map_.begin();
+         iter != persistent_command_buffer_map_.end();) {
+        bool references = false;
+        for (uint32_t i = 0; i < count && !references; i++) {
+            references = iter->second->References(ids[i]);
+        }
+        iter = references ? ErasePersistentCommandBuffer(iter) : std::next(iter);
+    }
 
     for (auto& pair : context_map_) {
-        pair.second->ReleaseBuffer(iter->second);
+        pair.second->ReleaseBuffers(buffers);
     }
 
-    buffer_map_.erase(iter);
-    // Now that our shared reference has been dropped we tell our
-    // device that we're done with the buffer
-    device->ReleaseBuffer(id);
+    for (auto& buffer : buffers) {
+        buffer_bytes_ -= buffer->size();
+    }
+    buffers.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        buffer_map_.erase(ids[i]);
+    }
+    UpdateUsage();
+    // Now that our shared references have been dropped we tell our
+    // device that we're done with the buffers
+    device->ReleaseBuffers(ids, count);
 
     return true;
 }
@@ -172,22 +380,52 @@ bool MagmaSystemConnection::ImportObject(uint32_t handle, magma::PlatformObject:
 
     switch (object_type) {
         case magma::PlatformObject::SEMAPHORE: {
-            uint64_t id;
-            if (!magma::PlatformObject::IdFromHandle(handle, &id))
-                return DRETF(false, "failed to get semaphore id for handle");
+            // Imported first, so the handle is closed on every failure below.
+            std::unique_ptr<magma::PlatformSemaphore> platform_semaphore =
+                magma::PlatformSemaphore::Import(handle);
+            if (!platform_semaphore)
+                return DRETF(false, "failed to import platform semaphore");
+            uint64_t id = platform_semaphore->id();
 
             auto iter = semaphore_map_.find(id);
             if (iter != semaphore_map_.end())
                 return DRETF(false, "semaphore 0x%" PRIx64 " already imported", id);
 
-            auto semaphore = MagmaSystemSemaphore::Create(magma::PlatformSemaphore::Import(handle));
+            if (!CheckQuota(0, 0, 1, 0))
+                return DRETF(false, "semaphore quota of %u exceeded",
+                             quota_.max_semaphore_count);
+
+            auto semaphore = MagmaSystemSemaphore::Create(std::move(platform_semaphore));
             if (!semaphore)
-                return DRETF(false, "failed to import platform semaphore");
+                return DRETF(false, "failed to create semaphore");
 
             semaphore_map_.insert(std::make_pair(id, std::move(semaphore)));
         } break;
+        case magma::PlatformObject::TIMELINE_SEMAPHORE:
+            return DRETF(false, "timeline semaphores must be imported with both handles");
     }
 
+    UpdateUsage();
+    return true;
+}
+
+bool MagmaSystemConnection::ImportTimelineSemaphore(uint32_t memory_handle, uint32_t event_handle)
+{
+    std::shared_ptr<magma::PlatformTimelineSemaphore> semaphore =
+        magma::PlatformTimelineSemaphore::Import(memory_handle, event_handle);
+    if (!semaphore)
+        return DRETF(false, "failed to import timeline semaphore");
+
+    uint64_t id = semaphore->id();
+    auto iter = timeline_semaphore_map_.find(id);
+    if (iter != timeline_semaphore_map_.end())
+        return DRETF(false, "timeline semaphore 0x%" PRIx64 " already imported", id);
+
+    if (!CheckQuota(0, 0, 1, 0))
+        return DRETF(false, "semaphore quota of %u exceeded", quota_.max_semaphore_count);
+
+    timeline_semaphore_map_.insert(std::make_pair(id, std::move(semaphore)));
+    UpdateUsage();
     return true;
 }
 
@@ -203,7 +441,16 @@ bool MagmaSystemConnection::ReleaseObject(uint64_t object_id,
 
             semaphore_map_.erase(iter);
         } break;
+        case magma::PlatformObject::TIMELINE_SEMAPHORE: {
+            auto iter = timeline_semaphore_map_.find(object_id);
+            if (iter == timeline_semaphore_map_.end())
+                return DRETF(false, "Attempting to free invalid timeline semaphore id 0x%" PRIx64,
+                             object_id);
+
+            timeline_semaphore_map_.erase(iter);
+        } break;
     }
+    UpdateUsage();
     return true;
 }
 
@@ -224,9 +471,46 @@ std::shared_ptr<MagmaSystemSemaphore> MagmaSystemConnection::LookupSemaphore(uin
     return iter->second;
 }
 
+std::shared_ptr<magma::PlatformTimelineSemaphore>
+MagmaSystemConnection::LookupTimelineSemaphore(uint64_t id)
+{
+    auto iter = timeline_semaphore_map_.find(id);
+    if (iter == timeline_semaphore_map_.end())
+        return nullptr;
+    return iter->second;
+}
+
+std::shared_ptr<MagmaSystemSemaphore> MagmaSystemConnection::BridgeTimelinePoint(
+    std::shared_ptr<magma::PlatformTimelineSemaphore> timeline, uint64_t value, bool signal)
+{
+    auto device = device_.lock();
+    if (!device)
+        return DRETP(nullptr, "failed to lock device");
+
+    MagmaSystemTimelineBridge* bridge = device->timeline_bridge();
+    if (!bridge)
+        return DRETP(nullptr, "no timeline bridge");
+
+    return signal ? bridge->SignalPoint(std::move(timeline), value)
+                  : bridge->WaitPoint(std::move(timeline), value);
+}
+
+void MagmaSystemConnection::UnbridgeTimelinePoints(
+    const std::vector<std::shared_ptr<MagmaSystemSemaphore>>& semaphores)
+{
+    if (semaphores.empty())
+        return;
+    // The bridge goes with the device, taking its points with it.
+    auto device = device_.lock();
+    if (device)
+        device->timeline_bridge()->RemovePoints(semaphores);
+}
+
 magma::Status MagmaSystemConnection::PageFlip(
     uint64_t id, uint32_t wait_semaphore_count, uint32_t signal_semaphore_count,
-    uint64_t* semaphore_ids, std::unique_ptr<magma::PlatformSemaphore> buffer_presented_semaphore)
+    uint64_t* semaphore_ids, uint32_t wait_point_count, uint32_t signal_point_count,
+    magma_system_timeline_point* timeline_points,
+    std::unique_ptr<magma::PlatformSemaphore> buffer_presented_semaphore)
 {
     if (!has_display_capability_)
         return DRET_MSG(MAGMA_STATUS_ACCESS_DENIED,
@@ -246,11 +530,42 @@ magma::Status MagmaSystemConnection::PageFlip(
         semaphores[i] = semaphore;
     }
 
+    std::vector<std::shared_ptr<magma::PlatformTimelineSemaphore>> timelines(wait_point_count +
+                                                                             signal_point_count);
+    for (uint32_t i = 0; i < wait_point_count + signal_point_count; i++) {
+        timelines[i] = LookupTimelineSemaphore(timeline_points[i].semaphore_id);
+        if (!timelines[i])
+            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
+                            "timeline semaphore id not found 0x%" PRIx64,
+                            timeline_points[i].semaphore_id);
+    }
+
     auto device = device_.lock();
     if (!device)
         return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR,
                         "Attempting to page flip, failed to lock device");
 
+    // Timeline points are presented to the msd as extra wait and signal semaphores.
+    std::vector<std::shared_ptr<MagmaSystemSemaphore>> bridged_semaphores;
+    for (uint32_t i = 0; i < wait_point_count + signal_point_count; i++) {
+        bool signal = i >= wait_point_count;
+        if (!signal && timelines[i]->value() >= timeline_points[i].value)
+            continue;
+        auto semaphore = BridgeTimelinePoint(timelines[i], timeline_points[i].value, signal);
+        if (!semaphore) {
+            UnbridgeTimelinePoints(bridged_semaphores);
+            return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to bridge timeline point");
+        }
+        bridged_semaphores.push_back(semaphore);
+        if (signal) {
+            semaphores.push_back(std::move(semaphore));
+            signal_semaphore_count++;
+        } else {
+            semaphores.insert(semaphores.begin() + wait_semaphore_count, std::move(semaphore));
+            wait_semaphore_count++;
+        }
+    }
+
     magma_system_image_descriptor image_desc{MAGMA_IMAGE_TILING_OPTIMAL};
 
     device->PageFlip(this, buf, &image_desc, wait_semaphore_count, signal_semaphore_count,
@@ -10,8 +10,11 @@
 #include "magma_util/macros.h"
 #include "magma_util/platform/platform_connection.h"
 #include "msd.h"
+#include "platform_timeline_semaphore.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 using msd_connection_unique_ptr_t =
@@ -27,6 +30,29 @@ class MagmaSystemDevice;
 class MagmaSystemConnection : private MagmaSystemContext::Owner,
                               public magma::PlatformConnection::Delegate {
 public:
+    // Limits on what one connection may hold, so a runaway client can't exhaust the device.
+    struct Quota {
+        // Buffers and persistent command buffers together.
+        uint32_t max_buffer_count;
+        uint64_t max_buffer_bytes;
+        // Binary and timeline semaphores together.
+        uint32_t max_semaphore_count;
+        uint32_t max_context_count;
+    };
+
+    static const Quota kDefaultRenderQuota;
+    static const Quota kDefaultDisplayQuota;
+
+    struct Usage {
+        uint32_t buffer_count;
+        uint64_t buffer_bytes;
+        uint32_t semaphore_count;
+        uint32_t context_count;
+        // Imports and creates refused for exceeding the quota.
+        uint64_t rejected_count;
+    };
+
+    // The quota is the device's for |capabilities| at the time the connection is created.
     MagmaSystemConnection(std::weak_ptr<MagmaSystemDevice> device,
                           msd_connection_unique_ptr_t msd_connection_t, uint32_t capabilities);
 
@@ -38,10 +64,14 @@ public:
     // This removes the reference to the shared_ptr in the map
     // other instances remain valid until deleted
     // Returns false if no buffer with the given |id| exists in the map
-    bool ReleaseBuffer(uint64_t id) override;
+    bool ReleaseBuffer(uint64_t id) override { return ReleaseBuffers(&id, 1); }
+    // Releases |count| buffers with one msd call per context and one device lock.  Returns false,
+    // releasing nothing, if any of |ids| isn't in the map.
+    bool ReleaseBuffers(const uint64_t* ids, uint32_t count) override;
 
     bool ImportObject(uint32_t handle, magma::PlatformObject::Type object_type) override;
     bool ReleaseObject(uint64_t object_id, magma::PlatformObject::Type object_type) override;
+    bool ImportTimelineSemaphore(uint32_t memory_handle, uint32_t event_handle) override;
 
     // Attempts to locate a buffer by |id| in the buffer map and return it.
     // Returns nullptr if the buffer is not found
@@ -50,22 +80,64 @@ public:
     // Returns the msd_semaphore for the given |id| if present in the semaphore map.
     std::shared_ptr<MagmaSystemSemaphore> LookupSemaphore(uint64_t id);
 
+    // Returns the timeline semaphore for the given |id| if present in the timeline semaphore map.
+    std::shared_ptr<magma::PlatformTimelineSemaphore> LookupTimelineSemaphore(uint64_t id);
+
+    // Returns a binary semaphore standing in for the given point on |timeline|, for use with the
+    // msd.  A wait point semaphore is signalled when the point is reached; signalling a signal
+    // point semaphore advances the timeline to the point.
+    std::shared_ptr<MagmaSystemSemaphore>
+    BridgeTimelinePoint(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline,
+                        uint64_t value, bool signal);
+
+    // Drops the bridged points behind |semaphores| when what they were bridged for fails.
+    void
+    UnbridgeTimelinePoints(const std::vector<std::shared_ptr<MagmaSystemSemaphore>>& semaphores);
+
     magma::Status ExecuteCommandBuffer(uint32_t command_buffer_handle,
                                        uint32_t context_id) override;
 
-    bool CreateContext(uint32_t context_id) override;
+    // Persistent command buffers are validated once, when created, and are released when any
+    // buffer they reference is released.
+    bool CreatePersistentCommandBuffer(uint32_t command_buffer_handle,
+                                       uint32_t command_buffer_id) override;
+    bool ReleasePersistentCommandBuffer(uint32_t command_buffer_id) override;
+    magma::Status ExecutePersistentCommandBuffer(uint32_t command_buffer_id, uint32_t context_id,
+                                                 const magma_system_command_buffer_patch* patch,
+                                                 const uint64_t* semaphore_ids) override;
+
+    // |priority| is one of MAGMA_CONTEXT_PRIORITY_*; high priority needs the display capability.
+    bool CreateContext(uint32_t context_id, uint32_t priority) override;
+    bool CreateContext(uint32_t context_id)
+    {
+        return CreateContext(context_id, MAGMA_CONTEXT_PRIORITY_NORMAL);
+    }
     bool DestroyContext(uint32_t context_id) override;
     MagmaSystemContext* LookupContext(uint32_t context_id);
 
     magma::Status WaitRendering(uint64_t buffer_id) override;
 
+    // Releases the connection thread from any wait in the msd, and fails later ones, so the thread
+    // can see its shutdown event.  Called from the driver thread.
+    void CancelWaits();
+
     uint32_t GetDeviceId();
 
+    const Quota& quota() { return quota_; }
+
+    // May be called from any thread.
+    Usage usage()
+    {
+        std::unique_lock<std::mutex> lock(usage_mutex_);
+        return usage_;
+    }
+
     msd_connection_t* msd_connection() { return msd_connection_.get(); }
 
     magma::Status
     PageFlip(uint64_t id, uint32_t wait_semaphore_count, uint32_t signal_semaphore_count,
-             uint64_t* semaphore_ids,
+             uint64_t* semaphore_ids, uint32_t wait_point_count, uint32_t signal_point_count,
+             magma_system_timeline_point* timeline_points,
              std::unique_ptr<magma::PlatformSemaphore> buffer_presented_semaphore) override;
 
 private:
@@ -78,15 +150,52 @@ private:
     {
         return LookupSemaphore(id);
     }
+    std::shared_ptr<magma::PlatformTimelineSemaphore>
+    LookupTimelineSemaphoreForContext(uint64_t id) override
+    {
+        return LookupTimelineSemaphore(id);
+    }
+    std::shared_ptr<MagmaSystemSemaphore>
+    BridgeTimelinePointForContext(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline,
+                                  uint64_t value, bool signal) override
+    {
+        return BridgeTimelinePoint(std::move(timeline), value, signal);
+    }
+    void UnbridgeTimelinePointsForContext(
+        const std::vector<std::shared_ptr<MagmaSystemSemaphore>>& semaphores) override
+    {
+        UnbridgeTimelinePoints(semaphores);
+    }
+
+    // Returns false, counting a rejection, if adding the given resources would exceed the quota.
+    bool CheckQuota(uint32_t buffer_count, uint64_t buffer_bytes, uint32_t semaphore_count,
+                    uint32_t context_count);
+    void UpdateUsage();
 
     std::weak_ptr<MagmaSystemDevice> device_;
     msd_connection_unique_ptr_t msd_connection_;
     std::unordered_map<uint32_t, std::unique_ptr<MagmaSystemContext>> context_map_;
     std::unordered_map<uint64_t, std::shared_ptr<MagmaSystemBuffer>> buffer_map_;
+    using persistent_command_buffer_map_t =
+        std::unordered_map<uint32_t, std::unique_ptr<MagmaSystemContext::ValidatedCommandBuffer>>;
+    // Also returns the command buffer's bytes to the quota.
+    persistent_command_buffer_map_t::iterator
+    ErasePersistentCommandBuffer(persistent_command_buffer_map_t::iterator iter);
+
+    persistent_command_buffer_map_t persistent_command_buffer_map_;
     std::unordered_map<uint64_t, std::shared_ptr<MagmaSystemSemaphore>> semaphore_map_;
+    std::unordered_map<uint64_t, std::shared_ptr<magma::PlatformTimelineSemaphore>>
+        timeline_semaphore_map_;
 
     bool has_display_capability_;
     bool has_render_capability_;
+    std::atomic_bool waits_cancelled_{false};
+
+    Quota quota_;
+    uint64_t buffer_bytes_ = 0;
+    // A copy of the counts for usage(), which other threads call.
+    Usage usage_ = {};
+    std::mutex usage_mutex_;
 };
 
 #endif //_MAGMA_SYSTEM_CONNECTION_H_
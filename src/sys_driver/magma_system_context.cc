@@ -8,6 +8,7 @@
 #include "magma_util/command_buffer.h"
 #include "magma_util/macros.h"
 
+#include <algorithm>
 #include <memory>
 #include <unordered_set>
 #include <vector>
@@ -26,38 +27,114 @@ private:
     std::unique_ptr<MagmaSystemBuffer> buffer_;
 };
 
-magma::Status
-MagmaSystemContext::ExecuteCommandBuffer(std::unique_ptr<magma::PlatformBuffer> command_buffer)
+// The msd is given a copy of the command buffer when its semaphores or batch start offset change:
+// the msd ABI has no timeline points, so they're replaced by the ids of the semaphores bridging
+// them, and the validated copy of a persistent command buffer may still be in use by the msd.
+// A copy may be submitted again with other semaphores of the same counts.
+static std::unique_ptr<MagmaSystemCommandBuffer>
+RewriteCommandBuffer(MagmaSystemCommandBuffer* cmd_buf, uint32_t batch_start_offset,
+                     const std::vector<uint64_t>& wait_semaphore_ids,
+                     const std::vector<uint64_t>& signal_semaphore_ids)
+{
+    const uint64_t tail_offset =
+        sizeof(magma_system_command_buffer) +
+        sizeof(uint64_t) * (cmd_buf->wait_semaphore_count() + cmd_buf->signal_semaphore_count()) +
+        sizeof(magma_system_timeline_point) *
+            (cmd_buf->wait_timeline_count() + cmd_buf->signal_timeline_count());
+    DASSERT(tail_offset <= cmd_buf->platform_buffer()->size());
+    const uint64_t tail_size = cmd_buf->platform_buffer()->size() - tail_offset;
+    const uint64_t ids_size =
+        sizeof(uint64_t) * (wait_semaphore_ids.size() + signal_semaphore_ids.size());
+
+    auto buffer = MagmaSystemBuffer::Create(magma::PlatformBuffer::Create(
+        sizeof(magma_system_command_buffer) + ids_size + tail_size, "command-buffer-copy"));
+    if (!buffer)
+        return DRETP(nullptr, "failed to create command buffer");
+
+    void* src;
+    if (!cmd_buf->platform_buffer()->MapCpu(&src))
+        return DRETP(nullptr, "failed to map command buffer");
+
+    void* dst;
+    if (!buffer->platform_buffer()->MapCpu(&dst))
+        return DRETP(nullptr, "failed to map rewritten command buffer");
+
+    auto header = reinterpret_cast<magma_system_command_buffer*>(dst);
+    *header = *reinterpret_cast<magma_system_command_buffer*>(src);
+    header->batch_start_offset = batch_start_offset;
+    header->wait_semaphore_count = wait_semaphore_ids.size();
+    header->signal_semaphore_count = signal_semaphore_ids.size();
+    header->wait_timeline_count = 0;
+    header->signal_timeline_count = 0;
+
+    uint64_t* ids = reinterpret_cast<uint64_t*>(header + 1);
+    ids = std::copy(wait_semaphore_ids.begin(), wait_semaphore_ids.end(), ids);
+    ids = std::copy(signal_semaphore_ids.begin(), signal_semaphore_ids.end(), ids);
+    memcpy(ids, reinterpret_cast<uint8_t*>(src) + tail_offset, tail_size);
+
+    if (!cmd_buf->platform_buffer()->UnmapCpu() || !buffer->platform_buffer()->UnmapCpu())
+        return DRETP(nullptr, "failed to unmap command buffers");
+
+    auto rewritten = std::make_unique<MagmaSystemCommandBuffer>(std::move(buffer));
+    if (!rewritten->Initialize())
+        return DRETP(nullptr, "failed to initialize rewritten command buffer");
+
+    return rewritten;
+}
+
+// Whether |cmd_buf| has the batch start offset and semaphore counts |patch| asks for.
+static bool MatchesPatch(MagmaSystemCommandBuffer* cmd_buf,
+                         const magma_system_command_buffer_patch* patch)
+{
+    return patch->batch_start_offset == cmd_buf->batch_start_offset() &&
+           patch->wait_semaphore_count == cmd_buf->wait_semaphore_count() &&
+           patch->signal_semaphore_count == cmd_buf->signal_semaphore_count();
+}
+
+MagmaSystemContext::ValidatedCommandBuffer::~ValidatedCommandBuffer() = default;
+
+bool MagmaSystemContext::ValidatedCommandBuffer::has_timeline_points()
+{
+    return cmd_buf_->wait_timeline_count() || cmd_buf_->signal_timeline_count();
+}
+
+uint64_t MagmaSystemContext::ValidatedCommandBuffer::size()
 {
+    return cmd_buf_->system_buffer()->size();
+}
 
+magma::Status MagmaSystemContext::ValidateCommandBuffer(
+    Owner* owner, std::unique_ptr<magma::PlatformBuffer> command_buffer,
+    std::unique_ptr<ValidatedCommandBuffer>* validated_out)
+{
     // copy command buffer before validating to avoid tampering after validating
     // TODO(MA-111) use Copy On Write here if possible
     auto command_buffer_copy = MagmaSystemBuffer::Create(
         magma::PlatformBuffer::Create(command_buffer->size(), "command-buffer-copy"));
     if (!command_buffer_copy)
         return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
-                        "ExecuteCommandBuffer: failed to create command buffer copy");
+                        "ValidateCommandBuffer: failed to create command buffer copy");
 
     void* cmd_buf_src;
     if (!command_buffer->MapCpu(&cmd_buf_src))
         return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
-                        "ExecuteCommandBuffer: Failed to map command buffer for copying");
+                        "ValidateCommandBuffer: Failed to map command buffer for copying");
 
     void* cmd_buf_dst;
     if (!command_buffer_copy->platform_buffer()->MapCpu(&cmd_buf_dst))
         return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
-                        "ExecuteCommandBuffer: Failed to map command buffer copy for copying");
+                        "ValidateCommandBuffer: Failed to map command buffer copy for copying");
 
     DASSERT(command_buffer->size() == command_buffer_copy->size());
     memcpy(cmd_buf_dst, cmd_buf_src, command_buffer->size());
 
     if (!command_buffer->UnmapCpu())
         return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
-                        "ExecuteCommandBuffer: Failed to unmap command buffer after copying");
+                        "ValidateCommandBuffer: Failed to unmap command buffer after copying");
 
     if (!command_buffer_copy->platform_buffer()->UnmapCpu())
         return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
-                        "ExecuteCommandBuffer: Failed to unmap command buffer copy after copying");
+                        "ValidateCommandBuffer: Failed to unmap command buffer copy after copying");
 
     // we're done with our shared reference to the original buffer so we release it for good measure
     command_buffer.reset();
@@ -66,37 +143,39 @@ MagmaSystemContext::ExecuteCommandBuffer(std::unique_ptr<magma::PlatformBuffer>
 
     if (!cmd_buf->Initialize())
         return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR,
-                        "ExecuteCommandBuffer: Failed to initialize command buffer");
+                        "ValidateCommandBuffer: Failed to initialize command buffer");
+
+    auto validated = std::unique_ptr<ValidatedCommandBuffer>(new ValidatedCommandBuffer());
 
     // used to validate that handles are not duplicated
-    std::unordered_set<uint32_t> id_set;
+    std::unordered_set<uint64_t>& id_set = validated->buffer_ids_;
 
     // used to keep resources in scope until msd_context_execute_command_buffer returns
-    std::vector<std::shared_ptr<MagmaSystemBuffer>> system_resources;
+    std::vector<std::shared_ptr<MagmaSystemBuffer>>& system_resources = validated->resources_;
     system_resources.reserve(cmd_buf->num_resources());
 
     // the resources to be sent to the MSD driver
-    auto msd_resources = std::vector<msd_buffer_t*>();
+    std::vector<msd_buffer_t*>& msd_resources = validated->msd_resources_;
     msd_resources.reserve(cmd_buf->num_resources());
 
     // validate batch buffer index
     if (cmd_buf->batch_buffer_resource_index() >= cmd_buf->num_resources())
         return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
-                        "ExecuteCommandBuffer: batch buffer resource index invalid");
+                        "ValidateCommandBuffer: batch buffer resource index invalid");
 
     // validate exec resources
     for (uint32_t i = 0; i < cmd_buf->num_resources(); i++) {
         uint64_t id = cmd_buf->resource(i).buffer_id();
 
-        auto buf = owner_->LookupBufferForContext(id);
+        auto buf = owner->LookupBufferForContext(id);
         if (!buf)
             return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
-                            "ExecuteCommandBuffer: exec resource has invalid buffer handle");
+                            "ValidateCommandBuffer: exec resource has invalid buffer handle");
 
         auto iter = id_set.find(id);
         if (iter != id_set.end())
             return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
-                            "ExecuteCommandBuffer: duplicate exec resource");
+                            "ValidateCommandBuffer: duplicate exec resource");
 
         id_set.insert(id);
         system_resources.push_back(buf);
@@ -118,51 +197,240 @@ MagmaSystemContext::ExecuteCommandBuffer(std::unique_ptr<magma::PlatformBuffer>
             auto relocation = resource->relocation(reloc_index);
             if (relocation->offset > system_resources[res_index]->size() - sizeof(uint32_t))
                 return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
-                                "ExecuteCommandBuffer: relocation offset invalid");
+                                "ValidateCommandBuffer: relocation offset invalid");
 
             uint32_t target_index = relocation->target_resource_index;
 
             if (target_index >= cmd_buf->num_resources())
                 return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
-                                "ExecuteCommandBuffer: relocation target_resource_index invalid");
+                                "ValidateCommandBuffer: relocation target_resource_index invalid");
 
             if (relocation->target_offset >
                 system_resources[target_index]->size() - sizeof(uint32_t))
                 return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
-                                "ExecuteCommandBuffer: relocation target_offset invalid");
+                                "ValidateCommandBuffer: relocation target_offset invalid");
         }
     }
 
-    // used to keep semaphores in scope until msd_context_execute_command_buffer returns
-    std::vector<msd_semaphore_t*> msd_wait_semaphores(cmd_buf->wait_semaphore_count());
-    std::vector<msd_semaphore_t*> msd_signal_semaphores(cmd_buf->signal_semaphore_count());
+    // wait only for the pages this command buffer references; the rest of each buffer may
+    // still be committing in the background
+    for (uint32_t i = 0; i < cmd_buf->num_resources(); i++) {
+        auto& resource = cmd_buf->resource(i);
+        if (!system_resources[i]->WaitForCommit(resource.offset(), resource.length()))
+            return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
+                            "ValidateCommandBuffer: failed to commit resource pages");
+    }
 
-    // validate semaphores
-    for (uint32_t i = 0; i < cmd_buf->wait_semaphore_count(); i++) {
-        auto semaphore = owner_->LookupSemaphoreForContext(cmd_buf->wait_semaphore_id(i));
+    // The batch length stands in for the work the submission costs the gpu.
+    auto& batch = cmd_buf->resource(cmd_buf->batch_buffer_resource_index());
+    uint64_t batch_size = system_resources[cmd_buf->batch_buffer_resource_index()]->size();
+    validated->batch_size_ = batch_size;
+    validated->cost_ =
+        batch.length() ? batch.length() : batch_size - std::min(batch.offset(), batch_size);
+
+    validated->cmd_buf_ = std::move(cmd_buf);
+    *validated_out = std::move(validated);
+    return MAGMA_STATUS_OK;
+}
+
+magma::Status
+MagmaSystemContext::LookupSemaphores(const std::vector<uint64_t>& ids,
+                                     std::vector<msd_semaphore_t*>* msd_semaphores_out)
+{
+    msd_semaphores_out->resize(ids.size());
+    for (uint32_t i = 0; i < ids.size(); i++) {
+        auto semaphore = owner_->LookupSemaphoreForContext(ids[i]);
         if (!semaphore)
-            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "wait semaphore id not found 0x%" PRIx64,
-                            cmd_buf->wait_semaphore_id(i));
-        msd_wait_semaphores[i] = semaphore->msd_semaphore();
+            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "semaphore id not found 0x%" PRIx64,
+                            ids[i]);
+        (*msd_semaphores_out)[i] = semaphore->msd_semaphore();
+    }
+    return MAGMA_STATUS_OK;
+}
+
+magma::Status
+MagmaSystemContext::ExecuteCommandBuffer(std::unique_ptr<magma::PlatformBuffer> command_buffer)
+{
+    std::unique_ptr<ValidatedCommandBuffer> validated;
+    magma::Status status = ValidateCommandBuffer(owner_, std::move(command_buffer), &validated);
+    if (!status)
+        return DRET_MSG(status.get(), "ExecuteCommandBuffer: invalid command buffer");
+
+    MagmaSystemCommandBuffer* cmd_buf = validated->cmd_buf_.get();
+
+    std::vector<uint64_t> wait_semaphore_ids;
+    for (uint32_t i = 0; i < cmd_buf->wait_semaphore_count(); i++) {
+        wait_semaphore_ids.push_back(cmd_buf->wait_semaphore_id(i));
     }
+    std::vector<uint64_t> signal_semaphore_ids;
     for (uint32_t i = 0; i < cmd_buf->signal_semaphore_count(); i++) {
-        auto semaphore = owner_->LookupSemaphoreForContext(cmd_buf->signal_semaphore_id(i));
-        if (!semaphore)
-            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "signal semaphore id not found 0x%" PRIx64,
-                            cmd_buf->signal_semaphore_id(i));
-        msd_signal_semaphores[i] = semaphore->msd_semaphore();
+        signal_semaphore_ids.push_back(cmd_buf->signal_semaphore_id(i));
+    }
+
+    // used to keep semaphores in scope until msd_context_execute_command_buffer returns
+    std::vector<msd_semaphore_t*> msd_wait_semaphores;
+    std::vector<msd_semaphore_t*> msd_signal_semaphores;
+
+    // validate semaphores
+    status = LookupSemaphores(wait_semaphore_ids, &msd_wait_semaphores);
+    if (!status)
+        return DRET_MSG(status.get(), "ExecuteCommandBuffer: invalid wait semaphore");
+    status = LookupSemaphores(signal_semaphore_ids, &msd_signal_semaphores);
+    if (!status)
+        return DRET_MSG(status.get(), "ExecuteCommandBuffer: invalid signal semaphore");
+
+    const uint32_t wait_timeline_count = cmd_buf->wait_timeline_count();
+    const uint32_t timeline_count = wait_timeline_count + cmd_buf->signal_timeline_count();
+    auto timeline_point = [cmd_buf, wait_timeline_count](uint32_t i) {
+        return i < wait_timeline_count ? cmd_buf->wait_timeline_point(i)
+                                       : cmd_buf->signal_timeline_point(i - wait_timeline_count);
+    };
+
+    // validate timeline points before bridging any of them
+    std::vector<std::shared_ptr<magma::PlatformTimelineSemaphore>> timelines(timeline_count);
+    for (uint32_t i = 0; i < timeline_count; i++) {
+        timelines[i] = owner_->LookupTimelineSemaphoreForContext(timeline_point(i).semaphore_id);
+        if (!timelines[i])
+            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS,
+                            "timeline semaphore id not found 0x%" PRIx64,
+                            timeline_point(i).semaphore_id);
+    }
+
+    // used to keep bridging semaphores in scope until msd_context_execute_command_buffer returns
+    std::vector<std::shared_ptr<MagmaSystemSemaphore>> bridged_semaphores;
+    std::unique_ptr<MagmaSystemCommandBuffer> rewritten;
+
+    if (timeline_count) {
+        for (uint32_t i = 0; i < timeline_count; i++) {
+            const magma_system_timeline_point& point = timeline_point(i);
+            bool signal = i >= wait_timeline_count;
+            if (!signal && timelines[i]->value() >= point.value)
+                continue;
+
+            auto semaphore =
+                owner_->BridgeTimelinePointForContext(timelines[i], point.value, signal);
+            if (!semaphore) {
+                owner_->UnbridgeTimelinePointsForContext(bridged_semaphores);
+                return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to bridge timeline point");
+            }
+
+            uint64_t id = semaphore->platform_semaphore()->id();
+            if (signal) {
+                signal_semaphore_ids.push_back(id);
+                msd_signal_semaphores.push_back(semaphore->msd_semaphore());
+            } else {
+                wait_semaphore_ids.push_back(id);
+                msd_wait_semaphores.push_back(semaphore->msd_semaphore());
+            }
+            bridged_semaphores.push_back(std::move(semaphore));
+        }
+
+        rewritten = RewriteCommandBuffer(cmd_buf, cmd_buf->batch_start_offset(),
+                                         wait_semaphore_ids, signal_semaphore_ids);
+        if (!rewritten) {
+            owner_->UnbridgeTimelinePointsForContext(bridged_semaphores);
+            return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
+                            "ExecuteCommandBuffer: failed to replace timeline points");
+        }
+        cmd_buf = rewritten.get();
     }
 
+    status = Submit(validated.get(), cmd_buf, msd_wait_semaphores, msd_signal_semaphores);
+    if (!status)
+        owner_->UnbridgeTimelinePointsForContext(bridged_semaphores);
+    return status;
+}
+
+magma::Status
+MagmaSystemContext::ExecuteCommandBuffer(ValidatedCommandBuffer* command_buffer,
+                                         const magma_system_command_buffer_patch* patch,
+                                         const uint64_t* semaphore_ids)
+{
+    MagmaSystemCommandBuffer* cmd_buf = command_buffer->cmd_buf_.get();
+    DASSERT(!command_buffer->has_timeline_points());
+
+    std::vector<uint64_t> wait_semaphore_ids;
+    std::vector<uint64_t> signal_semaphore_ids;
+    if (patch) {
+        if (patch->batch_start_offset >= command_buffer->batch_size_)
+            return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "invalid batch start offset 0x%x",
+                            patch->batch_start_offset);
+        wait_semaphore_ids.assign(semaphore_ids, semaphore_ids + patch->wait_semaphore_count);
+        signal_semaphore_ids.assign(semaphore_ids + patch->wait_semaphore_count,
+                                    semaphore_ids + patch->wait_semaphore_count +
+                                        patch->signal_semaphore_count);
+    } else {
+        for (uint32_t i = 0; i < cmd_buf->wait_semaphore_count(); i++) {
+            wait_semaphore_ids.push_back(cmd_buf->wait_semaphore_id(i));
+        }
+        for (uint32_t i = 0; i < cmd_buf->signal_semaphore_count(); i++) {
+            signal_semaphore_ids.push_back(cmd_buf->signal_semaphore_id(i));
+        }
+    }
+
+    std::vector<msd_semaphore_t*> msd_wait_semaphores;
+    std::vector<msd_semaphore_t*> msd_signal_semaphores;
+    magma::Status status = LookupSemaphores(wait_semaphore_ids, &msd_wait_semaphores);
+    if (!status)
+        return DRET_MSG(status.get(), "ExecuteCommandBuffer: invalid wait semaphore");
+    status = LookupSemaphores(signal_semaphore_ids, &msd_signal_semaphores);
+    if (!status)
+        return DRET_MSG(status.get(), "ExecuteCommandBuffer: invalid signal semaphore");
+
+    // The msd is passed the semaphores themselves and reads only their counts from the command
+    // buffer, so new semaphores alone don't need a copy.  A copy with another batch start offset
+    // or counts is never changed once made, so it's kept for later submits like it.
+    if (patch && !MatchesPatch(cmd_buf, patch)) {
+        auto& rewrites = command_buffer->rewrites_;
+        auto iter = std::find_if(rewrites.begin(), rewrites.end(),
+                                 [patch](const std::unique_ptr<MagmaSystemCommandBuffer>& rewrite) {
+                                     return MatchesPatch(rewrite.get(), patch);
+                                 });
+        if (iter == rewrites.end()) {
+            auto rewritten = RewriteCommandBuffer(cmd_buf, patch->batch_start_offset,
+                                                  wait_semaphore_ids, signal_semaphore_ids);
+            if (!rewritten)
+                return DRET_MSG(MAGMA_STATUS_MEMORY_ERROR,
+                                "ExecuteCommandBuffer: failed to patch command buffer");
+            if (rewrites.size() >= ValidatedCommandBuffer::kMaxRewrites)
+                rewrites.erase(rewrites.begin());
+            iter = rewrites.insert(rewrites.end(), std::move(rewritten));
+        }
+        cmd_buf = iter->get();
+    }
+
+    return Submit(command_buffer, cmd_buf, msd_wait_semaphores, msd_signal_semaphores);
+}
+
+magma::Status MagmaSystemContext::Submit(ValidatedCommandBuffer* validated,
+                                         MagmaSystemCommandBuffer* cmd_buf,
+                                         std::vector<msd_semaphore_t*>& msd_wait_semaphores,
+                                         std::vector<msd_semaphore_t*>& msd_signal_semaphores)
+{
     // submit command buffer to driver
-    magma_status_t result = msd_context_execute_command_buffer(
-        msd_ctx(), cmd_buf->system_buffer()->msd_buf(), msd_resources.data(),
-        msd_wait_semaphores.data(), msd_signal_semaphores.data());
+    auto submit = [&]() {
+        return msd_context_execute_command_buffer(
+            msd_ctx(), cmd_buf->system_buffer()->msd_buf(), validated->msd_resources_.data(),
+            msd_wait_semaphores.data(), msd_signal_semaphores.data());
+    };
+
+    magma_status_t result;
+    if (queue_) {
+        result = queue_->scheduler()->Submit(queue_.get(), validated->cost_, submit);
+    } else {
+        result = submit();
+    }
 
     return DRET_MSG(result, "ExecuteCommandBuffer: msd_context_execute_command_buffer failed: %d",
                     result);
 }
 
-void MagmaSystemContext::ReleaseBuffer(std::shared_ptr<MagmaSystemBuffer> buffer)
+void MagmaSystemContext::ReleaseBuffers(
+    const std::vector<std::shared_ptr<MagmaSystemBuffer>>& buffers)
 {
-    msd_context_release_buffer(msd_ctx(), buffer->msd_buf());
+    std::vector<msd_buffer_t*> msd_buffers(buffers.size());
+    for (uint32_t i = 0; i < buffers.size(); i++) {
+        msd_buffers[i] = buffers[i]->msd_buf();
+    }
+    msd_context_release_buffers(msd_ctx(), msd_buffers.data(), msd_buffers.size());
 }
@@ -7,11 +7,15 @@
 
 #include <functional>
 #include <memory>
+#include <unordered_set>
+#include <vector>
 
 #include "magma_system_buffer.h"
+#include "magma_system_scheduler.h"
 #include "magma_system_semaphore.h"
 #include "magma_util/status.h"
 #include "msd.h"
+#include "platform_timeline_semaphore.h"
 
 using msd_context_unique_ptr_t = std::unique_ptr<msd_context_t, decltype(&msd_context_destroy)>;
 
@@ -20,29 +24,95 @@ static inline msd_context_unique_ptr_t MsdContextUniquePtr(msd_context_t* contex
     return msd_context_unique_ptr_t(context, &msd_context_destroy);
 }
 
+class MagmaSystemCommandBuffer;
+
 class MagmaSystemContext {
 public:
     class Owner {
     public:
         virtual std::shared_ptr<MagmaSystemBuffer> LookupBufferForContext(uint64_t id) = 0;
         virtual std::shared_ptr<MagmaSystemSemaphore> LookupSemaphoreForContext(uint64_t id) = 0;
+        virtual std::shared_ptr<magma::PlatformTimelineSemaphore>
+        LookupTimelineSemaphoreForContext(uint64_t id) = 0;
+        virtual std::shared_ptr<MagmaSystemSemaphore>
+        BridgeTimelinePointForContext(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline,
+                                      uint64_t value, bool signal) = 0;
+        virtual void UnbridgeTimelinePointsForContext(
+            const std::vector<std::shared_ptr<MagmaSystemSemaphore>>& semaphores) = 0;
     };
 
-    MagmaSystemContext(Owner* owner, msd_context_unique_ptr_t msd_ctx)
-        : owner_(owner), msd_ctx_(std::move(msd_ctx))
+    // Submissions go through |queue| when one is given, and straight to the msd otherwise.
+    MagmaSystemContext(Owner* owner, msd_context_unique_ptr_t msd_ctx,
+                       std::unique_ptr<MagmaSystemScheduler::Queue> queue = nullptr)
+        : owner_(owner), msd_ctx_(std::move(msd_ctx)), queue_(std::move(queue))
     {
     }
 
+    // A command buffer copied out of the client's reach, with its resources and relocations checked
+    // against the owner's buffers.  Its semaphores are looked up when it's submitted.
+    class ValidatedCommandBuffer {
+    public:
+        ~ValidatedCommandBuffer();
+
+        bool References(uint64_t buffer_id) { return buffer_ids_.count(buffer_id); }
+
+        bool has_timeline_points();
+
+        // Bytes of the command buffer's copy.
+        uint64_t size();
+
+    private:
+        ValidatedCommandBuffer() = default;
+
+        std::unique_ptr<MagmaSystemCommandBuffer> cmd_buf_;
+        // Kept in scope until the command buffer is released, in the command buffer's order.
+        std::vector<std::shared_ptr<MagmaSystemBuffer>> resources_;
+        std::vector<msd_buffer_t*> msd_resources_;
+        std::unordered_set<uint64_t> buffer_ids_;
+        uint64_t batch_size_ = 0;
+        // What a submission costs in the scheduler.
+        uint64_t cost_ = 0;
+        // Copies made for patches with another batch start offset or semaphore counts, oldest
+        // first.
+        static constexpr uint32_t kMaxRewrites = 4;
+        std::vector<std::unique_ptr<MagmaSystemCommandBuffer>> rewrites_;
+
+        friend class MagmaSystemContext;
+        DISALLOW_COPY_AND_ASSIGN(ValidatedCommandBuffer);
+    };
+
+    static magma::Status
+    ValidateCommandBuffer(Owner* owner, std::unique_ptr<magma::PlatformBuffer> command_buffer,
+                          std::unique_ptr<ValidatedCommandBuffer>* validated_out);
+
     magma::Status ExecuteCommandBuffer(std::unique_ptr<magma::PlatformBuffer> command_buffer);
 
-    void ReleaseBuffer(std::shared_ptr<MagmaSystemBuffer> buffer);
+    // Executes a command buffer validated earlier, which mustn't have timeline points.  If |patch|
+    // isn't null, its batch start offset and |semaphore_ids| are used instead of the command
+    // buffer's.
+    magma::Status ExecuteCommandBuffer(ValidatedCommandBuffer* command_buffer,
+                                       const magma_system_command_buffer_patch* patch,
+                                       const uint64_t* semaphore_ids);
+
+    // Tells the msd in one call that none of |buffers| are in use on this context any more.
+    void ReleaseBuffers(const std::vector<std::shared_ptr<MagmaSystemBuffer>>& buffers);
 
 private:
     msd_context_t* msd_ctx() { return msd_ctx_.get(); }
 
+    // Looks up the msd semaphores for |ids|.
+    magma::Status LookupSemaphores(const std::vector<uint64_t>& ids,
+                                   std::vector<msd_semaphore_t*>* msd_semaphores_out);
+
+    // Passes |cmd_buf|, which is |validated|'s or a rewrite of it, to the msd through the queue.
+    magma::Status Submit(ValidatedCommandBuffer* validated, MagmaSystemCommandBuffer* cmd_buf,
+                         std::vector<msd_semaphore_t*>& msd_wait_semaphores,
+                         std::vector<msd_semaphore_t*>& msd_signal_semaphores);
+
     Owner* owner_;
 
     msd_context_unique_ptr_t msd_ctx_;
+    std::unique_ptr<MagmaSystemScheduler::Queue> queue_;
 
     friend class CommandBufferHelper;
 };
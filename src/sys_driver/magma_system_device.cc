@@ -6,9 +6,44 @@
 #include "magma_system_connection.h"
 #include "magma_util/macros.h"
 #include "platform_object.h"
+#include <chrono>
 
 uint32_t MagmaSystemDevice::GetDeviceId() { return msd_device_get_id(msd_dev()); }
 
+magma::Status MagmaSystemDevice::Query(const uint64_t* ids, uint32_t count, uint64_t* values_out)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        switch (ids[i]) {
+            case MAGMA_QUERY_DEVICE_ID:
+                values_out[i] = GetDeviceId();
+                break;
+            default: {
+                magma::Status status = Query(ids[i], &values_out[i]);
+                if (!status)
+                    return DRET_MSG(status.get(), "unhandled id 0x%" PRIx64, ids[i]);
+            }
+        }
+    }
+    return MAGMA_STATUS_OK;
+}
+
+MagmaSystemTimelineBridge* MagmaSystemDevice::timeline_bridge()
+{
+    std::unique_lock<std::mutex> lock(timeline_bridge_mutex_);
+    if (!timeline_bridge_)
+        timeline_bridge_ = MagmaSystemTimelineBridge::Create();
+    return timeline_bridge_.get();
+}
+
+MagmaSystemCommitService* MagmaSystemDevice::commit_service()
+{
+    std::unique_lock<std::mutex> lock(commit_service_mutex_);
+    if (!commit_service_)
+        commit_service_ = std::make_unique<MagmaSystemCommitService>(
+            MagmaSystemCommitService::kDefaultThreadCount);
+    return commit_service_.get();
+}
+
 std::shared_ptr<magma::PlatformConnection>
 MagmaSystemDevice::Open(std::shared_ptr<MagmaSystemDevice> device, msd_client_id_t client_id,
                         uint32_t capabilities)
@@ -157,16 +192,24 @@ std::shared_ptr<MagmaSystemBuffer> MagmaSystemDevice::ImportBuffer(uint32_t hand
     }
 
     std::shared_ptr<MagmaSystemBuffer> buf = MagmaSystemBuffer::Create(std::move(platform_buf));
+    if (!buf)
+        return DRETP(nullptr, "failed to create system buffer");
+
+    if (buf->size() >= MagmaSystemCommitService::kMinBufferSize)
+        buf->set_commit_job(commit_service()->Enqueue(buf->platform_buffer()));
+
     buffer_map_.insert(std::make_pair(id, buf));
     return buf;
 }
 
-void MagmaSystemDevice::ReleaseBuffer(uint64_t id)
+void MagmaSystemDevice::ReleaseBuffers(const uint64_t* ids, size_t count)
 {
     std::unique_lock<std::mutex> lock(buffer_map_mutex_);
-    auto iter = buffer_map_.find(id);
-    if (iter != buffer_map_.end() && iter->second.expired())
-        buffer_map_.erase(iter);
+    for (size_t i = 0; i < count; i++) {
+        auto iter = buffer_map_.find(ids[i]);
+        if (iter != buffer_map_.end() && iter->second.expired())
+            buffer_map_.erase(iter);
+    }
 }
 
 void MagmaSystemDevice::StartConnectionThread(
@@ -174,15 +217,100 @@ void MagmaSystemDevice::StartConnectionThread(
 {
     std::unique_lock<std::mutex> lock(connection_list_mutex_);
 
+    if (!connection_map_) {
+        DLOG("device is shut down");
+        return;
+    }
+
     auto shutdown_event = platform_connection->ShutdownEvent();
-    std::thread thread(magma::PlatformConnection::RunLoop, std::move(platform_connection));
+    std::shared_ptr<magma::PlatformEvent> exited_event = magma::PlatformEvent::Create();
+    if (!exited_event) {
+        DLOG("failed to create exited event");
+        return;
+    }
+
+    // When its connection closes the thread is detached, and it may still be signalling
+    // |exited_event| after the device is gone, so it mustn't touch the device.
+    std::thread thread([platform_connection, exited_event]() mutable {
+        magma::PlatformConnection::RunLoop(std::move(platform_connection));
+        exited_event->Signal();
+    });
 
     connection_map_->insert(std::pair<std::thread::id, Connection>(
-        thread.get_id(), Connection{std::move(thread), std::move(shutdown_event)}));
+        thread.get_id(),
+        Connection{std::move(thread), std::move(shutdown_event), std::move(exited_event)}));
+}
+
+void MagmaSystemDevice::SetConnectionQuota(uint32_t capability,
+                                           const MagmaSystemConnection::Quota& quota)
+{
+    std::unique_lock<std::mutex> lock(quota_mutex_);
+    switch (capability) {
+        case MAGMA_CAPABILITY_RENDERING:
+            render_quota_ = quota;
+            break;
+        case MAGMA_CAPABILITY_DISPLAY:
+            display_quota_ = quota;
+            break;
+        default:
+            DLOG("can't set quota for capability 0x%x", capability);
+    }
+}
+
+MagmaSystemConnection::Quota MagmaSystemDevice::ConnectionQuota(uint32_t capabilities)
+{
+    std::unique_lock<std::mutex> lock(quota_mutex_);
+    return (capabilities & MAGMA_CAPABILITY_RENDERING) ? render_quota_ : display_quota_;
+}
+
+void MagmaSystemDevice::DumpStatus()
+{
+    {
+        std::unique_lock<std::mutex> lock(live_connections_mutex_);
+        magma::log(magma::LOG_INFO, "%zu connections", live_connections_.size());
+        for (auto connection : live_connections_) {
+            MagmaSystemConnection::Usage usage = connection->usage();
+            const MagmaSystemConnection::Quota& quota = connection->quota();
+            magma::log(magma::LOG_INFO,
+                       "connection %p: buffers %u/%u bytes %" PRIu64 "/%" PRIu64
+                       " semaphores %u/%u contexts %u/%u rejected %" PRIu64,
+                       connection, usage.buffer_count, quota.max_buffer_count, usage.buffer_bytes,
+                       quota.max_buffer_bytes, usage.semaphore_count, quota.max_semaphore_count,
+                       usage.context_count, quota.max_context_count, usage.rejected_count);
+        }
+    }
+
+    MagmaSystemScheduler::Stats stats = scheduler_.stats();
+    for (uint32_t i = 0; i < MagmaSystemScheduler::kPriorityCount; i++) {
+        magma::log(magma::LOG_INFO,
+                   "scheduler priority %u: submits %" PRIu64 " mean wait %" PRIu64
+                   " us max wait %" PRIu64 " us",
+                   i, stats.submit_count[i],
+                   stats.submit_count[i] ? stats.total_wait_us[i] / stats.submit_count[i] : 0,
+                   stats.max_wait_us[i]);
+    }
+    magma::log(magma::LOG_INFO, "scheduler: starved %" PRIu64 " queue depth %u max %u",
+               stats.starvation_count, stats.queue_depth, stats.max_queue_depth);
+    // The msd's buffers live in this process, so this counts its bus address lookups.
+    magma::log(magma::LOG_INFO, "bus address lookups avoided: %" PRIu64,
+               magma::PlatformBuffer::total_bus_lookups_avoided());
+    msd_device_dump_status(msd_dev());
+}
+
+void MagmaSystemDevice::ConnectionOpened(MagmaSystemConnection* connection)
+{
+    std::unique_lock<std::mutex> lock(live_connections_mutex_);
+    live_connections_.insert(connection);
 }
 
-void MagmaSystemDevice::ConnectionClosed(std::thread::id thread_id)
+void MagmaSystemDevice::ConnectionClosed(MagmaSystemConnection* connection,
+                                         std::thread::id thread_id)
 {
+    {
+        std::unique_lock<std::mutex> lock(live_connections_mutex_);
+        live_connections_.erase(connection);
+    }
+
     std::unique_lock<std::mutex> lock(connection_list_mutex_);
 
     if (!connection_map_)
@@ -196,25 +324,81 @@ void MagmaSystemDevice::ConnectionClosed(std::thread::id thread_id)
     }
 }
 
-void MagmaSystemDevice::Shutdown()
+MagmaSystemDevice::ShutdownStats
+MagmaSystemDevice::Shutdown(std::shared_ptr<MagmaSystemDevice> device, uint32_t deadline_ms)
 {
-    std::unique_lock<std::mutex> lock(connection_list_mutex_);
-    auto map = std::move(connection_map_);
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::milliseconds(deadline_ms);
+
+    // Threads overdue at an earlier call are waited for again.
+    std::unique_lock<std::mutex> lock(device->connection_list_mutex_);
+    auto map = std::move(device->connection_map_);
+    std::vector<Connection> connections = std::move(device->overdue_connections_);
+    device->overdue_connections_.clear();
     lock.unlock();
 
-    for (auto& element : *map) {
-        element.second.shutdown_event->Signal();
+    if (map) {
+        for (auto& element : *map) {
+            element.second.shutdown_event->Signal();
+            connections.push_back(std::move(element.second));
+        }
     }
 
-    auto start = std::chrono::high_resolution_clock::now();
+    // A thread blocked in the msd won't see its shutdown event until it's released.
+    {
+        std::unique_lock<std::mutex> lock(device->live_connections_mutex_);
+        for (auto connection : device->live_connections_) {
+            connection->CancelWaits();
+        }
+    }
 
-    for (auto& element : *map) {
-        element.second.thread.join();
+    ShutdownStats stats = {};
+    stats.connection_count = connections.size();
+
+    // The threads exit in parallel, so waiting on each in turn costs only the slowest.
+    std::vector<Connection> overdue;
+    for (auto& connection : connections) {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t remaining_ms =
+            now < deadline
+                ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count()
+                : 0;
+        if (connection.exited_event->Wait(remaining_ms)) {
+            connection.thread.join();
+        } else {
+            overdue.push_back(std::move(connection));
+        }
     }
+    stats.overdue_count = overdue.size();
+
+    if (stats.overdue_count) {
+        magma::log(magma::LOG_WARNING, "%u of %u connections still running %u ms into shutdown",
+                   stats.overdue_count, stats.connection_count, deadline_ms);
+        lock.lock();
+        device->overdue_connections_ = std::move(overdue);
+    }
+
+    stats.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    DLOG("shutdown of %u connections took %u ms", stats.connection_count, stats.elapsed_ms);
 
-    std::chrono::duration<double, std::milli> elapsed =
-        std::chrono::high_resolution_clock::now() - start;
-    DLOG("shutdown took %u ms", (uint32_t)elapsed.count());
+    return stats;
+}
 
-    (void)elapsed;
+void MagmaSystemDevice::JoinOverdueConnections()
+{
+    std::unique_lock<std::mutex> lock(connection_list_mutex_);
+    std::vector<Connection> overdue = std::move(overdue_connections_);
+    overdue_connections_.clear();
+    lock.unlock();
+
+    for (auto& connection : overdue) {
+        // The last reference to the device may be dropped on a connection thread.
+        if (connection.thread.get_id() == std::this_thread::get_id()) {
+            connection.thread.detach();
+        } else {
+            connection.thread.join();
+        }
+    }
 }
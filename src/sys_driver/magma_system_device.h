@@ -5,7 +5,10 @@
 #ifndef _MAGMA_SYSTEM_DEVICE_H_
 #define _MAGMA_SYSTEM_DEVICE_H_
 
+#include "magma_system_commit_service.h"
 #include "magma_system_connection.h"
+#include "magma_system_scheduler.h"
+#include "magma_system_timeline_bridge.h"
 #include "msd.h"
 #include "platform_connection.h"
 #include "platform_event.h"
@@ -15,6 +18,7 @@
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 using msd_device_unique_ptr_t = std::unique_ptr<msd_device_t, decltype(&msd_device_destroy)>;
@@ -46,6 +50,10 @@ public:
         connection_map_ = std::make_unique<std::unordered_map<std::thread::id, Connection>>();
     }
 
+    // Blocks until any connection threads still running after Shutdown have exited, since they
+    // use the msd device.
+    ~MagmaSystemDevice() { JoinOverdueConnections(); }
+
     // Opens a connection to the device. On success |connection_handle_out| will contain the
     // connection handle to be passed to the client
     static std::shared_ptr<magma::PlatformConnection>
@@ -72,24 +80,71 @@ public:
     // Takes ownership of handle and either wraps it up in new MagmaSystemBuffer or
     // closes it and returns an existing MagmaSystemBuffer backed by the same memory
     std::shared_ptr<MagmaSystemBuffer> ImportBuffer(uint32_t handle);
-    void ReleaseBuffer(uint64_t id);
+    void ReleaseBuffer(uint64_t id) { ReleaseBuffers(&id, 1); }
+    // Forgets those of the |count| buffers no connection references any more, under one lock.
+    void ReleaseBuffers(const uint64_t* ids, size_t count);
 
-    // Called on driver thread
-    void Shutdown();
+    size_t buffer_count()
+    {
+        std::unique_lock<std::mutex> lock(buffer_map_mutex_);
+        return buffer_map_.size();
+    }
+
+    struct ShutdownStats {
+        uint32_t connection_count;
+        // Connections whose threads were still running at the deadline.
+        uint32_t overdue_count;
+        uint32_t elapsed_ms;
+    };
+
+    static constexpr uint32_t kShutdownDeadlineMs = 1000;
+
+    // Called on driver thread.  Stops every connection thread, cancelling any waits they're
+    // blocked in, and returns once they've exited or the deadline has passed.  A connection thread
+    // uses its msd connection until it exits, so the device keeps the threads still running at the
+    // deadline; while any are, the hardware mustn't be handed to another device.  Calling again
+    // waits again for those threads.
+    static ShutdownStats Shutdown(std::shared_ptr<MagmaSystemDevice> device,
+                                  uint32_t deadline_ms = kShutdownDeadlineMs);
+
+    // Blocks until the connection threads overdue at the last Shutdown have exited.
+    void JoinOverdueConnections();
 
     // Called on driver thread
     void StartConnectionThread(std::shared_ptr<magma::PlatformConnection> platform_connection);
 
-    // Called on connection thread
-    void ConnectionClosed(std::thread::id thread_id);
+    // Called as connections are created and destroyed, so Shutdown can reach them.
+    void ConnectionOpened(MagmaSystemConnection* connection);
+    void ConnectionClosed(MagmaSystemConnection* connection, std::thread::id thread_id);
+
+    // Sets the quota for connections opened afterwards with |capability|, one of
+    // MAGMA_CAPABILITY_RENDERING or MAGMA_CAPABILITY_DISPLAY.
+    void SetConnectionQuota(uint32_t capability, const MagmaSystemConnection::Quota& quota);
 
-    void DumpStatus() { msd_device_dump_status(msd_dev()); }
+    // A connection with the rendering capability gets the rendering quota.
+    MagmaSystemConnection::Quota ConnectionQuota(uint32_t capabilities);
+
+    // Logs each connection's resource usage against its quota and the scheduler's metrics, then
+    // has the msd dump its status.
+    void DumpStatus();
 
     magma::Status Query(uint32_t id, uint64_t* value_out)
     {
         return msd_device_query(msd_dev(), id, value_out);
     }
 
+    // Answers |count| queries, including MAGMA_QUERY_DEVICE_ID; fails on the first unhandled id.
+    magma::Status Query(const uint64_t* ids, uint32_t count, uint64_t* values_out);
+
+    // Created on first use, so devices whose clients never use timeline semaphores don't pay
+    // for the bridge thread.
+    MagmaSystemTimelineBridge* timeline_bridge();
+
+    // Created on first import of a buffer large enough to be committed in the background.
+    MagmaSystemCommitService* commit_service();
+
+    MagmaSystemScheduler* scheduler() { return &scheduler_; }
+
 private:
     msd_device_unique_ptr_t msd_dev_;
     msd_connection_unique_ptr_t msd_connection_; // for presenting buffers
@@ -111,10 +166,30 @@ private:
     struct Connection {
         std::thread thread;
         std::shared_ptr<magma::PlatformEvent> shutdown_event;
+        // Signalled by the thread as it exits.
+        std::shared_ptr<magma::PlatformEvent> exited_event;
     };
 
+    // Null once the device is shut down.
     std::unique_ptr<std::unordered_map<std::thread::id, Connection>> connection_map_;
+    // Connections whose threads hadn't exited by the last Shutdown's deadline.
+    std::vector<Connection> overdue_connections_;
     std::mutex connection_list_mutex_;
+
+    std::unordered_set<MagmaSystemConnection*> live_connections_;
+    std::mutex live_connections_mutex_;
+
+    MagmaSystemConnection::Quota render_quota_ = MagmaSystemConnection::kDefaultRenderQuota;
+    MagmaSystemConnection::Quota display_quota_ = MagmaSystemConnection::kDefaultDisplayQuota;
+    std::mutex quota_mutex_;
+
+    std::unique_ptr<MagmaSystemTimelineBridge> timeline_bridge_;
+    std::mutex timeline_bridge_mutex_;
+
+    std::unique_ptr<MagmaSystemCommitService> commit_service_;
+    std::mutex commit_service_mutex_;
+
+    MagmaSystemScheduler scheduler_;
 };
 
 #endif //_MAGMA_SYSTEM_DEVICE_H_
\ No newline at end of file
@@ -0,0 +1,175 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_system_scheduler.h"
+#include "platform_trace.h"
+#include <algorithm>
+
+constexpr uint64_t MagmaSystemScheduler::kQuantum;
+constexpr uint64_t MagmaSystemScheduler::kMaxCost;
+
+struct MagmaSystemScheduler::Queue::Waiter {
+    Waiter(Queue* queue, uint64_t cost)
+        : queue(queue), cost(cost), enqueue_time(std::chrono::steady_clock::now())
+    {
+    }
+
+    Queue* queue;
+    uint64_t cost;
+    std::chrono::steady_clock::time_point enqueue_time;
+    bool admitted = false;
+    std::condition_variable admitted_condition;
+};
+
+MagmaSystemScheduler::Queue::~Queue() { DASSERT(waiters_.empty()); }
+
+std::unique_ptr<MagmaSystemScheduler::Queue> MagmaSystemScheduler::CreateQueue(uint64_t client_id,
+                                                                               Priority priority)
+{
+    DASSERT(priority < kPriorityCount);
+    return std::unique_ptr<Queue>(new Queue(this, client_id, priority));
+}
+
+magma_status_t MagmaSystemScheduler::Submit(Queue* queue, uint64_t cost,
+                                            const std::function<magma_status_t()>& submit)
+{
+    DASSERT(queue->scheduler() == this);
+
+    Queue::Waiter waiter(queue, std::min(std::max(cost, uint64_t{1}), kMaxCost));
+    {
+        TRACE_DURATION("magma", "SchedulerWait");
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        if (queue->waiters_.empty()) {
+            PriorityClass& priority_class = classes_[queue->priority_];
+            auto iter = priority_class.clients.find(queue->client_id_);
+            if (iter == priority_class.clients.end()) {
+                iter = priority_class.clients.emplace(queue->client_id_, Client()).first;
+                priority_class.ring.push_back(queue->client_id_);
+            }
+            iter->second.queues.push_back(queue);
+        }
+        queue->waiters_.push_back(&waiter);
+
+        stats_.queue_depth++;
+        stats_.max_queue_depth = std::max(stats_.max_queue_depth, stats_.queue_depth);
+
+        if (!busy_)
+            AdmitNext();
+        waiter.admitted_condition.wait(lock, [&waiter] { return waiter.admitted; });
+    }
+
+    magma_status_t result = submit();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    busy_ = false;
+    if (stats_.queue_depth)
+        AdmitNext();
+
+    return result;
+}
+
+void MagmaSystemScheduler::AdmitNext()
+{
+    DASSERT(!busy_);
+    DASSERT(stats_.queue_depth);
+
+    auto now = std::chrono::steady_clock::now();
+
+    Queue::Waiter* waiter = PickStarved(now);
+    if (waiter) {
+        stats_.starvation_count++;
+    } else {
+        for (int priority = kPriorityCount - 1; priority >= 0; priority--) {
+            if (!classes_[priority].ring.empty()) {
+                waiter = PickDeficitRoundRobin(&classes_[priority]);
+                break;
+            }
+        }
+    }
+    DASSERT(waiter);
+    DASSERT(waiter->queue->waiters_.front() == waiter);
+
+    Dequeue(waiter->queue);
+
+    Priority priority = waiter->queue->priority_;
+    uint64_t wait_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - waiter->enqueue_time).count();
+    stats_.submit_count[priority]++;
+    stats_.total_wait_us[priority] += wait_us;
+    stats_.max_wait_us[priority] = std::max(stats_.max_wait_us[priority], wait_us);
+
+    busy_ = true;
+    waiter->admitted = true;
+    waiter->admitted_condition.notify_one();
+}
+
+// Looks for the longest waiting submission below the highest class with waiters.
+MagmaSystemScheduler::Queue::Waiter*
+MagmaSystemScheduler::PickStarved(std::chrono::steady_clock::time_point now)
+{
+    int top = kPriorityCount - 1;
+    while (top > 0 && classes_[top].ring.empty())
+        top--;
+
+    Queue::Waiter* oldest = nullptr;
+    for (int priority = 0; priority < top; priority++) {
+        for (auto& pair : classes_[priority].clients) {
+            for (Queue* queue : pair.second.queues) {
+                Queue::Waiter* waiter = queue->waiters_.front();
+                if (!oldest || waiter->enqueue_time < oldest->enqueue_time)
+                    oldest = waiter;
+            }
+        }
+    }
+
+    if (oldest && now - oldest->enqueue_time >= starvation_threshold_)
+        return oldest;
+    return nullptr;
+}
+
+// The client at the front of the ring is served while its deficit covers the cost of its next
+// submission; otherwise it's given another quantum and moved to the back.
+MagmaSystemScheduler::Queue::Waiter*
+MagmaSystemScheduler::PickDeficitRoundRobin(PriorityClass* priority_class)
+{
+    while (true) {
+        uint64_t client_id = priority_class->ring.front();
+        Client& client = priority_class->clients[client_id];
+        DASSERT(!client.queues.empty());
+
+        Queue::Waiter* waiter = client.queues.front()->waiters_.front();
+        if (client.deficit >= waiter->cost) {
+            client.deficit -= waiter->cost;
+            return waiter;
+        }
+
+        client.deficit += kQuantum;
+        priority_class->ring.pop_front();
+        priority_class->ring.push_back(client_id);
+    }
+}
+
+// Removes the front waiter of |queue|, moving the queue to the back of its client's turn order
+// and retiring the client once it has no waiters.
+void MagmaSystemScheduler::Dequeue(Queue* queue)
+{
+    queue->waiters_.pop_front();
+    stats_.queue_depth--;
+
+    PriorityClass& priority_class = classes_[queue->priority_];
+    auto iter = priority_class.clients.find(queue->client_id_);
+    DASSERT(iter != priority_class.clients.end());
+    Client& client = iter->second;
+
+    client.queues.erase(std::find(client.queues.begin(), client.queues.end(), queue));
+    if (!queue->waiters_.empty())
+        client.queues.push_back(queue);
+
+    if (client.queues.empty()) {
+        priority_class.ring.erase(
+            std::find(priority_class.ring.begin(), priority_class.ring.end(), queue->client_id_));
+        priority_class.clients.erase(iter);
+    }
+}
@@ -0,0 +1,129 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_SYSTEM_SCHEDULER_H_
+#define MAGMA_SYSTEM_SCHEDULER_H_
+
+#include "magma_common_defs.h"
+#include "magma_util/macros.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Orders the calls that hand submissions to the msd when several contexts submit at once.  Each
+// context has a queue; queued submissions are admitted one at a time, highest priority class
+// first, and within a class by deficit round robin across clients, so contending clients get
+// equal shares of the batch bytes handed to the msd however many contexts they use.  A submission
+// that has waited longer than the starvation threshold is admitted ahead of higher classes.
+//
+// This orders submission only; it does not share GPU time.  The msd reports no command buffer
+// completions to the system driver, so work already handed to the msd isn't accounted for, and a
+// client whose submissions don't contend is never held back.  GPU time is the msd's to schedule.
+//
+// Admitted submissions run on the submitting thread, outside the scheduler's lock, so msd calls
+// for a connection still come from its own thread and submit errors are returned to the caller as
+// before.
+class MagmaSystemScheduler {
+public:
+    // The context priorities of the abi, MAGMA_CONTEXT_PRIORITY_*.
+    enum Priority : uint32_t {
+        kPriorityLow,
+        kPriorityNormal,
+        kPriorityHigh,
+        kPriorityCount,
+    };
+
+    // Batch bytes each client may submit per round.
+    static constexpr uint64_t kQuantum = 64 * 1024;
+    // Costs are clamped so one huge batch doesn't take many rounds to schedule.
+    static constexpr uint64_t kMaxCost = 16 * kQuantum;
+    static constexpr uint32_t kDefaultStarvationMs = 100;
+
+    class Queue {
+    public:
+        ~Queue();
+
+        MagmaSystemScheduler* scheduler() { return scheduler_; }
+        Priority priority() { return priority_; }
+
+    private:
+        struct Waiter;
+
+        Queue(MagmaSystemScheduler* scheduler, uint64_t client_id, Priority priority)
+            : scheduler_(scheduler), client_id_(client_id), priority_(priority)
+        {
+        }
+
+        MagmaSystemScheduler* scheduler_;
+        uint64_t client_id_;
+        Priority priority_;
+        std::deque<Waiter*> waiters_;
+
+        friend class MagmaSystemScheduler;
+        DISALLOW_COPY_AND_ASSIGN(Queue);
+    };
+
+    struct Stats {
+        uint64_t submit_count[kPriorityCount];
+        uint64_t max_wait_us[kPriorityCount];
+        uint64_t total_wait_us[kPriorityCount];
+        // Submissions admitted ahead of a higher class because they'd waited too long.
+        uint64_t starvation_count;
+        uint32_t queue_depth;
+        uint32_t max_queue_depth;
+    };
+
+    explicit MagmaSystemScheduler(uint32_t starvation_ms = kDefaultStarvationMs)
+        : starvation_threshold_(std::chrono::milliseconds(starvation_ms))
+    {
+    }
+
+    // |client_id| groups the queues of one client, normally its connection, for round robin.
+    std::unique_ptr<Queue> CreateQueue(uint64_t client_id, Priority priority);
+
+    // Blocks until a submission of |cost| batch bytes on |queue| is admitted, then runs |submit|
+    // and returns its result.  Only one thread submits to a queue at a time.
+    magma_status_t Submit(Queue* queue, uint64_t cost,
+                          const std::function<magma_status_t()>& submit);
+
+    Stats stats()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+private:
+    struct Client {
+        uint64_t deficit = 0;
+        // Those of the client's queues with waiters, taken in turn.
+        std::deque<Queue*> queues;
+    };
+
+    struct PriorityClass {
+        // Clients with waiters, in round robin order.
+        std::deque<uint64_t> ring;
+        std::unordered_map<uint64_t, Client> clients;
+    };
+
+    // Admits the next submission; called with the lock held, the msd idle and waiters queued.
+    void AdmitNext();
+    Queue::Waiter* PickStarved(std::chrono::steady_clock::time_point now);
+    Queue::Waiter* PickDeficitRoundRobin(PriorityClass* priority_class);
+    void Dequeue(Queue* queue);
+
+    const std::chrono::steady_clock::duration starvation_threshold_;
+
+    std::mutex mutex_;
+    PriorityClass classes_[kPriorityCount];
+    bool busy_ = false;
+    Stats stats_ = {};
+
+    DISALLOW_COPY_AND_ASSIGN(MagmaSystemScheduler);
+};
+
+#endif // MAGMA_SYSTEM_SCHEDULER_H_
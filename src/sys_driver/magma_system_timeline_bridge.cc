@@ -0,0 +1,181 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_system_timeline_bridge.h"
+#include "magma_util/dlog.h"
+#include "platform_thread.h"
+#include "platform_trace.h"
+#include <algorithm>
+#include <chrono>
+
+std::unique_ptr<MagmaSystemTimelineBridge> MagmaSystemTimelineBridge::Create()
+{
+    auto port = magma::PlatformPort::Create();
+    if (!port)
+        return DRETP(nullptr, "failed to create port");
+
+    auto quit_semaphore = magma::PlatformSemaphore::Create();
+    if (!quit_semaphore)
+        return DRETP(nullptr, "failed to create quit semaphore");
+
+    if (!quit_semaphore->WaitAsync(port.get(), kQuitKey))
+        return DRETP(nullptr, "WaitAsync failed on quit semaphore");
+
+    return std::make_unique<MagmaSystemTimelineBridge>(std::move(port), std::move(quit_semaphore));
+}
+
+MagmaSystemTimelineBridge::MagmaSystemTimelineBridge(
+    std::unique_ptr<magma::PlatformPort> port,
+    std::unique_ptr<magma::PlatformSemaphore> quit_semaphore)
+    : port_(std::move(port)), quit_semaphore_(std::move(quit_semaphore))
+{
+    thread_ = std::thread([this] { Loop(); });
+}
+
+MagmaSystemTimelineBridge::~MagmaSystemTimelineBridge()
+{
+    quit_semaphore_->Signal();
+    thread_.join();
+}
+
+std::shared_ptr<MagmaSystemSemaphore>
+MagmaSystemTimelineBridge::WaitPoint(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline,
+                                     uint64_t value)
+{
+    return AddPoint(Point{std::move(timeline), value, nullptr, false});
+}
+
+std::shared_ptr<MagmaSystemSemaphore>
+MagmaSystemTimelineBridge::SignalPoint(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline,
+                                       uint64_t value)
+{
+    return AddPoint(Point{std::move(timeline), value, nullptr, true});
+}
+
+std::shared_ptr<MagmaSystemSemaphore> MagmaSystemTimelineBridge::AddPoint(Point point)
+{
+    point.semaphore = MagmaSystemSemaphore::Create(magma::PlatformSemaphore::Create());
+    if (!point.semaphore)
+        return DRETP(nullptr, "failed to create semaphore");
+
+    std::shared_ptr<MagmaSystemSemaphore> semaphore = point.semaphore;
+
+    // Arm under the lock so the loop can't see a packet for a key that isn't yet in the map.
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t key = next_key_++;
+    switch (Arm(key, &point)) {
+        case ArmResult::kArmed:
+            points_.insert(std::make_pair(key, std::move(point)));
+            break;
+        case ArmResult::kReached:
+            break;
+        case ArmResult::kFailed:
+            // Nothing would ever signal the semaphore or advance the timeline.
+            return DRETP(nullptr, "failed to arm timeline point");
+    }
+
+    return semaphore;
+}
+
+void MagmaSystemTimelineBridge::RemovePoints(
+    const std::vector<std::shared_ptr<MagmaSystemSemaphore>>& semaphores)
+{
+    // Any packet still due for a removed point finds no key and is ignored.
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto iter = points_.begin(); iter != points_.end();) {
+        bool remove = std::find(semaphores.begin(), semaphores.end(), iter->second.semaphore) !=
+                      semaphores.end();
+        iter = remove ? points_.erase(iter) : std::next(iter);
+    }
+}
+
+MagmaSystemTimelineBridge::ArmResult MagmaSystemTimelineBridge::Arm(uint64_t key, Point* point)
+{
+    if (point->signal) {
+        if (!point->semaphore->platform_semaphore()->WaitAsync(port_.get(), key)) {
+            DLOG("WaitAsync failed for signal point");
+            return ArmResult::kFailed;
+        }
+        return ArmResult::kArmed;
+    }
+
+    bool reached;
+    if (!point->timeline->WaitAsync(port_.get(), key, point->value, &reached)) {
+        DLOG("WaitAsync failed for wait point");
+        return ArmResult::kFailed;
+    }
+    if (!reached)
+        return ArmResult::kArmed;
+
+    point->semaphore->platform_semaphore()->Signal();
+    return ArmResult::kReached;
+}
+
+void MagmaSystemTimelineBridge::RecheckWaitPoints()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto iter = points_.begin(); iter != points_.end();) {
+        Point& point = iter->second;
+        bool reached = !point.signal && point.timeline->value() >= point.value;
+        if (reached)
+            point.semaphore->platform_semaphore()->Signal();
+        iter = reached ? points_.erase(iter) : std::next(iter);
+    }
+}
+
+uint32_t MagmaSystemTimelineBridge::MaxKeys()
+{
+    // At most one packet per point, plus the quit packet, can be queued.  Asking for no more lets
+    // WaitMany stop without a wait that would find the port empty, and a single outstanding point
+    // costs no more than a plain Wait.
+    std::unique_lock<std::mutex> lock(mutex_);
+    return std::min<size_t>(kMaxBatchSize, points_.size() + 1);
+}
+
+void MagmaSystemTimelineBridge::Loop()
+{
+    magma::PlatformThreadHelper::SetCurrentThreadName("TimelineBridge");
+
+    auto recheck_time = std::chrono::steady_clock::now();
+    while (true) {
+        // Packets arriving steadily mustn't postpone the recheck indefinitely.
+        auto now = std::chrono::steady_clock::now();
+        if (now - recheck_time >= std::chrono::milliseconds(kRecheckMs)) {
+            RecheckWaitPoints();
+            recheck_time = now;
+        }
+
+        uint64_t keys[kMaxBatchSize];
+        uint32_t count;
+        magma::Status status = port_->WaitMany(keys, MaxKeys(), &count, kRecheckMs);
+        if (status.get() == MAGMA_STATUS_TIMED_OUT)
+            continue;
+        if (!status) {
+            DLOG("port wait failed");
+            return;
+        }
+
+        TRACE_DURATION("magma:sync", "timeline bridge points", "count", count);
+
+        // Handle the whole burst under one lock acquisition.
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (uint32_t i = 0; i < count; i++) {
+            if (keys[i] == kQuitKey)
+                return;
+
+            auto iter = points_.find(keys[i]);
+            if (iter == points_.end())
+                continue;
+
+            // A wait point that can't be re-armed is kept for RecheckWaitPoints.
+            Point& point = iter->second;
+            if (point.signal) {
+                point.timeline->Signal(point.value);
+                points_.erase(iter);
+            } else if (Arm(keys[i], &point) == ArmResult::kReached) {
+                points_.erase(iter);
+            }
+        }
+    }
+}
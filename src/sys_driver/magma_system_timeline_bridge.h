@@ -0,0 +1,90 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_SYSTEM_TIMELINE_BRIDGE_H_
+#define MAGMA_SYSTEM_TIMELINE_BRIDGE_H_
+
+#include "magma_system_semaphore.h"
+#include "magma_util/macros.h"
+#include "platform_port.h"
+#include "platform_semaphore.h"
+#include "platform_timeline_semaphore.h"
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// The msd ABI only understands binary semaphores, so timeline points are presented to the msd as
+// binary semaphores which are signalled by, or which signal, a timeline semaphore.
+// A single thread services every outstanding point.  A wait point's async wait can miss a wakeup
+// if the timeline's signal ring wraps while it is being armed, so pending wait points are also
+// rechecked every |kRecheckMs|.
+class MagmaSystemTimelineBridge {
+public:
+    static std::unique_ptr<MagmaSystemTimelineBridge> Create();
+
+    MagmaSystemTimelineBridge(std::unique_ptr<magma::PlatformPort> port,
+                              std::unique_ptr<magma::PlatformSemaphore> quit_semaphore);
+
+    ~MagmaSystemTimelineBridge();
+
+    // Returns a semaphore which is signalled once |timeline| reaches |value|, or null if the
+    // point couldn't be armed.
+    std::shared_ptr<MagmaSystemSemaphore>
+    WaitPoint(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline, uint64_t value);
+
+    // Returns a semaphore which, once signalled, advances |timeline| to |value|, or null if the
+    // point couldn't be armed.
+    std::shared_ptr<MagmaSystemSemaphore>
+    SignalPoint(std::shared_ptr<magma::PlatformTimelineSemaphore> timeline, uint64_t value);
+
+    // Drops the points bridged by |semaphores|, for a submission that failed after bridging them.
+    void RemovePoints(const std::vector<std::shared_ptr<MagmaSystemSemaphore>>& semaphores);
+
+    uint32_t pending_count()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return points_.size();
+    }
+
+private:
+    struct Point {
+        std::shared_ptr<magma::PlatformTimelineSemaphore> timeline;
+        uint64_t value;
+        std::shared_ptr<MagmaSystemSemaphore> semaphore;
+        bool signal;
+    };
+
+    std::shared_ptr<MagmaSystemSemaphore> AddPoint(Point point);
+
+    enum class ArmResult { kArmed, kReached, kFailed };
+
+    // A wait point whose timeline has already reached its value is signalled rather than armed.
+    ArmResult Arm(uint64_t key, Point* point);
+
+    // Signals and drops the wait points whose timelines have reached their values.
+    void RecheckWaitPoints();
+
+    // Returns how many keys the loop should collect from one port wait.
+    uint32_t MaxKeys();
+
+    void Loop();
+
+    static constexpr uint64_t kQuitKey = 0;
+    static constexpr uint64_t kRecheckMs = 100;
+    static constexpr uint32_t kMaxBatchSize = 64;
+
+    std::unique_ptr<magma::PlatformPort> port_;
+    std::unique_ptr<magma::PlatformSemaphore> quit_semaphore_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    uint64_t next_key_ = kQuitKey + 1;
+    std::unordered_map<uint64_t, Point> points_;
+
+    DISALLOW_COPY_AND_ASSIGN(MagmaSystemTimelineBridge);
+};
+
+#endif // MAGMA_SYSTEM_TIMELINE_BRIDGE_H_
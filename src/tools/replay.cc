@@ -0,0 +1,81 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "replayer.h"
+
+// Replays a capture file against a device and writes a summary to stdout as JSON.
+
+namespace {
+
+constexpr const char* kDefaultDevice = "/dev/class/display/000";
+
+void Usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [--device=PATH] [--timing=fast|original] CAPTURE_FILE\n"
+            "  --device  magma device to replay against (default %s)\n"
+            "  --timing  replay as fast as possible (default), or keeping the captured\n"
+            "            intervals between calls\n",
+            name, kDefaultDevice);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* device = kDefaultDevice;
+    bool original_timing = false;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--device=", 9) == 0) {
+            device = arg + 9;
+        } else if (strcmp(arg, "--timing=fast") == 0) {
+            original_timing = false;
+        } else if (strcmp(arg, "--timing=original") == 0) {
+            original_timing = true;
+        } else if (arg[0] != '-' && !path) {
+            path = arg;
+        } else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!path) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return 1;
+    }
+
+    int fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", device);
+        fclose(file);
+        return 1;
+    }
+
+    int ret = 1;
+    {
+        Replayer replayer(fd, original_timing);
+        if (replayer.Run(file)) {
+            replayer.WriteJson(stdout, device);
+            ret = 0;
+        }
+    }
+
+    close(fd);
+    fclose(file);
+    return ret;
+}
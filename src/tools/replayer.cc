@@ -0,0 +1,647 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "replayer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "libmagma/magma_capture_format.h"
+
+using namespace magma_capture;
+
+namespace {
+
+// Waits the capturing process made on semaphores signalled outside the capture would otherwise
+// block forever.
+constexpr uint64_t kMaxWaitMs = 5000;
+
+using Clock = std::chrono::steady_clock;
+
+} // namespace
+
+bool Replayer::Run(FILE* file)
+{
+    FileHeader file_header;
+    if (fread(&file_header, sizeof(file_header), 1, file) != 1)
+        return DRETF(false, "failed to read file header");
+    if (file_header.magic != kMagic)
+        return DRETF(false, "not a capture file");
+    if (file_header.version != kVersion)
+        return DRETF(false, "unsupported capture version %u", file_header.version);
+
+    auto start = Clock::now();
+    RecordHeader header;
+    std::vector<uint8_t> payload;
+
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        payload.resize(header.size);
+        if (header.size && fread(payload.data(), header.size, 1, file) != 1)
+            return DRETF(false, "truncated record %" PRIu64, record_count_);
+
+        if (original_timing_)
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(header.timestamp_ns));
+
+        record_count_++;
+        captured_ns_ = header.timestamp_ns;
+        if (!Replay(header.type, payload)) {
+            fprintf(stderr, "skipped record %" PRIu64 " type %u\n", record_count_ - 1,
+                    header.type);
+            skipped_count_++;
+        }
+    }
+
+    elapsed_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start)
+                      .count();
+    return true;
+}
+
+bool Replayer::Replay(uint32_t type, const std::vector<uint8_t>& payload)
+{
+    switch (type) {
+        case kCreateConnection:
+            return CreateConnection(payload);
+        case kReleaseConnection: {
+            ConnectionRecord record;
+            if (!Payload(payload, &record))
+                return false;
+            ReleaseConnection(record.connection);
+            return true;
+        }
+        case kGetError: {
+            ErrorRecord record;
+            if (!Payload(payload, &record))
+                return false;
+            ReplayConnection* connection = FindConnection(record.connection);
+            if (!connection)
+                return false;
+            magma_status_t status = magma_get_error(connection->connection);
+            if (status != record.status)
+                fprintf(stderr, "get_error returned %d, captured %d\n", status, record.status);
+            return true;
+        }
+        case kCreateContext:
+        case kReleaseContext:
+            return ReplayContext(type, payload);
+        case kCreateBuffer:
+        case kImportBuffer:
+        case kReleaseBuffer:
+        case kMapBuffer:
+        case kUnmapBuffer:
+        case kWaitRendering:
+            return ReplayBuffer(type, payload);
+        case kMapBufferRange:
+        case kUnmapBufferRange:
+            return ReplayBufferRange(type, payload);
+        case kSubmitCommandBuffer:
+            return Submit(payload);
+        case kPageFlip:
+            return PageFlip(payload);
+        case kCreatePersistentCommandBuffer:
+        case kReleasePersistentCommandBuffer:
+            return ReplayPersistentCommandBuffer(type, payload);
+        case kSubmitPersistentCommandBuffer:
+            return SubmitPersistentCommandBuffer(payload);
+        case kCreateSemaphore:
+        case kImportSemaphore:
+        case kReleaseSemaphore:
+        case kSignalSemaphore:
+        case kResetSemaphore:
+        case kWaitSemaphore:
+            return ReplaySemaphore(type, payload);
+        case kNotCaptured: {
+            NotCapturedRecord record;
+            if (!Payload(payload, &record))
+                return false;
+            // Replay diverges from the capture from here on.
+            fprintf(stderr, "capture dropped a type %u call (%" PRIu64 " byte command buffer)\n",
+                    record.type, record.size);
+            return false;
+        }
+    }
+    return DRETF(false, "unknown record type %u", type);
+}
+
+ReplayConnection* Replayer::FindConnection(uint64_t id)
+{
+    auto iter = connections_.find(id);
+    if (iter == connections_.end())
+        return DRETP(nullptr, "unknown connection 0x%" PRIx64, id);
+    return iter->second.get();
+}
+
+ReplayConnection* Replayer::FindBufferOwner(uint64_t buffer_id)
+{
+    for (auto& iter : connections_) {
+        if (iter.second->buffers.count(buffer_id))
+            return iter.second.get();
+    }
+    return nullptr;
+}
+
+magma_semaphore_t Replayer::FindSemaphore(uint64_t semaphore_id)
+{
+    for (auto& iter : connections_) {
+        auto semaphore = iter.second->semaphores.find(semaphore_id);
+        if (semaphore != iter.second->semaphores.end())
+            return semaphore->second;
+    }
+    return 0;
+}
+
+bool Replayer::CreateConnection(const std::vector<uint8_t>& payload)
+{
+    ConnectionRecord record;
+    if (!Payload(payload, &record))
+        return false;
+
+    // The capturing process's connection may have been freed and its address reused.
+    if (connections_.count(record.connection))
+        ReleaseConnection(record.connection);
+
+    auto connection = std::make_unique<ReplayConnection>();
+    connection->connection = magma_create_connection(fd_, record.capabilities);
+    if (!connection->connection)
+        return DRETF(false, "failed to create connection");
+
+    connections_[record.connection] = std::move(connection);
+    return true;
+}
+
+void Replayer::ReleaseConnection(uint64_t id)
+{
+    auto iter = connections_.find(id);
+    if (iter == connections_.end())
+        return;
+
+    // Whatever the capturing process didn't release itself.
+    ReplayConnection* connection = iter->second.get();
+    for (auto& command_buffer : connection->persistent_command_buffers)
+        magma_release_persistent_command_buffer(connection->connection, command_buffer.second.id);
+    for (auto& buffer : connection->buffers)
+        magma_release_buffer(connection->connection, buffer.second);
+    for (auto& semaphore : connection->semaphores)
+        magma_release_semaphore(connection->connection, semaphore.second);
+    for (auto& context : connection->contexts)
+        magma_release_context(connection->connection, context.second);
+
+    magma_release_connection(connection->connection);
+    connections_.erase(iter);
+}
+
+bool Replayer::ReplayContext(uint32_t type, const std::vector<uint8_t>& payload)
+{
+    ContextRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+
+    if (type == kCreateContext) {
+        uint32_t context_id;
+        magma_create_context_with_priority(connection->connection, record.priority, &context_id);
+        connection->contexts[record.context_id] = context_id;
+        return true;
+    }
+
+    auto iter = connection->contexts.find(record.context_id);
+    if (iter == connection->contexts.end())
+        return DRETF(false, "unknown context %u", record.context_id);
+    magma_release_context(connection->connection, iter->second);
+    connection->contexts.erase(iter);
+    return true;
+}
+
+bool Replayer::ReplayBuffer(uint32_t type, const std::vector<uint8_t>& payload)
+{
+    BufferRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+
+    if (type == kCreateBuffer) {
+        uint64_t size;
+        magma_buffer_t buffer;
+        if (magma_create_buffer(connection->connection, record.size, &size, &buffer) !=
+            MAGMA_STATUS_OK)
+            return DRETF(false, "failed to create buffer");
+        connection->buffers[record.buffer_id] = buffer;
+        return true;
+    }
+
+    if (type == kImportBuffer)
+        return ImportBuffer(connection, record.buffer_id, record.size);
+
+    auto iter = connection->buffers.find(record.buffer_id);
+    if (iter == connection->buffers.end())
+        return DRETF(false, "unknown buffer 0x%" PRIx64, record.buffer_id);
+    magma_buffer_t buffer = iter->second;
+
+    switch (type) {
+        case kReleaseBuffer:
+            magma_release_buffer(connection->connection, buffer);
+            connection->buffers.erase(iter);
+            return true;
+        case kMapBuffer: {
+            void* addr;
+            return magma_map(connection->connection, buffer, &addr) == MAGMA_STATUS_OK;
+        }
+        case kUnmapBuffer:
+            return magma_unmap(connection->connection, buffer) == MAGMA_STATUS_OK;
+        case kWaitRendering:
+            magma_wait_rendering(connection->connection, buffer);
+            return true;
+    }
+    return false;
+}
+
+bool Replayer::ImportBuffer(ReplayConnection* connection, uint64_t buffer_id, uint64_t size)
+{
+    magma_buffer_t buffer;
+
+    ReplayConnection* owner = FindBufferOwner(buffer_id);
+    if (owner) {
+        uint32_t handle;
+        if (magma_export(owner->connection, owner->buffers[buffer_id], &handle) !=
+            MAGMA_STATUS_OK)
+            return DRETF(false, "failed to export buffer");
+        if (magma_import(connection->connection, handle, &buffer) != MAGMA_STATUS_OK)
+            return DRETF(false, "failed to import buffer");
+    } else {
+        // Exported by a process that wasn't captured; a buffer of the same size stands in.
+        uint64_t size_out;
+        if (magma_create_buffer(connection->connection, size, &size_out, &buffer) !=
+            MAGMA_STATUS_OK)
+            return DRETF(false, "failed to create buffer for import");
+    }
+
+    connection->buffers[buffer_id] = buffer;
+    return true;
+}
+
+bool Replayer::ReplayBufferRange(uint32_t type, const std::vector<uint8_t>& payload)
+{
+    BufferRangeRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+
+    auto iter = connection->buffers.find(record.buffer_id);
+    if (iter == connection->buffers.end())
+        return DRETF(false, "unknown buffer 0x%" PRIx64, record.buffer_id);
+
+    if (type == kMapBufferRange) {
+        void* addr;
+        return magma_map_range(connection->connection, iter->second, record.offset,
+                               record.length, record.flags, &addr) == MAGMA_STATUS_OK;
+    }
+    return magma_unmap_range(connection->connection, iter->second, record.offset,
+                             record.length) == MAGMA_STATUS_OK;
+}
+
+bool Replayer::ReplaySemaphore(uint32_t type, const std::vector<uint8_t>& payload)
+{
+    SemaphoreRecord record;
+    if (!Payload(payload, &record))
+        return false;
+
+    switch (type) {
+        case kCreateSemaphore:
+        case kImportSemaphore:
+        case kReleaseSemaphore: {
+            ReplayConnection* connection = FindConnection(record.connection);
+            if (!connection)
+                return false;
+            if (type == kImportSemaphore)
+                return ImportSemaphore(connection, record.semaphore_id);
+
+            if (type == kCreateSemaphore) {
+                magma_semaphore_t semaphore;
+                if (magma_create_semaphore(connection->connection, &semaphore) !=
+                    MAGMA_STATUS_OK)
+                    return DRETF(false, "failed to create semaphore");
+                connection->semaphores[record.semaphore_id] = semaphore;
+                return true;
+            }
+
+            auto iter = connection->semaphores.find(record.semaphore_id);
+            if (iter == connection->semaphores.end())
+                return DRETF(false, "unknown semaphore 0x%" PRIx64, record.semaphore_id);
+            magma_release_semaphore(connection->connection, iter->second);
+            connection->semaphores.erase(iter);
+            return true;
+        }
+    }
+
+    magma_semaphore_t semaphore = FindSemaphore(record.semaphore_id);
+    if (!semaphore)
+        return DRETF(false, "unknown semaphore 0x%" PRIx64, record.semaphore_id);
+
+    switch (type) {
+        case kSignalSemaphore:
+            magma_signal_semaphore(semaphore);
+            return true;
+        case kResetSemaphore:
+            magma_reset_semaphore(semaphore);
+            return true;
+        case kWaitSemaphore:
+            if (magma_wait_semaphore(semaphore, std::min(record.timeout_ms, kMaxWaitMs)) ==
+                MAGMA_STATUS_TIMED_OUT)
+                wait_timeout_count_++;
+            return true;
+    }
+    return false;
+}
+
+bool Replayer::ImportSemaphore(ReplayConnection* connection, uint64_t semaphore_id)
+{
+    magma_semaphore_t semaphore;
+
+    ReplayConnection* owner = nullptr;
+    for (auto& iter : connections_) {
+        if (iter.second->semaphores.count(semaphore_id))
+            owner = iter.second.get();
+    }
+
+    if (owner) {
+        uint32_t handle;
+        if (magma_export_semaphore(owner->connection, owner->semaphores[semaphore_id], &handle) !=
+            MAGMA_STATUS_OK)
+            return DRETF(false, "failed to export semaphore");
+        if (magma_import_semaphore(connection->connection, handle, &semaphore) != MAGMA_STATUS_OK)
+            return DRETF(false, "failed to import semaphore");
+    } else {
+        if (magma_create_semaphore(connection->connection, &semaphore) != MAGMA_STATUS_OK)
+            return DRETF(false, "failed to create semaphore for import");
+    }
+
+    connection->semaphores[semaphore_id] = semaphore;
+    return true;
+}
+
+bool Replayer::TranslateCommandBuffer(ReplayConnection* connection, uint8_t* command_buffer,
+                                      uint32_t size, uint64_t* batch_buffer_id_out)
+{
+    if (size < sizeof(magma_system_command_buffer))
+        return DRETF(false, "command buffer too small");
+    auto header = reinterpret_cast<magma_system_command_buffer*>(command_buffer);
+
+    if (header->wait_timeline_count || header->signal_timeline_count)
+        return DRETF(false, "timeline points aren't supported");
+
+    uint64_t semaphore_count =
+        static_cast<uint64_t>(header->wait_semaphore_count) + header->signal_semaphore_count;
+    uint64_t required = sizeof(*header) + semaphore_count * sizeof(uint64_t) +
+                        static_cast<uint64_t>(header->num_resources) *
+                            sizeof(magma_system_exec_resource);
+    if (required > size)
+        return DRETF(false, "command buffer truncated");
+    if (header->batch_buffer_resource_index >= header->num_resources)
+        return DRETF(false, "bad batch buffer resource index");
+
+    auto semaphore_ids = reinterpret_cast<uint64_t*>(header + 1);
+    for (uint64_t i = 0; i < semaphore_count; i++) {
+        auto iter = connection->semaphores.find(semaphore_ids[i]);
+        if (iter == connection->semaphores.end())
+            return DRETF(false, "unknown semaphore 0x%" PRIx64, semaphore_ids[i]);
+        semaphore_ids[i] = magma_get_semaphore_id(iter->second);
+    }
+
+    auto resources = reinterpret_cast<magma_system_exec_resource*>(semaphore_ids + semaphore_count);
+    for (uint32_t i = 0; i < header->num_resources; i++) {
+        auto iter = connection->buffers.find(resources[i].buffer_id);
+        if (iter == connection->buffers.end())
+            return DRETF(false, "unknown buffer 0x%" PRIx64, resources[i].buffer_id);
+        if (i == header->batch_buffer_resource_index)
+            *batch_buffer_id_out = resources[i].buffer_id;
+        resources[i].buffer_id = magma_get_buffer_id(iter->second);
+    }
+
+    return true;
+}
+
+bool Replayer::Submit(const std::vector<uint8_t>& payload)
+{
+    SubmitRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    if (payload.size() !=
+        sizeof(record) + static_cast<uint64_t>(record.command_buffer_size) + record.batch_size)
+        return DRETF(false, "bad submit record size");
+
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+    auto context = connection->contexts.find(record.context_id);
+    if (context == connection->contexts.end())
+        return DRETF(false, "unknown context %u", record.context_id);
+
+    std::vector<uint8_t> command_buffer_data(payload.begin() + sizeof(record),
+                                             payload.begin() + sizeof(record) +
+                                                 record.command_buffer_size);
+    uint64_t batch_buffer_id;
+    if (!TranslateCommandBuffer(connection, command_buffer_data.data(),
+                                command_buffer_data.size(), &batch_buffer_id))
+        return false;
+
+    const uint8_t* batch_data = payload.data() + sizeof(record) + record.command_buffer_size;
+    if (!WriteBatch(connection, connection->buffers[batch_buffer_id], record.batch_offset,
+                    record.batch_size, batch_data))
+        return false;
+
+    magma_buffer_t command_buffer;
+    if (!CreateCommandBuffer(connection, command_buffer_data, &command_buffer))
+        return false;
+
+    magma_submit_command_buffer(connection->connection, command_buffer, context->second);
+    submit_count_++;
+    return true;
+}
+
+bool Replayer::CreateCommandBuffer(ReplayConnection* connection, const std::vector<uint8_t>& data,
+                                   magma_buffer_t* command_buffer_out)
+{
+    magma_buffer_t command_buffer;
+    if (magma_create_command_buffer(connection->connection, data.size(), &command_buffer) !=
+        MAGMA_STATUS_OK)
+        return DRETF(false, "failed to create command buffer");
+
+    void* addr;
+    if (magma_map(connection->connection, command_buffer, &addr) != MAGMA_STATUS_OK) {
+        magma_release_command_buffer(connection->connection, command_buffer);
+        return DRETF(false, "failed to map command buffer");
+    }
+    memcpy(addr, data.data(), data.size());
+    magma_unmap(connection->connection, command_buffer);
+
+    *command_buffer_out = command_buffer;
+    return true;
+}
+
+bool Replayer::WriteBatch(ReplayConnection* connection, magma_buffer_t batch_buffer,
+                          uint64_t offset, uint32_t size, const uint8_t* data)
+{
+    if (!size)
+        return true;
+    if (offset + size > magma_get_buffer_size(batch_buffer))
+        return DRETF(false, "batch contents don't fit the batch buffer");
+
+    void* addr;
+    if (magma_map(connection->connection, batch_buffer, &addr) != MAGMA_STATUS_OK)
+        return DRETF(false, "failed to map batch buffer");
+    memcpy(static_cast<uint8_t*>(addr) + offset, data, size);
+    magma_unmap(connection->connection, batch_buffer);
+    return true;
+}
+
+bool Replayer::ReplayPersistentCommandBuffer(uint32_t type, const std::vector<uint8_t>& payload)
+{
+    PersistentCommandBufferRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    if (payload.size() != sizeof(record) + static_cast<uint64_t>(record.command_buffer_size))
+        return DRETF(false, "bad persistent command buffer record size");
+
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+
+    if (type == kReleasePersistentCommandBuffer) {
+        auto iter = connection->persistent_command_buffers.find(record.command_buffer_id);
+        if (iter == connection->persistent_command_buffers.end())
+            return DRETF(false, "unknown persistent command buffer %u", record.command_buffer_id);
+        magma_release_persistent_command_buffer(connection->connection, iter->second.id);
+        connection->persistent_command_buffers.erase(iter);
+        return true;
+    }
+
+    std::vector<uint8_t> command_buffer_data(payload.begin() + sizeof(record), payload.end());
+    uint64_t batch_buffer_id;
+    if (!TranslateCommandBuffer(connection, command_buffer_data.data(),
+                                command_buffer_data.size(), &batch_buffer_id))
+        return false;
+
+    magma_buffer_t command_buffer;
+    if (!CreateCommandBuffer(connection, command_buffer_data, &command_buffer))
+        return false;
+
+    // The driver keeps its own copy.
+    uint32_t command_buffer_id;
+    magma_status_t status = magma_create_persistent_command_buffer(
+        connection->connection, command_buffer, &command_buffer_id);
+    magma_release_command_buffer(connection->connection, command_buffer);
+    if (status != MAGMA_STATUS_OK)
+        return DRETF(false, "failed to create persistent command buffer");
+
+    connection->persistent_command_buffers[record.command_buffer_id] = {command_buffer_id,
+                                                                        batch_buffer_id};
+    return true;
+}
+
+bool Replayer::SubmitPersistentCommandBuffer(const std::vector<uint8_t>& payload)
+{
+    PersistentSubmitRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    uint64_t semaphore_count =
+        record.patched
+            ? static_cast<uint64_t>(record.wait_semaphore_count) + record.signal_semaphore_count
+            : 0;
+    if (payload.size() != sizeof(record) + semaphore_count * sizeof(uint64_t) + record.batch_size)
+        return DRETF(false, "bad persistent submit record size");
+
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+    auto context = connection->contexts.find(record.context_id);
+    if (context == connection->contexts.end())
+        return DRETF(false, "unknown context %u", record.context_id);
+    auto command_buffer = connection->persistent_command_buffers.find(record.command_buffer_id);
+    if (command_buffer == connection->persistent_command_buffers.end())
+        return DRETF(false, "unknown persistent command buffer %u", record.command_buffer_id);
+
+    std::vector<uint64_t> semaphore_ids(semaphore_count);
+    memcpy(semaphore_ids.data(), payload.data() + sizeof(record),
+           semaphore_count * sizeof(uint64_t));
+    for (uint64_t& id : semaphore_ids) {
+        auto iter = connection->semaphores.find(id);
+        if (iter == connection->semaphores.end())
+            return DRETF(false, "unknown semaphore 0x%" PRIx64, id);
+        id = magma_get_semaphore_id(iter->second);
+    }
+
+    if (record.batch_size) {
+        uint64_t batch_buffer_id = command_buffer->second.batch_buffer_id;
+        auto batch_buffer = connection->buffers.find(batch_buffer_id);
+        if (batch_buffer == connection->buffers.end())
+            return DRETF(false, "unknown buffer 0x%" PRIx64, batch_buffer_id);
+        if (!WriteBatch(connection, batch_buffer->second, record.batch_offset, record.batch_size,
+                        payload.data() + sizeof(record) + semaphore_count * sizeof(uint64_t)))
+            return false;
+    }
+
+    magma_system_command_buffer_patch patch = {record.batch_start_offset,
+                                               record.wait_semaphore_count,
+                                               record.signal_semaphore_count};
+    magma_submit_persistent_command_buffer(connection->connection, command_buffer->second.id,
+                                           context->second, record.patched ? &patch : nullptr,
+                                           semaphore_ids.data());
+    submit_count_++;
+    return true;
+}
+
+bool Replayer::PageFlip(const std::vector<uint8_t>& payload)
+{
+    PageFlipRecord record;
+    if (!Payload(payload, &record))
+        return false;
+    uint32_t semaphore_count = record.wait_semaphore_count + record.signal_semaphore_count;
+    if (payload.size() != sizeof(record) + semaphore_count * sizeof(uint64_t))
+        return DRETF(false, "bad page flip record size");
+
+    ReplayConnection* connection = FindConnection(record.connection);
+    if (!connection)
+        return false;
+    auto buffer = connection->buffers.find(record.buffer_id);
+    if (buffer == connection->buffers.end())
+        return DRETF(false, "unknown buffer 0x%" PRIx64, record.buffer_id);
+
+    std::vector<uint64_t> semaphore_ids(semaphore_count);
+    memcpy(semaphore_ids.data(), payload.data() + sizeof(record),
+           semaphore_count * sizeof(uint64_t));
+    semaphore_ids.push_back(record.buffer_presented_semaphore_id);
+
+    std::vector<magma_semaphore_t> semaphores;
+    for (uint64_t id : semaphore_ids) {
+        auto iter = connection->semaphores.find(id);
+        if (iter == connection->semaphores.end())
+            return DRETF(false, "unknown semaphore 0x%" PRIx64, id);
+        semaphores.push_back(iter->second);
+    }
+
+    return magma_display_page_flip(connection->connection, buffer->second,
+                                   record.wait_semaphore_count, semaphores.data(),
+                                   record.signal_semaphore_count,
+                                   semaphores.data() + record.wait_semaphore_count,
+                                   semaphores.back()) == MAGMA_STATUS_OK;
+}
+
+void Replayer::WriteJson(FILE* file, const char* device)
+{
+    double elapsed_s = elapsed_ns_ / 1e9;
+    fprintf(file,
+            "{\n  \"device\": \"%s\",\n  \"timing\": \"%s\",\n  \"records\": %" PRIu64
+            ",\n  \"skipped\": %" PRIu64 ",\n  \"submits\": %" PRIu64
+            ",\n  \"wait_timeouts\": %" PRIu64 ",\n  \"captured_ms\": %.3f,\n"
+            "  \"elapsed_ms\": %.3f,\n  \"submits_per_sec\": %.1f\n}\n",
+            device, original_timing_ ? "original" : "fast", record_count_, skipped_count_,
+            submit_count_, wait_timeout_count_, captured_ns_ / 1e6, elapsed_ns_ / 1e6,
+            elapsed_s > 0 ? submit_count_ / elapsed_s : 0.0);
+}
@@ -0,0 +1,107 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef MAGMA_REPLAYER_H_
+#define MAGMA_REPLAYER_H_
+
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+#include "magma.h"
+#include "magma_util/macros.h"
+
+// Feeds a file written by libmagma's capture mode (see MAGMA_CAPTURE_FILE) back through the ABI,
+// either as fast as possible or with the captured timing.  Objects are recreated as the records
+// are read and the ids in command buffers are translated to the new objects.  A summary can be
+// written as JSON, so runs against two sys drivers can be compared.
+
+struct ReplayPersistentCommandBuffer {
+    uint32_t id;
+    // The captured id, since submits rewrite the batch.
+    uint64_t batch_buffer_id;
+};
+
+struct ReplayConnection {
+    magma_connection_t* connection;
+    // Captured ids to replayed objects.
+    std::unordered_map<uint32_t, uint32_t> contexts;
+    std::unordered_map<uint64_t, magma_buffer_t> buffers;
+    std::unordered_map<uint64_t, magma_semaphore_t> semaphores;
+    std::unordered_map<uint32_t, ReplayPersistentCommandBuffer> persistent_command_buffers;
+};
+
+class Replayer {
+public:
+    Replayer(int fd, bool original_timing) : fd_(fd), original_timing_(original_timing) {}
+
+    ~Replayer()
+    {
+        while (!connections_.empty())
+            ReleaseConnection(connections_.begin()->first);
+    }
+
+    // Replays every record in |file|; returns false if it isn't a capture this can read.
+    bool Run(FILE* file);
+
+    void WriteJson(FILE* file, const char* device);
+
+    uint64_t record_count() { return record_count_; }
+    uint64_t skipped_count() { return skipped_count_; }
+    uint64_t submit_count() { return submit_count_; }
+
+private:
+    template <typename T> bool Payload(const std::vector<uint8_t>& payload, T* record_out)
+    {
+        if (payload.size() < sizeof(T))
+            return DRETF(false, "record too short: %zu", payload.size());
+        memcpy(record_out, payload.data(), sizeof(T));
+        return true;
+    }
+
+    bool Replay(uint32_t type, const std::vector<uint8_t>& payload);
+
+    ReplayConnection* FindConnection(uint64_t id);
+    // Searches every connection, since the capturing process may have shared the object.
+    ReplayConnection* FindBufferOwner(uint64_t buffer_id);
+    magma_semaphore_t FindSemaphore(uint64_t semaphore_id);
+
+    bool CreateConnection(const std::vector<uint8_t>& payload);
+    void ReleaseConnection(uint64_t id);
+    bool ReplayContext(uint32_t type, const std::vector<uint8_t>& payload);
+    bool ReplayBuffer(uint32_t type, const std::vector<uint8_t>& payload);
+    bool ImportBuffer(ReplayConnection* connection, uint64_t buffer_id, uint64_t size);
+    bool ReplayBufferRange(uint32_t type, const std::vector<uint8_t>& payload);
+    bool ReplaySemaphore(uint32_t type, const std::vector<uint8_t>& payload);
+    bool ImportSemaphore(ReplayConnection* connection, uint64_t semaphore_id);
+    bool Submit(const std::vector<uint8_t>& payload);
+    bool ReplayPersistentCommandBuffer(uint32_t type, const std::vector<uint8_t>& payload);
+    bool SubmitPersistentCommandBuffer(const std::vector<uint8_t>& payload);
+    // Rewrites the ids in a captured command buffer; returns the captured id of the batch buffer.
+    bool TranslateCommandBuffer(ReplayConnection* connection, uint8_t* command_buffer,
+                                uint32_t size, uint64_t* batch_buffer_id_out);
+    // Copies the captured |data| into a new command buffer.
+    bool CreateCommandBuffer(ReplayConnection* connection, const std::vector<uint8_t>& data,
+                             magma_buffer_t* command_buffer_out);
+    // Rewrites the batch with the captured contents, since the driver may have relocated it in
+    // place.
+    bool WriteBatch(ReplayConnection* connection, magma_buffer_t batch_buffer, uint64_t offset,
+                    uint32_t size, const uint8_t* data);
+    bool PageFlip(const std::vector<uint8_t>& payload);
+
+    int fd_;
+    bool original_timing_;
+    std::unordered_map<uint64_t, std::unique_ptr<ReplayConnection>> connections_;
+
+    uint64_t record_count_ = 0;
+    uint64_t skipped_count_ = 0;
+    uint64_t submit_count_ = 0;
+    uint64_t wait_timeout_count_ = 0;
+    uint64_t captured_ns_ = 0;
+    uint64_t elapsed_ns_ = 0;
+};
+
+#endif // MAGMA_REPLAYER_H_
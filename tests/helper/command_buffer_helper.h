@@ -54,6 +54,8 @@ public:
 
     msd_context_t* ctx() { return ctx_->msd_ctx(); }
     MagmaSystemDevice* dev() { return dev_.get(); }
+    std::shared_ptr<MagmaSystemDevice> shared_dev() { return dev_; }
+    MagmaSystemConnection* connection() { return connection_.get(); }
     magma::PlatformBuffer* buffer()
     {
         DASSERT(buffer_);
@@ -137,6 +139,8 @@ private:
         abi_cmd_buf()->num_resources = kNumResources;
         abi_cmd_buf()->wait_semaphore_count = kWaitSemaphoreCount;
         abi_cmd_buf()->signal_semaphore_count = kSignalSemaphoreCount;
+        abi_cmd_buf()->wait_timeline_count = 0;
+        abi_cmd_buf()->signal_timeline_count = 0;
 
         // batch buffer
         {
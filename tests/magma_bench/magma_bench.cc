@@ -0,0 +1,495 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "magma.h"
+#include "magma_util/macros.h"
+
+// Measures the client-visible cost of common operations through the full libmagma path, against
+// whichever driver serves the given device.  Results are written to stdout as JSON; progress and
+// errors go to stderr.
+
+namespace {
+
+constexpr const char* kDefaultDevice = "/dev/class/display/000";
+constexpr uint32_t kDefaultIterations = 1000;
+constexpr uint64_t kSemaphoreTimeoutMs = 1000;
+constexpr uint32_t kSubmitResourceCounts[] = {1, 16, 64};
+constexpr uint32_t kReleaseBufferCount = 10000;
+constexpr uint32_t kReleaseRounds = 10;
+
+// An end-of-batch instruction on Intel.
+constexpr uint32_t kBatchEnd = 0xA << 23;
+
+struct Result {
+    std::string name;
+    bool success;
+    uint32_t iterations;
+    double ops_per_sec;
+    double p50_us;
+    double p99_us;
+};
+
+using Clock = std::chrono::steady_clock;
+
+class Bench {
+public:
+    Bench(int fd, uint32_t iterations, const char* filter)
+        : fd_(fd), iterations_(iterations), filter_(filter)
+    {
+    }
+
+    ~Bench()
+    {
+        if (connection_)
+            magma_release_connection(connection_);
+        if (import_connection_)
+            magma_release_connection(import_connection_);
+    }
+
+    bool Init()
+    {
+        connection_ =
+            magma_create_connection(fd_, MAGMA_CAPABILITY_RENDERING | MAGMA_CAPABILITY_DISPLAY);
+        if (!connection_)
+            return DRETF(false, "failed to create connection");
+        import_connection_ = magma_create_connection(fd_, MAGMA_CAPABILITY_RENDERING);
+        if (!import_connection_)
+            return DRETF(false, "failed to create import connection");
+        return true;
+    }
+
+    void RunAll()
+    {
+        Run("create_release_buffer", [this](uint32_t) { return CreateReleaseBuffer(); });
+        RunExportImport();
+        for (uint32_t resource_count : kSubmitResourceCounts)
+            RunSubmit(resource_count);
+        RunSemaphorePingPong();
+        RunPageFlip();
+        RunReleaseManyBuffers();
+        Run("get_error", [this](uint32_t) {
+            return magma_get_error(connection_) == MAGMA_STATUS_OK;
+        });
+    }
+
+    void WriteJson(FILE* file, const char* device)
+    {
+        fprintf(file, "{\n  \"device\": \"%s\",\n  \"benchmarks\": [\n", device);
+        for (uint32_t i = 0; i < results_.size(); i++) {
+            const Result& result = results_[i];
+            fprintf(file, "    {\"name\": \"%s\", \"success\": %s", result.name.c_str(),
+                    result.success ? "true" : "false");
+            if (result.success) {
+                fprintf(file,
+                        ", \"iterations\": %u, \"ops_per_sec\": %.1f, \"p50_us\": %.2f, "
+                        "\"p99_us\": %.2f",
+                        result.iterations, result.ops_per_sec, result.p50_us, result.p99_us);
+            }
+            fprintf(file, "}%s\n", i + 1 < results_.size() ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+    }
+
+    bool all_succeeded()
+    {
+        return std::all_of(results_.begin(), results_.end(),
+                           [](const Result& result) { return result.success; });
+    }
+
+private:
+    bool Selected(const std::string& name)
+    {
+        return !filter_ || name.find(filter_) != std::string::npos;
+    }
+
+    // Times each of |iterations_| calls to |op|, after a tenth as many untimed warm up calls.
+    void Run(const std::string& name, std::function<bool(uint32_t)> op)
+    {
+        if (!Selected(name))
+            return;
+        fprintf(stderr, "running %s\n", name.c_str());
+
+        Result result{name, false, iterations_, 0, 0, 0};
+        for (uint32_t i = 0; i < iterations_ / 10; i++) {
+            if (!op(i)) {
+                fprintf(stderr, "%s failed during warm up\n", name.c_str());
+                results_.push_back(result);
+                return;
+            }
+        }
+
+        std::vector<double> latencies_us;
+        latencies_us.reserve(iterations_);
+        for (uint32_t i = 0; i < iterations_; i++) {
+            auto start = Clock::now();
+            bool success = op(i);
+            std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+            if (!success) {
+                fprintf(stderr, "%s failed at iteration %u\n", name.c_str(), i);
+                results_.push_back(result);
+                return;
+            }
+            latencies_us.push_back(elapsed.count());
+        }
+
+        Record(name, std::move(latencies_us));
+    }
+
+    void Record(const std::string& name, std::vector<double> latencies_us)
+    {
+        uint32_t iterations = latencies_us.size();
+        Result result{name, true, iterations, 0, 0, 0};
+        double total_us = 0;
+        for (double latency_us : latencies_us)
+            total_us += latency_us;
+
+        std::sort(latencies_us.begin(), latencies_us.end());
+        if (!latencies_us.empty()) {
+            result.ops_per_sec = total_us > 0 ? iterations * 1e6 / total_us : 0;
+            result.p50_us = Percentile(latencies_us, 50);
+            result.p99_us = Percentile(latencies_us, 99);
+        }
+        results_.push_back(result);
+    }
+
+    static double Percentile(const std::vector<double>& sorted, uint32_t percentile)
+    {
+        size_t index = (sorted.size() - 1) * percentile / 100;
+        return sorted[index];
+    }
+
+    bool CreateReleaseBuffer()
+    {
+        uint64_t size;
+        magma_buffer_t buffer;
+        if (magma_create_buffer(connection_, PAGE_SIZE, &size, &buffer) != MAGMA_STATUS_OK)
+            return false;
+        magma_release_buffer(connection_, buffer);
+        return true;
+    }
+
+    void RunExportImport()
+    {
+        if (!Selected("export_import"))
+            return;
+
+        uint64_t size;
+        magma_buffer_t buffer;
+        if (magma_create_buffer(connection_, PAGE_SIZE, &size, &buffer) != MAGMA_STATUS_OK)
+            return;
+
+        // A connection can't import a buffer it already has, so import into a second one.
+        Run("export_import", [this, buffer](uint32_t) {
+            uint32_t handle;
+            if (magma_export(connection_, buffer, &handle) != MAGMA_STATUS_OK)
+                return false;
+            magma_buffer_t imported;
+            if (magma_import(import_connection_, handle, &imported) != MAGMA_STATUS_OK)
+                return false;
+            magma_release_buffer(import_connection_, imported);
+            return true;
+        });
+
+        magma_release_buffer(connection_, buffer);
+    }
+
+    // Each iteration builds a command buffer referencing |resource_count| buffers, submits it
+    // and waits for it to complete.
+    void RunSubmit(uint32_t resource_count)
+    {
+        std::string name = "submit_" + std::to_string(resource_count) + "_resources";
+        if (!Selected(name))
+            return;
+
+        std::vector<magma_buffer_t> buffers(resource_count);
+        uint32_t created = 0;
+        for (; created < resource_count; created++) {
+            uint64_t size;
+            if (magma_create_buffer(connection_, PAGE_SIZE, &size, &buffers[created]) !=
+                MAGMA_STATUS_OK)
+                break;
+        }
+
+        uint32_t context_id;
+        magma_create_context(connection_, &context_id);
+
+        magma_semaphore_t semaphore;
+        bool ready = created == resource_count && InitBatchBuffer(buffers[0]) &&
+                     magma_create_semaphore(connection_, &semaphore) == MAGMA_STATUS_OK;
+
+        if (ready) {
+            Run(name, [this, &buffers, context_id, semaphore](uint32_t) {
+                if (!Submit(buffers, context_id, magma_get_semaphore_id(semaphore)))
+                    return false;
+                return magma_wait_semaphore(semaphore, kSemaphoreTimeoutMs) == MAGMA_STATUS_OK;
+            });
+            magma_release_semaphore(connection_, semaphore);
+        } else {
+            fprintf(stderr, "failed to set up %s\n", name.c_str());
+            results_.push_back(Result{name, false, 0, 0, 0, 0});
+        }
+
+        magma_release_context(connection_, context_id);
+        for (uint32_t i = 0; i < created; i++)
+            magma_release_buffer(connection_, buffers[i]);
+    }
+
+    bool InitBatchBuffer(magma_buffer_t buffer)
+    {
+        void* vaddr;
+        if (magma_map(connection_, buffer, &vaddr) != MAGMA_STATUS_OK)
+            return DRETF(false, "failed to map batch buffer");
+        memset(vaddr, 0, PAGE_SIZE);
+        *reinterpret_cast<uint32_t*>(vaddr) = kBatchEnd;
+        return magma_unmap(connection_, buffer) == MAGMA_STATUS_OK;
+    }
+
+    bool Submit(const std::vector<magma_buffer_t>& buffers, uint32_t context_id,
+                uint64_t signal_semaphore_id)
+    {
+        uint64_t size = sizeof(magma_system_command_buffer) + sizeof(uint64_t) +
+                        sizeof(magma_system_exec_resource) * buffers.size();
+
+        magma_buffer_t command_buffer;
+        if (magma_create_command_buffer(connection_, size, &command_buffer) != MAGMA_STATUS_OK)
+            return DRETF(false, "failed to create command buffer");
+
+        void* vaddr;
+        if (magma_map(connection_, command_buffer, &vaddr) != MAGMA_STATUS_OK) {
+            magma_release_command_buffer(connection_, command_buffer);
+            return DRETF(false, "failed to map command buffer");
+        }
+
+        auto header = reinterpret_cast<magma_system_command_buffer*>(vaddr);
+        header->batch_buffer_resource_index = 0;
+        header->batch_start_offset = 0;
+        header->num_resources = buffers.size();
+        header->wait_semaphore_count = 0;
+        header->signal_semaphore_count = 1;
+        header->wait_timeline_count = 0;
+        header->signal_timeline_count = 0;
+
+        auto signal_semaphore_ids = reinterpret_cast<uint64_t*>(header + 1);
+        signal_semaphore_ids[0] = signal_semaphore_id;
+
+        auto resources = reinterpret_cast<magma_system_exec_resource*>(signal_semaphore_ids + 1);
+        for (uint32_t i = 0; i < buffers.size(); i++) {
+            resources[i].buffer_id = magma_get_buffer_id(buffers[i]);
+            resources[i].num_relocations = 0;
+            resources[i].offset = 0;
+            resources[i].length = magma_get_buffer_size(buffers[i]);
+        }
+
+        if (magma_unmap(connection_, command_buffer) != MAGMA_STATUS_OK) {
+            magma_release_command_buffer(connection_, command_buffer);
+            return DRETF(false, "failed to unmap command buffer");
+        }
+
+        magma_submit_command_buffer(connection_, command_buffer, context_id);
+        return true;
+    }
+
+    // Each iteration is a round trip between two threads through a pair of semaphores.
+    void RunSemaphorePingPong()
+    {
+        if (!Selected("semaphore_ping_pong"))
+            return;
+
+        magma_semaphore_t ping, pong;
+        if (magma_create_semaphore(connection_, &ping) != MAGMA_STATUS_OK)
+            return;
+        if (magma_create_semaphore(connection_, &pong) != MAGMA_STATUS_OK) {
+            magma_release_semaphore(connection_, ping);
+            return;
+        }
+
+        // Both sides run the warm up iterations too.
+        uint32_t round_trips = iterations_ + iterations_ / 10;
+        std::thread ponger([ping, pong, round_trips] {
+            for (uint32_t i = 0; i < round_trips; i++) {
+                if (magma_wait_semaphore(ping, kSemaphoreTimeoutMs) != MAGMA_STATUS_OK)
+                    return;
+                magma_signal_semaphore(pong);
+            }
+        });
+
+        Run("semaphore_ping_pong", [ping, pong](uint32_t) {
+            magma_signal_semaphore(ping);
+            return magma_wait_semaphore(pong, kSemaphoreTimeoutMs) == MAGMA_STATUS_OK;
+        });
+
+        ponger.join();
+        magma_release_semaphore(connection_, ping);
+        magma_release_semaphore(connection_, pong);
+    }
+
+    // Each iteration flips to the other of two buffers and waits until it's presented.
+    void RunPageFlip()
+    {
+        if (!Selected("page_flip"))
+            return;
+
+        magma_display_size display_size;
+        if (magma_display_get_size(fd_, &display_size) != MAGMA_STATUS_OK) {
+            fprintf(stderr, "no display, skipping page_flip\n");
+            return;
+        }
+        uint64_t buffer_size = uint64_t(display_size.width) * display_size.height * 4;
+
+        magma_buffer_t buffers[2];
+        uint32_t created = 0;
+        for (; created < 2; created++) {
+            uint64_t size;
+            if (magma_create_buffer(connection_, buffer_size, &size, &buffers[created]) !=
+                MAGMA_STATUS_OK)
+                break;
+        }
+
+        magma_semaphore_t presented;
+        if (created == 2 && magma_create_semaphore(connection_, &presented) == MAGMA_STATUS_OK) {
+            Run("page_flip", [this, &buffers, presented](uint32_t i) {
+                if (magma_display_page_flip(connection_, buffers[i % 2], 0, nullptr, 0, nullptr,
+                                            presented) != MAGMA_STATUS_OK)
+                    return false;
+                return magma_wait_semaphore(presented, kSemaphoreTimeoutMs) == MAGMA_STATUS_OK;
+            });
+            magma_release_semaphore(connection_, presented);
+        } else {
+            results_.push_back(Result{"page_flip", false, 0, 0, 0, 0});
+        }
+
+        for (uint32_t i = 0; i < created; i++)
+            magma_release_buffer(connection_, buffers[i]);
+    }
+
+    // Each round fills a new connection with |kReleaseBufferCount| buffers, then times releasing
+    // them all and a round trip that waits for the driver to have freed them.
+    // Tearing down a connection that still holds its buffers is timed by the sys driver's
+    // TeardownBenchmark unit test instead, since a client can't see when that finishes.
+    void RunReleaseManyBuffers()
+    {
+        std::string name = "release_" + std::to_string(kReleaseBufferCount) + "_buffers";
+        if (!Selected(name))
+            return;
+        fprintf(stderr, "running %s\n", name.c_str());
+
+        std::vector<double> latencies_us;
+        std::vector<magma_buffer_t> buffers(kReleaseBufferCount);
+        for (uint32_t round = 0; round < kReleaseRounds; round++) {
+            magma_connection_t* connection =
+                magma_create_connection(fd_, MAGMA_CAPABILITY_RENDERING);
+            if (!connection) {
+                fprintf(stderr, "failed to create connection for %s\n", name.c_str());
+                results_.push_back(Result{name, false, 0, 0, 0, 0});
+                return;
+            }
+            bool success = true;
+            for (uint32_t i = 0; i < kReleaseBufferCount && success; i++) {
+                uint64_t size;
+                success =
+                    magma_create_buffer(connection, PAGE_SIZE, &size, &buffers[i]) ==
+                    MAGMA_STATUS_OK;
+            }
+            // Make sure the imports have reached the driver before timing their release.
+            success = success && magma_get_error(connection) == MAGMA_STATUS_OK;
+            if (!success) {
+                fprintf(stderr, "failed to set up %s\n", name.c_str());
+                magma_release_connection(connection);
+                results_.push_back(Result{name, false, 0, 0, 0, 0});
+                return;
+            }
+
+            auto start = Clock::now();
+            for (magma_buffer_t buffer : buffers)
+                magma_release_buffer(connection, buffer);
+            success = magma_get_error(connection) == MAGMA_STATUS_OK;
+            std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+
+            magma_release_connection(connection);
+            if (!success) {
+                fprintf(stderr, "%s failed in round %u\n", name.c_str(), round);
+                results_.push_back(Result{name, false, 0, 0, 0, 0});
+                return;
+            }
+            latencies_us.push_back(elapsed.count());
+        }
+
+        Record(name, std::move(latencies_us));
+    }
+
+    int fd_;
+    uint32_t iterations_;
+    const char* filter_;
+    magma_connection_t* connection_ = nullptr;
+    magma_connection_t* import_connection_ = nullptr;
+    std::vector<Result> results_;
+};
+
+void Usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [--device=PATH] [--iterations=N] [--filter=SUBSTRING]\n"
+            "  --device      magma device to benchmark (default %s)\n"
+            "  --iterations  timed iterations per benchmark (default %u)\n"
+            "  --filter      run only benchmarks whose names contain SUBSTRING\n",
+            name, kDefaultDevice, kDefaultIterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* device = kDefaultDevice;
+    uint32_t iterations = kDefaultIterations;
+    const char* filter = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--device=", 9) == 0) {
+            device = arg + 9;
+        } else if (strncmp(arg, "--iterations=", 13) == 0) {
+            iterations = strtoul(arg + 13, nullptr, 0);
+        } else if (strncmp(arg, "--filter=", 9) == 0) {
+            filter = arg + 9;
+        } else {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", device);
+        return 1;
+    }
+
+    int ret = 1;
+    {
+        Bench bench(fd, iterations, filter);
+        if (bench.Init()) {
+            bench.RunAll();
+            bench.WriteJson(stdout, device);
+            ret = bench.all_succeeded() ? 0 : 1;
+        }
+    }
+
+    close(fd);
+    return ret;
+}
@@ -7,11 +7,13 @@
 #include "magma_util/macros.h"
 #include "platform_buffer.h"
 #include "platform_semaphore.h"
+#include "platform_timeline_semaphore.h"
 
 #include <unordered_map>
 
 std::unordered_map<uint32_t, magma::PlatformBuffer*> exported_buffers;
 std::unordered_map<uint32_t, magma::PlatformSemaphore*> exported_semaphores;
+std::unordered_map<uint32_t, magma::PlatformTimelineSemaphore*> exported_timeline_semaphores;
 
 class MockConnection : public magma_connection_t {
 public:
@@ -46,11 +48,28 @@ magma_status_t magma_query(int32_t fd, uint64_t id, uint64_t* value_out)
     return MAGMA_STATUS_INVALID_ARGS;
 }
 
+magma_status_t magma_query_batch(int32_t fd, const uint64_t* ids, uint32_t count,
+                                 uint64_t* values_out)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        magma_status_t status = magma_query(fd, ids[i], &values_out[i]);
+        if (status != MAGMA_STATUS_OK)
+            return status;
+    }
+    return MAGMA_STATUS_OK;
+}
+
 void magma_create_context(magma_connection_t* connection, uint32_t* context_id_out)
 {
     *context_id_out = static_cast<MockConnection*>(connection)->next_context_id();
 }
 
+void magma_create_context_with_priority(magma_connection_t* connection, uint32_t priority,
+                                        uint32_t* context_id_out)
+{
+    magma_create_context(connection, context_id_out);
+}
+
 void magma_release_context(magma_connection_t* connection, uint32_t context_id) {}
 
 magma_status_t magma_create_buffer(magma_connection_t* connection, uint64_t size,
@@ -91,6 +110,39 @@ magma_status_t magma_unmap(magma_connection_t* connection, magma_buffer_t buffer
     return MAGMA_STATUS_OK;
 }
 
+magma_status_t magma_map_range(magma_connection_t* connection, magma_buffer_t buffer,
+                               uint64_t offset, uint64_t length, uint32_t flags, void** addr_out)
+{
+    if (flags & ~(MAGMA_MAP_FLAG_READ_ONLY | MAGMA_MAP_FLAG_WRITE_COMBINED))
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "invalid flags 0x%x", flags);
+
+    uint32_t platform_flags = 0;
+    if (flags & MAGMA_MAP_FLAG_READ_ONLY)
+        platform_flags |= magma::PlatformBuffer::kMapReadOnly;
+    if (flags & MAGMA_MAP_FLAG_WRITE_COMBINED)
+        platform_flags |= magma::PlatformBuffer::kMapWriteCombined;
+
+    if (!reinterpret_cast<magma::PlatformBuffer*>(buffer)->MapCpuRange(offset, length,
+                                                                        platform_flags, addr_out))
+        return MAGMA_STATUS_MEMORY_ERROR;
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_unmap_range(magma_connection_t* connection, magma_buffer_t buffer,
+                                 uint64_t offset, uint64_t length)
+{
+    if (!reinterpret_cast<magma::PlatformBuffer*>(buffer)->UnmapCpuRange(offset, length))
+        return MAGMA_STATUS_MEMORY_ERROR;
+    return MAGMA_STATUS_OK;
+}
+
+void magma_set_mapping_cache_budget(uint64_t budget_bytes) {}
+
+void magma_get_mapping_cache_stats(magma_mapping_cache_stats* stats_out)
+{
+    *stats_out = magma_mapping_cache_stats{};
+}
+
 magma_status_t magma_create_command_buffer(magma_connection_t* connection, uint64_t size,
                                            magma_buffer_t* buffer_out)
 {
@@ -110,6 +162,28 @@ void magma_submit_command_buffer(struct magma_connection_t* connection, uint64_t
     DLOG("magma_system submit command buffer - STUB");
 }
 
+magma_status_t magma_create_persistent_command_buffer(magma_connection_t* connection,
+                                                      magma_buffer_t command_buffer,
+                                                      uint32_t* command_buffer_id_out)
+{
+    DLOG("magma_system create persistent command buffer - STUB");
+    *command_buffer_id_out = 0;
+    return MAGMA_STATUS_OK;
+}
+
+void magma_release_persistent_command_buffer(magma_connection_t* connection,
+                                             uint32_t command_buffer_id)
+{
+}
+
+void magma_submit_persistent_command_buffer(magma_connection_t* connection,
+                                            uint32_t command_buffer_id, uint32_t context_id,
+                                            const magma_system_command_buffer_patch* patch,
+                                            const uint64_t* semaphore_ids)
+{
+    DLOG("magma_system submit persistent command buffer - STUB");
+}
+
 void magma_wait_rendering(magma_connection_t* connection, uintptr_t buffer) {}
 
 magma_status_t magma_export(magma_connection_t* connection, magma_buffer_t buffer,
@@ -158,6 +232,16 @@ magma_status_t magma_display_page_flip(magma_connection_t* connection, uint64_t
     return MAGMA_STATUS_OK;
 }
 
+magma_status_t magma_display_page_flip_timeline(
+    magma_connection_t* connection, magma_buffer_t buffer, uint32_t wait_semaphore_count,
+    const magma_semaphore_t* wait_semaphores, uint32_t signal_semaphore_count,
+    const magma_semaphore_t* signal_semaphores, uint32_t wait_point_count,
+    const magma_system_timeline_point* wait_points, uint32_t signal_point_count,
+    const magma_system_timeline_point* signal_points, magma_semaphore_t buffer_presented_semaphore)
+{
+    return MAGMA_STATUS_OK;
+}
+
 magma_status_t magma_create_semaphore(magma_connection_t* connection,
                                       magma_semaphore_t* semaphore_out)
 {
@@ -202,3 +286,61 @@ magma_status_t magma_import_semaphore(magma_connection_t* connection, uint32_t s
     exported_semaphores.erase(semaphore_handle);
     return MAGMA_STATUS_OK;
 }
+
+magma_status_t magma_create_timeline_semaphore(magma_connection_t* connection,
+                                               uint64_t initial_value,
+                                               magma_timeline_semaphore_t* semaphore_out)
+{
+    *semaphore_out = reinterpret_cast<magma_timeline_semaphore_t>(
+        magma::PlatformTimelineSemaphore::Create(initial_value).release());
+    return MAGMA_STATUS_OK;
+}
+
+void magma_release_timeline_semaphore(magma_connection_t* connection,
+                                      magma_timeline_semaphore_t semaphore)
+{
+    delete reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore);
+}
+
+uint64_t magma_get_timeline_semaphore_id(magma_timeline_semaphore_t semaphore)
+{
+    return reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->id();
+}
+
+uint64_t magma_get_timeline_semaphore_value(magma_timeline_semaphore_t semaphore)
+{
+    return reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->value();
+}
+
+void magma_signal_timeline_semaphore(magma_timeline_semaphore_t semaphore, uint64_t value) {}
+
+magma_status_t magma_wait_timeline_semaphore(magma_timeline_semaphore_t semaphore, uint64_t value,
+                                             uint64_t timeout)
+{
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_export_timeline_semaphore(magma_connection_t* connection,
+                                               magma_timeline_semaphore_t semaphore,
+                                               uint32_t* memory_handle_out,
+                                               uint32_t* event_handle_out)
+{
+    uint32_t memory_handle, event_handle;
+    reinterpret_cast<magma::PlatformTimelineSemaphore*>(semaphore)->duplicate_handles(
+        &memory_handle, &event_handle);
+    exported_timeline_semaphores[memory_handle] =
+        magma::PlatformTimelineSemaphore::Import(memory_handle, event_handle).release();
+    *memory_handle_out = memory_handle;
+    *event_handle_out = event_handle;
+    return MAGMA_STATUS_OK;
+}
+
+magma_status_t magma_import_timeline_semaphore(magma_connection_t* connection,
+                                               uint32_t memory_handle, uint32_t event_handle,
+                                               magma_timeline_semaphore_t* semaphore_out)
+{
+    *semaphore_out =
+        reinterpret_cast<magma_timeline_semaphore_t>(exported_timeline_semaphores[memory_handle]);
+    exported_timeline_semaphores.erase(memory_handle);
+    return MAGMA_STATUS_OK;
+}
@@ -53,9 +53,11 @@ magma_status_t msd_device_query(msd_device_t* device, uint64_t id, uint64_t* val
     return MAGMA_STATUS_INVALID_ARGS;
 }
 
-msd_context_t* msd_connection_create_context(msd_connection_t* dev)
+msd_context_t* msd_connection_create_context(msd_connection_t* dev, uint32_t priority)
 {
-    return MsdMockConnection::cast(dev)->CreateContext();
+    MsdMockContext* context = MsdMockConnection::cast(dev)->CreateContext();
+    context->set_priority(priority);
+    return context;
 }
 
 void msd_connection_present_buffer(msd_connection_t* abi_connection, msd_buffer_t* abi_buffer,
@@ -64,7 +66,8 @@ void msd_connection_present_buffer(msd_connection_t* abi_connection, msd_buffer_
                                    msd_semaphore_t** semaphores,
                                    msd_present_buffer_callback_t callback, void* callback_data)
 {
-    static std::vector<magma::PlatformSemaphore*> last_semaphores;
+    // Clones, because the semaphores may be released before the next present.
+    static std::vector<std::unique_ptr<magma::PlatformSemaphore>> last_semaphores;
 
     for (uint32_t i = 0; i < last_semaphores.size(); i++) {
         last_semaphores[i]->Signal();
@@ -77,16 +80,24 @@ void msd_connection_present_buffer(msd_connection_t* abi_connection, msd_buffer_
 
     for (uint32_t i = wait_semaphore_count; i < wait_semaphore_count + signal_semaphore_count;
          i++) {
-        last_semaphores.push_back(reinterpret_cast<magma::PlatformSemaphore*>(semaphores[i]));
+        last_semaphores.push_back(
+            reinterpret_cast<magma::PlatformSemaphore*>(semaphores[i])->Clone());
     }
 }
 
 magma_status_t msd_connection_wait_rendering(struct msd_connection_t* connection,
                                              struct msd_buffer_t* buf)
 {
+    if (MsdMockConnection::cast(connection)->waits_cancelled())
+        return MAGMA_STATUS_CONNECTION_LOST;
     return MAGMA_STATUS_OK;
 }
 
+void msd_connection_cancel_waits(struct msd_connection_t* connection)
+{
+    MsdMockConnection::cast(connection)->CancelWaits();
+}
+
 void msd_context_destroy(msd_context_t* ctx) { delete MsdMockContext::cast(ctx); }
 
 msd_buffer_t* msd_buffer_import(uint32_t handle)
@@ -115,6 +126,10 @@ magma_status_t msd_context_execute_command_buffer(msd_context_t* ctx, msd_buffer
 
 void msd_context_release_buffer(msd_context_t* context, msd_buffer_t* buffer) {}
 
+void msd_context_release_buffers(msd_context_t* context, msd_buffer_t** buffers, uint32_t count)
+{
+}
+
 void MsdMockBufferManager::SetTestBufferManager(std::unique_ptr<MsdMockBufferManager> bufmgr)
 {
     g_bufmgr = std::move(bufmgr);
@@ -9,6 +9,7 @@
 #include "magma_util/macros.h"
 #include "msd.h"
 #include "platform_buffer.h"
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -55,6 +56,9 @@ public:
     MsdMockContext(MsdMockConnection* connection) : connection_(connection) { magic_ = kMagic; }
     virtual ~MsdMockContext();
 
+    uint32_t priority() { return priority_; }
+    void set_priority(uint32_t priority) { priority_ = priority; }
+
     magma_status_t ExecuteCommandBuffer(msd_buffer_t* cmd_buf_in, msd_buffer_t** exec_resources)
     {
         auto cmd_buf = MsdMockCommandBuffer(MsdMockBuffer::cast(cmd_buf_in));
@@ -64,6 +68,10 @@ public:
         for (uint32_t i = 0; i < cmd_buf.num_resources(); i++) {
             last_submitted_exec_resources_.push_back(MsdMockBuffer::cast(exec_resources[i]));
         }
+        last_submitted_command_buffer_ = MsdMockBuffer::cast(cmd_buf_in);
+        last_submitted_batch_start_offset_ = cmd_buf.batch_start_offset();
+        last_submitted_semaphore_count_ =
+            cmd_buf.wait_semaphore_count() + cmd_buf.signal_semaphore_count();
         return MAGMA_STATUS_OK;
     }
 
@@ -79,8 +87,16 @@ public:
         return last_submitted_exec_resources_;
     }
 
+    MsdMockBuffer* last_submitted_command_buffer() { return last_submitted_command_buffer_; }
+    uint32_t last_submitted_batch_start_offset() { return last_submitted_batch_start_offset_; }
+    uint32_t last_submitted_semaphore_count() { return last_submitted_semaphore_count_; }
+
 private:
     std::vector<MsdMockBuffer*> last_submitted_exec_resources_;
+    MsdMockBuffer* last_submitted_command_buffer_ = nullptr;
+    uint32_t last_submitted_batch_start_offset_ = 0;
+    uint32_t last_submitted_semaphore_count_ = 0;
+    uint32_t priority_ = MAGMA_CONTEXT_PRIORITY_NORMAL;
 
     MsdMockConnection* connection_;
     static const uint32_t kMagic = 0x6d6b6378; // "mkcx" (Mock Context)
@@ -95,6 +111,10 @@ public:
 
     virtual void DestroyContext(MsdMockContext* ctx) {}
 
+    // Waits return immediately, so cancelling only has to fail the later ones.
+    void CancelWaits() { waits_cancelled_ = true; }
+    bool waits_cancelled() { return waits_cancelled_; }
+
     static MsdMockConnection* cast(msd_connection_t* connection)
     {
         DASSERT(connection);
@@ -103,6 +123,8 @@ public:
     }
 
 private:
+    std::atomic_bool waits_cancelled_{false};
+
     static const uint32_t kMagic = 0x6d6b636e; // "mkcn" (Mock Connection)
 };
 
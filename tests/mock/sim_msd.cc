@@ -0,0 +1,355 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sim_msd.h"
+#include "magma_util/command_buffer.h"
+#include "platform_thread.h"
+#include "platform_trace.h"
+#include <algorithm>
+
+static std::mutex g_config_mutex;
+static MsdSimConfig g_config;
+
+// Semaphore waits are polled so engines can shut down while a batch is blocked.
+static constexpr uint64_t kSemaphorePollMs = 100;
+
+class MsdSimCommandBuffer : public magma::CommandBuffer {
+public:
+    MsdSimCommandBuffer(MsdSimBuffer* buffer) : buffer_(buffer) {}
+
+    magma::PlatformBuffer* platform_buffer() override { return buffer_->platform_buffer(); }
+
+private:
+    MsdSimBuffer* buffer_;
+};
+
+void MsdSimDriver::SetConfig(const MsdSimConfig& config)
+{
+    std::unique_lock<std::mutex> lock(g_config_mutex);
+    g_config = config;
+}
+
+MsdSimConfig MsdSimDriver::GetConfig()
+{
+    std::unique_lock<std::mutex> lock(g_config_mutex);
+    return g_config;
+}
+
+MsdSimEngine::MsdSimEngine(MsdSimDevice* device, uint32_t index)
+    : device_(device), random_(index + 1)
+{
+    thread_ = std::thread([this] { Loop(); });
+}
+
+MsdSimEngine::~MsdSimEngine()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        quit_ = true;
+    }
+    job_queued_.notify_all();
+    thread_.join();
+}
+
+void MsdSimEngine::Submit(Batch batch)
+{
+    const MsdSimConfig& config = device_->config();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [this, &config] { return outstanding_count_ < config.queue_depth; });
+
+    int64_t execution_time_us = config.execution_time_us;
+    if (config.jitter_us) {
+        std::uniform_int_distribution<int64_t> jitter(-int64_t(config.jitter_us),
+                                                      config.jitter_us);
+        execution_time_us = std::max<int64_t>(0, execution_time_us + jitter(random_));
+    }
+
+    device_->Submitted(batch.buffer_ids);
+    outstanding_count_++;
+    auto iter = std::find_if(queue_.begin(), queue_.end(), [&batch](const Job& job) {
+        return job.batch.priority < batch.priority;
+    });
+    queue_.insert(iter, Job{std::move(batch), std::chrono::microseconds(execution_time_us)});
+    lock.unlock();
+
+    job_queued_.notify_one();
+}
+
+bool MsdSimEngine::WaitSemaphores(Job* job)
+{
+    for (auto& semaphore : job->batch.wait_semaphores) {
+        while (!semaphore->Wait(kSemaphorePollMs)) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (quit_)
+                return false;
+        }
+    }
+    return true;
+}
+
+void MsdSimEngine::Loop()
+{
+    magma::PlatformThreadHelper::SetCurrentThreadName("SimEngine");
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_queued_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+            if (quit_)
+                return;
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        if (!WaitSemaphores(&job))
+            return;
+
+        {
+            TRACE_DURATION("magma", "SimEngine execute");
+            std::this_thread::sleep_for(job.execution_time);
+        }
+
+        for (auto& semaphore : job.batch.signal_semaphores) {
+            semaphore->Signal();
+        }
+        device_->Completed(job.batch.buffer_ids);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            outstanding_count_--;
+        }
+        job_done_.notify_all();
+    }
+}
+
+magma_status_t MsdSimContext::ExecuteCommandBuffer(msd_buffer_t* cmd_buf_in,
+                                                   msd_buffer_t** exec_resources,
+                                                   msd_semaphore_t** wait_semaphores,
+                                                   msd_semaphore_t** signal_semaphores)
+{
+    auto cmd_buf = MsdSimCommandBuffer(MsdSimBuffer::cast(cmd_buf_in));
+    if (!cmd_buf.Initialize())
+        return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to Initialize command buffer");
+
+    // Clones, because the semaphores may be released before the batch completes.
+    MsdSimEngine::Batch batch;
+    for (uint32_t i = 0; i < cmd_buf.wait_semaphore_count(); i++) {
+        auto semaphore =
+            reinterpret_cast<magma::PlatformSemaphore*>(wait_semaphores[i])->Clone();
+        if (!semaphore)
+            return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to clone wait semaphore");
+        batch.wait_semaphores.push_back(std::move(semaphore));
+    }
+    for (uint32_t i = 0; i < cmd_buf.signal_semaphore_count(); i++) {
+        auto semaphore =
+            reinterpret_cast<magma::PlatformSemaphore*>(signal_semaphores[i])->Clone();
+        if (!semaphore)
+            return DRET_MSG(MAGMA_STATUS_INTERNAL_ERROR, "failed to clone signal semaphore");
+        batch.signal_semaphores.push_back(std::move(semaphore));
+    }
+    for (uint32_t i = 0; i < cmd_buf.num_resources(); i++) {
+        batch.buffer_ids.push_back(MsdSimBuffer::cast(exec_resources[i])->id());
+    }
+    batch.priority = priority_;
+
+    engine_->Submit(std::move(batch));
+    return MAGMA_STATUS_OK;
+}
+
+MsdSimDevice::MsdSimDevice(const MsdSimConfig& config) : config_(config)
+{
+    magic_ = kMagic;
+
+    config_.queue_depth = std::max(1u, config_.queue_depth);
+    config_.engine_count = std::max(1u, config_.engine_count);
+    for (uint32_t i = 0; i < config_.engine_count; i++) {
+        engines_.push_back(std::make_unique<MsdSimEngine>(this, i));
+    }
+}
+
+MsdSimEngine* MsdSimDevice::NextEngine()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    MsdSimEngine* engine = engines_[next_engine_].get();
+    next_engine_ = (next_engine_ + 1) % engines_.size();
+    return engine;
+}
+
+bool MsdSimDevice::WaitRendering(MsdSimConnection* connection, uint64_t buffer_id)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    buffer_idle_.wait(lock, [this, connection, buffer_id] {
+        return connection->waits_cancelled() ||
+               pending_buffers_.find(buffer_id) == pending_buffers_.end();
+    });
+    return !connection->waits_cancelled();
+}
+
+void MsdSimDevice::CancelWaits(MsdSimConnection* connection)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        connection->set_waits_cancelled();
+    }
+    buffer_idle_.notify_all();
+}
+
+void MsdSimDevice::Submitted(const std::vector<uint64_t>& buffer_ids)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    submitted_count_++;
+    for (uint64_t id : buffer_ids) {
+        pending_buffers_[id]++;
+    }
+}
+
+void MsdSimDevice::Completed(const std::vector<uint64_t>& buffer_ids)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        completed_count_++;
+        for (uint64_t id : buffer_ids) {
+            auto iter = pending_buffers_.find(id);
+            DASSERT(iter != pending_buffers_.end());
+            if (--iter->second == 0)
+                pending_buffers_.erase(iter);
+        }
+    }
+    buffer_idle_.notify_all();
+}
+
+void MsdSimDevice::DumpStatus()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    printf("sim msd: %u engines, queue depth %u, execution time %u us, jitter %u us\n",
+           config_.engine_count, config_.queue_depth, config_.execution_time_us,
+           config_.jitter_us);
+    printf("submitted %" PRIu64 " completed %" PRIu64 " pending buffers %zu\n", submitted_count_,
+           completed_count_, pending_buffers_.size());
+    for (uint32_t i = 0; i < engines_.size(); i++) {
+        printf("engine %u outstanding %u\n", i, engines_[i]->outstanding_count());
+    }
+}
+
+struct msd_driver_t* msd_driver_create(void) { return new MsdSimDriver(); }
+
+void msd_driver_configure(struct msd_driver_t* drv, uint32_t flags) {}
+
+void msd_driver_destroy(msd_driver_t* drv) { delete MsdSimDriver::cast(drv); }
+
+msd_device_t* msd_driver_create_device(msd_driver_t* drv, void* device)
+{
+    // There's no hardware, so |device| is ignored.
+    return new MsdSimDevice(MsdSimDriver::GetConfig());
+}
+
+void msd_device_destroy(msd_device_t* dev) { delete MsdSimDevice::cast(dev); }
+
+magma_status_t msd_device_display_get_size(struct msd_device_t* dev,
+                                           struct magma_display_size* size_out)
+{
+    return MAGMA_STATUS_INTERNAL_ERROR;
+}
+
+msd_connection_t* msd_device_open(msd_device_t* dev, msd_client_id_t client_id)
+{
+    return new MsdSimConnection(MsdSimDevice::cast(dev));
+}
+
+void msd_connection_close(msd_connection_t* connection)
+{
+    delete MsdSimConnection::cast(connection);
+}
+
+uint32_t msd_device_get_id(msd_device_t* dev) { return 0; }
+
+magma_status_t msd_device_query(msd_device_t* device, uint64_t id, uint64_t* value_out)
+{
+    return MAGMA_STATUS_INVALID_ARGS;
+}
+
+void msd_device_dump_status(struct msd_device_t* dev) { MsdSimDevice::cast(dev)->DumpStatus(); }
+
+msd_context_t* msd_connection_create_context(msd_connection_t* abi_connection, uint32_t priority)
+{
+    auto connection = MsdSimConnection::cast(abi_connection);
+    return new MsdSimContext(connection->device()->NextEngine(), priority);
+}
+
+void msd_connection_present_buffer(msd_connection_t* abi_connection, msd_buffer_t* abi_buffer,
+                                   magma_system_image_descriptor* image_desc,
+                                   uint32_t wait_semaphore_count, uint32_t signal_semaphore_count,
+                                   msd_semaphore_t** semaphores,
+                                   msd_present_buffer_callback_t callback, void* callback_data)
+{
+    // There's no display; the buffer is released as soon as it's presented.
+    for (uint32_t i = wait_semaphore_count; i < wait_semaphore_count + signal_semaphore_count;
+         i++) {
+        reinterpret_cast<magma::PlatformSemaphore*>(semaphores[i])->Signal();
+    }
+    if (callback)
+        callback(MAGMA_STATUS_OK, 0, callback_data);
+}
+
+magma_status_t msd_connection_wait_rendering(struct msd_connection_t* abi_connection,
+                                             struct msd_buffer_t* buf)
+{
+    auto connection = MsdSimConnection::cast(abi_connection);
+    if (!connection->device()->WaitRendering(connection, MsdSimBuffer::cast(buf)->id()))
+        return MAGMA_STATUS_CONNECTION_LOST;
+    return MAGMA_STATUS_OK;
+}
+
+void msd_connection_cancel_waits(struct msd_connection_t* abi_connection)
+{
+    auto connection = MsdSimConnection::cast(abi_connection);
+    connection->device()->CancelWaits(connection);
+}
+
+void msd_context_destroy(msd_context_t* ctx) { delete MsdSimContext::cast(ctx); }
+
+msd_buffer_t* msd_buffer_import(uint32_t handle)
+{
+    auto platform_buf = magma::PlatformBuffer::Import(handle);
+    if (!platform_buf)
+        return DRETP(nullptr, "failed to import buffer");
+    return new MsdSimBuffer(std::move(platform_buf));
+}
+
+void msd_buffer_destroy(msd_buffer_t* buf)
+{
+    if (buf)
+        delete MsdSimBuffer::cast(buf);
+}
+
+magma_status_t msd_context_execute_command_buffer(msd_context_t* ctx, msd_buffer_t* cmd_buf,
+                                                  msd_buffer_t** exec_resources,
+                                                  msd_semaphore_t** wait_semaphores,
+                                                  msd_semaphore_t** signal_semaphores)
+{
+    return MsdSimContext::cast(ctx)->ExecuteCommandBuffer(cmd_buf, exec_resources,
+                                                          wait_semaphores, signal_semaphores);
+}
+
+void msd_context_release_buffer(msd_context_t* context, msd_buffer_t* buffer) {}
+
+void msd_context_release_buffers(msd_context_t* context, msd_buffer_t** buffers, uint32_t count)
+{
+}
+
+magma_status_t msd_semaphore_import(uint32_t handle, msd_semaphore_t** semaphore_out)
+{
+    auto semaphore = magma::PlatformSemaphore::Import(handle);
+    if (!semaphore)
+        return DRET_MSG(MAGMA_STATUS_INVALID_ARGS, "failed to import semaphore");
+    *semaphore_out = reinterpret_cast<msd_semaphore_t*>(semaphore.release());
+    return MAGMA_STATUS_OK;
+}
+
+void msd_semaphore_release(msd_semaphore_t* semaphore)
+{
+    delete reinterpret_cast<magma::PlatformSemaphore*>(semaphore);
+}
@@ -0,0 +1,236 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef _SIM_MSD_H_
+#define _SIM_MSD_H_
+
+#include "magma_util/macros.h"
+#include "msd.h"
+#include "platform_buffer.h"
+#include "platform_semaphore.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// An msd which simulates a GPU rather than driving one, so the sys driver can be load tested with
+// realistic queueing behaviour without hardware.  It's linked into test executables in place of a
+// real msd, not built as a loadable driver, and is configured through MsdSimDriver::SetConfig.
+// Each context is assigned one of a number of engines; an engine executes its command buffers in
+// order, one at a time, waiting on their wait semaphores, occupying itself for the configured
+// execution time, then signalling their signal semaphores.
+
+struct MsdSimConfig {
+    // Time each command buffer occupies its engine.
+    uint32_t execution_time_us = 1000;
+    // Each execution time varies uniformly by up to this much either way.
+    uint32_t jitter_us = 0;
+    // Command buffers an engine holds, including the one executing, before submits block.
+    uint32_t queue_depth = 16;
+    uint32_t engine_count = 1;
+};
+
+class MsdSimBuffer : public msd_buffer_t {
+public:
+    MsdSimBuffer(std::unique_ptr<magma::PlatformBuffer> platform_buf)
+        : platform_buf_(std::move(platform_buf))
+    {
+        magic_ = kMagic;
+    }
+
+    static MsdSimBuffer* cast(msd_buffer_t* buf)
+    {
+        DASSERT(buf);
+        DASSERT(buf->magic_ == kMagic);
+        return static_cast<MsdSimBuffer*>(buf);
+    }
+
+    uint64_t id() { return platform_buf_->id(); }
+
+    magma::PlatformBuffer* platform_buffer() { return platform_buf_.get(); }
+
+private:
+    std::unique_ptr<magma::PlatformBuffer> platform_buf_;
+    static const uint32_t kMagic = 0x73696266; // "sibf" (Sim Buffer)
+};
+
+class MsdSimDevice;
+
+class MsdSimEngine {
+public:
+    MsdSimEngine(MsdSimDevice* device, uint32_t index);
+    ~MsdSimEngine();
+
+    struct Batch {
+        std::vector<std::unique_ptr<magma::PlatformSemaphore>> wait_semaphores;
+        std::vector<std::unique_ptr<magma::PlatformSemaphore>> signal_semaphores;
+        std::vector<uint64_t> buffer_ids;
+        uint32_t priority = MAGMA_CONTEXT_PRIORITY_NORMAL;
+    };
+
+    // Blocks while the engine's queue is full.  A batch is queued ahead of any lower priority
+    // batches that haven't started, standing in for preemption.
+    void Submit(Batch batch);
+
+    uint32_t outstanding_count()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return outstanding_count_;
+    }
+
+private:
+    struct Job {
+        Batch batch;
+        std::chrono::microseconds execution_time;
+    };
+
+    void Loop();
+
+    // Returns false if the engine is shutting down.
+    bool WaitSemaphores(Job* job);
+
+    MsdSimDevice* device_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable job_queued_;
+    std::condition_variable job_done_;
+    std::deque<Job> queue_;
+    // Queued plus executing.
+    uint32_t outstanding_count_ = 0;
+    bool quit_ = false;
+    std::minstd_rand random_;
+
+    DISALLOW_COPY_AND_ASSIGN(MsdSimEngine);
+};
+
+class MsdSimContext : public msd_context_t {
+public:
+    MsdSimContext(MsdSimEngine* engine, uint32_t priority) : engine_(engine), priority_(priority)
+    {
+        magic_ = kMagic;
+    }
+
+    static MsdSimContext* cast(msd_context_t* ctx)
+    {
+        DASSERT(ctx);
+        DASSERT(ctx->magic_ == kMagic);
+        return static_cast<MsdSimContext*>(ctx);
+    }
+
+    magma_status_t ExecuteCommandBuffer(msd_buffer_t* cmd_buf, msd_buffer_t** exec_resources,
+                                        msd_semaphore_t** wait_semaphores,
+                                        msd_semaphore_t** signal_semaphores);
+
+private:
+    MsdSimEngine* engine_;
+    uint32_t priority_;
+    static const uint32_t kMagic = 0x73696378; // "sicx" (Sim Context)
+};
+
+class MsdSimConnection : public msd_connection_t {
+public:
+    MsdSimConnection(MsdSimDevice* device) : device_(device) { magic_ = kMagic; }
+
+    static MsdSimConnection* cast(msd_connection_t* connection)
+    {
+        DASSERT(connection);
+        DASSERT(connection->magic_ == kMagic);
+        return static_cast<MsdSimConnection*>(connection);
+    }
+
+    MsdSimDevice* device() { return device_; }
+
+    // Guarded by the device's lock.
+    bool waits_cancelled() { return waits_cancelled_; }
+    void set_waits_cancelled() { waits_cancelled_ = true; }
+
+private:
+    MsdSimDevice* device_;
+    bool waits_cancelled_ = false;
+    static const uint32_t kMagic = 0x7369636e; // "sicn" (Sim Connection)
+};
+
+class MsdSimDevice : public msd_device_t {
+public:
+    MsdSimDevice(const MsdSimConfig& config);
+
+    // Stops the engines before the state they report completions to goes away.
+    ~MsdSimDevice() { engines_.clear(); }
+
+    static MsdSimDevice* cast(msd_device_t* dev)
+    {
+        DASSERT(dev);
+        DASSERT(dev->magic_ == kMagic);
+        return static_cast<MsdSimDevice*>(dev);
+    }
+
+    const MsdSimConfig& config() { return config_; }
+
+    // Assigns engines to contexts round robin.
+    MsdSimEngine* NextEngine();
+
+    // Blocks until no submitted command buffer referencing |buffer_id| is outstanding.  Returns
+    // false if the wait was cancelled.
+    bool WaitRendering(MsdSimConnection* connection, uint64_t buffer_id);
+    void CancelWaits(MsdSimConnection* connection);
+
+    // Called by engines.
+    void Submitted(const std::vector<uint64_t>& buffer_ids);
+    void Completed(const std::vector<uint64_t>& buffer_ids);
+
+    uint64_t submitted_count()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return submitted_count_;
+    }
+
+    uint64_t completed_count()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return completed_count_;
+    }
+
+    void DumpStatus();
+
+private:
+    MsdSimConfig config_;
+    std::vector<std::unique_ptr<MsdSimEngine>> engines_;
+    uint32_t next_engine_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable buffer_idle_;
+    // Outstanding command buffers referencing each buffer.
+    std::unordered_map<uint64_t, uint32_t> pending_buffers_;
+    uint64_t submitted_count_ = 0;
+    uint64_t completed_count_ = 0;
+
+    static const uint32_t kMagic = 0x73696476; // "sidv" (Sim Device)
+};
+
+class MsdSimDriver : public msd_driver_t {
+public:
+    MsdSimDriver() { magic_ = kMagic; }
+
+    static MsdSimDriver* cast(msd_driver_t* drv)
+    {
+        DASSERT(drv);
+        DASSERT(drv->magic_ == kMagic);
+        return static_cast<MsdSimDriver*>(drv);
+    }
+
+    // Applies to devices created afterwards by any driver.
+    static void SetConfig(const MsdSimConfig& config);
+    static MsdSimConfig GetConfig();
+
+private:
+    static const uint32_t kMagic = 0x73696472; // "sidr" (Sim Driver)
+};
+
+#endif // _SIM_MSD_H_
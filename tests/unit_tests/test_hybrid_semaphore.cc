@@ -0,0 +1,140 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_util/hybrid_semaphore.h"
+#include "platform_semaphore.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <thread>
+
+namespace {
+
+class TestHybridSemaphore {
+public:
+    static void Test()
+    {
+        std::shared_ptr<magma::HybridSemaphore> sem = magma::HybridSemaphore::Create();
+        ASSERT_NE(sem, nullptr);
+
+        // Verify timeout
+        EXPECT_FALSE(sem->Wait(100));
+
+        // Signal then wait completes without entering the kernel
+        uint64_t kernel_wait_count = sem->kernel_wait_count();
+        sem->Signal();
+        EXPECT_TRUE(sem->Wait(100));
+        EXPECT_EQ(kernel_wait_count, sem->kernel_wait_count());
+        EXPECT_EQ(0u, sem->kernel_signal_count());
+
+        // Verify autoreset
+        EXPECT_FALSE(sem->Wait(10));
+
+        // Verify wakeup of a sleeping waiter
+        std::thread thread([sem] { EXPECT_TRUE(sem->Wait()); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sem->Signal();
+        thread.join();
+
+        // Verify Reset
+        sem->Signal();
+        sem->Reset();
+        EXPECT_FALSE(sem->Wait(10));
+    }
+
+    static void Import()
+    {
+        auto sem = magma::HybridSemaphore::Create();
+        ASSERT_NE(sem, nullptr);
+
+        uint32_t buffer_handle, event_handle;
+        ASSERT_TRUE(sem->duplicate_handles(&buffer_handle, &event_handle));
+        std::shared_ptr<magma::HybridSemaphore> imported =
+            magma::HybridSemaphore::Import(buffer_handle, event_handle);
+        ASSERT_NE(imported, nullptr);
+        EXPECT_EQ(sem->id(), imported->id());
+
+        sem->Signal();
+        EXPECT_TRUE(imported->Wait(100));
+
+        std::thread thread([imported] { EXPECT_TRUE(imported->Wait()); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        sem->Signal();
+        thread.join();
+    }
+
+    // Ping-pong between two threads, reporting the mean signal->wait latency.
+    template <typename Semaphore>
+    static double PingPong(std::shared_ptr<Semaphore> ping, std::shared_ptr<Semaphore> pong,
+                           uint32_t iterations)
+    {
+        std::thread thread([ping, pong, iterations] {
+            for (uint32_t i = 0; i < iterations; i++) {
+                EXPECT_TRUE(ping->Wait());
+                pong->Signal();
+            }
+        });
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            ping->Signal();
+            EXPECT_TRUE(pong->Wait());
+        }
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::high_resolution_clock::now() - start;
+
+        thread.join();
+        return elapsed.count() / (2 * iterations);
+    }
+
+    // Signal followed by wait on the same thread; the common case where the signal has already
+    // happened by the time the client waits.
+    template <typename Semaphore>
+    static double Signalled(Semaphore* sem, uint32_t iterations)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            sem->Signal();
+            EXPECT_TRUE(sem->Wait());
+        }
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count() / iterations;
+    }
+
+    static void Benchmark(uint32_t iterations)
+    {
+        std::shared_ptr<magma::PlatformSemaphore> platform[2] = {
+            magma::PlatformSemaphore::Create(), magma::PlatformSemaphore::Create()};
+        std::shared_ptr<magma::HybridSemaphore> hybrid[2] = {magma::HybridSemaphore::Create(),
+                                                             magma::HybridSemaphore::Create()};
+
+        double platform_signalled_us = Signalled(platform[0].get(), iterations);
+        double hybrid_signalled_us = Signalled(hybrid[0].get(), iterations);
+        EXPECT_EQ(0u, hybrid[0]->kernel_wait_count());
+        EXPECT_EQ(0u, hybrid[0]->kernel_signal_count());
+
+        double platform_ping_pong_us = PingPong(platform[0], platform[1], iterations);
+        double hybrid_ping_pong_us = PingPong(hybrid[0], hybrid[1], iterations);
+
+        uint64_t hybrid_syscalls = 0;
+        for (auto& sem : hybrid) {
+            hybrid_syscalls += sem->kernel_wait_count() + sem->kernel_signal_count();
+        }
+
+        // Each PlatformSemaphore signal and wait is a syscall.
+        printf("signalled wait: PlatformSemaphore %.3f us HybridSemaphore %.3f us\n",
+               platform_signalled_us, hybrid_signalled_us);
+        printf("ping pong: PlatformSemaphore %.3f us (%u syscalls) HybridSemaphore %.3f us "
+               "(%" PRIu64 " syscalls)\n",
+               platform_ping_pong_us, 4 * iterations, hybrid_ping_pong_us, hybrid_syscalls);
+    }
+};
+
+} // namespace
+
+TEST(HybridSemaphore, Test) { TestHybridSemaphore::Test(); }
+
+TEST(HybridSemaphore, Import) { TestHybridSemaphore::Import(); }
+
+TEST(HybridSemaphore, Benchmark) { TestHybridSemaphore::Benchmark(10000); }
@@ -30,6 +30,22 @@ public:
         EXPECT_NE(0u, device_id);
     }
 
+    void QueryBatch()
+    {
+        uint64_t device_id = 0;
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_query(fd_, MAGMA_QUERY_DEVICE_ID, &device_id));
+
+        uint64_t ids[] = {MAGMA_QUERY_DEVICE_ID, MAGMA_QUERY_DEVICE_ID};
+        uint64_t values[] = {0, 0};
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_query_batch(fd_, ids, 2, values));
+        EXPECT_EQ(device_id, values[0]);
+        EXPECT_EQ(device_id, values[1]);
+
+        EXPECT_NE(MAGMA_STATUS_OK, magma_query_batch(fd_, ids, 0, values));
+        EXPECT_NE(MAGMA_STATUS_OK,
+                  magma_query_batch(fd_, ids, MAGMA_QUERY_BATCH_MAX_COUNT + 1, values));
+    }
+
 private:
     int fd_;
 };
@@ -72,6 +88,21 @@ public:
         EXPECT_NE(magma_get_error(connection_), 0);
     }
 
+    void ContextPriority()
+    {
+        ASSERT_NE(connection_, nullptr);
+
+        uint32_t context_id;
+        magma_create_context_with_priority(connection_, MAGMA_CONTEXT_PRIORITY_LOW, &context_id);
+        EXPECT_EQ(magma_get_error(connection_), 0);
+        magma_release_context(connection_, context_id);
+        EXPECT_EQ(magma_get_error(connection_), 0);
+
+        // Rendering only connections can't have high priority contexts.
+        magma_create_context_with_priority(connection_, MAGMA_CONTEXT_PRIORITY_HIGH, &context_id);
+        EXPECT_NE(magma_get_error(connection_), 0);
+    }
+
     void Buffer()
     {
         ASSERT_NE(connection_, nullptr);
@@ -104,6 +135,46 @@ public:
         EXPECT_EQ(magma_get_error(connection_), 0);
     }
 
+    void MappingCache()
+    {
+        ASSERT_NE(connection_, nullptr);
+
+        uint64_t size = PAGE_SIZE;
+        magma_buffer_t buffer;
+        ASSERT_EQ(magma_create_buffer(connection_, size, &size, &buffer), 0);
+
+        magma_mapping_cache_stats before;
+        magma_get_mapping_cache_stats(&before);
+
+        void* addr;
+        ASSERT_EQ(magma_map(connection_, buffer, &addr), 0);
+        *reinterpret_cast<uint32_t*>(addr) = 0xabcd1234;
+        EXPECT_EQ(magma_unmap(connection_, buffer), 0);
+
+        // Still mapped, so mapping again returns the same address.
+        void* addr2;
+        ASSERT_EQ(magma_map(connection_, buffer, &addr2), 0);
+        EXPECT_EQ(addr, addr2);
+        EXPECT_EQ(0xabcd1234u, *reinterpret_cast<uint32_t*>(addr2));
+        EXPECT_EQ(magma_unmap(connection_, buffer), 0);
+        EXPECT_NE(magma_unmap(connection_, buffer), 0);
+
+        magma_mapping_cache_stats after;
+        magma_get_mapping_cache_stats(&after);
+        EXPECT_EQ(before.miss_count + 1, after.miss_count);
+        EXPECT_EQ(before.hit_count + 1, after.hit_count);
+        EXPECT_EQ(before.cached_bytes + size, after.cached_bytes);
+
+        // Shrinking the budget evicts.
+        magma_set_mapping_cache_budget(0);
+        magma_get_mapping_cache_stats(&after);
+        EXPECT_EQ(0u, after.cached_bytes);
+        EXPECT_LT(before.eviction_count, after.eviction_count);
+        magma_set_mapping_cache_budget(before.budget_bytes);
+
+        magma_release_buffer(connection_, buffer);
+    }
+
     void BufferExport(uint32_t* handle_out, uint64_t* id_out)
     {
         ASSERT_NE(connection_, nullptr);
@@ -224,6 +295,54 @@ public:
         test2->SemaphoreImport(handle, id);
     }
 
+    void TimelineSemaphore()
+    {
+        ASSERT_NE(connection_, nullptr);
+
+        magma_timeline_semaphore_t semaphore;
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_create_timeline_semaphore(connection_, 1, &semaphore));
+
+        EXPECT_NE(0u, magma_get_timeline_semaphore_id(semaphore));
+        EXPECT_EQ(1u, magma_get_timeline_semaphore_value(semaphore));
+
+        std::thread thread([semaphore] {
+            EXPECT_EQ(MAGMA_STATUS_OK, magma_wait_timeline_semaphore(semaphore, 3, 1000));
+            EXPECT_EQ(MAGMA_STATUS_TIMED_OUT, magma_wait_timeline_semaphore(semaphore, 4, 100));
+        });
+
+        magma_signal_timeline_semaphore(semaphore, 3);
+        thread.join();
+
+        // reached points never need to be reset
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_wait_timeline_semaphore(semaphore, 2, 0));
+
+        magma_release_timeline_semaphore(connection_, semaphore);
+    }
+
+    static void TimelineSemaphoreImportExport(TestConnection* test1, TestConnection* test2)
+    {
+        magma_timeline_semaphore_t semaphore;
+        EXPECT_EQ(MAGMA_STATUS_OK,
+                  magma_create_timeline_semaphore(test1->connection_, 0, &semaphore));
+
+        uint32_t memory_handle, event_handle;
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_export_timeline_semaphore(
+                                       test1->connection_, semaphore, &memory_handle,
+                                       &event_handle));
+
+        magma_timeline_semaphore_t imported;
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_import_timeline_semaphore(
+                                       test2->connection_, memory_handle, event_handle, &imported));
+        EXPECT_EQ(magma_get_timeline_semaphore_id(semaphore),
+                  magma_get_timeline_semaphore_id(imported));
+
+        magma_signal_timeline_semaphore(semaphore, 5);
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_wait_timeline_semaphore(imported, 5, 1000));
+
+        magma_release_timeline_semaphore(test2->connection_, imported);
+        magma_release_timeline_semaphore(test1->connection_, semaphore);
+    }
+
 private:
     magma_connection_t* connection_;
 };
@@ -309,12 +428,24 @@ TEST(MagmaAbi, DeviceId)
     test.GetDeviceId();
 }
 
+TEST(MagmaAbi, QueryBatch)
+{
+    TestBase test;
+    test.QueryBatch();
+}
+
 TEST(MagmaAbi, Buffer)
 {
     TestConnection test;
     test.Buffer();
 }
 
+TEST(MagmaAbi, MappingCache)
+{
+    TestConnection test;
+    test.MappingCache();
+}
+
 TEST(MagmaAbi, Connection)
 {
     TestConnection test;
@@ -327,6 +458,12 @@ TEST(MagmaAbi, Context)
     test.Context();
 }
 
+TEST(MagmaAbi, ContextPriority)
+{
+    TestConnection test;
+    test.ContextPriority();
+}
+
 TEST(MagmaAbi, WaitRendering)
 {
     TestConnection test;
@@ -360,6 +497,19 @@ TEST(MagmaAbi, SemaphoreImportExport)
     TestConnection::SemaphoreImportExport(&test1, &test2);
 }
 
+TEST(MagmaAbi, TimelineSemaphore)
+{
+    TestConnection test;
+    test.TimelineSemaphore();
+}
+
+TEST(MagmaAbi, TimelineSemaphoreImportExport)
+{
+    TestConnection test1;
+    TestConnection test2;
+    TestConnection::TimelineSemaphoreImportExport(&test1, &test2);
+}
+
 TEST(MagmaAbi, FromC) { EXPECT_TRUE(test_magma_abi_from_c()); }
 
 TEST(MagmaAbi, DisplayDoubleBuffered)
@@ -0,0 +1,304 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "libmagma/magma_capture.h"
+#include "magma.h"
+#include "platform_buffer.h"
+#include "tools/replayer.h"
+#include "gtest/gtest.h"
+
+using namespace magma_capture;
+
+namespace {
+
+constexpr const char* kCapturePath = "/tmp/magma_capture_test";
+
+class CaptureReader {
+public:
+    CaptureReader(const char* path) : file_(fopen(path, "rb")) {}
+
+    ~CaptureReader()
+    {
+        if (file_)
+            fclose(file_);
+    }
+
+    bool ReadFileHeader(FileHeader* header_out)
+    {
+        return file_ && fread(header_out, sizeof(*header_out), 1, file_) == 1;
+    }
+
+    bool ReadRecord(RecordHeader* header_out, std::vector<uint8_t>* payload_out)
+    {
+        if (fread(header_out, sizeof(*header_out), 1, file_) != 1)
+            return false;
+        payload_out->resize(header_out->size);
+        return !header_out->size || fread(payload_out->data(), header_out->size, 1, file_) == 1;
+    }
+
+    // Reads the next record, checking its type and that it starts with a T.
+    template <typename T> bool ReadRecord(RecordType type, T* record_out)
+    {
+        RecordHeader header;
+        if (!ReadRecord(&header, &payload_) || header.type != type || payload_.size() < sizeof(T))
+            return false;
+        memcpy(record_out, payload_.data(), sizeof(T));
+        return true;
+    }
+
+    // The variable length data after the last record's struct.
+    template <typename T> const uint8_t* tail() { return payload_.data() + sizeof(T); }
+
+    size_t payload_size() { return payload_.size(); }
+
+    bool at_end()
+    {
+        RecordHeader header;
+        return fread(&header, sizeof(header), 1, file_) == 0 && feof(file_);
+    }
+
+private:
+    FILE* file_;
+    std::vector<uint8_t> payload_;
+};
+
+// A command buffer executing the whole of |batch_buffer|.
+std::unique_ptr<magma::PlatformBuffer> CreateCommandBuffer(magma::PlatformBuffer* batch_buffer)
+{
+    auto buffer = magma::PlatformBuffer::Create(
+        sizeof(magma_system_command_buffer) + sizeof(magma_system_exec_resource), "command-buffer");
+    void* addr;
+    if (!buffer || !buffer->MapCpu(&addr))
+        return nullptr;
+
+    auto command_buffer = reinterpret_cast<magma_system_command_buffer*>(addr);
+    *command_buffer = {};
+    command_buffer->num_resources = 1;
+    auto resource = reinterpret_cast<magma_system_exec_resource*>(command_buffer + 1);
+    *resource = {};
+    resource->buffer_id = batch_buffer->id();
+    resource->length = batch_buffer->size();
+
+    if (!buffer->UnmapCpu())
+        return nullptr;
+    return buffer;
+}
+
+} // namespace
+
+TEST(MagmaCapture, FileFormat)
+{
+    auto connection = reinterpret_cast<magma_connection_t*>(0x1000);
+    uint64_t connection_key = reinterpret_cast<uintptr_t>(connection);
+    constexpr uint32_t kContextId = 3;
+    constexpr uint32_t kCommandBufferId = 7;
+    constexpr uint64_t kSemaphoreId = 42;
+
+    auto batch_buffer = magma::PlatformBuffer::Create(PAGE_SIZE, "batch");
+    ASSERT_NE(nullptr, batch_buffer);
+    void* batch_addr;
+    ASSERT_TRUE(batch_buffer->MapCpu(&batch_addr));
+    memset(batch_addr, 0xab, PAGE_SIZE);
+    auto command_buffer = CreateCommandBuffer(batch_buffer.get());
+    ASSERT_NE(nullptr, command_buffer);
+
+    {
+        FILE* file = fopen(kCapturePath, "wb");
+        ASSERT_NE(nullptr, file);
+        MagmaCapture capture(file);
+        capture.RecordConnection(kCreateConnection, connection, MAGMA_CAPABILITY_RENDERING);
+        capture.RecordBuffer(kCreateBuffer, connection, batch_buffer.get());
+        capture.RecordBufferRange(kMapBufferRange, connection, batch_buffer.get(), 0, PAGE_SIZE,
+                                  MAGMA_MAP_FLAG_READ_ONLY);
+        capture.RecordSubmit(connection, command_buffer.get(), kContextId);
+        capture.RecordCreatePersistentCommandBuffer(connection, command_buffer.get(),
+                                                    kCommandBufferId);
+        magma_system_command_buffer_patch patch = {0, 1, 0};
+        capture.RecordSubmitPersistentCommandBuffer(connection, kCommandBufferId, kContextId,
+                                                    &patch, &kSemaphoreId);
+        capture.RecordConnection(kReleaseConnection, connection, 0);
+    }
+
+    CaptureReader reader(kCapturePath);
+    FileHeader file_header;
+    ASSERT_TRUE(reader.ReadFileHeader(&file_header));
+    EXPECT_EQ(kMagic, file_header.magic);
+    EXPECT_EQ(kVersion, file_header.version);
+
+    ConnectionRecord connection_record;
+    ASSERT_TRUE(reader.ReadRecord(kCreateConnection, &connection_record));
+    EXPECT_EQ(connection_key, connection_record.connection);
+    EXPECT_EQ(static_cast<uint32_t>(MAGMA_CAPABILITY_RENDERING), connection_record.capabilities);
+
+    BufferRecord buffer_record;
+    ASSERT_TRUE(reader.ReadRecord(kCreateBuffer, &buffer_record));
+    EXPECT_EQ(batch_buffer->id(), buffer_record.buffer_id);
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), buffer_record.size);
+
+    BufferRangeRecord range_record;
+    ASSERT_TRUE(reader.ReadRecord(kMapBufferRange, &range_record));
+    EXPECT_EQ(batch_buffer->id(), range_record.buffer_id);
+    EXPECT_EQ(0u, range_record.offset);
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), range_record.length);
+    EXPECT_EQ(static_cast<uint32_t>(MAGMA_MAP_FLAG_READ_ONLY), range_record.flags);
+
+    const uint32_t command_buffer_size =
+        sizeof(magma_system_command_buffer) + sizeof(magma_system_exec_resource);
+
+    SubmitRecord submit_record;
+    ASSERT_TRUE(reader.ReadRecord(kSubmitCommandBuffer, &submit_record));
+    EXPECT_EQ(kContextId, submit_record.context_id);
+    EXPECT_EQ(command_buffer_size, submit_record.command_buffer_size);
+    EXPECT_EQ(0u, submit_record.batch_offset);
+    EXPECT_EQ(static_cast<uint32_t>(PAGE_SIZE), submit_record.batch_size);
+    ASSERT_EQ(sizeof(submit_record) + command_buffer_size + PAGE_SIZE, reader.payload_size());
+    const uint8_t* batch = reader.tail<SubmitRecord>() + command_buffer_size;
+    EXPECT_EQ(0, memcmp(batch_addr, batch, PAGE_SIZE));
+
+    PersistentCommandBufferRecord persistent_record;
+    ASSERT_TRUE(reader.ReadRecord(kCreatePersistentCommandBuffer, &persistent_record));
+    EXPECT_EQ(kCommandBufferId, persistent_record.command_buffer_id);
+    EXPECT_EQ(command_buffer_size, persistent_record.command_buffer_size);
+
+    PersistentSubmitRecord persistent_submit_record;
+    ASSERT_TRUE(reader.ReadRecord(kSubmitPersistentCommandBuffer, &persistent_submit_record));
+    EXPECT_EQ(kCommandBufferId, persistent_submit_record.command_buffer_id);
+    EXPECT_EQ(1u, persistent_submit_record.patched);
+    EXPECT_EQ(1u, persistent_submit_record.wait_semaphore_count);
+    EXPECT_EQ(0u, persistent_submit_record.signal_semaphore_count);
+    EXPECT_EQ(static_cast<uint32_t>(PAGE_SIZE), persistent_submit_record.batch_size);
+    ASSERT_EQ(sizeof(persistent_submit_record) + sizeof(uint64_t) + PAGE_SIZE,
+              reader.payload_size());
+    uint64_t semaphore_id;
+    memcpy(&semaphore_id, reader.tail<PersistentSubmitRecord>(), sizeof(semaphore_id));
+    EXPECT_EQ(kSemaphoreId, semaphore_id);
+    batch = reader.tail<PersistentSubmitRecord>() + sizeof(uint64_t);
+    EXPECT_EQ(0, memcmp(batch_addr, batch, PAGE_SIZE));
+
+    ASSERT_TRUE(reader.ReadRecord(kReleaseConnection, &connection_record));
+    EXPECT_TRUE(reader.at_end());
+
+    EXPECT_TRUE(batch_buffer->UnmapCpu());
+    unlink(kCapturePath);
+}
+
+TEST(MagmaCapture, NotCaptured)
+{
+    auto connection = reinterpret_cast<magma_connection_t*>(0x1000);
+
+    // Claims far more resources than the buffer holds.
+    auto command_buffer = magma::PlatformBuffer::Create(PAGE_SIZE, "command-buffer");
+    ASSERT_NE(nullptr, command_buffer);
+    void* addr;
+    ASSERT_TRUE(command_buffer->MapCpu(&addr));
+    memset(addr, 0xff, PAGE_SIZE);
+    EXPECT_TRUE(command_buffer->UnmapCpu());
+
+    {
+        FILE* file = fopen(kCapturePath, "wb");
+        ASSERT_NE(nullptr, file);
+        MagmaCapture capture(file);
+        capture.RecordSubmit(connection, command_buffer.get(), 0);
+        capture.RecordCreatePersistentCommandBuffer(connection, command_buffer.get(), 1);
+    }
+
+    CaptureReader reader(kCapturePath);
+    FileHeader file_header;
+    ASSERT_TRUE(reader.ReadFileHeader(&file_header));
+
+    // The dropped calls still leave a record, so replay can report the gap.
+    NotCapturedRecord record;
+    ASSERT_TRUE(reader.ReadRecord(kNotCaptured, &record));
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(connection), record.connection);
+    EXPECT_EQ(static_cast<uint32_t>(kSubmitCommandBuffer), record.type);
+    EXPECT_EQ(static_cast<uint64_t>(PAGE_SIZE), record.size);
+    ASSERT_TRUE(reader.ReadRecord(kNotCaptured, &record));
+    EXPECT_EQ(static_cast<uint32_t>(kCreatePersistentCommandBuffer), record.type);
+    EXPECT_TRUE(reader.at_end());
+
+    unlink(kCapturePath);
+}
+
+// Captures calls made through the ABI, then replays them against the same device.
+TEST(MagmaCapture, RoundTrip)
+{
+    int fd = open("/dev/class/display/000", O_RDONLY);
+    ASSERT_GE(fd, 0);
+
+    {
+        FILE* file = fopen(kCapturePath, "wb");
+        ASSERT_NE(nullptr, file);
+        MagmaCapture capture(file);
+
+        magma_connection_t* connection = magma_create_connection(fd, MAGMA_CAPABILITY_RENDERING);
+        ASSERT_NE(nullptr, connection);
+        capture.RecordConnection(kCreateConnection, connection, MAGMA_CAPABILITY_RENDERING);
+
+        uint32_t context_id;
+        magma_create_context(connection, &context_id);
+        capture.RecordContext(kCreateContext, connection, context_id);
+
+        uint64_t size;
+        magma_buffer_t buffer;
+        ASSERT_EQ(MAGMA_STATUS_OK, magma_create_buffer(connection, PAGE_SIZE, &size, &buffer));
+        auto platform_buffer = reinterpret_cast<magma::PlatformBuffer*>(buffer);
+        capture.RecordBuffer(kCreateBuffer, connection, platform_buffer);
+
+        void* addr;
+        ASSERT_EQ(MAGMA_STATUS_OK, magma_map(connection, buffer, &addr));
+        capture.RecordBuffer(kMapBuffer, connection, platform_buffer);
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_unmap(connection, buffer));
+        capture.RecordBuffer(kUnmapBuffer, connection, platform_buffer);
+
+        ASSERT_EQ(MAGMA_STATUS_OK,
+                  magma_map_range(connection, buffer, 0, PAGE_SIZE, MAGMA_MAP_FLAG_READ_ONLY,
+                                  &addr));
+        capture.RecordBufferRange(kMapBufferRange, connection, platform_buffer, 0, PAGE_SIZE,
+                                  MAGMA_MAP_FLAG_READ_ONLY);
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_unmap_range(connection, buffer, 0, PAGE_SIZE));
+        capture.RecordBufferRange(kUnmapBufferRange, connection, platform_buffer, 0, PAGE_SIZE);
+
+        magma_semaphore_t semaphore;
+        ASSERT_EQ(MAGMA_STATUS_OK, magma_create_semaphore(connection, &semaphore));
+        uint64_t semaphore_id = magma_get_semaphore_id(semaphore);
+        capture.RecordSemaphore(kCreateSemaphore, connection, semaphore_id);
+        magma_signal_semaphore(semaphore);
+        capture.RecordSemaphore(kSignalSemaphore, nullptr, semaphore_id);
+        EXPECT_EQ(MAGMA_STATUS_OK, magma_wait_semaphore(semaphore, 0));
+        capture.RecordSemaphore(kWaitSemaphore, nullptr, semaphore_id, 0);
+        magma_release_semaphore(connection, semaphore);
+        capture.RecordSemaphore(kReleaseSemaphore, connection, semaphore_id);
+
+        capture.RecordBuffer(kReleaseBuffer, connection, platform_buffer);
+        magma_release_buffer(connection, buffer);
+        magma_release_context(connection, context_id);
+        capture.RecordContext(kReleaseContext, connection, context_id);
+
+        magma_status_t status = magma_get_error(connection);
+        EXPECT_EQ(MAGMA_STATUS_OK, status);
+        capture.RecordError(connection, status);
+
+        capture.RecordConnection(kReleaseConnection, connection, 0);
+        magma_release_connection(connection);
+    }
+
+    FILE* file = fopen(kCapturePath, "rb");
+    ASSERT_NE(nullptr, file);
+    {
+        Replayer replayer(fd, false);
+        EXPECT_TRUE(replayer.Run(file));
+        EXPECT_EQ(15u, replayer.record_count());
+        EXPECT_EQ(0u, replayer.skipped_count());
+    }
+    fclose(file);
+
+    unlink(kCapturePath);
+    close(fd);
+}
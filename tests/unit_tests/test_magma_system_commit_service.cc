@@ -0,0 +1,104 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sys_driver/magma_system_commit_service.h"
+#include "gtest/gtest.h"
+#include <vector>
+
+TEST(MagmaSystemCommitService, SmallBuffer)
+{
+    MagmaSystemCommitService service(MagmaSystemCommitService::kDefaultThreadCount);
+
+    auto buffer = magma::PlatformBuffer::Create(PAGE_SIZE, "test");
+    ASSERT_NE(buffer, nullptr);
+    EXPECT_EQ(nullptr, service.Enqueue(buffer.get()));
+}
+
+TEST(MagmaSystemCommitService, WaitCommitsOnlyReferencedChunks)
+{
+    constexpr uint64_t kChunkSize = MagmaSystemCommitService::kChunkSize;
+
+    // No background threads, so only waits commit anything.
+    MagmaSystemCommitService service(0);
+
+    auto buffer = magma::PlatformBuffer::Create(16 * kChunkSize + PAGE_SIZE, "test");
+    ASSERT_NE(buffer, nullptr);
+
+    auto job = service.Enqueue(buffer.get());
+    ASSERT_NE(job, nullptr);
+    EXPECT_EQ(17u, job->chunk_count());
+    EXPECT_FALSE(job->IsCommitted(0, buffer->size()));
+
+    EXPECT_TRUE(job->WaitRange(kChunkSize + PAGE_SIZE, PAGE_SIZE));
+    EXPECT_TRUE(job->IsCommitted(kChunkSize, kChunkSize));
+    EXPECT_FALSE(job->IsCommitted(0, PAGE_SIZE));
+    EXPECT_FALSE(job->IsCommitted(2 * kChunkSize, PAGE_SIZE));
+
+    // Clamped to the end of the buffer.
+    EXPECT_TRUE(job->WaitRange(buffer->size() - PAGE_SIZE, 4 * kChunkSize));
+    EXPECT_TRUE(job->IsCommitted(16 * kChunkSize, PAGE_SIZE));
+    EXPECT_FALSE(job->IsCommitted(15 * kChunkSize, PAGE_SIZE));
+
+    EXPECT_TRUE(job->WaitRange(buffer->size(), PAGE_SIZE));
+    EXPECT_EQ(0u, service.background_chunk_count());
+}
+
+TEST(MagmaSystemCommitService, Background)
+{
+    constexpr uint32_t kBufferCount = 8;
+    constexpr uint64_t kBufferSize = 8 * MagmaSystemCommitService::kChunkSize;
+
+    MagmaSystemCommitService service(MagmaSystemCommitService::kDefaultThreadCount);
+
+    std::vector<std::unique_ptr<magma::PlatformBuffer>> buffers;
+    std::vector<std::shared_ptr<MagmaSystemCommitService::Job>> jobs;
+    for (uint32_t i = 0; i < kBufferCount; i++) {
+        buffers.push_back(magma::PlatformBuffer::Create(kBufferSize, "test"));
+        ASSERT_NE(buffers.back(), nullptr);
+        jobs.push_back(service.Enqueue(buffers.back().get()));
+        ASSERT_NE(jobs.back(), nullptr);
+    }
+
+    for (auto& job : jobs) {
+        EXPECT_TRUE(job->WaitRange(0, kBufferSize));
+        EXPECT_TRUE(job->IsCommitted(0, kBufferSize));
+    }
+}
+
+TEST(MagmaSystemCommitService, CancelLeavesQueue)
+{
+    // No background threads, so the job stays queued until it's cancelled.
+    MagmaSystemCommitService service(0);
+
+    auto buffer = magma::PlatformBuffer::Create(4 * MagmaSystemCommitService::kChunkSize, "test");
+    ASSERT_NE(buffer, nullptr);
+
+    auto job = service.Enqueue(buffer.get());
+    ASSERT_NE(job, nullptr);
+    EXPECT_EQ(2, job.use_count());
+
+    job->Cancel();
+    EXPECT_EQ(1, job.use_count());
+
+    // Chunks are still committed on demand.
+    EXPECT_TRUE(job->WaitRange(0, buffer->size()));
+}
+
+TEST(MagmaSystemCommitService, DestroyWithPendingJobs)
+{
+    auto buffer = magma::PlatformBuffer::Create(64 * MagmaSystemCommitService::kChunkSize, "test");
+    ASSERT_NE(buffer, nullptr);
+
+    std::shared_ptr<MagmaSystemCommitService::Job> job;
+    {
+        MagmaSystemCommitService service(MagmaSystemCommitService::kDefaultThreadCount);
+        job = service.Enqueue(buffer.get());
+        ASSERT_NE(job, nullptr);
+        job->Cancel();
+    }
+
+    // Whatever the background threads didn't get to is committed on demand.
+    EXPECT_TRUE(job->WaitRange(0, buffer->size()));
+    EXPECT_TRUE(job->IsCommitted(0, buffer->size()));
+}
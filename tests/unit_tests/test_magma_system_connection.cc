@@ -7,6 +7,7 @@
 #include "sys_driver/magma_system_connection.h"
 #include "sys_driver/magma_system_device.h"
 #include "gtest/gtest.h"
+#include <chrono>
 
 class MsdMockDevice_GetDeviceId : public MsdMockDevice {
 public:
@@ -30,6 +31,24 @@ TEST(MagmaSystemConnection, GetDeviceId)
     EXPECT_EQ(device_id, test_id);
 }
 
+TEST(MagmaSystemConnection, QueryBatch)
+{
+    uint32_t test_id = 0xdeadbeef;
+
+    auto msd_dev = new MsdMockDevice_GetDeviceId(test_id);
+    auto device = MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev));
+
+    uint64_t ids[] = {MAGMA_QUERY_DEVICE_ID, MAGMA_QUERY_DEVICE_ID};
+    uint64_t values[] = {0, 0};
+    EXPECT_TRUE(device->Query(ids, 2, values));
+    EXPECT_EQ(test_id, values[0]);
+    EXPECT_EQ(test_id, values[1]);
+
+    // The mock msd doesn't handle vendor params.
+    ids[1] = MAGMA_QUERY_VENDOR_PARAM_0;
+    EXPECT_FALSE(device->Query(ids, 2, values));
+}
+
 class MsdMockConnection_ContextManagement : public MsdMockConnection {
 public:
     MsdMockConnection_ContextManagement() {}
@@ -82,6 +101,44 @@ TEST(MagmaSystemConnection, ContextManagement)
     EXPECT_FALSE(connection.DestroyContext(context_id_1));
 }
 
+class MsdMockConnection_ContextPriority : public MsdMockConnection {
+public:
+    MsdMockContext* CreateContext() override
+    {
+        last_context_ = MsdMockConnection::CreateContext();
+        return last_context_;
+    }
+
+    // The msd learns a context's priority once it's created.
+    uint32_t last_priority() { return last_context_->priority(); }
+
+private:
+    MsdMockContext* last_context_ = nullptr;
+};
+
+TEST(MagmaSystemConnection, ContextPriority)
+{
+    auto msd_dev = new MsdMockDevice();
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+
+    auto msd_connection = new MsdMockConnection_ContextPriority();
+    MagmaSystemConnection connection(dev, MsdConnectionUniquePtr(msd_connection),
+                                     MAGMA_CAPABILITY_RENDERING);
+    EXPECT_TRUE(connection.CreateContext(0, MAGMA_CONTEXT_PRIORITY_LOW));
+    EXPECT_EQ(static_cast<uint32_t>(MAGMA_CONTEXT_PRIORITY_LOW), msd_connection->last_priority());
+    EXPECT_FALSE(connection.CreateContext(1, MAGMA_CONTEXT_PRIORITY_HIGH));
+    EXPECT_FALSE(connection.CreateContext(1, MAGMA_CONTEXT_PRIORITY_HIGH + 1));
+
+    auto display_msd_connection = new MsdMockConnection_ContextPriority();
+    MagmaSystemConnection display_connection(
+        dev, MsdConnectionUniquePtr(display_msd_connection),
+        MAGMA_CAPABILITY_RENDERING | MAGMA_CAPABILITY_DISPLAY);
+    EXPECT_TRUE(display_connection.CreateContext(0, MAGMA_CONTEXT_PRIORITY_HIGH));
+    EXPECT_EQ(static_cast<uint32_t>(MAGMA_CONTEXT_PRIORITY_HIGH),
+              display_msd_connection->last_priority());
+}
+
 TEST(MagmaSystemConnection, BufferManagement)
 {
     auto msd_drv = msd_driver_create();
@@ -127,6 +184,153 @@ TEST(MagmaSystemConnection, BufferManagement)
     EXPECT_FALSE(connection.ReleaseBuffer(id));
 }
 
+TEST(MagmaSystemConnection, ReleaseBuffers)
+{
+    auto msd_drv = msd_driver_create();
+    ASSERT_NE(msd_drv, nullptr);
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    ASSERT_NE(msd_dev, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+    auto msd_connection = msd_device_open(msd_dev, 0);
+    ASSERT_NE(msd_connection, nullptr);
+    MagmaSystemConnection connection(dev, MsdConnectionUniquePtr(msd_connection),
+                                     MAGMA_CAPABILITY_RENDERING);
+    EXPECT_TRUE(connection.CreateContext(0));
+
+    std::vector<uint64_t> ids(3);
+    for (auto& id : ids) {
+        auto buf = magma::PlatformBuffer::Create(PAGE_SIZE, "test");
+        ASSERT_NE(buf, nullptr);
+        uint32_t duplicate_handle;
+        ASSERT_TRUE(buf->duplicate_handle(&duplicate_handle));
+        EXPECT_TRUE(connection.ImportBuffer(duplicate_handle, &id));
+    }
+    EXPECT_EQ(3u, dev->buffer_count());
+
+    // An unknown id fails the whole batch.
+    uint64_t bad_ids[] = {ids[0], ids[1] + ids[2]};
+    EXPECT_FALSE(connection.ReleaseBuffers(bad_ids, 2));
+    EXPECT_NE(connection.LookupBuffer(ids[0]), nullptr);
+
+    // So does an id named twice.
+    uint64_t duplicate_ids[] = {ids[0], ids[1], ids[0]};
+    EXPECT_FALSE(connection.ReleaseBuffers(duplicate_ids, 3));
+    EXPECT_NE(connection.LookupBuffer(ids[0]), nullptr);
+    EXPECT_NE(connection.LookupBuffer(ids[1]), nullptr);
+    EXPECT_EQ(3u, dev->buffer_count());
+
+    EXPECT_TRUE(connection.ReleaseBuffers(ids.data(), 2));
+    EXPECT_EQ(connection.LookupBuffer(ids[0]), nullptr);
+    EXPECT_EQ(connection.LookupBuffer(ids[1]), nullptr);
+    EXPECT_NE(connection.LookupBuffer(ids[2]), nullptr);
+    EXPECT_EQ(1u, dev->buffer_count());
+
+    EXPECT_FALSE(connection.ReleaseBuffers(ids.data(), 1));
+}
+
+TEST(MagmaSystemConnection, TeardownBenchmark)
+{
+    constexpr uint32_t kBufferCount = 100000;
+    constexpr uint32_t kContextCount = 4;
+
+    auto msd_drv = msd_driver_create();
+    ASSERT_NE(msd_drv, nullptr);
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    ASSERT_NE(msd_dev, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+    auto msd_connection = msd_device_open(msd_dev, 0);
+    ASSERT_NE(msd_connection, nullptr);
+    auto connection = std::make_unique<MagmaSystemConnection>(
+        dev, MsdConnectionUniquePtr(msd_connection), MAGMA_CAPABILITY_RENDERING);
+    for (uint32_t i = 0; i < kContextCount; i++) {
+        EXPECT_TRUE(connection->CreateContext(i));
+    }
+
+    for (uint32_t i = 0; i < kBufferCount; i++) {
+        auto buf = magma::PlatformBuffer::Create(PAGE_SIZE, "test");
+        ASSERT_NE(buf, nullptr);
+        uint32_t duplicate_handle;
+        ASSERT_TRUE(buf->duplicate_handle(&duplicate_handle));
+        uint64_t id;
+        ASSERT_TRUE(connection->ImportBuffer(duplicate_handle, &id));
+    }
+    EXPECT_EQ(kBufferCount, dev->buffer_count());
+
+    auto start = std::chrono::steady_clock::now();
+    connection.reset();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(0u, dev->buffer_count());
+    printf("teardown of %u buffers took %.1f ms\n", kBufferCount, elapsed.count());
+
+    msd_driver_destroy(msd_drv);
+}
+
+TEST(MagmaSystemConnection, Quotas)
+{
+    auto msd_drv = msd_driver_create();
+    ASSERT_NE(msd_drv, nullptr);
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    ASSERT_NE(msd_dev, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+    dev->SetConnectionQuota(MAGMA_CAPABILITY_RENDERING, {2, 3 * PAGE_SIZE, 1, 1});
+    auto msd_connection = msd_device_open(msd_dev, 0);
+    ASSERT_NE(msd_connection, nullptr);
+    MagmaSystemConnection connection(dev, MsdConnectionUniquePtr(msd_connection),
+                                     MAGMA_CAPABILITY_RENDERING);
+
+    auto import_buffer = [&connection](uint64_t size, uint64_t* id_out) {
+        auto buf = magma::PlatformBuffer::Create(size, "test");
+        uint32_t duplicate_handle;
+        if (!buf || !buf->duplicate_handle(&duplicate_handle))
+            return false;
+        return connection.ImportBuffer(duplicate_handle, id_out);
+    };
+
+    uint64_t id;
+    EXPECT_TRUE(import_buffer(2 * PAGE_SIZE, &id));
+    // Over the byte quota.
+    uint64_t rejected_id;
+    EXPECT_FALSE(import_buffer(2 * PAGE_SIZE, &rejected_id));
+    EXPECT_EQ(1u, dev->buffer_count());
+    EXPECT_TRUE(import_buffer(PAGE_SIZE, &rejected_id));
+    // Over the count quota.
+    EXPECT_FALSE(import_buffer(PAGE_SIZE, &rejected_id));
+
+    // Releasing frees quota.
+    EXPECT_TRUE(connection.ReleaseBuffer(id));
+    EXPECT_TRUE(import_buffer(PAGE_SIZE, &id));
+
+    EXPECT_TRUE(connection.CreateContext(0));
+    EXPECT_FALSE(connection.CreateContext(1));
+
+    auto semaphore = magma::PlatformSemaphore::Create();
+    ASSERT_NE(semaphore, nullptr);
+    uint32_t handle;
+    ASSERT_TRUE(semaphore->duplicate_handle(&handle));
+    EXPECT_TRUE(connection.ImportObject(handle, magma::PlatformObject::SEMAPHORE));
+    semaphore = magma::PlatformSemaphore::Create();
+    ASSERT_NE(semaphore, nullptr);
+    ASSERT_TRUE(semaphore->duplicate_handle(&handle));
+    EXPECT_FALSE(connection.ImportObject(handle, magma::PlatformObject::SEMAPHORE));
+
+    MagmaSystemConnection::Usage usage = connection.usage();
+    EXPECT_EQ(2u, usage.buffer_count);
+    EXPECT_EQ(2u * PAGE_SIZE, usage.buffer_bytes);
+    EXPECT_EQ(1u, usage.semaphore_count);
+    EXPECT_EQ(1u, usage.context_count);
+    EXPECT_EQ(4u, usage.rejected_count);
+
+    dev->DumpStatus();
+
+    // Display only connections get the display quota.
+    EXPECT_EQ(MagmaSystemConnection::kDefaultDisplayQuota.max_buffer_count,
+              dev->ConnectionQuota(MAGMA_CAPABILITY_DISPLAY).max_buffer_count);
+}
+
 TEST(MagmaSystemConnection, Semaphores)
 {
     auto msd_drv = msd_driver_create();
@@ -239,22 +443,109 @@ TEST(MagmaSystemConnection, PageFlip)
     auto buffer_presented_semaphore = magma::PlatformSemaphore::Create();
 
     // scanout the buffer
-    EXPECT_TRUE(connection.PageFlip(buf->id(), 0, 1, semaphore_ids.data(),
+    EXPECT_TRUE(connection.PageFlip(buf->id(), 0, 1, semaphore_ids.data(), 0, 0, nullptr,
                                     buffer_presented_semaphore->Clone()));
     EXPECT_TRUE(buffer_presented_semaphore->Wait(100));
 
     // should be unable to pageflip totally bogus handle
-    EXPECT_FALSE(connection.PageFlip(0, 0, 0, nullptr, buffer_presented_semaphore->Clone()));
+    EXPECT_FALSE(connection.PageFlip(0, 0, 0, nullptr, 0, 0, nullptr,
+                                     buffer_presented_semaphore->Clone()));
 
     // should be unable to pageflip unknown semaphore
-    EXPECT_FALSE(connection.PageFlip(buf->id(), 0, 1, bogus_semaphore_ids.data(),
-                                     buffer_presented_semaphore->Clone()));
+    EXPECT_FALSE(connection.PageFlip(buf->id(), 0, 1, bogus_semaphore_ids.data(), 0, 0,
+                                     nullptr, buffer_presented_semaphore->Clone()));
 
     // should be ok to page flip now
-    EXPECT_TRUE(connection.PageFlip(buf->id(), 0, 1, semaphore_ids.data(),
+    EXPECT_TRUE(connection.PageFlip(buf->id(), 0, 1, semaphore_ids.data(), 0, 0, nullptr,
                                     buffer_presented_semaphore->Clone()));
     EXPECT_TRUE(buffer_presented_semaphore->Wait(100));
     EXPECT_TRUE(semaphore->Wait(100));
 
     msd_driver_destroy(msd_drv);
 }
+
+// Points bridged for a submission that then fails are dropped rather than left pending.
+TEST(MagmaSystemConnection, UnbridgeTimelinePoints)
+{
+    auto msd_drv = msd_driver_create();
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+
+    auto msd_connection = msd_device_open(msd_dev, 0);
+    ASSERT_NE(msd_connection, nullptr);
+    MagmaSystemConnection connection(dev, MsdConnectionUniquePtr(msd_connection),
+                                     MAGMA_CAPABILITY_RENDERING);
+
+    std::shared_ptr<magma::PlatformTimelineSemaphore> timeline =
+        magma::PlatformTimelineSemaphore::Create(0);
+    ASSERT_NE(timeline, nullptr);
+
+    auto wait_point = connection.BridgeTimelinePoint(timeline, 1, false);
+    ASSERT_NE(wait_point, nullptr);
+    auto signal_point = connection.BridgeTimelinePoint(timeline, 2, true);
+    ASSERT_NE(signal_point, nullptr);
+    EXPECT_EQ(2u, dev->timeline_bridge()->pending_count());
+
+    connection.UnbridgeTimelinePoints({wait_point, signal_point});
+    EXPECT_EQ(0u, dev->timeline_bridge()->pending_count());
+
+    // Signalling a dropped signal point no longer advances the timeline.
+    signal_point->platform_semaphore()->Signal();
+    EXPECT_FALSE(timeline->Wait(2, 100));
+
+    msd_driver_destroy(msd_drv);
+}
+
+TEST(MagmaSystemConnection, PageFlipTimeline)
+{
+    auto msd_drv = msd_driver_create();
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+
+    auto msd_connection = msd_device_open(msd_dev, 0);
+    ASSERT_NE(msd_connection, nullptr);
+    MagmaSystemConnection connection(dev, MsdConnectionUniquePtr(msd_connection),
+                                     MAGMA_CAPABILITY_DISPLAY);
+
+    auto buf = magma::PlatformBuffer::Create(PAGE_SIZE, "test");
+
+    uint64_t imported_id;
+    uint32_t handle;
+    ASSERT_TRUE(buf->duplicate_handle(&handle));
+    ASSERT_TRUE(connection.ImportBuffer(handle, &imported_id));
+
+    auto timeline = magma::PlatformTimelineSemaphore::Create(0);
+    ASSERT_NE(timeline, nullptr);
+    uint32_t memory_handle, event_handle;
+    ASSERT_TRUE(timeline->duplicate_handles(&memory_handle, &event_handle));
+    ASSERT_TRUE(connection.ImportTimelineSemaphore(memory_handle, event_handle));
+    ASSERT_NE(connection.LookupTimelineSemaphore(timeline->id()), nullptr);
+
+    auto buffer_presented_semaphore = magma::PlatformSemaphore::Create();
+
+    // should be unable to pageflip unknown timeline semaphore
+    magma_system_timeline_point bogus_point{UINT64_MAX, 1};
+    EXPECT_FALSE(connection.PageFlip(buf->id(), 0, 0, nullptr, 0, 1, &bogus_point,
+                                     buffer_presented_semaphore->Clone()));
+
+    // the wait point has already been reached; the signal point advances the timeline when the
+    // buffer is released by the next flip
+    magma_system_timeline_point points[]{{timeline->id(), 0}, {timeline->id(), 1}};
+    EXPECT_TRUE(connection.PageFlip(buf->id(), 0, 0, nullptr, 1, 1, points,
+                                    buffer_presented_semaphore->Clone()));
+    EXPECT_TRUE(buffer_presented_semaphore->Wait(100));
+    EXPECT_FALSE(timeline->Wait(1, 0));
+
+    EXPECT_TRUE(connection.PageFlip(buf->id(), 0, 0, nullptr, 0, 0, nullptr,
+                                    buffer_presented_semaphore->Clone()));
+    EXPECT_TRUE(buffer_presented_semaphore->Wait(100));
+    EXPECT_TRUE(timeline->Wait(1, 1000));
+
+    EXPECT_TRUE(connection.ReleaseObject(timeline->id(),
+                                         magma::PlatformObject::TIMELINE_SEMAPHORE));
+    EXPECT_EQ(connection.LookupTimelineSemaphore(timeline->id()), nullptr);
+
+    msd_driver_destroy(msd_drv);
+}
@@ -5,6 +5,8 @@
 #include "helper/command_buffer_helper.h"
 #include "mock/mock_msd.h"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <vector>
 
 TEST(MagmaSystemContext, ExecuteCommandBuffer_Normal)
 {
@@ -98,3 +100,90 @@ TEST(MagmaSystemContext, ExecuteCommandBuffer_InvalidSignalSemaphore)
     }
     EXPECT_FALSE(cmd_buf->Execute());
 }
+
+TEST(MagmaSystemContext, ExecutePersistentCommandBuffer)
+{
+    constexpr uint32_t kCommandBufferId = 1;
+    constexpr uint32_t kContextId = 0;
+    constexpr uint32_t kBatchStartOffset = PAGE_SIZE;
+
+    auto cmd_buf = CommandBufferHelper::Create();
+    auto connection = cmd_buf->connection();
+    auto ctx = MsdMockContext::cast(cmd_buf->ctx());
+    uint64_t signal_semaphore_id = cmd_buf->abi_signal_semaphore_ids()[0];
+    uint64_t resource_id = cmd_buf->abi_resources()[1].buffer_id;
+
+    MagmaSystemConnection::Usage usage = connection->usage();
+    uint32_t handle;
+    ASSERT_TRUE(cmd_buf->buffer()->duplicate_handle(&handle));
+    ASSERT_TRUE(connection->CreatePersistentCommandBuffer(handle, kCommandBufferId));
+    // The driver's copy counts against the buffer quota.
+    EXPECT_EQ(usage.buffer_count + 1, connection->usage().buffer_count);
+    EXPECT_EQ(usage.buffer_bytes + cmd_buf->buffer()->size(), connection->usage().buffer_bytes);
+
+    // The driver's copy was validated when it was created.
+    cmd_buf->abi_cmd_buf()->batch_buffer_resource_index = CommandBufferHelper::kNumResources;
+    EXPECT_TRUE(
+        connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, nullptr, nullptr));
+    EXPECT_EQ(CommandBufferHelper::kNumResources, ctx->last_submitted_exec_resources().size());
+    EXPECT_EQ(0u, ctx->last_submitted_batch_start_offset());
+    EXPECT_EQ(CommandBufferHelper::kWaitSemaphoreCount + CommandBufferHelper::kSignalSemaphoreCount,
+              ctx->last_submitted_semaphore_count());
+    MsdMockBuffer* registered = ctx->last_submitted_command_buffer();
+
+    // Other semaphores of the registered counts don't need a copy.
+    magma_system_command_buffer_patch patch = {0, CommandBufferHelper::kWaitSemaphoreCount,
+                                               CommandBufferHelper::kSignalSemaphoreCount};
+    std::vector<uint64_t> reversed_ids(
+        cmd_buf->abi_wait_semaphore_ids(),
+        cmd_buf->abi_wait_semaphore_ids() + CommandBufferHelper::kWaitSemaphoreCount +
+            CommandBufferHelper::kSignalSemaphoreCount);
+    std::reverse(reversed_ids.begin(), reversed_ids.end());
+    EXPECT_TRUE(connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, &patch,
+                                                           reversed_ids.data()));
+    EXPECT_EQ(registered, ctx->last_submitted_command_buffer());
+
+    patch = {kBatchStartOffset, 0, 1};
+    uint64_t semaphore_ids[] = {signal_semaphore_id};
+    EXPECT_TRUE(connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, &patch,
+                                                           semaphore_ids));
+    EXPECT_EQ(kBatchStartOffset, ctx->last_submitted_batch_start_offset());
+    EXPECT_EQ(1u, ctx->last_submitted_semaphore_count());
+    MsdMockBuffer* patched = ctx->last_submitted_command_buffer();
+    EXPECT_NE(registered, patched);
+
+    // The copy is reused by later patches like it.
+    uint64_t other_semaphore_ids[] = {cmd_buf->abi_wait_semaphore_ids()[0]};
+    EXPECT_TRUE(connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, &patch,
+                                                           other_semaphore_ids));
+    EXPECT_EQ(patched, ctx->last_submitted_command_buffer());
+    EXPECT_EQ(kBatchStartOffset, ctx->last_submitted_batch_start_offset());
+
+    patch.batch_start_offset = CommandBufferHelper::kBufferSize;
+    EXPECT_FALSE(connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, &patch,
+                                                            semaphore_ids));
+    patch.batch_start_offset = 0;
+    semaphore_ids[0] = 0;
+    EXPECT_FALSE(connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, &patch,
+                                                            semaphore_ids));
+    EXPECT_FALSE(connection->ExecutePersistentCommandBuffer(kCommandBufferId + 1, kContextId,
+                                                            nullptr, nullptr));
+
+    // Releasing a buffer it references releases the command buffer.
+    EXPECT_TRUE(connection->ReleaseBuffer(resource_id));
+    EXPECT_FALSE(
+        connection->ExecutePersistentCommandBuffer(kCommandBufferId, kContextId, nullptr, nullptr));
+    EXPECT_FALSE(connection->ReleasePersistentCommandBuffer(kCommandBufferId));
+    EXPECT_EQ(usage.buffer_count - 1, connection->usage().buffer_count);
+}
+
+TEST(MagmaSystemContext, CreatePersistentCommandBuffer_Invalid)
+{
+    auto cmd_buf = CommandBufferHelper::Create();
+    cmd_buf->abi_resources()[0].buffer_id = 0xdeadbeefdeadbeef;
+
+    uint32_t handle;
+    ASSERT_TRUE(cmd_buf->buffer()->duplicate_handle(&handle));
+    EXPECT_FALSE(cmd_buf->connection()->CreatePersistentCommandBuffer(handle, 1));
+    EXPECT_FALSE(cmd_buf->connection()->ReleasePersistentCommandBuffer(1));
+}
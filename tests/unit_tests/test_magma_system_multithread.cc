@@ -104,6 +104,10 @@ public:
         command_buffer->batch_buffer_resource_index = 0;
         command_buffer->batch_start_offset = 0;
         command_buffer->num_resources = 1;
+        command_buffer->wait_semaphore_count = 0;
+        command_buffer->signal_semaphore_count = 0;
+        command_buffer->wait_timeline_count = 0;
+        command_buffer->signal_timeline_count = 0;
 
         auto exec_resource =
             reinterpret_cast<struct magma_system_exec_resource*>(command_buffer + 1);
@@ -0,0 +1,217 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "helper/command_buffer_helper.h"
+#include "sys_driver/magma_system_scheduler.h"
+#include "gtest/gtest.h"
+#include <future>
+#include <thread>
+
+namespace {
+
+constexpr uint64_t kBlockerClient = ~0ull;
+
+bool WaitFor(const std::function<bool()>& predicate)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+uint64_t SubmitCount(MagmaSystemScheduler* scheduler)
+{
+    auto stats = scheduler->stats();
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < MagmaSystemScheduler::kPriorityCount; i++) {
+        count += stats.submit_count[i];
+    }
+    return count;
+}
+
+// Occupies the scheduler until released, so the order of the submissions queued behind it can be
+// observed.
+class Blocker {
+public:
+    explicit Blocker(MagmaSystemScheduler* scheduler)
+        : queue_(scheduler->CreateQueue(kBlockerClient, MagmaSystemScheduler::kPriorityHigh))
+    {
+        std::shared_future<void> released = release_.get_future().share();
+        thread_ = std::thread([this, scheduler, released] {
+            scheduler->Submit(queue_.get(), 1, [released] {
+                released.wait();
+                return MAGMA_STATUS_OK;
+            });
+        });
+        EXPECT_TRUE(WaitFor([scheduler] { return SubmitCount(scheduler) == 1; }));
+    }
+
+    void Release()
+    {
+        release_.set_value();
+        thread_.join();
+    }
+
+private:
+    std::unique_ptr<MagmaSystemScheduler::Queue> queue_;
+    std::promise<void> release_;
+    std::thread thread_;
+};
+
+// Queues submissions one at a time behind a Blocker and records the order they run in.
+class OrderTest {
+public:
+    explicit OrderTest(MagmaSystemScheduler* scheduler) : scheduler_(scheduler) {}
+
+    void Submit(MagmaSystemScheduler::Queue* queue, uint64_t cost, uint32_t tag)
+    {
+        uint32_t depth = scheduler_->stats().queue_depth;
+        threads_.emplace_back([this, queue, cost, tag] {
+            scheduler_->Submit(queue, cost, [this, tag] {
+                std::unique_lock<std::mutex> lock(mutex_);
+                order_.push_back(tag);
+                return MAGMA_STATUS_OK;
+            });
+        });
+        EXPECT_TRUE(
+            WaitFor([this, depth] { return scheduler_->stats().queue_depth == depth + 1; }));
+    }
+
+    std::vector<uint32_t> Join()
+    {
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+        return order_;
+    }
+
+private:
+    MagmaSystemScheduler* scheduler_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::vector<uint32_t> order_;
+};
+
+} // namespace
+
+TEST(MagmaSystemScheduler, Priority)
+{
+    MagmaSystemScheduler scheduler(10000);
+    auto low = scheduler.CreateQueue(1, MagmaSystemScheduler::kPriorityLow);
+    auto normal = scheduler.CreateQueue(2, MagmaSystemScheduler::kPriorityNormal);
+    auto high = scheduler.CreateQueue(3, MagmaSystemScheduler::kPriorityHigh);
+
+    Blocker blocker(&scheduler);
+    OrderTest test(&scheduler);
+    test.Submit(low.get(), 1, MagmaSystemScheduler::kPriorityLow);
+    test.Submit(normal.get(), 1, MagmaSystemScheduler::kPriorityNormal);
+    test.Submit(high.get(), 1, MagmaSystemScheduler::kPriorityHigh);
+    blocker.Release();
+
+    std::vector<uint32_t> expected = {MagmaSystemScheduler::kPriorityHigh,
+                                      MagmaSystemScheduler::kPriorityNormal,
+                                      MagmaSystemScheduler::kPriorityLow};
+    EXPECT_EQ(expected, test.Join());
+    EXPECT_EQ(0u, scheduler.stats().starvation_count);
+}
+
+// A client with several contending contexts gets no more turns than a client with one.
+TEST(MagmaSystemScheduler, RoundRobinAcrossClients)
+{
+    constexpr uint32_t kClientA = 1;
+    constexpr uint32_t kClientB = 2;
+
+    MagmaSystemScheduler scheduler(10000);
+    std::vector<std::unique_ptr<MagmaSystemScheduler::Queue>> queues;
+    for (uint32_t i = 0; i < 4; i++) {
+        queues.push_back(scheduler.CreateQueue(kClientA, MagmaSystemScheduler::kPriorityNormal));
+    }
+    queues.push_back(scheduler.CreateQueue(kClientB, MagmaSystemScheduler::kPriorityNormal));
+
+    Blocker blocker(&scheduler);
+    OrderTest test(&scheduler);
+    for (uint32_t i = 0; i < 4; i++) {
+        test.Submit(queues[i].get(), MagmaSystemScheduler::kQuantum, kClientA);
+    }
+    test.Submit(queues[4].get(), MagmaSystemScheduler::kQuantum, kClientB);
+    blocker.Release();
+
+    std::vector<uint32_t> expected = {kClientA, kClientB, kClientA, kClientA, kClientA};
+    EXPECT_EQ(expected, test.Join());
+}
+
+TEST(MagmaSystemScheduler, Starvation)
+{
+    MagmaSystemScheduler scheduler(20);
+    auto low = scheduler.CreateQueue(1, MagmaSystemScheduler::kPriorityLow);
+    auto high = scheduler.CreateQueue(2, MagmaSystemScheduler::kPriorityHigh);
+
+    Blocker blocker(&scheduler);
+    OrderTest test(&scheduler);
+    test.Submit(low.get(), 1, MagmaSystemScheduler::kPriorityLow);
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    test.Submit(high.get(), 1, MagmaSystemScheduler::kPriorityHigh);
+    blocker.Release();
+
+    std::vector<uint32_t> expected = {MagmaSystemScheduler::kPriorityLow,
+                                      MagmaSystemScheduler::kPriorityHigh};
+    EXPECT_EQ(expected, test.Join());
+    EXPECT_EQ(1u, scheduler.stats().starvation_count);
+}
+
+TEST(MagmaSystemScheduler, ManySubmitters)
+{
+    constexpr uint32_t kHighThreadCount = 4;
+    constexpr uint32_t kNormalThreadCount = 12;
+    constexpr uint32_t kSubmitCount = 200;
+
+    MagmaSystemScheduler scheduler;
+    std::atomic_bool running{false};
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < kHighThreadCount + kNormalThreadCount; i++) {
+        auto priority = i < kHighThreadCount ? MagmaSystemScheduler::kPriorityHigh
+                                             : MagmaSystemScheduler::kPriorityNormal;
+        threads.emplace_back([&scheduler, &running, i, priority] {
+            auto queue = scheduler.CreateQueue(i, priority);
+            for (uint32_t j = 0; j < kSubmitCount; j++) {
+                magma_status_t status =
+                    scheduler.Submit(queue.get(), (j % 8 + 1) * PAGE_SIZE, [&running] {
+                        // Only one submission runs at a time.
+                        EXPECT_FALSE(running.exchange(true));
+                        std::this_thread::sleep_for(std::chrono::microseconds(20));
+                        running = false;
+                        return MAGMA_STATUS_OK;
+                    });
+                EXPECT_EQ(MAGMA_STATUS_OK, status);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto stats = scheduler.stats();
+    EXPECT_EQ(kHighThreadCount * kSubmitCount,
+              stats.submit_count[MagmaSystemScheduler::kPriorityHigh]);
+    EXPECT_EQ(kNormalThreadCount * kSubmitCount,
+              stats.submit_count[MagmaSystemScheduler::kPriorityNormal]);
+    EXPECT_EQ(0u, stats.queue_depth);
+    EXPECT_LE(stats.max_queue_depth, kHighThreadCount + kNormalThreadCount);
+    // High priority submissions wait less on average.
+    EXPECT_LE(stats.total_wait_us[MagmaSystemScheduler::kPriorityHigh] /
+                  stats.submit_count[MagmaSystemScheduler::kPriorityHigh],
+              stats.total_wait_us[MagmaSystemScheduler::kPriorityNormal] /
+                  stats.submit_count[MagmaSystemScheduler::kPriorityNormal]);
+}
+
+TEST(MagmaSystemScheduler, ContextSubmitsThroughScheduler)
+{
+    auto cmd_buf = CommandBufferHelper::Create();
+    EXPECT_TRUE(cmd_buf->Execute());
+    auto stats = cmd_buf->dev()->scheduler()->stats();
+    EXPECT_EQ(1u, stats.submit_count[MagmaSystemScheduler::kPriorityNormal]);
+}
@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "sys_driver/magma_system_timeline_bridge.h"
+#include "gtest/gtest.h"
+
+TEST(MagmaSystemTimelineBridge, Points)
+{
+    auto bridge = MagmaSystemTimelineBridge::Create();
+    ASSERT_NE(bridge, nullptr);
+
+    std::shared_ptr<magma::PlatformTimelineSemaphore> timeline =
+        magma::PlatformTimelineSemaphore::Create(0);
+    ASSERT_NE(timeline, nullptr);
+
+    auto wait_semaphore = bridge->WaitPoint(timeline, 1);
+    ASSERT_NE(wait_semaphore, nullptr);
+    EXPECT_EQ(1u, bridge->pending_count());
+    timeline->Signal(1);
+    EXPECT_TRUE(wait_semaphore->platform_semaphore()->Wait(1000));
+
+    auto signal_semaphore = bridge->SignalPoint(timeline, 2);
+    ASSERT_NE(signal_semaphore, nullptr);
+    signal_semaphore->platform_semaphore()->Signal();
+    EXPECT_TRUE(timeline->Wait(2, 1000));
+
+    // Already reached, so signalled without being armed.
+    wait_semaphore = bridge->WaitPoint(timeline, 2);
+    ASSERT_NE(wait_semaphore, nullptr);
+    EXPECT_TRUE(wait_semaphore->platform_semaphore()->Wait(0));
+}
+
+TEST(MagmaSystemTimelineBridge, FailingPort)
+{
+    auto port = magma::PlatformPort::Create();
+    ASSERT_NE(port, nullptr);
+    port->Close();
+
+    MagmaSystemTimelineBridge bridge(std::move(port), magma::PlatformSemaphore::Create());
+
+    std::shared_ptr<magma::PlatformTimelineSemaphore> timeline =
+        magma::PlatformTimelineSemaphore::Create(0);
+    ASSERT_NE(timeline, nullptr);
+
+    // Points that can't be armed would never be signalled, so they're refused.
+    EXPECT_EQ(nullptr, bridge.WaitPoint(timeline, 1));
+    EXPECT_EQ(nullptr, bridge.SignalPoint(timeline, 1));
+    EXPECT_EQ(0u, bridge.pending_count());
+
+    // A reached wait point doesn't need the port.
+    auto semaphore = bridge.WaitPoint(timeline, 0);
+    ASSERT_NE(semaphore, nullptr);
+    EXPECT_TRUE(semaphore->platform_semaphore()->Wait(0));
+}
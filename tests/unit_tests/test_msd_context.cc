@@ -20,7 +20,7 @@ TEST(MsdContext, CreateAndDestroy)
     auto msd_connection = msd_device_open(msd_device, 0);
     ASSERT_NE(msd_connection, nullptr);
 
-    auto msd_context = msd_connection_create_context(msd_connection);
+    auto msd_context = msd_connection_create_context(msd_connection, MAGMA_CONTEXT_PRIORITY_NORMAL);
     EXPECT_NE(msd_context, nullptr);
 
     msd_context_destroy(msd_context);
@@ -0,0 +1,176 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_util/pin_count_map.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <inttypes.h>
+#include <vector>
+
+namespace {
+
+struct Range {
+    uint32_t start;
+    uint32_t count;
+};
+
+std::vector<Range> Unpin(magma::PinCountMap* map, uint32_t start, uint32_t count, bool* result)
+{
+    std::vector<Range> released;
+    *result = map->Unpin(start, count, [&released](uint32_t release_start, uint32_t release_count) {
+        released.push_back({release_start, release_count});
+    });
+    return released;
+}
+
+} // namespace
+
+TEST(PinCountMap, Basic)
+{
+    magma::PinCountMap map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.IsPinned(0, 1));
+
+    map.Pin(10, 10);
+    EXPECT_EQ(1u, map.extent_count());
+    EXPECT_EQ(0u, map.pin_count(9));
+    EXPECT_EQ(1u, map.pin_count(10));
+    EXPECT_EQ(1u, map.pin_count(19));
+    EXPECT_EQ(0u, map.pin_count(20));
+    EXPECT_TRUE(map.IsPinned(10, 10));
+    EXPECT_FALSE(map.IsPinned(9, 2));
+    EXPECT_FALSE(map.IsPinned(19, 2));
+
+    bool result;
+    auto released = Unpin(&map, 10, 10, &result);
+    EXPECT_TRUE(result);
+    ASSERT_EQ(1u, released.size());
+    EXPECT_EQ(10u, released[0].start);
+    EXPECT_EQ(10u, released[0].count);
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(PinCountMap, Overlap)
+{
+    magma::PinCountMap map;
+    map.Pin(0, 10);
+    map.Pin(5, 10);
+    EXPECT_EQ(3u, map.extent_count());
+    EXPECT_EQ(1u, map.pin_count(4));
+    EXPECT_EQ(2u, map.pin_count(5));
+    EXPECT_EQ(2u, map.pin_count(9));
+    EXPECT_EQ(1u, map.pin_count(10));
+    EXPECT_TRUE(map.IsPinned(0, 15));
+
+    bool result;
+    auto released = Unpin(&map, 0, 10, &result);
+    EXPECT_TRUE(result);
+    ASSERT_EQ(1u, released.size());
+    EXPECT_EQ(0u, released[0].start);
+    EXPECT_EQ(5u, released[0].count);
+
+    // The remaining extents have equal counts and are merged.
+    EXPECT_EQ(1u, map.extent_count());
+    EXPECT_TRUE(map.IsPinned(5, 10));
+
+    // Unpinning a partly unpinned range fails without effect.
+    released = Unpin(&map, 0, 10, &result);
+    EXPECT_FALSE(result);
+    EXPECT_TRUE(released.empty());
+    EXPECT_EQ(1u, map.pin_count(5));
+
+    released = Unpin(&map, 5, 10, &result);
+    EXPECT_TRUE(result);
+    ASSERT_EQ(1u, released.size());
+    EXPECT_EQ(5u, released[0].start);
+    EXPECT_EQ(10u, released[0].count);
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(PinCountMap, ReleasedRanges)
+{
+    magma::PinCountMap map;
+    map.Pin(0, 30);
+    map.Pin(10, 10);
+
+    // Only the ends drop to zero.
+    bool result;
+    auto released = Unpin(&map, 0, 30, &result);
+    EXPECT_TRUE(result);
+    ASSERT_EQ(2u, released.size());
+    EXPECT_EQ(0u, released[0].start);
+    EXPECT_EQ(10u, released[0].count);
+    EXPECT_EQ(20u, released[1].start);
+    EXPECT_EQ(10u, released[1].count);
+    EXPECT_EQ(1u, map.extent_count());
+}
+
+TEST(PinCountMap, Erase)
+{
+    magma::PinCountMap map;
+    map.Pin(0, 30);
+    map.Pin(10, 10);
+
+    map.Erase(5, 10);
+    EXPECT_EQ(1u, map.pin_count(4));
+    EXPECT_EQ(0u, map.pin_count(5));
+    EXPECT_EQ(0u, map.pin_count(14));
+    EXPECT_EQ(2u, map.pin_count(15));
+    EXPECT_FALSE(map.IsPinned(0, 30));
+    EXPECT_TRUE(map.IsPinned(15, 15));
+
+    // Erasing what isn't pinned is a no-op.
+    map.Erase(5, 10);
+    map.Erase(40, 10);
+    EXPECT_EQ(3u, map.extent_count());
+
+    map.Erase(0, 30);
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(PinCountMap, NoCountLimit)
+{
+    magma::PinCountMap map;
+    constexpr uint32_t kPinCount = 1000;
+    for (uint32_t i = 0; i < kPinCount; i++)
+        map.Pin(0, 16);
+    EXPECT_EQ(kPinCount, map.pin_count(0));
+    EXPECT_EQ(1u, map.extent_count());
+
+    bool result;
+    for (uint32_t i = 0; i < kPinCount - 1; i++) {
+        EXPECT_TRUE(Unpin(&map, 0, 16, &result).empty());
+        EXPECT_TRUE(result);
+    }
+    EXPECT_EQ(1u, Unpin(&map, 0, 16, &result).size());
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(PinCountMap, Benchmark)
+{
+    constexpr uint64_t kBufferSizes[] = {4096, 64ull * 1024 * 1024, 1024ull * 1024 * 1024};
+    constexpr uint32_t kIterations = 1000;
+
+    for (uint64_t size : kBufferSizes) {
+        uint32_t page_count = size / 4096;
+        magma::PinCountMap map;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < kIterations; i++) {
+            // A whole buffer pin overlapping a pin of its first half, as when a buffer is mapped
+            // into two address spaces.
+            map.Pin(0, page_count);
+            map.Pin(0, (page_count + 1) / 2);
+            bool result = map.Unpin(0, page_count, [](uint32_t, uint32_t) {});
+            result &= map.Unpin(0, (page_count + 1) / 2, [](uint32_t, uint32_t) {});
+            ASSERT_TRUE(result);
+        }
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::high_resolution_clock::now() - start;
+
+        EXPECT_TRUE(map.empty());
+        printf("buffer size %" PRIu64 " pin/unpin cycle %f us\n", size,
+               elapsed.count() / kIterations);
+    }
+}
@@ -240,6 +240,121 @@ public:
         }
     }
 
+    static void BusAddressCache()
+    {
+        constexpr uint32_t kNumPages = 8;
+        std::unique_ptr<magma::PlatformBuffer> buffer =
+            magma::PlatformBuffer::Create(kNumPages * PAGE_SIZE, "test");
+        ASSERT_NE(buffer, nullptr);
+
+        EXPECT_TRUE(buffer->PinPages(0, kNumPages));
+
+        uint64_t total_avoided = magma::PlatformBuffer::total_bus_lookups_avoided();
+
+        uint64_t bus_addr[kNumPages];
+        EXPECT_TRUE(buffer->MapPageRangeBus(0, kNumPages, bus_addr));
+        EXPECT_EQ(0u, buffer->bus_lookups_avoided());
+
+        // Sub-ranges of pages already looked up come from the cache.
+        uint64_t cached_addr[kNumPages];
+        EXPECT_TRUE(buffer->MapPageRangeBus(2, 3, cached_addr));
+        EXPECT_EQ(1u, buffer->bus_lookups_avoided());
+        EXPECT_EQ(total_avoided + 1, magma::PlatformBuffer::total_bus_lookups_avoided());
+        for (uint32_t i = 0; i < 3; i++)
+            EXPECT_EQ(bus_addr[i + 2], cached_addr[i]);
+
+        EXPECT_TRUE(buffer->MapPageRangeBus(0, kNumPages, cached_addr));
+        EXPECT_EQ(2u, buffer->bus_lookups_avoided());
+        for (uint32_t i = 0; i < kNumPages; i++)
+            EXPECT_EQ(bus_addr[i], cached_addr[i]);
+
+        // Unpinning invalidates, so the next mapping has to look the pages up again.
+        EXPECT_TRUE(buffer->PinPages(0, 1));
+        EXPECT_TRUE(buffer->UnpinPages(0, kNumPages));
+        EXPECT_TRUE(buffer->PinPages(4, 4));
+        EXPECT_TRUE(buffer->MapPageRangeBus(4, 4, cached_addr));
+        EXPECT_EQ(2u, buffer->bus_lookups_avoided());
+        EXPECT_TRUE(buffer->MapPageRangeBus(0, 1, cached_addr));
+        EXPECT_EQ(3u, buffer->bus_lookups_avoided());
+
+        EXPECT_TRUE(buffer->UnpinPages(0, 1));
+        EXPECT_TRUE(buffer->UnpinPages(4, 4));
+        EXPECT_FALSE(buffer->MapPageRangeBus(0, 1, cached_addr));
+
+        // Extents are looked up separately, merged, and split by unpinning their middle.
+        EXPECT_TRUE(buffer->PinPages(0, kNumPages));
+        EXPECT_TRUE(buffer->MapPageRangeBus(1, 2, cached_addr));
+        EXPECT_TRUE(buffer->MapPageRangeBus(5, 2, cached_addr));
+        EXPECT_TRUE(buffer->MapPageRangeBus(0, kNumPages, bus_addr));
+        EXPECT_EQ(3u, buffer->bus_lookups_avoided());
+        EXPECT_TRUE(buffer->MapPageRangeBus(0, kNumPages, cached_addr));
+        EXPECT_EQ(4u, buffer->bus_lookups_avoided());
+        for (uint32_t i = 0; i < kNumPages; i++)
+            EXPECT_EQ(bus_addr[i], cached_addr[i]);
+
+        EXPECT_TRUE(buffer->UnpinPages(3, 2));
+        EXPECT_TRUE(buffer->MapPageRangeBus(0, 3, cached_addr));
+        EXPECT_TRUE(buffer->MapPageRangeBus(5, 3, cached_addr));
+        EXPECT_EQ(6u, buffer->bus_lookups_avoided());
+        EXPECT_EQ(bus_addr[5], cached_addr[0]);
+        EXPECT_FALSE(buffer->MapPageRangeBus(2, 2, cached_addr));
+        EXPECT_TRUE(buffer->UnpinPages(0, 3));
+        EXPECT_TRUE(buffer->UnpinPages(5, 3));
+    }
+
+    static void MapCpuRange()
+    {
+        constexpr uint32_t kNumPages = 16;
+        std::unique_ptr<magma::PlatformBuffer> buffer =
+            magma::PlatformBuffer::Create(kNumPages * PAGE_SIZE, "test");
+        ASSERT_NE(buffer, nullptr);
+
+        void* whole_addr;
+        ASSERT_TRUE(buffer->MapCpu(&whole_addr));
+        for (uint32_t i = 0; i < kNumPages; i++)
+            reinterpret_cast<uint32_t*>(whole_addr)[i * PAGE_SIZE / sizeof(uint32_t)] = i;
+
+        // Unaligned ranges return the address of the offset.
+        void* addr;
+        ASSERT_TRUE(buffer->MapCpuRange(2 * PAGE_SIZE + 4, 8, 0, &addr));
+        EXPECT_EQ(4u, reinterpret_cast<uintptr_t>(addr) % PAGE_SIZE);
+        void* page2_addr = reinterpret_cast<uint8_t*>(addr) - 4;
+        EXPECT_EQ(2u, *reinterpret_cast<uint32_t*>(page2_addr));
+
+        // Overlapping ranges share the mapping.
+        void* range_addr;
+        ASSERT_TRUE(buffer->MapCpuRange(PAGE_SIZE, 4 * PAGE_SIZE, 0, &range_addr));
+        EXPECT_EQ(reinterpret_cast<uint8_t*>(range_addr) + PAGE_SIZE, page2_addr);
+        EXPECT_EQ(4u, reinterpret_cast<uint32_t*>(range_addr)[3 * PAGE_SIZE / sizeof(uint32_t)]);
+
+        // Read only mappings can't coexist with writable ones.
+        EXPECT_FALSE(buffer->MapCpuRange(8 * PAGE_SIZE, PAGE_SIZE,
+                                         magma::PlatformBuffer::kMapReadOnly, &addr));
+
+        EXPECT_TRUE(buffer->UnmapCpuRange(PAGE_SIZE, 4 * PAGE_SIZE));
+        // Page 2 is still mapped by the first range.
+        EXPECT_EQ(2u, *reinterpret_cast<uint32_t*>(page2_addr));
+        EXPECT_TRUE(buffer->UnmapCpuRange(2 * PAGE_SIZE + 4, 8));
+        EXPECT_FALSE(buffer->UnmapCpuRange(2 * PAGE_SIZE, PAGE_SIZE));
+
+        ASSERT_TRUE(buffer->MapCpuRange(8 * PAGE_SIZE, PAGE_SIZE,
+                                        magma::PlatformBuffer::kMapReadOnly, &addr));
+        EXPECT_EQ(8u, *reinterpret_cast<uint32_t*>(addr));
+
+        // Single pages follow the same rule.
+        EXPECT_FALSE(buffer->MapPageCpu(9, &addr));
+        ASSERT_TRUE(buffer->MapPageCpu(9, magma::PlatformBuffer::kMapReadOnly, &addr));
+        EXPECT_EQ(9u, *reinterpret_cast<uint32_t*>(addr));
+        EXPECT_TRUE(buffer->UnmapPageCpu(9));
+
+        EXPECT_TRUE(buffer->UnmapCpuRange(8 * PAGE_SIZE, PAGE_SIZE));
+
+        EXPECT_FALSE(buffer->MapCpuRange(kNumPages * PAGE_SIZE - 4, 8, 0, &addr));
+        EXPECT_FALSE(buffer->MapCpuRange(0, 0, 0, &addr));
+
+        EXPECT_TRUE(buffer->UnmapCpu());
+    }
+
     static void CommitPages(uint32_t num_pages)
     {
         std::unique_ptr<magma::PlatformBuffer> buffer =
@@ -272,6 +387,11 @@ TEST(PlatformBuffer, Basic)
 TEST(PlatformBuffer, BufferPassing) { TestPlatformBuffer::BufferPassing(); }
 TEST(PlatformBuffer, BufferFdPassing) { TestPlatformBuffer::BufferFdPassing(); }
 
+TEST(PlatformBuffer, BusAddressCache) { TestPlatformBuffer::BusAddressCache(); }
+
+
+TEST(PlatformBuffer, MapCpuRange) { TestPlatformBuffer::MapCpuRange(); }
+
 TEST(PlatformBuffer, Commit)
 {
     TestPlatformBuffer::CommitPages(1);
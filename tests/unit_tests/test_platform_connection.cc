@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include "platform_connection.h"
+#include "platform_timeline_semaphore.h"
 #include "gtest/gtest.h"
 #include <chrono>
 #include <thread>
@@ -39,6 +40,28 @@ public:
         EXPECT_EQ(ipc_connection_->ImportBuffer(buf.get()), 0);
         EXPECT_EQ(ipc_connection_->ReleaseBuffer(test_buffer_id), 0);
         EXPECT_EQ(ipc_connection_->GetError(), 0);
+        EXPECT_EQ(1u, test_release_count);
+    }
+    void TestReleaseBuffers()
+    {
+        for (uint32_t i = 0; i < 3; i++) {
+            EXPECT_EQ(ipc_connection_->ReleaseBuffer(test_buffer_id), 0);
+        }
+        EXPECT_EQ(0u, test_release_count);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+        EXPECT_EQ(3u, test_release_count);
+        EXPECT_EQ(1u, test_release_batch_count);
+    }
+    void TestReimportBuffer()
+    {
+        auto buf = magma::PlatformBuffer::Create(1, "test");
+        test_buffer_id = buf->id();
+        EXPECT_EQ(ipc_connection_->ImportBuffer(buf.get()), 0);
+        EXPECT_EQ(ipc_connection_->ReleaseBuffer(test_buffer_id), 0);
+        // The delegate checks the release arrives before the second import.
+        EXPECT_EQ(ipc_connection_->ImportBuffer(buf.get()), 0);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+        EXPECT_EQ(2u, test_import_count);
     }
 
     void TestImportObject()
@@ -65,9 +88,10 @@ public:
     void TestCreateContext()
     {
         uint32_t context_id;
-        ipc_connection_->CreateContext(&context_id);
+        ipc_connection_->CreateContext(MAGMA_CONTEXT_PRIORITY_LOW, &context_id);
         EXPECT_EQ(ipc_connection_->GetError(), 0);
         EXPECT_EQ(test_context_id, context_id);
+        EXPECT_EQ(static_cast<uint32_t>(MAGMA_CONTEXT_PRIORITY_LOW), test_context_priority);
     }
     void TestDestroyContext()
     {
@@ -84,6 +108,31 @@ public:
         ipc_connection_->ExecuteCommandBuffer(handle, test_context_id);
         EXPECT_EQ(ipc_connection_->GetError(), 0);
     }
+    void TestPersistentCommandBuffer()
+    {
+        auto buf = magma::PlatformBuffer::Create(1, "test");
+        test_buffer_id = buf->id();
+        uint32_t handle;
+        EXPECT_TRUE(buf->duplicate_handle(&handle));
+        ipc_connection_->CreatePersistentCommandBuffer(handle, &test_command_buffer_id);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+
+        ipc_connection_->ExecutePersistentCommandBuffer(test_command_buffer_id, test_context_id,
+                                                        nullptr, nullptr);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+        EXPECT_FALSE(test_patched);
+
+        magma_system_command_buffer_patch patch = {8, 2, 1};
+        uint64_t semaphore_ids[] = {0, 1, 2};
+        ipc_connection_->ExecutePersistentCommandBuffer(test_command_buffer_id, test_context_id,
+                                                        &patch, semaphore_ids);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+        EXPECT_TRUE(test_patched);
+
+        ipc_connection_->ReleasePersistentCommandBuffer(test_command_buffer_id);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+    }
+
     void TestWaitRendering()
     {
         ipc_connection_->WaitRendering(test_buffer_id);
@@ -96,7 +145,19 @@ public:
         test_semaphore = magma::PlatformSemaphore::Create();
         uint32_t buffer_presented_handle;
         EXPECT_TRUE(test_semaphore->duplicate_handle(&buffer_presented_handle));
-        ipc_connection_->PageFlip(test_buffer_id, 2, 1, semaphore_ids, buffer_presented_handle);
+        magma_system_timeline_point timeline_points[]{{3, 4}, {5, 6}};
+        ipc_connection_->PageFlip(test_buffer_id, 2, 1, semaphore_ids, 1, 1, timeline_points,
+                                  buffer_presented_handle);
+        EXPECT_EQ(ipc_connection_->GetError(), 0);
+    }
+
+    void TestImportTimelineSemaphore()
+    {
+        auto semaphore = magma::PlatformTimelineSemaphore::Create(0);
+        test_semaphore_id = semaphore->id();
+        uint32_t memory_handle, event_handle;
+        EXPECT_TRUE(semaphore->duplicate_handles(&memory_handle, &event_handle));
+        EXPECT_EQ(ipc_connection_->ImportTimelineSemaphore(memory_handle, event_handle), 0);
         EXPECT_EQ(ipc_connection_->GetError(), 0);
     }
 
@@ -107,7 +168,13 @@ public:
     }
 
     static uint64_t test_buffer_id;
+    static uint32_t test_import_count;
+    static uint32_t test_release_count;
+    static uint32_t test_release_batch_count;
     static uint32_t test_context_id;
+    static uint32_t test_context_priority;
+    static uint32_t test_command_buffer_id;
+    static bool test_patched;
     static uint64_t test_semaphore_id;
     static magma_status_t test_error;
     static bool test_complete;
@@ -125,8 +192,14 @@ private:
 };
 
 uint64_t TestPlatformConnection::test_buffer_id;
+uint32_t TestPlatformConnection::test_import_count;
+uint32_t TestPlatformConnection::test_release_count;
+uint32_t TestPlatformConnection::test_release_batch_count;
 uint64_t TestPlatformConnection::test_semaphore_id;
 uint32_t TestPlatformConnection::test_context_id;
+uint32_t TestPlatformConnection::test_context_priority;
+uint32_t TestPlatformConnection::test_command_buffer_id;
+bool TestPlatformConnection::test_patched;
 magma_status_t TestPlatformConnection::test_error;
 bool TestPlatformConnection::test_complete;
 std::unique_ptr<magma::PlatformSemaphore> TestPlatformConnection::test_semaphore;
@@ -137,12 +210,19 @@ public:
     {
         auto buf = magma::PlatformBuffer::Import(handle);
         EXPECT_EQ(buf->id(), TestPlatformConnection::test_buffer_id);
+        EXPECT_EQ(TestPlatformConnection::test_import_count++,
+                  TestPlatformConnection::test_release_count);
         TestPlatformConnection::test_complete = true;
         return true;
     }
-    bool ReleaseBuffer(uint64_t buffer_id) override
+    bool ReleaseBuffer(uint64_t buffer_id) override { return ReleaseBuffers(&buffer_id, 1); }
+    bool ReleaseBuffers(const uint64_t* buffer_ids, uint32_t count) override
     {
-        EXPECT_EQ(buffer_id, TestPlatformConnection::test_buffer_id);
+        for (uint32_t i = 0; i < count; i++) {
+            EXPECT_EQ(buffer_ids[i], TestPlatformConnection::test_buffer_id);
+        }
+        TestPlatformConnection::test_release_count += count;
+        TestPlatformConnection::test_release_batch_count++;
         TestPlatformConnection::test_complete = true;
         return true;
     }
@@ -160,10 +240,18 @@ public:
         TestPlatformConnection::test_complete = true;
         return true;
     }
+    bool ImportTimelineSemaphore(uint32_t memory_handle, uint32_t event_handle) override
+    {
+        auto semaphore = magma::PlatformTimelineSemaphore::Import(memory_handle, event_handle);
+        EXPECT_EQ(semaphore->id(), TestPlatformConnection::test_semaphore_id);
+        TestPlatformConnection::test_complete = true;
+        return true;
+    }
 
-    bool CreateContext(uint32_t context_id) override
+    bool CreateContext(uint32_t context_id, uint32_t priority) override
     {
         TestPlatformConnection::test_context_id = context_id;
+        TestPlatformConnection::test_context_priority = priority;
         TestPlatformConnection::test_complete = true;
         return true;
     }
@@ -182,6 +270,39 @@ public:
         TestPlatformConnection::test_complete = true;
         return MAGMA_STATUS_OK;
     }
+
+    bool CreatePersistentCommandBuffer(uint32_t command_buffer_handle,
+                                       uint32_t command_buffer_id) override
+    {
+        auto buffer = magma::PlatformBuffer::Import(command_buffer_handle);
+        EXPECT_EQ(buffer->id(), TestPlatformConnection::test_buffer_id);
+        EXPECT_EQ(command_buffer_id, TestPlatformConnection::test_command_buffer_id);
+        return true;
+    }
+    bool ReleasePersistentCommandBuffer(uint32_t command_buffer_id) override
+    {
+        EXPECT_EQ(command_buffer_id, TestPlatformConnection::test_command_buffer_id);
+        TestPlatformConnection::test_complete = true;
+        return true;
+    }
+    magma::Status ExecutePersistentCommandBuffer(uint32_t command_buffer_id, uint32_t context_id,
+                                                 const magma_system_command_buffer_patch* patch,
+                                                 const uint64_t* semaphore_ids) override
+    {
+        EXPECT_EQ(command_buffer_id, TestPlatformConnection::test_command_buffer_id);
+        EXPECT_EQ(context_id, TestPlatformConnection::test_context_id);
+        TestPlatformConnection::test_patched = patch != nullptr;
+        if (patch) {
+            EXPECT_EQ(8u, patch->batch_start_offset);
+            EXPECT_EQ(2u, patch->wait_semaphore_count);
+            EXPECT_EQ(1u, patch->signal_semaphore_count);
+            for (uint32_t i = 0; i < 3; i++) {
+                EXPECT_EQ(i, semaphore_ids[i]);
+            }
+        }
+        return MAGMA_STATUS_OK;
+    }
+
     magma::Status WaitRendering(uint64_t buffer_id) override
     {
         EXPECT_EQ(buffer_id, TestPlatformConnection::test_buffer_id);
@@ -191,7 +312,8 @@ public:
 
     magma::Status
     PageFlip(uint64_t buffer_id, uint32_t wait_semaphore_count, uint32_t signal_semaphore_count,
-             uint64_t* semaphore_ids,
+             uint64_t* semaphore_ids, uint32_t wait_point_count, uint32_t signal_point_count,
+             magma_system_timeline_point* timeline_points,
              std::unique_ptr<magma::PlatformSemaphore> buffer_presented_semaphore) override
     {
         EXPECT_EQ(buffer_id, TestPlatformConnection::test_buffer_id);
@@ -200,6 +322,12 @@ public:
         for (uint32_t i = 0; i < wait_semaphore_count + signal_semaphore_count; i++) {
             EXPECT_EQ(i, semaphore_ids[i]);
         }
+        EXPECT_EQ(1u, wait_point_count);
+        EXPECT_EQ(1u, signal_point_count);
+        for (uint32_t i = 0; i < wait_point_count + signal_point_count; i++) {
+            EXPECT_EQ(3 + 2 * i, timeline_points[i].semaphore_id);
+            EXPECT_EQ(4 + 2 * i, timeline_points[i].value);
+        }
         EXPECT_EQ(buffer_presented_semaphore->id(), TestPlatformConnection::test_semaphore->id());
         TestPlatformConnection::test_complete = true;
         return MAGMA_STATUS_OK;
@@ -209,8 +337,14 @@ public:
 std::unique_ptr<TestPlatformConnection> TestPlatformConnection::Create()
 {
     test_buffer_id = 0xcafecafecafecafe;
+    test_import_count = 0;
+    test_release_count = 0;
+    test_release_batch_count = 0;
     test_semaphore_id = ~0u;
     test_context_id = 0xdeadbeef;
+    test_context_priority = ~0u;
+    test_command_buffer_id = ~0u;
+    test_patched = false;
     test_error = 0x12345678;
     test_complete = false;
     auto delegate = std::make_unique<TestDelegate>();
@@ -249,6 +383,20 @@ TEST(PlatformConnection, ReleaseBuffer)
     Test->TestReleaseBuffer();
 }
 
+TEST(PlatformConnection, ReleaseBuffers)
+{
+    auto Test = TestPlatformConnection::Create();
+    ASSERT_NE(Test, nullptr);
+    Test->TestReleaseBuffers();
+}
+
+TEST(PlatformConnection, ReimportBuffer)
+{
+    auto Test = TestPlatformConnection::Create();
+    ASSERT_NE(Test, nullptr);
+    Test->TestReimportBuffer();
+}
+
 TEST(PlatformConnection, ImportObject)
 {
     auto Test = TestPlatformConnection::Create();
@@ -263,6 +411,13 @@ TEST(PlatformConnection, ReleaseObject)
     Test->TestReleaseObject();
 }
 
+TEST(PlatformConnection, ImportTimelineSemaphore)
+{
+    auto Test = TestPlatformConnection::Create();
+    ASSERT_NE(Test, nullptr);
+    Test->TestImportTimelineSemaphore();
+}
+
 TEST(PlatformConnection, CreateContext)
 {
     auto Test = TestPlatformConnection::Create();
@@ -284,6 +439,13 @@ TEST(PlatformConnection, ExecuteCommandBuffer)
     Test->TestExecuteCommandBuffer();
 }
 
+TEST(PlatformConnection, PersistentCommandBuffer)
+{
+    auto Test = TestPlatformConnection::Create();
+    ASSERT_NE(Test, nullptr);
+    Test->TestPersistentCommandBuffer();
+}
+
 TEST(PlatformConnection, WaitRendering)
 {
     auto Test = TestPlatformConnection::Create();
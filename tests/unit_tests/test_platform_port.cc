@@ -8,6 +8,7 @@
 #include "gtest/gtest.h"
 #include <chrono>
 #include <thread>
+#include <vector>
 
 namespace {
 
@@ -81,6 +82,33 @@ public:
             thread->join();
         }
 
+        // Verify WaitMany drains every queued packet
+        {
+            std::vector<std::unique_ptr<magma::PlatformSemaphore>> sems;
+            for (uint32_t i = 0; i < 3; i++) {
+                sems.push_back(magma::PlatformSemaphore::Create());
+                EXPECT_TRUE(sems[i]->WaitAsync(port.get()));
+                sems[i]->Signal();
+            }
+
+            uint64_t keys[3];
+            uint32_t count = 0;
+            EXPECT_EQ(MAGMA_STATUS_OK, port->WaitMany(keys, 2, &count, 100).get());
+            EXPECT_EQ(2u, count);
+            EXPECT_EQ(MAGMA_STATUS_OK, port->WaitMany(keys + 2, 2, &count, 100).get());
+            EXPECT_EQ(1u, count);
+            EXPECT_EQ(MAGMA_STATUS_TIMED_OUT, port->WaitMany(keys, 2, &count, 100).get());
+
+            // Packets are delivered in the order the semaphores were signalled.
+            for (uint32_t i = 0; i < 3; i++) {
+                EXPECT_EQ(sems[i]->id(), keys[i]);
+            }
+
+            for (auto& s : sems) {
+                s->Reset();
+            }
+        }
+
         // Verify close
         // TODO(ZX-594): test Close after Wait also
         port->Close();
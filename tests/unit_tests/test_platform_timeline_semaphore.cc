@@ -0,0 +1,136 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "magma_util/dlog.h"
+#include "platform_port.h"
+#include "platform_timeline_semaphore.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+class TestTimelineSemaphore {
+public:
+    static void Test()
+    {
+        std::shared_ptr<magma::PlatformTimelineSemaphore> sem =
+            magma::PlatformTimelineSemaphore::Create(1);
+        ASSERT_NE(sem, nullptr);
+        EXPECT_EQ(1u, sem->value());
+
+        // Points already reached don't block
+        EXPECT_TRUE(sem->Wait(0, 0));
+        EXPECT_TRUE(sem->Wait(1, 0));
+
+        // Verify timeout
+        EXPECT_FALSE(sem->Wait(2, 100));
+
+        // Verify return before timeout
+        std::unique_ptr<std::thread> thread(new std::thread([sem] {
+            DLOG("Waiting for timeline semaphore");
+            EXPECT_TRUE(sem->Wait(2, 1000));
+            DLOG("Timeline semaphore wait returned");
+        }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        sem->Signal(2);
+        thread->join();
+
+        // Values never decrease
+        sem->Signal(1);
+        EXPECT_EQ(2u, sem->value());
+        EXPECT_TRUE(sem->Wait(2, 0));
+    }
+
+    static void MultipleWaiters()
+    {
+        std::shared_ptr<magma::PlatformTimelineSemaphore> sem =
+            magma::PlatformTimelineSemaphore::Create(0);
+        ASSERT_NE(sem, nullptr);
+
+        constexpr uint32_t kWaiterCount = 10;
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i <= kWaiterCount; i++) {
+            threads.emplace_back([sem, i] { EXPECT_TRUE(sem->Wait(i, 5000)); });
+        }
+
+        // Some values are skipped; each waiter wakes once its point is passed.
+        for (uint32_t i = 1; i <= kWaiterCount; i += 3) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            sem->Signal(i);
+        }
+        sem->Signal(kWaiterCount);
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    static void Import()
+    {
+        auto sem = magma::PlatformTimelineSemaphore::Create(5);
+        ASSERT_NE(sem, nullptr);
+
+        uint32_t memory_handle, event_handle;
+        ASSERT_TRUE(sem->duplicate_handles(&memory_handle, &event_handle));
+        std::shared_ptr<magma::PlatformTimelineSemaphore> imported =
+            magma::PlatformTimelineSemaphore::Import(memory_handle, event_handle);
+        ASSERT_NE(imported, nullptr);
+
+        EXPECT_EQ(sem->id(), imported->id());
+        EXPECT_EQ(5u, imported->value());
+
+        std::thread thread([imported] { EXPECT_TRUE(imported->Wait(6, 1000)); });
+        sem->Signal(6);
+        thread.join();
+
+        imported->Signal(7);
+        EXPECT_EQ(7u, sem->value());
+    }
+
+    static void WaitAsync()
+    {
+        auto sem = magma::PlatformTimelineSemaphore::Create(0);
+        ASSERT_NE(sem, nullptr);
+        auto port = magma::PlatformPort::Create();
+        ASSERT_NE(port, nullptr);
+
+        constexpr uint64_t kKey = 0xabcd;
+
+        bool reached;
+        EXPECT_TRUE(sem->WaitAsync(port.get(), kKey, 0, &reached));
+        EXPECT_TRUE(reached);
+
+        EXPECT_TRUE(sem->WaitAsync(port.get(), kKey, 2, &reached));
+        EXPECT_FALSE(reached);
+
+        uint64_t key;
+        EXPECT_FALSE(port->Wait(&key, 100));
+
+        // Any change delivers a packet; the caller rechecks the value.
+        sem->Signal(1);
+        EXPECT_TRUE(port->Wait(&key, 1000));
+        EXPECT_EQ(kKey, key);
+
+        EXPECT_TRUE(sem->WaitAsync(port.get(), kKey, 2, &reached));
+        EXPECT_FALSE(reached);
+        sem->Signal(2);
+        EXPECT_TRUE(port->Wait(&key, 1000));
+        EXPECT_EQ(kKey, key);
+
+        EXPECT_TRUE(sem->WaitAsync(port.get(), kKey, 2, &reached));
+        EXPECT_TRUE(reached);
+    }
+};
+
+} // namespace
+
+TEST(PlatformTimelineSemaphore, Test) { TestTimelineSemaphore::Test(); }
+
+TEST(PlatformTimelineSemaphore, MultipleWaiters) { TestTimelineSemaphore::MultipleWaiters(); }
+
+TEST(PlatformTimelineSemaphore, Import) { TestTimelineSemaphore::Import(); }
+
+TEST(PlatformTimelineSemaphore, WaitAsync) { TestTimelineSemaphore::WaitAsync(); }
@@ -5,6 +5,7 @@
 #include "magma_util/dlog.h"
 #include "magma_util/semaphore_port.h"
 #include "gtest/gtest.h"
+#include <atomic>
 #include <chrono>
 #include <thread>
 
@@ -74,6 +75,60 @@ public:
         }
     }
 
+    // Measures how many wait sets per second the wait thread can complete when every semaphore
+    // is already signalled, and how many wait thread wakeups (WaitBatch or WaitOne calls) that
+    // took.  Each packet still costs one kernel port wait; batching only cuts the wakeups.
+    void Throughput(uint32_t wait_set_count, uint32_t semaphores_per_set, bool batch)
+    {
+        auto semaphore_port = std::shared_ptr<magma::SemaphorePort>(magma::SemaphorePort::Create());
+
+        std::vector<std::shared_ptr<magma::PlatformSemaphore>> semaphores;
+        for (uint32_t i = 0; i < wait_set_count * semaphores_per_set; i++) {
+            semaphores.push_back(magma::PlatformSemaphore::Create());
+        }
+
+        std::atomic_uint32_t callback_count{0};
+        uint32_t wakeup_count = 0;
+
+        std::thread thread([semaphore_port, batch, &wakeup_count] {
+            while (batch ? semaphore_port->WaitBatch() : semaphore_port->WaitOne())
+                ++wakeup_count;
+        });
+
+        auto start = std::chrono::high_resolution_clock::now();
+
+        for (uint32_t i = 0; i < wait_set_count; i++) {
+            auto first = semaphores.begin() + i * semaphores_per_set;
+            auto wait_set = std::make_unique<magma::SemaphorePort::WaitSet>(
+                [&callback_count](magma::SemaphorePort::WaitSet* wait_set) { ++callback_count; },
+                magma::SemaphorePort::shared_semaphore_vector_t(first,
+                                                                first + semaphores_per_set));
+            EXPECT_TRUE(semaphore_port->AddWaitSet(std::move(wait_set)));
+            for (uint32_t j = 0; j < semaphores_per_set; j++) {
+                first[j]->Signal();
+            }
+        }
+
+        while (callback_count < wait_set_count &&
+               std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() -
+                                                         start)
+                       .count() < 10000)
+            std::this_thread::yield();
+
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        semaphore_port->Close();
+        thread.join();
+
+        EXPECT_EQ(wait_set_count, callback_count);
+
+        printf("SemaphorePort %s: %u wait sets of %u semaphores in %.3f ms (%.0f semaphores/s) "
+               "%.2f wakeups per wait set\n",
+               batch ? "WaitBatch" : "WaitOne", wait_set_count, semaphores_per_set,
+               elapsed.count() * 1000, wait_set_count * semaphores_per_set / elapsed.count(),
+               static_cast<double>(wakeup_count) / wait_set_count);
+    }
+
 private:
     volatile uint32_t callback_count_ = 0;
 };
@@ -83,3 +138,59 @@ private:
 TEST(SemaphorePort, One) { std::make_unique<TestSemaphorePort>()->Test(1); }
 
 TEST(SemaphorePort, Many) { std::make_unique<TestSemaphorePort>()->Test(50); }
+
+TEST(SemaphorePort, Throughput)
+{
+    std::make_unique<TestSemaphorePort>()->Throughput(10000, 4, false);
+    std::make_unique<TestSemaphorePort>()->Throughput(10000, 4, true);
+}
+
+TEST(SemaphorePort, RejectsPendingSemaphore)
+{
+    auto semaphore_port = magma::SemaphorePort::Create();
+    ASSERT_NE(nullptr, semaphore_port);
+
+    std::shared_ptr<magma::PlatformSemaphore> semaphore = magma::PlatformSemaphore::Create();
+    auto callback = [](magma::SemaphorePort::WaitSet* wait_set) {};
+
+    EXPECT_FALSE(semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+        callback, magma::SemaphorePort::shared_semaphore_vector_t{semaphore, semaphore})));
+    EXPECT_EQ(1u, semaphore.use_count());
+
+    EXPECT_TRUE(semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+        callback, magma::SemaphorePort::shared_semaphore_vector_t{semaphore})));
+    EXPECT_FALSE(semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+        callback, magma::SemaphorePort::shared_semaphore_vector_t{semaphore})));
+
+    semaphore->Signal();
+    EXPECT_TRUE(semaphore_port->WaitOne());
+    EXPECT_TRUE(semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+        callback, magma::SemaphorePort::shared_semaphore_vector_t{semaphore})));
+
+    // A port destroyed with the wait still pending releases the semaphore.
+    semaphore_port.reset();
+    semaphore_port = magma::SemaphorePort::Create();
+    ASSERT_NE(nullptr, semaphore_port);
+    EXPECT_TRUE(semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+        callback, magma::SemaphorePort::shared_semaphore_vector_t{semaphore})));
+}
+
+TEST(SemaphorePort, CallbackRearms)
+{
+    auto semaphore_port = magma::SemaphorePort::Create();
+    ASSERT_NE(nullptr, semaphore_port);
+
+    std::shared_ptr<magma::PlatformSemaphore> semaphore = magma::PlatformSemaphore::Create();
+    bool rearmed = false;
+    auto rearm = [&semaphore_port, &semaphore, &rearmed](magma::SemaphorePort::WaitSet* wait_set) {
+        rearmed = semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+            [](magma::SemaphorePort::WaitSet* wait_set) {},
+            magma::SemaphorePort::shared_semaphore_vector_t{semaphore}));
+    };
+
+    EXPECT_TRUE(semaphore_port->AddWaitSet(std::make_unique<magma::SemaphorePort::WaitSet>(
+        rearm, magma::SemaphorePort::shared_semaphore_vector_t{semaphore})));
+    semaphore->Signal();
+    EXPECT_TRUE(semaphore_port->WaitBatch());
+    EXPECT_TRUE(rearmed);
+}
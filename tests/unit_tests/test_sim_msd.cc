@@ -0,0 +1,201 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "helper/command_buffer_helper.h"
+#include "mock/sim_msd.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <thread>
+
+namespace {
+
+class ScopedSimConfig {
+public:
+    ScopedSimConfig(const MsdSimConfig& config) { MsdSimDriver::SetConfig(config); }
+    ~ScopedSimConfig() { MsdSimDriver::SetConfig(MsdSimConfig()); }
+};
+
+// A connection whose only request blocks until |release| is signalled, regardless of shutdown.
+class StuckConnection : public magma::PlatformConnection {
+public:
+    StuckConnection(std::shared_ptr<magma::PlatformSemaphore> release)
+        : magma::PlatformConnection(magma::PlatformEvent::Create()), release_(std::move(release))
+    {
+    }
+
+    uint32_t GetHandle() override { return 0; }
+
+    bool HandleRequest() override
+    {
+        release_->Wait();
+        return false;
+    }
+
+private:
+    std::shared_ptr<magma::PlatformSemaphore> release_;
+};
+
+std::chrono::milliseconds ElapsedSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+}
+
+} // namespace
+
+TEST(SimMsd, ExecutionTime)
+{
+    MsdSimConfig config;
+    config.execution_time_us = 20000;
+    ScopedSimConfig scoped_config(config);
+
+    auto helper = CommandBufferHelper::Create();
+    ASSERT_NE(helper, nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(helper->ExecuteAndWait());
+    EXPECT_GE(ElapsedSince(start).count(), 20);
+}
+
+TEST(SimMsd, QueueDepth)
+{
+    MsdSimConfig config;
+    config.execution_time_us = 20000;
+    config.queue_depth = 1;
+    ScopedSimConfig scoped_config(config);
+
+    auto helper = CommandBufferHelper::Create();
+    ASSERT_NE(helper, nullptr);
+    auto device = MsdSimDevice::cast(helper->dev()->msd_dev());
+
+    // The second submit can't be queued until the first completes.
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_TRUE(helper->Execute());
+    EXPECT_TRUE(helper->Execute());
+    EXPECT_GE(ElapsedSince(start).count(), 20);
+    EXPECT_GE(device->completed_count(), 1u);
+
+    EXPECT_TRUE(helper->ExecuteAndWait());
+}
+
+TEST(SimMsd, WaitRendering)
+{
+    MsdSimConfig config;
+    config.execution_time_us = 10000;
+    config.jitter_us = 5000;
+    config.engine_count = 2;
+    ScopedSimConfig scoped_config(config);
+
+    auto helper = CommandBufferHelper::Create();
+    ASSERT_NE(helper, nullptr);
+    auto device = MsdSimDevice::cast(helper->dev()->msd_dev());
+
+    msd_connection_t* connection = msd_device_open(helper->dev()->msd_dev(), 0);
+    ASSERT_NE(connection, nullptr);
+
+    EXPECT_TRUE(helper->Execute());
+    EXPECT_EQ(1u, device->submitted_count());
+
+    EXPECT_EQ(MAGMA_STATUS_OK,
+              msd_connection_wait_rendering(connection, helper->msd_resources()[1]));
+    EXPECT_EQ(1u, device->completed_count());
+
+    msd_connection_close(connection);
+}
+
+TEST(SimMsd, ShutdownCancelsWaits)
+{
+    MsdSimConfig config;
+    config.execution_time_us = 500000;
+    ScopedSimConfig scoped_config(config);
+
+    auto helper = CommandBufferHelper::Create();
+    ASSERT_NE(helper, nullptr);
+
+    EXPECT_TRUE(helper->Execute());
+
+    auto start = std::chrono::steady_clock::now();
+    magma::Status status(MAGMA_STATUS_OK);
+    std::thread waiter([&helper, &status] {
+        status = helper->connection()->WaitRendering(helper->resources()[0]->id());
+    });
+
+    // Whether or not the waiter has blocked yet, the cancel applies.
+    auto stats = MagmaSystemDevice::Shutdown(helper->shared_dev());
+    waiter.join();
+
+    EXPECT_EQ(MAGMA_STATUS_CONNECTION_LOST, status.get());
+    EXPECT_LT(ElapsedSince(start).count(), 400);
+    EXPECT_EQ(0u, stats.connection_count);
+    EXPECT_EQ(0u, stats.overdue_count);
+
+    // Later waits fail immediately.
+    EXPECT_EQ(MAGMA_STATUS_CONNECTION_LOST,
+              helper->connection()->WaitRendering(helper->resources()[0]->id()).get());
+}
+
+TEST(SimMsd, ShutdownKeepsOverdueConnections)
+{
+    auto msd_drv = msd_driver_create();
+    ASSERT_NE(msd_drv, nullptr);
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    ASSERT_NE(msd_dev, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+    ASSERT_NE(dev, nullptr);
+
+    std::shared_ptr<magma::PlatformSemaphore> release = magma::PlatformSemaphore::Create();
+    dev->StartConnectionThread(std::make_shared<StuckConnection>(release));
+
+    auto start = std::chrono::steady_clock::now();
+    auto stats = MagmaSystemDevice::Shutdown(dev, 50);
+    EXPECT_LT(ElapsedSince(start).count(), 500);
+    EXPECT_EQ(1u, stats.connection_count);
+    EXPECT_EQ(1u, stats.overdue_count);
+
+    // A restart is refused while the connection is stuck, and retried once it's released.
+    stats = MagmaSystemDevice::Shutdown(dev, 50);
+    EXPECT_EQ(1u, stats.connection_count);
+    EXPECT_EQ(1u, stats.overdue_count);
+
+    release->Signal();
+    stats = MagmaSystemDevice::Shutdown(dev);
+    EXPECT_EQ(1u, stats.connection_count);
+    EXPECT_EQ(0u, stats.overdue_count);
+
+    stats = MagmaSystemDevice::Shutdown(dev);
+    EXPECT_EQ(0u, stats.connection_count);
+
+    dev.reset();
+    msd_driver_destroy(msd_drv);
+}
+
+TEST(SimMsd, ReleaseWaitsForOverdueConnections)
+{
+    auto msd_drv = msd_driver_create();
+    ASSERT_NE(msd_drv, nullptr);
+    auto msd_dev = msd_driver_create_device(msd_drv, nullptr);
+    ASSERT_NE(msd_dev, nullptr);
+    auto dev =
+        std::shared_ptr<MagmaSystemDevice>(MagmaSystemDevice::Create(MsdDeviceUniquePtr(msd_dev)));
+    ASSERT_NE(dev, nullptr);
+
+    std::shared_ptr<magma::PlatformSemaphore> release = magma::PlatformSemaphore::Create();
+    dev->StartConnectionThread(std::make_shared<StuckConnection>(release));
+
+    auto stats = MagmaSystemDevice::Shutdown(dev, 50);
+    EXPECT_EQ(1u, stats.overdue_count);
+
+    // Destroying the device blocks until the overdue thread has exited.
+    std::thread releaser([release] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        release->Signal();
+    });
+    auto start = std::chrono::steady_clock::now();
+    dev.reset();
+    EXPECT_GE(ElapsedSince(start).count(), 50);
+    releaser.join();
+
+    msd_driver_destroy(msd_drv);
+}
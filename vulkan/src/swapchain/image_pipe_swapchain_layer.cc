@@ -24,6 +24,8 @@ struct LayerData {
     VkInstance instance;
     VkLayerDispatchTable* device_dispatch_table;
     VkLayerInstanceDispatchTable* instance_dispatch_table;
+    // Null if the driver can't import semaphores, in which case presents idle the queue.
+    PFN_vkImportSemaphoreFuchsiaHandleKHR import_semaphore_fuchsia_handle;
 };
 
 // Global because thats how the layer code in the loader works and I dont know how to make it work
@@ -47,9 +49,56 @@ struct ImagePipeSurface {
     SupportedImageProperties supported_properties;
 };
 
-struct PendingImageInfo {
+// Fixed capacity queue of image indices.  Storage is allocated once when the swapchain is created.
+class ImageQueue {
+public:
+    void Reset(uint32_t capacity)
+    {
+        slots_.resize(capacity);
+        head_ = 0;
+        size_ = 0;
+    }
+
+    bool empty() { return size_ == 0; }
+    uint32_t size() { return size_; }
+
+    void push_back(uint32_t index)
+    {
+        FXL_DCHECK(size_ < slots_.size());
+        slots_[(head_ + size_++) % slots_.size()] = index;
+    }
+
+    uint32_t pop_front()
+    {
+        FXL_DCHECK(size_ > 0);
+        uint32_t index = slots_[head_];
+        head_ = (head_ + 1) % slots_.size();
+        size_--;
+        return index;
+    }
+
+    // Returns the |i|th index from the front.
+    uint32_t operator[](uint32_t i) { return slots_[(head_ + i) % slots_.size()]; }
+
+private:
+    std::vector<uint32_t> slots_;
+    uint32_t head_ = 0;
+    uint32_t size_ = 0;
+};
+
+// Per image state.  The release fence is created with the swapchain and re-armed each time the
+// image is acquired.  A semaphore may only be unsignalled by a wait through the driver, so each
+// acquire gives |acquire_semaphore| a fresh event as its payload rather than clearing the old one.
+struct SwapchainImage {
+    enum State { AVAILABLE, ACQUIRED, PENDING };
+
+    State state = AVAILABLE;
+    // Signalled by the consumer once it is done with the image.
     zx::event release_fence;
-    uint32_t image_index;
+    // Signalled once rendering to the image has completed.  If the driver can import semaphores
+    // this is the payload of |acquire_semaphore|, which the present's queue submission signals.
+    zx::event acquire_fence;
+    VkSemaphore acquire_semaphore = VK_NULL_HANDLE;
 };
 
 class ImagePipeSwapchain {
@@ -67,17 +116,32 @@ public:
     void Cleanup(VkDevice device, const VkAllocationCallbacks* pAllocator);
 
     VkResult GetSwapchainImages(uint32_t* pCount, VkImage* pSwapchainImages);
-    VkResult AcquireNextImage(uint64_t timeout_ns, VkSemaphore semaphore, uint32_t* pImageIndex);
+    VkResult AcquireNextImage(VkDevice device, uint64_t timeout_ns, VkSemaphore semaphore,
+                              uint32_t* pImageIndex);
     VkResult Present(uint32_t index);
 
+    // Returns the semaphore the present of |index| must signal, or VK_NULL_HANDLE if the driver
+    // can't import semaphores.
+    VkSemaphore acquire_semaphore(uint32_t index) { return image_state_[index].acquire_semaphore; }
+
 private:
+    VkResult CreateFences(VkDevice device, SwapchainImage* image);
+    // Replaces the payload of |image|'s acquire semaphore with a new unsignalled event.
+    VkResult ImportAcquireFence(VkDevice device, SwapchainImage* image);
+
+    // Waits until the consumer releases at least one pending image.
+    VkResult WaitForReleasedImage(uint64_t timeout_ns);
+
+    VkPresentModeKHR present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
     SupportedImageProperties supported_properties_;
     fidl::SynchronousInterfacePtr<scenic::ImagePipe> image_pipe_;
     std::vector<VkImage> images_;
     std::vector<VkDeviceMemory> memories_;
-    std::vector<uint32_t> acquired_ids_;
-    std::vector<uint32_t> available_ids_;
-    std::vector<PendingImageInfo> pending_images_;
+    std::vector<SwapchainImage> image_state_;
+    ImageQueue available_;
+    // In presentation order.
+    ImageQueue pending_;
+    std::vector<zx_wait_item_t> wait_items_;
     bool image_pipe_closed_;
 };
 
@@ -89,6 +153,8 @@ VkResult ImagePipeSwapchain::Initialize(VkDevice device,
     VkLayerDispatchTable* pDisp =
         GetLayerDataPtr(get_dispatch_key(device), layer_data_map)->device_dispatch_table;
 
+    present_mode_ = pCreateInfo->presentMode;
+
     bool scanout_tiling_enabled = false;
     uint32_t instance_extension_count;
     result = vkEnumerateInstanceExtensionProperties(nullptr, &instance_extension_count, nullptr);
@@ -113,6 +179,10 @@ VkResult ImagePipeSwapchain::Initialize(VkDevice device,
 
     uint32_t num_images = pCreateInfo->minImageCount;
     assert(pCreateInfo->sType == VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR);
+    image_state_.resize(num_images);
+    available_.Reset(num_images);
+    pending_.Reset(num_images);
+    wait_items_.resize(std::min<uint32_t>(num_images, ZX_WAIT_MANY_MAX_ITEMS));
     for (uint32_t i = 0; i < num_images; i++) {
         // Allocate a buffer.
         VkImage image;
@@ -179,6 +249,10 @@ VkResult ImagePipeSwapchain::Initialize(VkDevice device,
 
         zx::vmo vmo(vmo_handle);
 
+        result = CreateFences(device, &image_state_[i]);
+        if (result != VK_SUCCESS)
+            return result;
+
         auto image_info = scenic::ImageInfo::New();
         image_info->width = width;
         image_info->height = height;
@@ -190,11 +264,75 @@ VkResult ImagePipeSwapchain::Initialize(VkDevice device,
         image_pipe_->AddImage(i, std::move(image_info), std::move(vmo),
                               scenic::MemoryType::VK_DEVICE_MEMORY, 0);
 
-        available_ids_.push_back(i);
+        available_.push_back(i);
     }
     return VK_SUCCESS;
 }
 
+VkResult ImagePipeSwapchain::CreateFences(VkDevice device, SwapchainImage* image)
+{
+    LayerData* layer_data = GetLayerDataPtr(get_dispatch_key(device), layer_data_map);
+    VkLayerDispatchTable* pDisp = layer_data->device_dispatch_table;
+
+    zx_status_t status = zx::event::create(0, &image->release_fence);
+    if (status != ZX_OK) {
+        FXL_DLOG(ERROR) << "zx::event::create failed: " << status;
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    if (!layer_data->import_semaphore_fuchsia_handle) {
+        status = zx::event::create(0, &image->acquire_fence);
+        if (status != ZX_OK) {
+            FXL_DLOG(ERROR) << "zx::event::create failed: " << status;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        return VK_SUCCESS;
+    }
+
+    // The payload is imported when the image is acquired.
+    VkSemaphoreCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = nullptr,
+        .flags = 0,
+    };
+    VkResult result =
+        pDisp->CreateSemaphore(device, &create_info, nullptr, &image->acquire_semaphore);
+    if (result != VK_SUCCESS) {
+        FXL_DLOG(ERROR) << "vkCreateSemaphore failed: " << result;
+        return result;
+    }
+    return VK_SUCCESS;
+}
+
+VkResult ImagePipeSwapchain::ImportAcquireFence(VkDevice device, SwapchainImage* image)
+{
+    LayerData* layer_data = GetLayerDataPtr(get_dispatch_key(device), layer_data_map);
+
+    zx::event acquire_fence, payload;
+    zx_status_t status = zx::event::create(0, &acquire_fence);
+    if (status == ZX_OK)
+        status = acquire_fence.duplicate(ZX_RIGHT_SAME_RIGHTS, &payload);
+    if (status != ZX_OK) {
+        FXL_DLOG(ERROR) << "failed to create acquire fence: " << status;
+        return VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    VkImportSemaphoreFuchsiaHandleInfoKHR import_info = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FUCHSIA_HANDLE_INFO_KHR,
+        .pNext = nullptr,
+        .semaphore = image->acquire_semaphore,
+        .handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_FUCHSIA_FENCE_BIT_KHR,
+        .handle = payload.release(),
+    };
+    VkResult result = layer_data->import_semaphore_fuchsia_handle(device, &import_info);
+    if (result != VK_SUCCESS) {
+        FXL_DLOG(ERROR) << "vkImportSemaphoreFuchsiaHandleKHR failed: " << result;
+        return result;
+    }
+    image->acquire_fence = std::move(acquire_fence);
+    return VK_SUCCESS;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL CreateSwapchainKHR(VkDevice device,
                                                   const VkSwapchainCreateInfoKHR* pCreateInfo,
                                                   const VkAllocationCallbacks* pAllocator,
@@ -226,6 +364,10 @@ void ImagePipeSwapchain::Cleanup(VkDevice device, const VkAllocationCallbacks* p
         pDisp->DestroyImage(device, image, pAllocator);
     for (auto memory : memories_)
         pDisp->FreeMemory(device, memory, pAllocator);
+    for (auto& image : image_state_) {
+        if (image.acquire_semaphore != VK_NULL_HANDLE)
+            pDisp->DestroySemaphore(device, image.acquire_semaphore, nullptr);
+    }
 }
 
 VKAPI_ATTR void VKAPI_CALL DestroySwapchainKHR(VkDevice device, VkSwapchainKHR vk_swapchain,
@@ -262,35 +404,98 @@ VKAPI_ATTR VkResult VKAPI_CALL GetSwapchainImagesKHR(VkDevice device, VkSwapchai
     return swapchain->GetSwapchainImages(pCount, pSwapchainImages);
 }
 
-VkResult ImagePipeSwapchain::AcquireNextImage(uint64_t timeout_ns, VkSemaphore semaphore,
-                                              uint32_t* pImageIndex)
+VkResult ImagePipeSwapchain::WaitForReleasedImage(uint64_t timeout_ns)
 {
-    if (available_ids_.empty()) {
-        // only way this can happen is if there are 0 images or if the client has already acquired
-        // all images
-        FXL_DCHECK(!pending_images_.empty());
-        if (timeout_ns == 0)
-            return VK_NOT_READY;
-        // wait for image to become available
-        zx_signals_t pending;
+    zx_time_t deadline =
+        timeout_ns == UINT64_MAX ? ZX_TIME_INFINITE : zx_deadline_after(timeout_ns);
 
-        zx_status_t status = pending_images_[0].release_fence.wait_one(
-            ZX_EVENT_SIGNALED,
-            timeout_ns == UINT64_MAX ? ZX_TIME_INFINITE : zx_deadline_after(timeout_ns), &pending);
+    if (present_mode_ == VK_PRESENT_MODE_FIFO_KHR) {
+        // The consumer releases images in presentation order, so the oldest is released first.
+        zx_signals_t pending;
+        zx_status_t status = image_state_[pending_[0]].release_fence.wait_one(ZX_EVENT_SIGNALED,
+                                                                             deadline, &pending);
         if (status == ZX_ERR_TIMED_OUT) {
-            return VK_TIMEOUT;
+            return timeout_ns == 0 ? VK_NOT_READY : VK_TIMEOUT;
         } else if (status != ZX_OK) {
             FXL_DLOG(ERROR) << "event::wait_one returned " << status;
             return VK_ERROR_DEVICE_LOST;
         }
         FXL_DCHECK(pending & ZX_EVENT_SIGNALED);
 
-        available_ids_.push_back(pending_images_[0].image_index);
-        pending_images_.erase(pending_images_.begin());
+        uint32_t index = pending_.pop_front();
+        image_state_[index].state = SwapchainImage::AVAILABLE;
+        available_.push_back(index);
+        return VK_SUCCESS;
+    }
+
+    // Queued frames may be skipped by the consumer and released out of order, so take whichever
+    // images have been released.  zx_object_wait_many takes a bounded number of items; the oldest
+    // pending images are the most likely to have been released, so wait on those.
+    uint32_t pending_count = pending_.size();
+    uint32_t wait_count = std::min<uint32_t>(pending_count, wait_items_.size());
+    for (uint32_t i = 0; i < wait_count; i++) {
+        wait_items_[i].handle = image_state_[pending_[i]].release_fence.get();
+        wait_items_[i].waitfor = ZX_EVENT_SIGNALED;
+        wait_items_[i].pending = 0;
+    }
+
+    zx_status_t status = zx_object_wait_many(wait_items_.data(), wait_count, deadline);
+    if (status == ZX_ERR_TIMED_OUT) {
+        return timeout_ns == 0 ? VK_NOT_READY : VK_TIMEOUT;
+    } else if (status != ZX_OK) {
+        FXL_DLOG(ERROR) << "zx_object_wait_many returned " << status;
+        return VK_ERROR_DEVICE_LOST;
+    }
+
+    // Rotate through the pending queue once, keeping the order of the images left behind.
+    for (uint32_t i = 0; i < pending_count; i++) {
+        uint32_t index = pending_.pop_front();
+        if (i < wait_count && (wait_items_[i].pending & ZX_EVENT_SIGNALED)) {
+            image_state_[index].state = SwapchainImage::AVAILABLE;
+            available_.push_back(index);
+        } else {
+            pending_.push_back(index);
+        }
     }
-    *pImageIndex = available_ids_[0];
-    available_ids_.erase(available_ids_.begin());
-    acquired_ids_.push_back(*pImageIndex);
+    FXL_DCHECK(!available_.empty());
+
+    return VK_SUCCESS;
+}
+
+VkResult ImagePipeSwapchain::AcquireNextImage(VkDevice device, uint64_t timeout_ns,
+                                              VkSemaphore semaphore, uint32_t* pImageIndex)
+{
+    if (available_.empty()) {
+        // only way this can happen is if there are 0 images or if the client has already acquired
+        // all images
+        FXL_DCHECK(!pending_.empty());
+        VkResult result = WaitForReleasedImage(timeout_ns);
+        if (result != VK_SUCCESS)
+            return result;
+    }
+
+    uint32_t index = available_[0];
+    SwapchainImage& image = image_state_[index];
+
+    // The consumer has released the image, so it has seen both fences signalled and is done with
+    // them.  Re-arm them for the next present.  The acquire semaphore's payload belongs to the
+    // driver, so it gets a new one instead.
+    zx_status_t status = image.release_fence.signal(ZX_EVENT_SIGNALED, 0);
+    if (status == ZX_OK && image.acquire_semaphore == VK_NULL_HANDLE)
+        status = image.acquire_fence.signal(ZX_EVENT_SIGNALED, 0);
+    if (status != ZX_OK) {
+        FXL_DLOG(ERROR) << "failed to reset fences: " << status;
+        return VK_ERROR_DEVICE_LOST;
+    }
+    if (image.acquire_semaphore != VK_NULL_HANDLE) {
+        VkResult result = ImportAcquireFence(device, &image);
+        if (result != VK_SUCCESS)
+            return result;
+    }
+
+    available_.pop_front();
+    image.state = SwapchainImage::ACQUIRED;
+    *pImageIndex = index;
     return VK_SUCCESS;
 }
 
@@ -303,7 +508,7 @@ VKAPI_ATTR VkResult VKAPI_CALL AcquireNextImageKHR(VkDevice device, VkSwapchainK
     FXL_CHECK(semaphore == VK_NULL_HANDLE);
 
     auto swapchain = reinterpret_cast<ImagePipeSwapchain*>(vk_swapchain);
-    return swapchain->AcquireNextImage(timeout, semaphore, pImageIndex);
+    return swapchain->AcquireNextImage(device, timeout, semaphore, pImageIndex);
 }
 
 VkResult ImagePipeSwapchain::Present(uint32_t index)
@@ -311,37 +516,33 @@ VkResult ImagePipeSwapchain::Present(uint32_t index)
     if (image_pipe_closed_)
         return VK_ERROR_DEVICE_LOST;
 
-    auto iter = std::find(acquired_ids_.begin(), acquired_ids_.end(), index);
-    FXL_DCHECK(iter != acquired_ids_.end());
-    acquired_ids_.erase(iter);
+    SwapchainImage& image = image_state_[index];
+    FXL_DCHECK(image.state == SwapchainImage::ACQUIRED);
 
-    zx::event acquire_fence, release_fence;
     zx_status_t status;
-    status = zx::event::create(0, &acquire_fence);
-    if (status != ZX_OK)
-        return VK_ERROR_DEVICE_LOST;
-
-    status = zx::event::create(0, &release_fence);
-    if (status != ZX_OK)
-        return VK_ERROR_DEVICE_LOST;
-
-    status = acquire_fence.signal(0u, ZX_EVENT_SIGNALED);
-    if (status) {
-        FXL_DLOG(ERROR) << "failed to signal fence event, zx::event::signal() failed with status "
-                        << status;
-        return VK_ERROR_DEVICE_LOST;
+    if (image.acquire_semaphore == VK_NULL_HANDLE) {
+        // The caller has idled the queue, so rendering is complete.
+        status = image.acquire_fence.signal(0u, ZX_EVENT_SIGNALED);
+        if (status) {
+            FXL_DLOG(ERROR)
+                << "failed to signal fence event, zx::event::signal() failed with status "
+                << status;
+            return VK_ERROR_DEVICE_LOST;
+        }
     }
 
-    zx::event image_release_fence;
-    status = release_fence.duplicate(ZX_RIGHT_SAME_RIGHTS, &image_release_fence);
+    zx::event acquire_fence, release_fence;
+    status = image.acquire_fence.duplicate(ZX_RIGHT_SAME_RIGHTS, &acquire_fence);
+    if (status == ZX_OK)
+        status = image.release_fence.duplicate(ZX_RIGHT_SAME_RIGHTS, &release_fence);
     if (status) {
-        FXL_DLOG(ERROR)
-            << "failed to duplicate release fence, zx::event::duplicate() failed with status "
-            << status;
+        FXL_DLOG(ERROR) << "failed to duplicate fences, zx::event::duplicate() failed with status "
+                        << status;
         return VK_ERROR_DEVICE_LOST;
     }
 
-    pending_images_.push_back({std::move(image_release_fence), index});
+    image.state = SwapchainImage::PENDING;
+    pending_.push_back(index);
 
     scenic::PresentationInfoPtr info;
     image_pipe_->PresentImage(index, 0, std::move(acquire_fence), std::move(release_fence), &info);
@@ -349,17 +550,63 @@ VkResult ImagePipeSwapchain::Present(uint32_t index)
     return VK_SUCCESS;
 }
 
+// Presents rarely name more than a few swapchains or wait semaphores; up to this many need no
+// allocation.
+constexpr uint32_t kMaxInlinePresentCount = 4;
+
 VKAPI_ATTR VkResult VKAPI_CALL QueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo)
 {
+    LayerData* layer_data = GetLayerDataPtr(get_dispatch_key(queue), layer_data_map);
+    VkLayerDispatchTable* pDisp = layer_data->device_dispatch_table;
+    uint32_t count = pPresentInfo->swapchainCount;
+
+    if (layer_data->import_semaphore_fuchsia_handle) {
+        // Submit an empty batch which waits on the application's semaphores and signals each
+        // image's acquire semaphore, so the consumer rather than the CPU waits for
+        // rendering to complete.
+        VkSemaphore inline_semaphores[kMaxInlinePresentCount];
+        std::vector<VkSemaphore> semaphore_storage;
+        VkSemaphore* semaphores = inline_semaphores;
+        if (count > kMaxInlinePresentCount) {
+            semaphore_storage.resize(count);
+            semaphores = semaphore_storage.data();
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            auto swapchain = reinterpret_cast<ImagePipeSwapchain*>(pPresentInfo->pSwapchains[i]);
+            semaphores[i] = swapchain->acquire_semaphore(pPresentInfo->pImageIndices[i]);
+        }
 
-    VkLayerDispatchTable* pDisp =
-        GetLayerDataPtr(get_dispatch_key(queue), layer_data_map)->device_dispatch_table;
+        uint32_t wait_count = pPresentInfo->waitSemaphoreCount;
+        VkPipelineStageFlags inline_stages[kMaxInlinePresentCount];
+        std::vector<VkPipelineStageFlags> stage_storage;
+        VkPipelineStageFlags* stages = inline_stages;
+        if (wait_count > kMaxInlinePresentCount) {
+            stage_storage.resize(wait_count);
+            stages = stage_storage.data();
+        }
+        std::fill(stages, stages + wait_count, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-    // TODO(MA-264) Should export semaphores to an zx::event handle and give to ImagePipe consumer.
-    // For now we just idle the queue
-    pDisp->QueueWaitIdle(queue);
+        VkSubmitInfo submit_info = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = nullptr,
+            .waitSemaphoreCount = wait_count,
+            .pWaitSemaphores = pPresentInfo->pWaitSemaphores,
+            .pWaitDstStageMask = stages,
+            .commandBufferCount = 0,
+            .pCommandBuffers = nullptr,
+            .signalSemaphoreCount = count,
+            .pSignalSemaphores = semaphores,
+        };
+        VkResult result = pDisp->QueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+        if (result != VK_SUCCESS) {
+            FXL_DLOG(ERROR) << "vkQueueSubmit failed: " << result;
+            return result;
+        }
+    } else {
+        pDisp->QueueWaitIdle(queue);
+    }
 
-    for (uint32_t i = 0; i < pPresentInfo->swapchainCount; i++) {
+    for (uint32_t i = 0; i < count; i++) {
         auto swapchain = reinterpret_cast<ImagePipeSwapchain*>(pPresentInfo->pSwapchains[i]);
         VkResult result = swapchain->Present(pPresentInfo->pImageIndices[i]);
         if (pPresentInfo->pResults) {
@@ -450,16 +697,19 @@ VKAPI_ATTR VkResult VKAPI_CALL
 GetPhysicalDeviceSurfacePresentModesKHR(VkPhysicalDevice physicalDevice, const VkSurfaceKHR surface,
                                         uint32_t* pCount, VkPresentModeKHR* pPresentModes)
 {
-    constexpr int present_mode_count = 1;
-    constexpr VkPresentModeKHR present_modes[] = {VK_PRESENT_MODE_FIFO_KHR};
+    // The consumer only ever shows the newest ready frame at a vsync and never tears, so MAILBOX
+    // and IMMEDIATE differ from FIFO only in which released image is acquired next.
+    constexpr VkPresentModeKHR present_modes[] = {
+        VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+    constexpr uint32_t present_mode_count = sizeof(present_modes) / sizeof(present_modes[0]);
     if (pPresentModes == nullptr) {
         *pCount = present_mode_count;
         return VK_SUCCESS;
     }
-    FXL_DCHECK(*pCount >= present_mode_count);
-    memcpy(pPresentModes, present_modes, present_mode_count);
-    *pCount = present_mode_count;
-    return VK_SUCCESS;
+    uint32_t count = std::min(*pCount, present_mode_count);
+    memcpy(pPresentModes, present_modes, count * sizeof(VkPresentModeKHR));
+    *pCount = count;
+    return count < present_mode_count ? VK_INCOMPLETE : VK_SUCCESS;
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL CreateInstance(const VkInstanceCreateInfo* pCreateInfo,
@@ -505,6 +755,28 @@ VKAPI_ATTR void VKAPI_CALL DestroyInstance(VkInstance instance,
     layer_data_map.erase(key);
 }
 
+static bool SupportsDeviceExtension(LayerData* instance_data, VkPhysicalDevice gpu,
+                                    const char* name)
+{
+    uint32_t count;
+    VkResult result = instance_data->instance_dispatch_table->EnumerateDeviceExtensionProperties(
+        gpu, nullptr, &count, nullptr);
+    if (result != VK_SUCCESS)
+        return false;
+
+    std::vector<VkExtensionProperties> extensions(count);
+    result = instance_data->instance_dispatch_table->EnumerateDeviceExtensionProperties(
+        gpu, nullptr, &count, extensions.data());
+    if (result != VK_SUCCESS)
+        return false;
+
+    for (auto& extension : extensions) {
+        if (!strcmp(extension.extensionName, name))
+            return true;
+    }
+    return false;
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu,
                                             const VkDeviceCreateInfo* pCreateInfo,
                                             const VkAllocationCallbacks* pAllocator,
@@ -527,7 +799,28 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu,
     // Advance the link info for the next element on the chain
     chain_info->u.pLayerInfo = chain_info->u.pLayerInfo->pNext;
 
-    VkResult result = fpCreateDevice(gpu, pCreateInfo, pAllocator, pDevice);
+    // Presents hand the consumer the payload of an imported semaphore as the acquire fence, so
+    // enable semaphore import if the driver supports it.
+    std::vector<const char*> enabled_extensions(pCreateInfo->ppEnabledExtensionNames,
+                                                pCreateInfo->ppEnabledExtensionNames +
+                                                    pCreateInfo->enabledExtensionCount);
+    bool semaphore_import_supported =
+        SupportsDeviceExtension(my_instance_data, gpu, VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME) &&
+        SupportsDeviceExtension(my_instance_data, gpu,
+                                VK_KHR_EXTERNAL_SEMAPHORE_FUCHSIA_EXTENSION_NAME);
+    if (semaphore_import_supported) {
+        for (const char* name : {VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME,
+                                 VK_KHR_EXTERNAL_SEMAPHORE_FUCHSIA_EXTENSION_NAME}) {
+            if (std::none_of(enabled_extensions.begin(), enabled_extensions.end(),
+                             [name](const char* enabled) { return !strcmp(enabled, name); }))
+                enabled_extensions.push_back(name);
+        }
+    }
+    VkDeviceCreateInfo create_info = *pCreateInfo;
+    create_info.enabledExtensionCount = enabled_extensions.size();
+    create_info.ppEnabledExtensionNames = enabled_extensions.data();
+
+    VkResult result = fpCreateDevice(gpu, &create_info, pAllocator, pDevice);
     if (result != VK_SUCCESS) {
         return result;
     }
@@ -539,6 +832,13 @@ VKAPI_ATTR VkResult VKAPI_CALL CreateDevice(VkPhysicalDevice gpu,
     layer_init_device_dispatch_table(*pDevice, my_device_data->device_dispatch_table,
                                      fpGetDeviceProcAddr);
 
+    my_device_data->import_semaphore_fuchsia_handle = nullptr;
+    if (semaphore_import_supported) {
+        my_device_data->import_semaphore_fuchsia_handle =
+            reinterpret_cast<PFN_vkImportSemaphoreFuchsiaHandleKHR>(
+                fpGetDeviceProcAddr(*pDevice, "vkImportSemaphoreFuchsiaHandleKHR"));
+    }
+
     return result;
 }
 